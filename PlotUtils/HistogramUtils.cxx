@@ -14,11 +14,26 @@
 #define HISTOGRAMUTILS_cxx
 
 #include "HistogramUtils.h"
+#include "PlotUtils/MULinearMap.h"
 #include <TMath.h>
 #include <algorithm>
+#include <utility>
+#include <vector>
 
 using namespace PlotUtils;
 
+namespace
+{
+  //! Low edges of all bins of an axis and the up edge of the last one
+  std::vector<double> GetBinEdges( const TAxis* axis )
+  {
+    std::vector<double> edges( axis->GetNbins() + 1 );
+    for( int i = 0; i <= axis->GetNbins(); i++ )
+      edges[i] = axis->GetBinLowEdge(i+1);
+    return edges;
+  }
+}
+
 
 bool MUHist::IsNotPhysicalShift( double shift ){
   return fabs(NotPhysicalShiftNumber - shift) < 1E-6;
@@ -31,18 +46,71 @@ bool MUHist::IsAutoAxisLimit( double x ){
 
 
 //===========================
+namespace
+{
+  //! Elements k1 <= k2 of the sorted vector, found by selection.  Reorders vec.
+  std::pair<double,double> GetOrderStatistics( std::vector<double>& vec, const size_t k1, const size_t k2 )
+  {
+    std::nth_element( vec.begin(), vec.begin() + k2, vec.end() );
+    //everything before k2 is now <= vec[k2], so k1 is among them
+    if( k1 != k2 )
+      std::nth_element( vec.begin(), vec.begin() + k1, vec.begin() + k2 );
+    return std::make_pair( vec[k1], vec[k2] );
+  }
+}
+
 double MUHist::GetInterquartileRange( const std::vector<double>& vec ){
   if( vec.empty() ) {
     Warning( "MUHist::GetInterquartileRange", "Attempt to get inter-quartile range for an empty vector.  Returning 0." );
     return 0.;
   }
 
-  //make a copy so we can sort
+  //make a copy so we can reorder
   std::vector<double> vecCopy = vec;
-  sort( vecCopy.begin(), vecCopy.end() );
   size_t firstQ  = vecCopy.size() / 4;
   size_t thrirdQ = 3 * ( vecCopy.size() / 4 );
-  return vecCopy[thrirdQ] - vecCopy[firstQ];
+  std::pair<double,double> quartiles = GetOrderStatistics( vecCopy, firstQ, thrirdQ );
+  return quartiles.second - quartiles.first;
+}
+
+std::vector<double> MUHist::GetQuantiles( std::vector<double>& vec, const std::vector<double>& q ){
+  std::vector<double> quantiles( q.size(), 0. );
+  if( vec.empty() ) {
+    Warning( "MUHist::GetQuantiles", "Attempt to get quantiles of an empty vector.  Returning 0." );
+    return quantiles;
+  }
+
+  //select in increasing order, so each selection only searches above the previous one
+  std::vector< std::pair<size_t,size_t> > order;
+  for( size_t i = 0; i != q.size(); ++i ) {
+    const double qi = std::min( 1., std::max( 0., q[i] ) );
+    order.push_back( std::make_pair( std::min( vec.size() - 1, size_t( qi * vec.size() ) ), i ) );
+  }
+  sort( order.begin(), order.end() );
+
+  std::vector<double>::iterator first = vec.begin();
+  for( size_t i = 0; i != order.size(); ++i ) {
+    std::vector<double>::iterator nth = vec.begin() + order[i].first;
+    if( first <= nth ) {
+      std::nth_element( first, nth, vec.end() );
+      first = nth + 1;
+    }
+    quantiles[ order[i].second ] = *nth;
+  }
+  return quantiles;
+}
+
+double MUHist::GetSpread( std::vector<double>& vec, const unsigned int nUniverses ){
+  if( vec.empty() )
+    return 0.;
+
+  if( nUniverses < 10 ) {
+    const double range = *std::max_element( vec.begin(), vec.end() ) - *std::min_element( vec.begin(), vec.end() );
+    return ( nUniverses == 1 ) ? range : range / 2.;
+  }
+
+  std::pair<double,double> quartiles = GetOrderStatistics( vec, vec.size() / 4, 3 * ( vec.size() / 4 ) );
+  return ( quartiles.second - quartiles.first ) * InterquartileRangeToSigma;
 }
 
 
@@ -160,188 +228,50 @@ MUH1D* MUHist::divide1D( const MUH1D *num, const MUH1D *den ){
 //=============================================================================
 TH2D* MUHist::average3D_to_2D( const TH3D *object, const char *axis1, const char *axis2 ){
 
-  int xbins=0, ybins=0, zbins=0;
-  double* x_bins(0);
-  double* y_bins(0);
-  double* z_bins(0);
-  char axis3[2]; // 1 char + \0
-  char axes[4];  // 3 char + \0
-
-  if( (0 == strcmp(axis1,"1") && 0 == strcmp(axis2,"2")) || (0 == strcmp(axis1,"2") && 0 == strcmp(axis2,"1")) )
-    sprintf( axis3, "3" );
-  if( (0 == strcmp(axis1,"1") && 0 == strcmp(axis2,"3")) || (0 == strcmp(axis1,"3") && 0 == strcmp(axis2,"1")) )
-    sprintf( axis3, "2" );
-  if( (0 == strcmp(axis1,"2") && 0 == strcmp(axis2,"3")) || (0 == strcmp(axis1,"3") && 0 == strcmp(axis2,"2")) )
-    sprintf( axis3, "1" );
-
-  sprintf( axes, "%s%s%s", axis1, axis2, axis3 );
-
-  if( 0 == strcmp(axes,"123") )
-  {
-    xbins = object->GetNbinsX();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsY();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-    zbins = object->GetNbinsZ();
-    z_bins = new double[zbins+1];
-    for( int i = 0; i <= zbins; i++ )
-      z_bins[i] = object->GetZaxis()->GetBinLowEdge(i+1);
-  }
-  else if( 0 == strcmp(axes,"132") )
-  {
-    xbins = object->GetNbinsX();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsZ();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetZaxis()->GetBinLowEdge(i+1);
-    zbins = object->GetNbinsY();
-    z_bins = new double[zbins+1];
-    for( int i = 0; i <= zbins; i++ )
-      z_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-  }
-  else if( 0 == strcmp(axes,"213") )
-  {
-    xbins = object->GetNbinsY();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsX();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-    zbins = object->GetNbinsZ();
-    z_bins = new double[zbins+1];
-    for( int i = 0; i <= zbins; i++ )
-      z_bins[i] = object->GetZaxis()->GetBinLowEdge(i+1);
-  }
-  else if( 0 == strcmp(axes,"231") )
-  {
-    xbins = object->GetNbinsY();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsZ();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetZaxis()->GetBinLowEdge(i+1);
-    zbins = object->GetNbinsX();
-    z_bins = new double[zbins+1];
-    for( int i = 0; i <= zbins; i++ )
-      z_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-  }
-  else if( 0 == strcmp(axes,"312") )
-  {
-    xbins = object->GetNbinsZ();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetZaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsX();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-    zbins = object->GetNbinsY();
-    z_bins = new double[zbins+1];
-    for( int i = 0; i <= zbins; i++ )
-      z_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-  }
-  else if( 0 == strcmp(axes,"321") )
-  {
-    xbins = object->GetNbinsZ();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetZaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsY();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-    zbins = object->GetNbinsX();
-    z_bins = new double[zbins+1];
-    for( int i = 0; i <= zbins; i++ )
-      z_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-  }
-  else
+  //! The axes of object that become x and y of the result, and the one averaged over
+  const int d1 = atoi( axis1 ) - 1;
+  const int d2 = atoi( axis2 ) - 1;
+  if( d1 < 0 || 2 < d1 || d2 < 0 || 2 < d2 || d1 == d2 )
   {
     cout << " Unhandled axis settings.  here' a NULL pointer." << endl;
     return NULL;
   }
+  const int d3 = 3 - d1 - d2;
 
+  const TAxis *axes[3] = { object->GetXaxis(), object->GetYaxis(), object->GetZaxis() };
+  const int xbins = axes[d1]->GetNbins();
+  const int ybins = axes[d2]->GetNbins();
+  const int zbins = axes[d3]->GetNbins();
+  const std::vector<double> x_bins = GetBinEdges( axes[d1] );
+  const std::vector<double> y_bins = GetBinEdges( axes[d2] );
 
-  TH2D *result = new TH2D("result", "result", xbins, x_bins, ybins, y_bins );
-
-  double sum = 0;
-  int count = 0;
-  double errorSum2=0;
+  TH2D *result = new TH2D("result", "result", xbins, &x_bins[0], ybins, &y_bins[0] );
 
+  //! Each bin that is not -99 goes to its result bin with weight 1/count, and its error with 1/count^2
+  MULinearMap average( object->GetNcells(), result->GetNcells() );
+  std::vector<int> bins;
   for( int i = 1; i <= xbins; i++ )
   {
     for( int j = 1; j <= ybins; j++ )
     {
-      count = 0;
-      sum = 0;
-      errorSum2 = 0;
+      bins.clear();
       for( int k = 1; k <= zbins; k++ )
       {
-        if( 0 == strcmp(axes,"123") ){
-          if( object->GetBinContent(i,j,k) != -99 ){
-            sum += object->GetBinContent(i,j,k);
-            count++;
-            errorSum2 += pow(object->GetBinError(i,j,k),2);
-          }
-        }else if( 0 == strcmp(axes,"132") ){
-          if( object->GetBinContent(i,k,j) != -99 ){
-            sum += object->GetBinContent(i,k,j);
-            count++;
-            errorSum2 += pow(object->GetBinError(i,k,j),2);
-          }
-        }else if( 0 == strcmp(axes,"213") ){
-          if( object->GetBinContent(j,i,k) != -99 ){
-            sum += object->GetBinContent(j,i,k);
-            count++;
-            errorSum2 += pow(object->GetBinError(j,i,k),2);
-          }
-        }else if( 0 == strcmp(axes,"231") ){
-          if( object->GetBinContent(k,i,j) != -99 ){
-            sum += object->GetBinContent(k,i,j);
-            count++;
-            errorSum2 += pow(object->GetBinError(k,i,j),2);
-          }
-        }else if( 0 == strcmp(axes,"312") ){
-          if( object->GetBinContent(j,k,i) != -99 ){
-            sum += object->GetBinContent(j,k,i);
-            count++;
-            errorSum2 += pow(object->GetBinError(j,k,i),2);
-          }
-        }else if( 0 == strcmp(axes,"321") ){
-          if( object->GetBinContent(k,j,i) != -99 ){
-            sum += object->GetBinContent(k,j,i);
-            count++;
-            errorSum2 += pow(object->GetBinError(k,j,i),2);
-          }
-        }
-      }
-      if( count != 0 )
-      {
-        result->SetBinContent(i,j,sum/(double)count);
-        double error = sqrt( errorSum2 ) / count;
-        result->SetBinError(i,j, error );
-        //cout << i << ", " << j << " = " << sum << " / " << count << " = "
-        //<< result->GetBinContent(i,j) << " +- " << error << endl;
-      }
-      else
-      {
-        result->SetBinContent(i,j,0);
-        result->SetBinError(i,j,0);
+        int coord[3];
+        coord[d1] = i;
+        coord[d2] = j;
+        coord[d3] = k;
+        const int bin = object->GetBin( coord[0], coord[1], coord[2] );
+        if( object->GetBinContent(bin) != -99 )
+          bins.push_back( bin );
       }
+      for( unsigned int b = 0; b != bins.size(); b++ )
+        average.AddEntry( bins[b], result->GetBin(i,j), 1. / bins.size() );
     }
   }
 
+  //! Bins with nothing to average stay 0
+  average.Apply( object, result );
   return result;
 }
 
@@ -351,74 +281,38 @@ TH2D* MUHist::average3D_to_2D( const TH3D *object, const char *axis1, const char
 //=============================================================================
 MUH1D* MUHist::average2D_to_1D( const TH2D* object, const char *axis1 ){
 
-  int xbins=0, ybins=0;
-  double* x_bins(0);
-  double* y_bins(0);
-  char axis2[2]; // 1 char + \0
-
-  if( 0 == strcmp(axis1,"1") )
-  {
-    sprintf( axis2, "2" );
-    xbins = object->GetNbinsX();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsY();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-  }
-  else
-  {
-    sprintf( axis2, "1" );
-    xbins = object->GetNbinsY();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsX();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-  }
-
-  MUH1D *result = new MUH1D( "result", "result", xbins, x_bins );
+  //! The axis of object that becomes x of the result, and the one averaged over
+  const int d1 = ( 0 == strcmp(axis1,"1") ) ? 0 : 1;
+  const TAxis *axis  = ( 0 == d1 ) ? object->GetXaxis() : object->GetYaxis();
+  const TAxis *other = ( 0 == d1 ) ? object->GetYaxis() : object->GetXaxis();
+  const int xbins = axis->GetNbins();
+  const int ybins = other->GetNbins();
+  const std::vector<double> x_bins = GetBinEdges( axis );
 
-  double sum = 0;
-  int count = 0;
-  double errorSum2=0;
+  MUH1D *result = new MUH1D( "result", "result", xbins, &x_bins[0] );
 
+  //! Each bin that is not -99 goes to its result bin with weight 1/count, and its error with 1/count^2
+  MULinearMap average( object->GetNcells(), result->GetNcells() );
+  std::vector<int> bins;
+  std::vector<bool> empty( xbins + 2, false );
   for( int i = 1; i <= xbins; i++ )
   {
-    sum = 0;
-    count = 0;
-    errorSum2 = 0;
+    bins.clear();
     for( int j = 1; j <= ybins; j++ )
     {
-      if( 0 == strcmp(axis1,"1") ){
-        if( object->GetBinContent(i,j) != -99 )
-        {
-          sum += object->GetBinContent(i,j);
-          count++;
-          errorSum2 += pow(object->GetBinError(i,j),2);
-        }
-      }else{
-        if( object->GetBinContent(j,i) != -99 )
-        {
-          sum += object->GetBinContent(j,i);
-          count++;
-          errorSum2 += pow(object->GetBinError(j,i),2);
-        }
-      }
-    }
-    if( count != 0 )
-    {
-      result->SetBinContent(i,sum/(double)count);
-      double error = sqrt( errorSum2 ) / count;
-      result->SetBinError(i,error );
-      //cout << i << " = " << sum << " / " << count << " = "
-      //<< result->GetBinContent(i) << " +- " << error << endl;
+      const int bin = ( 0 == d1 ) ? object->GetBin(i,j) : object->GetBin(j,i);
+      if( object->GetBinContent(bin) != -99 )
+        bins.push_back( bin );
     }
-    else
+    for( unsigned int b = 0; b != bins.size(); b++ )
+      average.AddEntry( bins[b], i, 1. / bins.size() );
+    empty[i] = bins.empty();
+  }
+
+  average.Apply( object, result );
+  for( int i = 1; i <= xbins; i++ )
+  {
+    if( empty[i] )
     {
       result->SetBinContent(i,-99);
       result->SetBinError(i,1);
@@ -435,89 +329,62 @@ MUH1D* MUHist::average2D_to_1D( const TH2D* object, const char *axis1 ){
 //=============================================================================
 MUH1D* MUHist::integrate2D_to_1D( const TH2D* object, const char *axis1, const double mult, const char *option ){
 
-  int xbins=0, ybins=0;
-  double* x_bins(0);
-  double* y_bins(0);
-  char axis2[2];  // 1 char + \0
-
-  if( 0 == strcmp(axis1,"1") )
+  //! The axis of object that becomes x of the result, and the one integrated over
+  const int d1 = ( 0 == strcmp(axis1,"1") ) ? 0 : 1;
+  const TAxis *axis  = ( 0 == d1 ) ? object->GetXaxis() : object->GetYaxis();
+  const TAxis *other = ( 0 == d1 ) ? object->GetYaxis() : object->GetXaxis();
+  const int xbins = axis->GetNbins();
+  const int ybins = other->GetNbins();
+  const std::vector<double> x_bins = GetBinEdges( axis );
+
+  //! The width of each bin integrated over, as solid angle for "omega" along y
+  const bool omega = ( 0 == d1 && strcmp( option, "omega" ) == 0 );
+  std::vector<double> widths( ybins + 1, 0. );
+  for( int j = 1; j <= ybins; j++ )
   {
-    sprintf( axis2, "2" );
-    xbins = object->GetNbinsX();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsY();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-  }
-  else
-  {
-    sprintf( axis2, "1" );
-    xbins = object->GetNbinsY();
-    x_bins = new double[xbins+1];
-    for( int i = 0; i <= xbins; i++ )
-      x_bins[i] = object->GetYaxis()->GetBinLowEdge(i+1);
-    ybins = object->GetNbinsX();
-    y_bins = new double[ybins+1];
-    for( int i = 0; i <= ybins; i++ )
-      y_bins[i] = object->GetXaxis()->GetBinLowEdge(i+1);
+    if( omega )
+      widths[j] = (cos(other->GetBinLowEdge(j)) - cos(other->GetBinUpEdge(j))) * mult;
+    else
+      widths[j] = other->GetBinWidth(j) * mult;
   }
 
-  MUH1D *result = new MUH1D( "result", "result", xbins, x_bins );
-
-  double sum = 0;
-  int count = 0;
-  double errorSum2=0;
+  MUH1D *result = new MUH1D( "result", "result", xbins, &x_bins[0] );
 
+  //! Each bin that is not -99 goes to its result bin weighted by its width.
+  //! Its squared error is added with no width when integrating along y without "omega", else with the width itself.
+  MULinearMap integral( object->GetNcells(), result->GetNcells() );
+  MULinearMap errors( object->GetNcells(), result->GetNcells() );
+  std::vector<bool> empty( xbins + 2, true );
   for( int i = 1; i <= xbins; i++ )
   {
-    sum = 0;
-    count = 0;
-    errorSum2 = 0;
     for( int j = 1; j <= ybins; j++ )
     {
-      if( 0 == strcmp(axis1,"1") ){
-        if( object->GetBinContent(i,j) != -99 )
-        {
-          if( strcmp( option, "omega" ) == 0 )
-          {
-            sum += object->GetBinContent(i,j) *
-              (cos(object->GetYaxis()->GetBinLowEdge(j)) - cos(object->GetYaxis()->GetBinUpEdge(j))) * mult;
-            count++;
-            errorSum2 += pow(object->GetBinError(i,j),2) *
-              (cos(object->GetYaxis()->GetBinLowEdge(j)) - cos(object->GetYaxis()->GetBinUpEdge(j))) * mult;
-          }
-          else
-          {
-            sum += object->GetBinContent(i,j) * object->GetYaxis()->GetBinWidth(j) * mult;
-            count++;
-            errorSum2 += pow(object->GetBinError(i,j),2);
-          }
-        }
-      }else{
-        if( object->GetBinContent(j,i) != -99 )
-        {
-          sum += object->GetBinContent(j,i) * object->GetXaxis()->GetBinWidth(j) * mult;
-          count++;
-          errorSum2 += pow(object->GetBinError(j,i),2) * object->GetXaxis()->GetBinWidth(j) * mult;;
-        }
+      const int bin = ( 0 == d1 ) ? object->GetBin(i,j) : object->GetBin(j,i);
+      if( object->GetBinContent(bin) != -99 )
+      {
+        integral.AddEntry( bin, i, widths[j] );
+        errors.AddEntry( bin, i, ( 0 == d1 && !omega ) ? 1. : widths[j] );
+        empty[i] = false;
       }
     }
-    if( count != 0 )
-    {
-      result->SetBinContent(i,sum);
-      double error = sqrt( errorSum2 );
-      result->SetBinError(i,error );
-      //cout << i << " = " << sum << " / " << count << " = "
-      //<< result->GetBinContent(i) << " +- " << error << endl;
-    }
-    else
+  }
+
+  integral.Apply( object, result );
+
+  std::vector<double> errorSum2( object->GetNcells() ), newErrorSum2( result->GetNcells(), 0. );
+  for( int bin = 0; bin != object->GetNcells(); bin++ )
+    errorSum2[bin] = pow(object->GetBinError(bin),2);
+  errors.Apply( &errorSum2[0], &newErrorSum2[0] );
+
+  for( int i = 1; i <= xbins; i++ )
+  {
+    if( empty[i] )
     {
       result->SetBinContent(i,-99);
       result->SetBinError(i,1);
     }
+    else
+      result->SetBinError(i, sqrt( newErrorSum2[i] ) );
   }
 
   return result;
@@ -646,15 +513,130 @@ int MUHist::AddInQuadrature( TH1* a, const TH1* b){
 
 TMatrixD MUHist::GetErrorsAsMatrix( const TH1D *h )
 {
-  const int highBin = h->GetNbinsX() + 1;
-  const int lowBin = 0;
-  TMatrixD covmx(highBin+1,highBin+1);
+  return GetErrorsAsDiagonal( h ).GetMatrix();
+}
 
+MUDiagonalCovariance MUHist::GetErrorsAsDiagonal( const TH1 *h )
+{
   // stat error
-  for (int iBin=lowBin; iBin<=highBin; ++iBin )
-    covmx[iBin][iBin] = TMath::Power( h->GetBinError(iBin), 2 );
+  MUDiagonalCovariance cov( h->GetNcells() );
+  cov.AddErrors( h );
+  return cov;
+}
+
+namespace
+{
+  //! Exchange the storage of two arrays, without copying
+  void SwapArrays( TArrayD& a, TArrayD& b )
+  {
+    std::swap( a.fArray, b.fArray );
+    std::swap( a.fN, b.fN );
+  }
+
+  //! Copy an axis but take its bin edges, leaving from with none
+  void MoveAxis( TAxis& to, TAxis& from )
+  {
+    TArrayD edges;
+    SwapArrays( edges, *const_cast<TArrayD*>( from.GetXbins() ) );
+    TObject *parent = to.GetParent();
+    from.Copy( to );
+    to.SetParent( parent );
+    SwapArrays( edges, *const_cast<TArrayD*>( to.GetXbins() ) );
+    from.Set( 1, 0., 1. );
+  }
+}
+
+bool MUHist::StatOverflows( const TH1& h )
+{
+#ifdef ROOT5
+  (void)h; // ROOT 5 only has the global setting
+  return TH1::GetStatOverflows();
+#else
+  return h.GetStatOverflowsBehaviour();
+#endif
+}
+
+void MUHist::MoveHistogram( TH1& to, TH1& from )
+{
+  TArrayD *toBins = dynamic_cast<TArrayD*>( &to );
+  TArrayD *fromBins = dynamic_cast<TArrayD*>( &from );
+  if( !toBins || !fromBins || to.GetDimension() != from.GetDimension() )
+  {
+    from.Copy( to );
+    return;
+  }
+
+  // Fills still buffered go to the bins first
+  const Int_t bufferSize = from.GetBuffer() ? from.GetBufferSize() : 0;
+  if( from.GetBuffer() )
+    from.BufferEmpty();
+  to.SetBuffer( bufferSize );
+
+  // GetStats sums the bins in the range of an axis, so the stored sums are read with the ranges lifted
+  TAxis *fromAxes[3] = { from.GetXaxis(), from.GetYaxis(), from.GetZaxis() };
+  TAxis *toAxes[3] = { to.GetXaxis(), to.GetYaxis(), to.GetZaxis() };
+  bool ranged[3];
+  for( int d = 0; d != 3; ++d )
+  {
+    ranged[d] = fromAxes[d]->TestBit( TAxis::kAxisRange );
+    fromAxes[d]->ResetBit( TAxis::kAxisRange );
+  }
+  Double_t stats[TH1::kNstat];
+  from.GetStats( stats );
+  for( int d = 0; d != 3; ++d )
+    fromAxes[d]->SetBit( TAxis::kAxisRange, ranged[d] );
+
+  // Settings, then name, title and bits with TNamed::Copy
+  const Int_t nLevels = from.GetContour();
+  std::vector<double> levels( nLevels );
+  for( int i = 0; i != nLevels; ++i )
+    levels[i] = from.GetContourLevel( i );
+  to.SetContour( nLevels, nLevels ? &levels[0] : 0 );
+  to.SetMaximum( from.GetMaximumStored() );
+  to.SetMinimum( from.GetMinimumStored() );
+  to.SetNormFactor( from.GetNormFactor() );
+  to.SetBarOffset( from.GetBarOffset() );
+  to.SetBarWidth( from.GetBarWidth() );
+  to.SetOption( from.GetOption() );
+  to.SetBinErrorOption( from.GetBinErrorOption() );
+#ifndef ROOT5
+  // Only the resulting use of under/overflows can be read, so it is set only where it differs from the global one
+  const bool statOverflows = from.GetStatOverflowsBehaviour();
+  to.SetStatOverflows( statOverflows == TH1::GetStatOverflows() ? TH1::kNeutral : ( statOverflows ? TH1::kConsider : TH1::kIgnore ) );
+#endif
+  from.TNamed::Copy( to );
+  from.TAttLine::Copy( to );
+  from.TAttFill::Copy( to );
+  from.TAttMarker::Copy( to );
+
+  // The functions change lists, not owners
+  if( to.GetListOfFunctions() )
+    to.GetListOfFunctions()->Delete();
+  TList *functions = from.GetListOfFunctions();
+  while( functions && functions->First() )
+  {
+    TObject *f = functions->First();
+    functions->Remove( f );
+    to.GetListOfFunctions()->Add( f );
+  }
 
-  return covmx;
+  // Axes and bins change hands, and the number of bins follows the arrays without reallocating them
+  for( int d = 0; d != 3; ++d )
+    MoveAxis( *toAxes[d], *fromAxes[d] );
+  SwapArrays( *toBins, *fromBins );
+  SwapArrays( *to.GetSumw2(), *from.GetSumw2() );
+  to.SetBinsLength( toBins->fN );
+  to.PutStats( stats );
+  to.SetEntries( from.GetEntries() );
+
+  // from keeps nothing
+  fromBins->Set( 0 );
+  from.GetSumw2()->Set( 0 );
+  from.SetBinsLength( 0 );
+  for( int i = 0; i != TH1::kNstat; ++i )
+    stats[i] = 0.;
+  from.PutStats( stats );
+  from.SetEntries( 0. );
 }
 
 #endif
@@ -48,10 +48,28 @@ namespace PlotUtils {
 		//! Convert Interquartile range to sigma
 		const double InterquartileRangeToSigma = 1.0 / 1.34896;
 
+		/*! Get several quantiles of a vector in O(n) each, by selection instead of sorting.
+			The q-quantile is element floor(q*n) of the sorted vector, with q clamped to [0,1].
+			vec is reordered.
+			*/
+		std::vector<double> GetQuantiles( std::vector<double>& vec, const std::vector<double>& q );
+
+		/*! Get the spread of one bin's universe values (and CV), as used for spread errors.
+			For 1 universe this is the full range, for fewer than 10 half the range, otherwise the
+			interquartile range converted to sigma.  vec is reordered.
+			*/
+		double GetSpread( std::vector<double>& vec, const unsigned int nUniverses );
+
 		TH3D*   divide3D( const TH3D *num, const TH3D *den );
 		TH2D*   divide2D( const TH2D *num, const TH2D *den );
 		MUH1D* divide1D( const MUH1D *num, const MUH1D *den );
 
+		/*! Average (integrate) over the axes that are not kept, leaving out bins of content -99.
+			These are linear maps (see MULinearMap).  The averages propagate errors with the squared weights.
+			integrate2D_to_1D adds the squared errors with no width along y (axis1 "1" without "omega"),
+			and with the width itself otherwise.  A bin of the result with nothing to add up
+			is 0 for average3D_to_2D and -99 +- 1 for the others.
+			*/
 		TH2D*   average3D_to_2D( const TH3D *object, const char *axis1, const char *axis2 );
 		MUH1D* average2D_to_1D( const TH2D *object, const char *axis1 );
 
@@ -67,6 +85,19 @@ namespace PlotUtils {
 		//! Put histogram bin errors into a diagonal matrix
 		TMatrixD GetErrorsAsMatrix( const TH1D *h );
 
+		//! Histogram bin errors squared, as a diagonal covariance
+		MUDiagonalCovariance GetErrorsAsDiagonal( const TH1 *h );
+
+		/*! Hand the TH1 part of from to to without copying the bins, for move constructors and assignments.
+			to takes the bin contents and sumw2 arrays, the axes (with their edges), the statistics, the functions
+			and the drawing settings of from.  from is left an empty histogram of one bin.  Neither directory changes.
+			to and from must both be TH1D, TH2D or TH3D; any other pair is copied with TH1::Copy.
+			*/
+		void MoveHistogram( TH1& to, TH1& from );
+
+		//! Whether fills in the under/overflow bins of h enter its statistics, as TH1::Fill decides it for h
+		bool StatOverflows( const TH1& h );
+
 	} //end of MUHist
 
 }//end of PlotUtils
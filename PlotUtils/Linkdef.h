@@ -6,12 +6,15 @@
 
 #pragma link C++ namespace PlotUtils;
 
-#pragma link C++ class PlotUtils::MULatErrorBand+;
-#pragma link C++ class PlotUtils::MULatErrorBand2D+;
-#pragma link C++ class PlotUtils::MULatErrorBand3D+;
-#pragma link C++ class PlotUtils::MUVertErrorBand+;
-#pragma link C++ class PlotUtils::MUVertErrorBand2D+;
-#pragma link C++ class PlotUtils::MUVertErrorBand3D+;
+#pragma link C++ class PlotUtils::MUErrorBandHandle+;
+#pragma link C++ class PlotUtils::MUUniverseStore+;
+#pragma link C++ class PlotUtils::MUEventUniverseWeights+;
+#pragma link C++ class PlotUtils::MULatErrorBand-;
+#pragma link C++ class PlotUtils::MULatErrorBand2D-;
+#pragma link C++ class PlotUtils::MULatErrorBand3D-;
+#pragma link C++ class PlotUtils::MUVertErrorBand-;
+#pragma link C++ class PlotUtils::MUVertErrorBand2D-;
+#pragma link C++ class PlotUtils::MUVertErrorBand3D-;
 #pragma link C++ class PlotUtils::MUH1D+;
 #pragma link C++ class PlotUtils::MUH2D+;
 #pragma link C++ class PlotUtils::MUH3D+;
@@ -0,0 +1,159 @@
+#ifndef MNV_MUBinLocator_cxx
+#define MNV_MUBinLocator_cxx 1
+
+#include "PlotUtils/MUBinLocator.h"
+
+#include "TAxis.h"
+#include "TArrayD.h"
+
+#include <cstring>
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define MU_BIN_LOCATOR_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using namespace PlotUtils;
+
+//======================================================================
+// Batch kernels
+//======================================================================
+namespace
+{
+#ifdef MU_BIN_LOCATOR_X86_KERNELS
+  bool HaveAVX2()
+  {
+    static const bool have = ( __builtin_cpu_init(), __builtin_cpu_supports( "avx2" ) );
+    return have;
+  }
+
+  //! Turn 4 bin positions t (-1 for underflow, nbins for overflow) into bins 1 + int(t)
+  __attribute__((target("avx2")))
+  inline void StoreBins( const __m256d t, int *bins )
+  {
+    const __m128i b = _mm_add_epi32( _mm256_cvttpd_epi32( t ), _mm_set1_epi32( 1 ) );
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( bins ), b );
+  }
+
+  //! Uniform axis, 4 values per iteration, same arithmetic as TAxis::FindFixBin
+  __attribute__((target("avx2")))
+  unsigned int FindUniformAVX2( const double val, const double *shifts, const unsigned int n, int *bins, const int nbins, const double xmin, const double xmax )
+  {
+    const __m256d v     = _mm256_set1_pd( val );
+    const __m256d lo    = _mm256_set1_pd( xmin );
+    const __m256d hi    = _mm256_set1_pd( xmax );
+    const __m256d nb    = _mm256_set1_pd( nbins );
+    const __m256d width = _mm256_set1_pd( xmax - xmin );
+    const __m256d under = _mm256_set1_pd( -1. );
+    unsigned int i = 0;
+    for( ; i + 4 <= n; i += 4 )
+    {
+      const __m256d x = _mm256_add_pd( v, _mm256_loadu_pd( shifts + i ) );
+      __m256d t = _mm256_div_pd( _mm256_mul_pd( nb, _mm256_sub_pd( x, lo ) ), width );
+      //! overflow is !(x < xmax), which also catches NaN
+      t = _mm256_blendv_pd( t, nb,    _mm256_cmp_pd( x, hi, _CMP_NLT_UQ ) );
+      t = _mm256_blendv_pd( t, under, _mm256_cmp_pd( x, lo, _CMP_LT_OQ ) );
+      StoreBins( t, bins + i );
+    }
+    return i;
+  }
+
+  //! Variable axis, 4 values per iteration.  The search depth only depends on the number of edges, so all lanes step together.
+  __attribute__((target("avx2")))
+  unsigned int FindVariableAVX2( const double val, const double *shifts, const unsigned int n, int *bins, const std::vector<double>& edges )
+  {
+    const double *e = &edges[0];
+    const int nbins = edges.size() - 1;
+    const __m256d v     = _mm256_set1_pd( val );
+    const __m256d lo    = _mm256_set1_pd( edges.front() );
+    const __m256d hi    = _mm256_set1_pd( edges.back() );
+    const __m256d nb    = _mm256_set1_pd( nbins );
+    const __m256d under = _mm256_set1_pd( -1. );
+    unsigned int i = 0;
+    for( ; i + 4 <= n; i += 4 )
+    {
+      const __m256d x = _mm256_add_pd( v, _mm256_loadu_pd( shifts + i ) );
+      __m256i base = _mm256_setzero_si256();
+      for( long long len = edges.size(); len > 1; )
+      {
+        const long long half = len / 2;
+        const __m256i probe = _mm256_add_epi64( base, _mm256_set1_epi64x( half ) );
+        const __m256d edge = _mm256_i64gather_pd( e, probe, 8 );
+        const __m256i take = _mm256_castpd_si256( _mm256_cmp_pd( edge, x, _CMP_LE_OQ ) );
+        base = _mm256_blendv_epi8( base, probe, take );
+        len -= half;
+      }
+      //! base is the index of the last edge <= x; move it into doubles so out-of-range lanes can be blended in as for a uniform axis
+      const __m128i base32 = _mm256_castsi256_si128( _mm256_permutevar8x32_epi32( base, _mm256_setr_epi32( 0, 2, 4, 6, 0, 2, 4, 6 ) ) );
+      __m256d t = _mm256_cvtepi32_pd( base32 );
+      t = _mm256_blendv_pd( t, nb,    _mm256_cmp_pd( x, hi, _CMP_NLT_UQ ) );
+      t = _mm256_blendv_pd( t, under, _mm256_cmp_pd( x, lo, _CMP_LT_OQ ) );
+      StoreBins( t, bins + i );
+    }
+    return i;
+  }
+#endif
+}
+
+//======================================================================
+// MUBinLocator
+//======================================================================
+MUBinLocator::MUBinLocator( ) :
+  fNbins(0),
+  fXmin(0.),
+  fXmax(0.)
+{ }
+
+MUBinLocator::MUBinLocator( const TAxis* axis ) :
+  fNbins(0),
+  fXmin(0.),
+  fXmax(0.)
+{
+  Set( axis );
+}
+
+void MUBinLocator::Set( const TAxis* axis )
+{
+  fNbins = axis->GetNbins();
+  fXmin  = axis->GetXmin();
+  fXmax  = axis->GetXmax();
+
+  //! TAxis does a binary search whenever it has an edge array, so do the same
+  const TArrayD *xbins = axis->GetXbins();
+  if( xbins->fN )
+    fEdges.assign( xbins->fArray, xbins->fArray + xbins->fN );
+  else
+    fEdges.clear();
+}
+
+bool MUBinLocator::Matches( const TAxis* axis ) const
+{
+  if( fNbins != axis->GetNbins() || fXmin != axis->GetXmin() || fXmax != axis->GetXmax() )
+    return false;
+
+  //! New edges with the same count and range move bins too.  memcmp over a few hundred bytes is cheap next to a fill.
+  const TArrayD *xbins = axis->GetXbins();
+  if( fEdges.size() != (size_t)xbins->fN )
+    return false;
+  return fEdges.empty() || 0 == memcmp( &fEdges[0], xbins->fArray, fEdges.size() * sizeof(double) );
+}
+
+void MUBinLocator::FindBins( const double val, const double *shifts, const unsigned int n, int *bins ) const
+{
+  unsigned int i = 0;
+#ifdef MU_BIN_LOCATOR_X86_KERNELS
+  if( HaveAVX2() )
+  {
+    if( fEdges.empty() )
+      i = FindUniformAVX2( val, shifts, n, bins, fNbins, fXmin, fXmax );
+    else
+      i = FindVariableAVX2( val, shifts, n, bins, fEdges );
+  }
+#endif
+
+  //! Whatever the vector kernel did not cover
+  for( ; i < n; ++i )
+    bins[i] = FindBin( val + shifts[i] );
+}
+
+#endif
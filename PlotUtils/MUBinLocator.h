@@ -0,0 +1,87 @@
+#ifndef MNV_MUBinLocator_H
+#define MNV_MUBinLocator_H 1
+
+#include <vector>
+
+class TAxis;
+
+namespace PlotUtils
+{
+
+	/*! @brief Finds bins on one axis, giving the same answer as TAxis::FindFixBin.
+
+		The axis is copied into plain members, so a lookup needs no virtual calls:
+		<ul>
+		<li>Uniform axes use the same arithmetic as TAxis, which is O(1).
+		<li>Variable axes use a branchless binary search over a cached copy of the bin edges.
+		</ul>
+		FindBins resolves many shifted values at once (e.g. all universes of a lateral error band),
+		four at a time with AVX2 when the CPU has it.
+
+		Bin 0 is the underflow and nbins+1 the overflow, as for TAxis.
+		*/
+	class MUBinLocator
+	{
+		public:
+			//! Default constructor (no bins)
+			MUBinLocator( );
+
+			//! Locator for this axis
+			explicit MUBinLocator( const TAxis* axis );
+
+			//! Copy the binning of this axis
+			void Set( const TAxis* axis );
+
+			//! Does this locator still describe the axis?  Checks the number of bins, the range and the edges.
+			bool Matches( const TAxis* axis ) const;
+
+			//! Number of bins, excluding under/overflow
+			int GetNbins() const { return fNbins; };
+
+			//! Are all bins the same width?
+			bool IsUniform() const { return fEdges.empty(); };
+
+			//! Bin of x
+			int FindBin( const double x ) const
+			{
+				if( x < fXmin )
+					return 0;
+				if( !( x < fXmax ) )
+					return fNbins + 1;
+				if( fEdges.empty() )
+					return 1 + int( fNbins*(x-fXmin)/(fXmax-fXmin) );
+				return 1 + SearchEdges( x );
+			};
+
+			/*! Bins of val + shifts[i] for i < n
+				@param[in] val Central value
+				@param[in] shifts Array of n shifts
+				@param[in] n Number of shifts
+				@param[out] bins Array of n bins to fill
+				*/
+			void FindBins( const double val, const double *shifts, const unsigned int n, int *bins ) const;
+
+		private:
+			//! Index of the last edge <= x, for fXmin <= x < fXmax
+			int SearchEdges( const double x ) const
+			{
+				const double *base = &fEdges[0];
+				unsigned int len = fEdges.size();
+				while( len > 1 )
+				{
+					const unsigned int half = len / 2;
+					base = ( base[half] <= x ) ? base + half : base;
+					len -= half;
+				}
+				return base - &fEdges[0];
+			};
+
+			int fNbins;                 ///< Number of bins, excluding under/overflow
+			double fXmin;               ///< Low edge of the first bin
+			double fXmax;               ///< High edge of the last bin
+			std::vector<double> fEdges; ///< All bin edges for a variable axis, empty for a uniform one
+	}; //end of MUBinLocator
+
+} //end of PlotUtils
+
+#endif
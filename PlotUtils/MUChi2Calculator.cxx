@@ -0,0 +1,479 @@
+#ifndef MNV_MUChi2Calculator_cxx
+#define MNV_MUChi2Calculator_cxx 1
+
+#include "PlotUtils/MUChi2Calculator.h"
+
+#include "TH1.h"
+#include "TDecompSVD.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+using namespace PlotUtils;
+
+namespace
+{
+  //! Replace the lower triangle of the n x n row-major matrix a by its Cholesky factor.  False if a is not positive definite.
+  bool CholeskyDecompose( std::vector<double>& a, const unsigned int n )
+  {
+    for( unsigned int j = 0; j != n; ++j )
+    {
+      double *rowj = &a[ (size_t)j*n ];
+      double d = rowj[j];
+      for( unsigned int k = 0; k != j; ++k )
+        d -= rowj[k] * rowj[k];
+      if( !( 0. < d && d < HUGE_VAL ) )
+        return false;
+      d = sqrt( d );
+      rowj[j] = d;
+
+      for( unsigned int i = j+1; i < n; ++i )
+      {
+        double *rowi = &a[ (size_t)i*n ];
+        double s = rowi[j];
+        for( unsigned int k = 0; k != j; ++k )
+          s -= rowi[k] * rowj[k];
+        rowi[j] = s / d;
+      }
+    }
+    return true;
+  }
+
+  //! Solve L z = b in place, L lower triangular
+  void ForwardSubstitute( const std::vector<double>& l, const unsigned int n, double *b )
+  {
+    for( unsigned int i = 0; i != n; ++i )
+    {
+      const double *row = &l[ (size_t)i*n ];
+      double s = b[i];
+      for( unsigned int k = 0; k != i; ++k )
+        s -= row[k] * b[k];
+      b[i] = s / row[i];
+    }
+  }
+
+  //! Solve L^T x = z in place, L lower triangular
+  void BackSubstitute( const std::vector<double>& l, const unsigned int n, double *z )
+  {
+    for( unsigned int i = n; i-- != 0; )
+    {
+      double s = z[i];
+      for( unsigned int k = i+1; k < n; ++k )
+        s -= l[ (size_t)k*n + i ] * z[k];
+      z[i] = s / l[ (size_t)i*n + i ];
+    }
+  }
+}
+
+MUChi2Calculator::MUChi2Calculator( ) :
+  fMethod( kNone ),
+  fNBins( 0 ),
+  fRank( 0 )
+{ }
+
+void MUChi2Calculator::Clear()
+{
+  fMethod = kNone;
+  fNBins = 0;
+  fRank = 0;
+  fBins.clear();
+  fUsed.clear();
+  fZero.clear();
+  fInvSqrtD.clear();
+  fG.clear();
+  fL.clear();
+  fFZero.clear();
+  fHZero.clear();
+}
+
+bool MUChi2Calculator::SetCovariance( const MULowRankCovariance& cov, const std::vector<int>& bins )
+{
+  Clear();
+  fNBins = bins.size();
+  fBins = bins;
+
+  //! The variance of each bin, to sort out the bins Woodbury can take as they are
+  const std::vector<double>& diag = cov.GetDiagonalTerm();
+  std::vector<double> variance( fNBins );
+  for( unsigned int i = 0; i != fNBins; ++i )
+    variance[i] = diag[ bins[i] ];
+  for( unsigned int c = 0; c != cov.GetRank(); ++c )
+  {
+    const double *col = cov.GetFactorColumn( c );
+    for( unsigned int i = 0; i != fNBins; ++i )
+      variance[i] += col[ bins[i] ] * col[ bins[i] ];
+  }
+  for( unsigned int i = 0; i != fNBins; ++i )
+  {
+    if( 0. < diag[ bins[i] ] )
+      fUsed.push_back( i );
+    else if( 0. < variance[i] )
+      fZero.push_back( i );
+  }
+  if( 0 != GetNDroppedBins() )
+    std::cout << "Warning [MUChi2Calculator::SetCovariance] : " << GetNDroppedBins() << " of " << fNBins << " bins have no variance. They are left out of the chi2." << std::endl;
+
+  //! Woodbury only pays off while the rank is below the number of bins
+  const unsigned int nBins = fUsed.size();
+  if( !fUsed.empty() && cov.GetRank() < nBins + fZero.size() )
+  {
+    fRank = cov.GetRank();
+    fInvSqrtD.resize( nBins );
+    for( unsigned int i = 0; i != nBins; ++i )
+      fInvSqrtD[i] = 1. / sqrt( diag[ bins[ fUsed[i] ] ] );
+
+    //! G = D^-1/2 F, restricted to the bins with D > 0
+    fG.resize( (size_t)fRank * nBins );
+    for( unsigned int c = 0; c != fRank; ++c )
+    {
+      const double *col = cov.GetFactorColumn( c );
+      double *g = &fG[ (size_t)c*nBins ];
+      for( unsigned int i = 0; i != nBins; ++i )
+        g[i] = col[ bins[ fUsed[i] ] ] * fInvSqrtD[i];
+    }
+
+    //! C^-1 = D^-1/2 ( 1 - G K^-1 G^T ) D^-1/2 with the capacitance K = 1 + G^T G
+    fL.assign( (size_t)fRank * fRank, 0. );
+    for( unsigned int a = 0; a != fRank; ++a )
+    {
+      const double *ga = &fG[ (size_t)a*nBins ];
+      for( unsigned int b = 0; b <= a; ++b )
+      {
+        const double *gb = &fG[ (size_t)b*nBins ];
+        double s = 0.;
+        for( unsigned int i = 0; i != nBins; ++i )
+          s += ga[i] * gb[i];
+        fL[ (size_t)a*fRank + b ] = s + ( a == b ? 1. : 0. );
+      }
+    }
+    bool ok = CholeskyDecompose( fL, fRank );
+
+    /*! Bins with D = 0 go through their Schur complement S = F_Z K^-1 F_Z^T = H H^T, with the rows h = L^-1 f
+        of H.  Its pseudo-inverse only needs the rank x rank matrix H^T H.
+        */
+    if( ok && !fZero.empty() )
+    {
+      const unsigned int nZero = fZero.size();
+      fFZero.resize( (size_t)nZero * fRank );
+      for( unsigned int c = 0; c != fRank; ++c )
+      {
+        const double *col = cov.GetFactorColumn( c );
+        for( unsigned int j = 0; j != nZero; ++j )
+          fFZero[ (size_t)j*fRank + c ] = col[ bins[ fZero[j] ] ];
+      }
+      fHZero = fFZero;
+      for( unsigned int j = 0; j != nZero; ++j )
+        ForwardSubstitute( fL, fRank, &fHZero[ (size_t)j*fRank ] );
+
+      TMatrixD hth( fRank, fRank );
+      double *m = hth.GetMatrixArray();
+      for( unsigned int j = 0; j != nZero; ++j )
+      {
+        const double *h = &fHZero[ (size_t)j*fRank ];
+        for( unsigned int a = 0; a != fRank; ++a )
+          for( unsigned int b = 0; b != fRank; ++b )
+            m[ (size_t)a*fRank + b ] += h[a] * h[b];
+      }
+      TDecompSVD svd( hth );
+      fZeroInverse.ResizeTo( hth );
+      fZeroInverse = hth;
+      ok = svd.Invert( fZeroInverse );
+    }
+
+    if( ok )
+    {
+      fMethod = kWoodbury;
+      return true;
+    }
+
+    std::cout << "Warning [MUChi2Calculator::SetCovariance] : Could not factor the Woodbury capacitance matrix. Using the dense covariance instead." << std::endl;
+    fRank = 0;
+    fInvSqrtD.clear();
+    fG.clear();
+    fL.clear();
+    fFZero.clear();
+    fHZero.clear();
+  }
+
+  //! Dense over all bins that have variance
+  fUsed.insert( fUsed.end(), fZero.begin(), fZero.end() );
+  fZero.clear();
+  std::sort( fUsed.begin(), fUsed.end() );
+  std::vector<int> usedBins( fUsed.size() );
+  for( unsigned int i = 0; i != fUsed.size(); ++i )
+    usedBins[i] = bins[ fUsed[i] ];
+  return FactorDense( cov.GetBlock( usedBins, usedBins ) );
+}
+
+bool MUChi2Calculator::SetCovariance( const TMatrixD& cov )
+{
+  Clear();
+  fNBins = cov.GetNrows();
+  fBins.resize( fNBins );
+  for( unsigned int i = 0; i != fNBins; ++i )
+  {
+    fBins[i] = i;
+    if( 0. < cov( i, i ) )
+      fUsed.push_back( i );
+  }
+  if( fUsed.size() == fNBins )
+    return FactorDense( cov );
+
+  std::cout << "Warning [MUChi2Calculator::SetCovariance] : " << GetNDroppedBins() << " of " << fNBins << " bins have no variance. They are left out of the chi2." << std::endl;
+  const unsigned int n = fUsed.size();
+  TMatrixD used( n, n );
+  for( unsigned int i = 0; i != n; ++i )
+    for( unsigned int k = 0; k != n; ++k )
+      used( i, k ) = cov( fUsed[i], fUsed[k] );
+  return FactorDense( used );
+}
+
+bool MUChi2Calculator::FactorDense( const TMatrixD& cov )
+{
+  fMethod = kNone;
+  const unsigned int n = cov.GetNrows();
+  if( 0 == n )
+  {
+    fL.clear();
+    fMethod = kCholesky;
+    return true;
+  }
+
+  //! Cholesky first, it is several times cheaper than the SVD and gives chi2 by one triangular solve
+  fL.assign( cov.GetMatrixArray(), cov.GetMatrixArray() + (size_t)n*n );
+  if( CholeskyDecompose( fL, n ) )
+  {
+    fMethod = kCholesky;
+    return true;
+  }
+  fL.clear();
+
+  //! TDecompSVD can handle singular matrices
+  TDecompSVD svd( cov );
+  fInverse.ResizeTo( cov );
+  fInverse = cov;
+  if( !svd.Invert( fInverse ) )
+  {
+    std::cout << "Warning [MUChi2Calculator::FactorDense] : Cannot invert the covariance matrix." << std::endl;
+    return false;
+  }
+  fMethod = kSVD;
+  return true;
+}
+
+void MUChi2Calculator::SolveWoodbury( const double *r, std::vector<double>& v, std::vector<double>& z ) const
+{
+  const unsigned int nBins = fUsed.size();
+  v.resize( nBins );
+  for( unsigned int i = 0; i != nBins; ++i )
+    v[i] = r[i] * fInvSqrtD[i];
+
+  //! z = K^-1 G^T w
+  z.assign( fRank, 0. );
+  for( unsigned int c = 0; c != fRank; ++c )
+  {
+    const double *g = &fG[ (size_t)c*nBins ];
+    double s = 0.;
+    for( unsigned int i = 0; i != nBins; ++i )
+      s += g[i] * v[i];
+    z[c] = s;
+  }
+  if( 0 == fRank )
+    return;
+  ForwardSubstitute( fL, fRank, &z[0] );
+  BackSubstitute( fL, fRank, &z[0] );
+
+  //! v = w - G z
+  for( unsigned int c = 0; c != fRank; ++c )
+  {
+    const double *g = &fG[ (size_t)c*nBins ];
+    for( unsigned int i = 0; i != nBins; ++i )
+      v[i] -= g[i] * z[c];
+  }
+}
+
+double MUChi2Calculator::Chi2( const double *r ) const
+{
+  //! Residuals of the factored bins
+  std::vector<double> used( fUsed.size() );
+  for( unsigned int i = 0; i != fUsed.size(); ++i )
+    used[i] = r[ fUsed[i] ];
+
+  if( kWoodbury == fMethod )
+  {
+    //! r^T C^-1 r = |v|^2 + |z|^2, a sum of squares that cannot cancel
+    std::vector<double> v, z;
+    SolveWoodbury( used.empty() ? 0 : &used[0], v, z );
+    double chi2 = 0.;
+    for( unsigned int i = 0; i != v.size(); ++i )
+      chi2 += v[i] * v[i];
+    for( unsigned int c = 0; c != fRank; ++c )
+      chi2 += z[c] * z[c];
+    if( fZero.empty() )
+      return chi2;
+
+    //! Plus s^T S^+ s = |(H^T H)^+ H^T s|^2 with s = r_Z - F_Z z
+    std::vector<double> u( fRank, 0. );
+    for( unsigned int j = 0; j != fZero.size(); ++j )
+    {
+      const double *f = &fFZero[ (size_t)j*fRank ];
+      const double *h = &fHZero[ (size_t)j*fRank ];
+      double s = r[ fZero[j] ];
+      for( unsigned int c = 0; c != fRank; ++c )
+        s -= f[c] * z[c];
+      for( unsigned int c = 0; c != fRank; ++c )
+        u[c] += h[c] * s;
+    }
+    const double *inv = fZeroInverse.GetMatrixArray();
+    for( unsigned int a = 0; a != fRank; ++a )
+    {
+      const double *row = inv + (size_t)a*fRank;
+      double q = 0.;
+      for( unsigned int b = 0; b != fRank; ++b )
+        q += row[b] * u[b];
+      chi2 += q * q;
+    }
+    return chi2;
+  }
+
+  const unsigned int nUsed = fUsed.size();
+  if( kCholesky == fMethod )
+  {
+    //! r^T C^-1 r = |L^-1 r|^2
+    if( 0 == nUsed )
+      return 0.;
+    ForwardSubstitute( fL, nUsed, &used[0] );
+    double chi2 = 0.;
+    for( unsigned int i = 0; i != nUsed; ++i )
+      chi2 += used[i] * used[i];
+    return chi2;
+  }
+
+  if( kSVD == fMethod )
+  {
+    const double *inv = fInverse.GetMatrixArray();
+    double chi2 = 0.;
+    for( unsigned int i = 0; i != nUsed; ++i )
+    {
+      const double *row = inv + (size_t)i*nUsed;
+      double s = 0.;
+      for( unsigned int k = 0; k != nUsed; ++k )
+        s += row[k] * used[k];
+      chi2 += used[i] * s;
+    }
+    return chi2;
+  }
+
+  std::cout << "Warning [MUChi2Calculator::Chi2] : There is no covariance. Returning -1." << std::endl;
+  return -1.;
+}
+
+double MUChi2Calculator::Chi2( const std::vector<double>& r ) const
+{
+  if( r.size() != fNBins )
+  {
+    std::cout << "Warning [MUChi2Calculator::Chi2] : Got " << r.size() << " residuals for " << fNBins << " bins. Returning -1." << std::endl;
+    return -1.;
+  }
+  return fNBins ? Chi2( &r[0] ) : 0.;
+}
+
+double MUChi2Calculator::Chi2( const TH1* a, const TH1* b, const double bScale /* = 1. */ ) const
+{
+  std::vector<double> r( fNBins );
+  for( unsigned int i = 0; i != fNBins; ++i )
+    r[i] = a->GetBinContent( fBins[i] ) - bScale * b->GetBinContent( fBins[i] );
+  return Chi2( r );
+}
+
+void MUChi2Calculator::Solve( const double *r, double *x ) const
+{
+  //! Bins left out get 0
+  std::fill( x, x + fNBins, 0. );
+  const unsigned int nUsed = fUsed.size();
+  std::vector<double> used( nUsed );
+  for( unsigned int i = 0; i != nUsed; ++i )
+    used[i] = r[ fUsed[i] ];
+
+  if( kWoodbury == fMethod )
+  {
+    if( !fZero.empty() )
+    {
+      //! x_Z = S^+ s = H (H^T H)^+ (H^T H)^+ H^T s, with s = r_Z - F_Z z
+      std::vector<double> v, z;
+      SolveWoodbury( nUsed ? &used[0] : 0, v, z );
+      std::vector<double> u( fRank, 0. );
+      for( unsigned int j = 0; j != fZero.size(); ++j )
+      {
+        const double *f = &fFZero[ (size_t)j*fRank ];
+        const double *h = &fHZero[ (size_t)j*fRank ];
+        double s = r[ fZero[j] ];
+        for( unsigned int c = 0; c != fRank; ++c )
+          s -= f[c] * z[c];
+        for( unsigned int c = 0; c != fRank; ++c )
+          u[c] += h[c] * s;
+      }
+      const double *inv = fZeroInverse.GetMatrixArray();
+      std::vector<double> q( fRank, 0. ), q2( fRank, 0. );
+      for( unsigned int a = 0; a != fRank; ++a )
+        for( unsigned int b = 0; b != fRank; ++b )
+          q[a] += inv[ (size_t)a*fRank + b ] * u[b];
+      for( unsigned int a = 0; a != fRank; ++a )
+        for( unsigned int b = 0; b != fRank; ++b )
+          q2[a] += inv[ (size_t)a*fRank + b ] * q[b];
+
+      //! Then x_P = C_PP^-1 ( r_P - F_P F_Z^T x_Z )
+      std::vector<double> y( fRank, 0. );
+      for( unsigned int j = 0; j != fZero.size(); ++j )
+      {
+        const double *h = &fHZero[ (size_t)j*fRank ];
+        const double *f = &fFZero[ (size_t)j*fRank ];
+        double xz = 0.;
+        for( unsigned int c = 0; c != fRank; ++c )
+          xz += h[c] * q2[c];
+        x[ fZero[j] ] = xz;
+        for( unsigned int c = 0; c != fRank; ++c )
+          y[c] += f[c] * xz;
+      }
+      for( unsigned int c = 0; c != fRank; ++c )
+      {
+        const double *g = &fG[ (size_t)c*nUsed ];
+        for( unsigned int i = 0; i != nUsed; ++i )
+          used[i] -= g[i] / fInvSqrtD[i] * y[c];
+      }
+    }
+
+    //! x = D^-1/2 v
+    std::vector<double> v, z;
+    SolveWoodbury( nUsed ? &used[0] : 0, v, z );
+    for( unsigned int i = 0; i != nUsed; ++i )
+      x[ fUsed[i] ] = v[i] * fInvSqrtD[i];
+  }
+  else if( kCholesky == fMethod )
+  {
+    if( nUsed )
+    {
+      ForwardSubstitute( fL, nUsed, &used[0] );
+      BackSubstitute( fL, nUsed, &used[0] );
+    }
+    for( unsigned int i = 0; i != nUsed; ++i )
+      x[ fUsed[i] ] = used[i];
+  }
+  else if( kSVD == fMethod )
+  {
+    const double *inv = fInverse.GetMatrixArray();
+    for( unsigned int i = 0; i != nUsed; ++i )
+    {
+      const double *row = inv + (size_t)i*nUsed;
+      double s = 0.;
+      for( unsigned int k = 0; k != nUsed; ++k )
+        s += row[k] * used[k];
+      x[ fUsed[i] ] = s;
+    }
+  }
+  else
+    std::cout << "Warning [MUChi2Calculator::Solve] : There is no covariance. Returning zeros." << std::endl;
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef MNV_MUChi2Calculator_H
+#define MNV_MUChi2Calculator_H 1
+
+#include "PlotUtils/MULowRankCovariance.h"
+
+#include "TMatrixD.h"
+
+#include <vector>
+
+class TH1;
+
+namespace PlotUtils
+{
+
+	/*! @brief chi2 = r^T C^-1 r against one covariance matrix C, factored once and reused for every r.
+
+		The covariance is factored when it is set, in the cheapest way that works:
+		  - Woodbury: for C = F F^T + D with D > 0 in some bins and rank(F) < nBins (e.g. the stat errors plus
+		    the universes of all error bands, MUH3D::GetTotalErrorLowRank).  Factoring costs O(nBins * rank^2)
+		    and each chi2 costs O(nBins * rank).
+		  - Cholesky: for dense matrices, or low-rank ones that fail the above.  Factoring costs O(nBins^3 / 3)
+		    and each chi2 costs O(nBins^2).
+		  - SVD: only if the Cholesky decomposition fails, i.e. C is not positive definite.  Like the old
+		    MUPlotter::Chi2DataMC, this copes with singular matrices.
+
+		Bins with no variance at all (e.g. empty bins) carry no information and are left out, with a warning
+		when the covariance is set, as the pseudo-inverse of the SVD would leave them out.  Woodbury still works if
+		D is 0 in a few bins that do have variance from F: those are solved exactly through their Schur complement,
+		which costs O(rank^3 + nZero * rank^2) more, instead of falling back to the dense matrix.
+
+		The Woodbury chi2 is computed as |v|^2 + |z|^2, two sums of squares, rather than as a difference of
+		two large numbers, so it stays accurate (and nonnegative) when the residuals lie mostly along F.
+
+		To scan many models against the same covariance, set it once and call Chi2 for each model.
+		*/
+	class MUChi2Calculator
+	{
+		public:
+			//! How the covariance was factored
+			enum EMethod
+			{
+				kNone     = 0, //!< Nothing was set, or factoring failed
+				kWoodbury = 1, //!< Diagonal plus low rank, through the Woodbury identity
+				kCholesky = 2, //!< Dense Cholesky factor
+				kSVD      = 3  //!< Pseudo-inverse from an SVD
+			};
+
+			//! Default constructor (no covariance)
+			MUChi2Calculator( );
+
+			/*! Use the covariance between some bins of a low-rank covariance
+				@param[in] cov Covariance of all global bins
+				@param[in] bins Global bins the chi2 is taken over; residuals are given in this order
+				@return Could the covariance be factored?
+				*/
+			bool SetCovariance( const MULowRankCovariance& cov, const std::vector<int>& bins );
+
+			//! Use a dense covariance.  Residuals are given for each of its rows.
+			bool SetCovariance( const TMatrixD& cov );
+
+			//! How the covariance was factored
+			EMethod GetMethod() const { return fMethod; };
+
+			//! Is there a covariance to compute chi2 with?
+			bool IsValid() const { return kNone != fMethod; };
+
+			//! Number of residuals
+			unsigned int GetNBins() const { return fNBins; };
+
+			//! Global bins of the residuals, if the covariance came from a MULowRankCovariance
+			const std::vector<int>& GetBins() const { return fBins; };
+
+			//! Number of residuals left out because their bins have no variance
+			unsigned int GetNDroppedBins() const { return fNBins - fUsed.size() - fZero.size(); };
+
+			//! r^T C^-1 r for GetNBins() residuals
+			double Chi2( const double *r ) const;
+
+			//! r^T C^-1 r
+			double Chi2( const std::vector<double>& r ) const;
+
+			/*! r^T C^-1 r with r_i = a_i - bScale * b_i, for the bins given to SetCovariance
+				@param[in] a,b Histograms with the binning of the covariance, e.g. data and MC
+				@param[in] bScale Scale applied to b
+				*/
+			double Chi2( const TH1* a, const TH1* b, const double bScale = 1. ) const;
+
+			//! x = C^-1 r
+			void Solve( const double *r, double *x ) const;
+
+		private:
+			//! Forget the covariance
+			void Clear();
+
+			//! Factor a dense covariance of the fUsed residuals, by Cholesky or else SVD
+			bool FactorDense( const TMatrixD& cov );
+
+			/*! The Woodbury solve over the fUsed bins: z = K^-1 G^T w and v = w - G z with w = D^-1/2 r.
+				Then C^-1 r = D^-1/2 v and r^T C^-1 r = |v|^2 + |z|^2.
+				@param[in] r Residuals of the fUsed bins
+				*/
+			void SolveWoodbury( const double *r, std::vector<double>& v, std::vector<double>& z ) const;
+
+			EMethod fMethod;                  ///< How the covariance was factored
+			unsigned int fNBins;              ///< Number of residuals
+			unsigned int fRank;               ///< Number of columns of G, for Woodbury
+			std::vector<int> fBins;           ///< Global bins of the residuals
+			std::vector<int> fUsed;           ///< Position among the residuals of each factored bin (those with D > 0 for Woodbury)
+			std::vector<int> fZero;           ///< Position among the residuals of bins with D = 0 but variance from F, for Woodbury
+			std::vector<double> fInvSqrtD;    ///< D^-1/2 of the fUsed bins, for Woodbury
+			std::vector<double> fG;           ///< G = D^-1/2 F over the fUsed bins, [column][bin], for Woodbury
+			std::vector<double> fL;           ///< Lower Cholesky factor, of K = I + G^T G (Woodbury) or of C (Cholesky)
+			std::vector<double> fFZero;       ///< F in the fZero bins, [bin][column]
+			std::vector<double> fHZero;       ///< L^-1 F^T in the fZero bins, [bin][column]
+			TMatrixD fZeroInverse;            ///< Pseudo-inverse of the sum of h h^T over the rows h of fHZero
+			TMatrixD fInverse;                ///< Pseudo-inverse of C, for SVD
+	}; //end of MUChi2Calculator
+
+} //end of PlotUtils
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef MNV_MUCovarianceCache_cxx
+#define MNV_MUCovarianceCache_cxx 1
+
+#include "PlotUtils/MUCovarianceCache.h"
+
+#include "TH1.h"
+#include "TArrayD.h"
+
+#include <cstring>
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <mutex>
+#endif
+
+using namespace PlotUtils;
+
+namespace
+{
+#if __cplusplus >= 201103L
+  std::atomic<ULong64_t> gLastStamp( 0 );
+  std::atomic<unsigned long> gHits( 0 );
+  std::atomic<unsigned long> gMisses( 0 );
+  std::atomic<bool> gEnabled( true );
+  std::atomic<int> gMaxRows( 2048 );
+#else
+  ULong64_t gLastStamp = 0;
+  unsigned long gHits = 0;
+  unsigned long gMisses = 0;
+  bool gEnabled = true;
+  int gMaxRows = 2048;
+#endif
+
+  //! Mix the bits of one value into a checksum (FNV-1a on 64-bit words)
+  inline ULong64_t Mix( const ULong64_t sum, const double value )
+  {
+    ULong64_t bits;
+    memcpy( &bits, &value, sizeof(bits) );
+    return ( sum ^ bits ) * 1099511628211ULL;
+  }
+
+  ULong64_t Mix( ULong64_t sum, const double *values, const int n )
+  {
+    for( int i = 0; i < n; ++i )
+      sum = Mix( sum, values[i] );
+    return sum;
+  }
+}
+
+//======================================================================
+// MUCacheVersion
+//======================================================================
+MUCacheVersion::MUCacheVersion( ) :
+  fStamp( Next() ),
+  fChecksum( 0 )
+{ }
+
+MUCacheVersion::MUCacheVersion( const MUCacheVersion& ) :
+  fStamp( Next() ),
+  fChecksum( 0 )
+{ }
+
+ULong64_t MUCacheVersion::GetChecksum( const TH1* h )
+{
+  ULong64_t sum = Mix( 14695981039346656037ULL, h->GetEntries() );
+
+  //! TH1D, TH2D and TH3D keep their contents in their TArrayD base
+  const TArrayD *contents = dynamic_cast<const TArrayD*>( h );
+  if( contents )
+    sum = Mix( sum, contents->fArray, contents->fN );
+  else
+  {
+    for( int bin = 0; bin != h->GetNcells(); ++bin )
+      sum = Mix( sum, h->GetBinContent( bin ) );
+  }
+
+  if( 0 < h->GetSumw2N() )
+    sum = Mix( sum, h->GetSumw2()->fArray, h->GetSumw2N() );
+  return sum;
+}
+
+void MUCacheVersion::Touch()
+{
+  const ULong64_t stamp = Next();
+#if __cplusplus >= 201103L
+  std::lock_guard<std::mutex> lock( fMutex );
+#endif
+  fStamp = stamp;
+}
+
+ULong64_t MUCacheVersion::Get() const
+{
+#if __cplusplus >= 201103L
+  std::lock_guard<std::mutex> lock( fMutex );
+#endif
+  return fStamp;
+}
+
+ULong64_t MUCacheVersion::Get( const TH1* h ) const
+{
+  //! Changes made behind the owner's back still change the contents or errors
+  const ULong64_t checksum = GetChecksum( h );
+
+#if __cplusplus >= 201103L
+  std::lock_guard<std::mutex> lock( fMutex );
+#endif
+  if( checksum != fChecksum )
+  {
+    fChecksum = checksum;
+    fStamp = Next();
+  }
+  return fStamp;
+}
+
+ULong64_t MUCacheVersion::Next()
+{
+  return ++gLastStamp;
+}
+
+//======================================================================
+// MUCovarianceCache
+//======================================================================
+bool MUCovarianceCache::Get( const int variant, const ULong64_t version, TMatrixD& m )
+{
+  const bool enabled = gEnabled;
+
+#if __cplusplus >= 201103L
+  //! Only take a reference to the matrix under the lock, and copy it out after
+  std::shared_ptr<const TMatrixD> found;
+  {
+    std::lock_guard<std::mutex> lock( fMutex );
+    for( std::vector<Entry>::const_iterator i = fEntries.begin(); enabled && i != fEntries.end(); ++i )
+    {
+      if( i->variant == variant && i->version == version )
+      {
+        found = i->matrix;
+        break;
+      }
+    }
+    if( found )
+      ++fStats.hits;
+    else
+      ++fStats.misses;
+  }
+
+  if( !found )
+  {
+    ++gMisses;
+    return false;
+  }
+  ++gHits;
+  m.ResizeTo( *found );
+  m = *found;
+  return true;
+#else
+  for( std::vector<Entry>::const_iterator i = fEntries.begin(); enabled && i != fEntries.end(); ++i )
+  {
+    if( i->variant == variant && i->version == version )
+    {
+      m.ResizeTo( i->matrix );
+      m = i->matrix;
+      ++fStats.hits;
+      ++gHits;
+      return true;
+    }
+  }
+  ++fStats.misses;
+  ++gMisses;
+  return false;
+#endif
+}
+
+void MUCovarianceCache::Put( const int variant, const ULong64_t version, const TMatrixD& m )
+{
+  if( !gEnabled || gMaxRows < m.GetNrows() )
+    return;
+
+#if __cplusplus >= 201103L
+  //! Copy before taking the lock, and let the matrix this replaces go after releasing it
+  std::shared_ptr<const TMatrixD> matrix( new TMatrixD( m ) );
+  {
+    std::lock_guard<std::mutex> lock( fMutex );
+    std::vector<Entry>::iterator i = fEntries.begin();
+    while( i != fEntries.end() && i->variant != variant )
+      ++i;
+    if( i == fEntries.end() )
+    {
+      fEntries.push_back( Entry() );
+      i = fEntries.end() - 1;
+      i->variant = variant;
+    }
+    i->version = version;
+    i->matrix.swap( matrix );
+  }
+#else
+  for( std::vector<Entry>::iterator i = fEntries.begin(); i != fEntries.end(); ++i )
+  {
+    if( i->variant == variant )
+    {
+      i->version = version;
+      i->matrix.ResizeTo( m );
+      i->matrix = m;
+      return;
+    }
+  }
+
+  fEntries.push_back( Entry() );
+  fEntries.back().variant = variant;
+  fEntries.back().version = version;
+  fEntries.back().matrix.ResizeTo( m );
+  fEntries.back().matrix = m;
+#endif
+}
+
+MUCovarianceCache::Stats MUCovarianceCache::GetStats() const
+{
+#if __cplusplus >= 201103L
+  std::lock_guard<std::mutex> lock( fMutex );
+#endif
+  return fStats;
+}
+
+void MUCovarianceCache::Clear()
+{
+  std::vector<Entry> old;
+  {
+#if __cplusplus >= 201103L
+    std::lock_guard<std::mutex> lock( fMutex );
+#endif
+    fEntries.swap( old );
+  }
+}
+
+MUCovarianceCache::Stats MUCovarianceCache::GetGlobalStats()
+{
+  Stats s;
+  s.hits = gHits;
+  s.misses = gMisses;
+  return s;
+}
+
+void MUCovarianceCache::ResetGlobalStats()
+{
+  gHits = 0;
+  gMisses = 0;
+}
+
+void MUCovarianceCache::SetEnabled( const bool enabled )
+{
+  gEnabled = enabled;
+}
+
+bool MUCovarianceCache::IsEnabled()
+{
+  return gEnabled;
+}
+
+void MUCovarianceCache::SetMaxRows( const int nRows )
+{
+  gMaxRows = nRows;
+}
+
+int MUCovarianceCache::GetMaxRows()
+{
+  return gMaxRows;
+}
+
+#endif
@@ -0,0 +1,144 @@
+#ifndef MNV_MUCovarianceCache_H
+#define MNV_MUCovarianceCache_H 1
+
+#include "Rtypes.h"
+#include "TMatrixD.h"
+
+#include <vector>
+#if __cplusplus >= 201103L
+#include <memory>
+#include <mutex>
+#endif
+
+class TH1;
+
+namespace PlotUtils
+{
+
+	/*! @brief Modification stamp of a histogram, for checking that cached results are still valid.
+
+		Stamps come from one global counter, so every change gets a stamp larger than any stamp
+		handed out before it.  A result that depends on several histograms is therefore still valid
+		as long as the largest of their stamps has not changed.
+
+		The owner calls Touch() whenever it changes.  Get( h ) also notices changes made to the
+		histogram through plain TH1 calls (TH1::Fill, SetBinContent, AddBinContent, Add, writes through
+		GetArray(), ...): it keeps a checksum of the entries, the bin contents and the squared errors, and
+		takes a new stamp when that changes.  The checksum is one pass over the bins, which is little next to
+		the covariance matrices it guards.
+		*/
+	class MUCacheVersion
+	{
+		public:
+			//! A new stamp
+			MUCacheVersion( );
+
+			//! A copy is a different histogram, so it gets a new stamp
+			MUCacheVersion( const MUCacheVersion& );
+
+			//! Assigning changes the histogram
+			MUCacheVersion& operator=( const MUCacheVersion& ) { Touch(); return *this; };
+
+			//! Mark the histogram as changed
+			void Touch();
+
+			//! Stamp of the last change seen
+			ULong64_t Get() const;
+
+			//! Current stamp of h, the histogram this belongs to
+			ULong64_t Get( const TH1* h ) const;
+
+			//! A stamp larger than all stamps handed out so far
+			static ULong64_t Next();
+
+			//! Checksum of the entries, bin contents and squared errors of h
+			static ULong64_t GetChecksum( const TH1* h );
+
+		private:
+			mutable ULong64_t fStamp;     ///< Stamp of the last change
+			mutable ULong64_t fChecksum;  ///< GetChecksum of the histogram when fStamp was taken
+#if __cplusplus >= 201103L
+			mutable std::mutex fMutex;    ///< Guards fStamp and fChecksum
+#endif
+	}; //end of MUCacheVersion
+
+	/*! @brief Covariance matrices cached by variant (e.g. shape-only or fractional) and version.
+
+		A lookup only hits if the matrix was stored at the same version.  Copies start out empty.
+		Matrices with more rows than GetMaxRows() are not kept, since a 3D histogram's matrix can be
+		hundreds of MB.
+
+		Get, Put, GetStats and all MUCacheVersion calls may be made from several threads at once (with C++11),
+		so const queries such as CalcCovMx can run concurrently on one band.  Each cache has its own lock,
+		held only to find or swap an entry: the matrices are shared and copied in or out after it is released.
+		*/
+	class MUCovarianceCache
+	{
+		public:
+			//! Number of lookups that found a valid matrix, and that did not
+			struct Stats
+			{
+				Stats( ) : hits(0), misses(0) {};
+				unsigned long hits;   ///< Lookups answered from the cache
+				unsigned long misses; ///< Lookups that had to compute
+			};
+
+			MUCovarianceCache( ) {};
+			MUCovarianceCache( const MUCovarianceCache& ) {};
+			MUCovarianceCache& operator=( const MUCovarianceCache& ) { Clear(); return *this; };
+
+			/*! Copy the matrix of this variant into m, if it was stored at this version
+				@return Was there one?  Counts as a hit or a miss.
+				*/
+			bool Get( const int variant, const ULong64_t version, TMatrixD& m );
+
+			//! Remember m as the matrix of this variant at this version
+			void Put( const int variant, const ULong64_t version, const TMatrixD& m );
+
+			//! Forget all matrices, keeping the statistics
+			void Clear();
+
+			//! Hits and misses of this cache, copied under its lock
+			Stats GetStats() const;
+
+			//! Hits and misses of all caches
+			static Stats GetGlobalStats();
+
+			//! Zero the hits and misses of all caches
+			static void ResetGlobalStats();
+
+			//! Turn caching on or off everywhere (on by default)
+			static void SetEnabled( const bool enabled );
+
+			//! Is caching on?
+			static bool IsEnabled();
+
+			//! Do not cache matrices with more rows than this (default 2048, 32 MB)
+			static void SetMaxRows( const int nRows );
+
+			//! Largest number of rows of a cached matrix
+			static int GetMaxRows();
+
+		private:
+			//! One cached matrix
+			struct Entry
+			{
+				int variant;       ///< Which variant of the matrix this is
+				ULong64_t version; ///< Version of the inputs when it was computed
+#if __cplusplus >= 201103L
+				std::shared_ptr<const TMatrixD> matrix; ///< The matrix, kept alive by a lookup copying it out
+#else
+				TMatrixD matrix;   ///< The matrix
+#endif
+			};
+
+			std::vector<Entry> fEntries; ///< Cached matrices, one per variant
+			Stats fStats;                ///< Hits and misses
+#if __cplusplus >= 201103L
+			mutable std::mutex fMutex;   ///< Guards fEntries and fStats
+#endif
+	}; //end of MUCovarianceCache
+
+} //end of PlotUtils
+
+#endif
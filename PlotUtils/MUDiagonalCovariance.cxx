@@ -0,0 +1,81 @@
+#ifndef MNV_MUDiagonalCovariance_cxx
+#define MNV_MUDiagonalCovariance_cxx 1
+
+#include "PlotUtils/MUDiagonalCovariance.h"
+#include "PlotUtils/MULowRankCovariance.h"
+
+#include "TH1.h"
+
+#include <iostream>
+
+using namespace PlotUtils;
+
+void MUDiagonalCovariance::AddErrors( const TH1* h, const double scale /* = 1. */ )
+{
+  for( unsigned int i = 0; i != fVar.size() && (int)i < h->GetNcells(); ++i )
+  {
+    const double err = scale * h->GetBinError( i );
+    fVar[i] += err * err;
+  }
+}
+
+void MUDiagonalCovariance::Add( const MUDiagonalCovariance& other )
+{
+  if( other.fVar.size() != fVar.size() )
+  {
+    std::cout << "Warning [MUDiagonalCovariance::Add] : Cannot add a covariance of " << other.fVar.size() << " bins to one of " << fVar.size() << " bins. Doing nothing." << std::endl;
+    return;
+  }
+  for( unsigned int i = 0; i != fVar.size(); ++i )
+    fVar[i] += other.fVar[i];
+}
+
+void MUDiagonalCovariance::ScaleBins( const std::vector<double>& factors )
+{
+  for( unsigned int i = 0; i != fVar.size(); ++i )
+    fVar[i] *= factors[i] * factors[i];
+}
+
+void MUDiagonalCovariance::MakeFractional( const TH1* cv )
+{
+  for( unsigned int i = 0; i != fVar.size(); ++i )
+  {
+    const double binCon = cv->GetBinContent( i );
+    fVar[i] = ( binCon != 0. ) ? fVar[i] / ( binCon * binCon ) : 0.;
+  }
+}
+
+void MUDiagonalCovariance::AddTo( TMatrixD& m ) const
+{
+  if( m.GetNrows() != (int)fVar.size() || m.GetNcols() != (int)fVar.size() )
+  {
+    std::cout << "Warning [MUDiagonalCovariance::AddTo] : The matrix is " << m.GetNrows() << "x" << m.GetNcols() << ", not " << fVar.size() << "x" << fVar.size() << ". Doing nothing." << std::endl;
+    return;
+  }
+
+  //! Straight into the matrix array, one element per row
+  double *a = m.GetMatrixArray();
+  const unsigned int n = fVar.size();
+  for( unsigned int i = 0; i != n; ++i )
+    a[ (size_t)i*n + i ] += fVar[i];
+}
+
+void MUDiagonalCovariance::AddTo( MULowRankCovariance& cov ) const
+{
+  if( cov.GetNBins() != fVar.size() )
+  {
+    std::cout << "Warning [MUDiagonalCovariance::AddTo] : The covariance has " << cov.GetNBins() << " bins, not " << fVar.size() << ". Doing nothing." << std::endl;
+    return;
+  }
+  if( !fVar.empty() )
+    cov.AddDiagonal( &fVar[0] );
+}
+
+TMatrixD MUDiagonalCovariance::GetMatrix() const
+{
+  TMatrixD m( fVar.size(), fVar.size() );
+  AddTo( m );
+  return m;
+}
+
+#endif
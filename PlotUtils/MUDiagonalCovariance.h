@@ -0,0 +1,70 @@
+#ifndef MNV_MUDiagonalCovariance_H
+#define MNV_MUDiagonalCovariance_H 1
+
+#include "Rtypes.h"
+#include "TMatrixD.h"
+
+#include <vector>
+
+class TH1;
+
+namespace PlotUtils
+{
+
+	class MULowRankCovariance;
+
+	/*! @brief A covariance matrix with no correlations between bins, kept as its diagonal.
+
+		Statistical and uncorrelated errors only have a variance per bin.  Keeping just those nBins
+		numbers avoids allocating, multiplying and adding nBins x nBins matrices that are zero off
+		the diagonal.  AddTo adds them into a dense or low-rank total in O(nBins).
+		*/
+	class MUDiagonalCovariance
+	{
+		public:
+			//! Default constructor (no bins)
+			MUDiagonalCovariance( ) {};
+
+			//! Zero covariance of nBins global bins
+			explicit MUDiagonalCovariance( const unsigned int nBins ) : fVar( nBins, 0. ) {};
+
+			//! Number of global bins, including under/overflow
+			unsigned int GetNBins() const { return fVar.size(); };
+
+			//! Variance of each bin
+			const std::vector<double>& GetVariances() const { return fVar; };
+
+			//! Variance of one bin
+			double GetVariance( const unsigned int i ) const { return fVar[i]; };
+
+			//! Set the variance of one bin
+			void SetVariance( const unsigned int i, const double var ) { fVar[i] = var; };
+
+			//! Add the squared bin errors of a histogram with nBins global bins, each error times scale
+			void AddErrors( const TH1* h, const double scale = 1. );
+
+			//! Add another diagonal covariance of the same bins
+			void Add( const MUDiagonalCovariance& other );
+
+			//! Var_i -> f_i^2 Var_i, i.e. the errors are scaled by f_i
+			void ScaleBins( const std::vector<double>& factors );
+
+			//! Divide by the CV like asFrac does: Var_i -> Var_i / cv_i^2, and 0 where the CV is 0
+			void MakeFractional( const TH1* cv );
+
+			//! Add to the diagonal of a dense nBins x nBins matrix
+			void AddTo( TMatrixD& m ) const;
+
+			//! Add to the diagonal term of a low-rank covariance of the same bins
+			void AddTo( MULowRankCovariance& cov ) const;
+
+			//! The dense nBins x nBins matrix
+			TMatrixD GetMatrix() const;
+
+		private:
+			std::vector<double> fVar; ///< Variance of each global bin
+	}; //end of MUDiagonalCovariance
+
+} //end of PlotUtils
+
+#endif
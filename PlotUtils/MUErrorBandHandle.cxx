@@ -0,0 +1,210 @@
+#ifndef MNV_MUErrorBandHandle_cxx
+#define MNV_MUErrorBandHandle_cxx 1
+
+#include "PlotUtils/MUErrorBandHandle.h"
+#include "PlotUtils/MUTaskPool.h"
+
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <functional>
+#include <mutex>
+#else
+#include <deque>
+#endif
+
+using namespace PlotUtils;
+
+namespace
+{
+#if __cplusplus >= 201103L
+  //! One interned name, which never moves or changes once it is in the table
+  struct NameEntry
+  {
+    std::string name;                   ///< The name
+    unsigned int id;                    ///< Its ID
+    std::atomic<const NameEntry*> next; ///< Next entry in the same hash bucket
+  };
+
+  /*! Append-only name table.  Entries live in chunks that double in size, so adding a name never copies the
+      names before it, and each entry is linked into a hash bucket for lookups by name.  Add fills an entry in
+      completely before publishing it through its bucket and the size, so lookups read the table without a lock.
+      Entries are never removed.
+      */
+  class NameTable
+  {
+    public:
+      NameTable() : fSize( 0 )
+      {
+        for( unsigned int c = 0; c != kNChunks; ++c )
+          fChunks[c].store( nullptr, std::memory_order_relaxed );
+        for( unsigned int b = 0; b != kNBuckets; ++b )
+          fBuckets[b].store( nullptr, std::memory_order_relaxed );
+      }
+
+      //! ID of a name, or kInvalidID if it is not in the table
+      unsigned int Find( const std::string& name ) const
+      {
+        for( const NameEntry* e = fBuckets[ Bucket( name ) ].load( std::memory_order_acquire ); e; e = e->next.load( std::memory_order_acquire ) )
+        {
+          if( e->name == name )
+            return e->id;
+        }
+        return MUErrorBandHandle::kInvalidID;
+      }
+
+      //! Add a name that is not in the table and return its ID.  Only one thread may add at a time.
+      unsigned int Add( const std::string& name )
+      {
+        const unsigned int id = fSize.load( std::memory_order_relaxed );
+        unsigned int offset;
+        const unsigned int chunk = Locate( id, offset );
+        NameEntry* entries = fChunks[chunk].load( std::memory_order_relaxed );
+        if( !entries )
+        {
+          entries = new NameEntry[ kFirstChunk << chunk ];
+          fChunks[chunk].store( entries, std::memory_order_release );
+        }
+
+        NameEntry& entry = entries[offset];
+        entry.name = name;
+        entry.id = id;
+        std::atomic<const NameEntry*>& head = fBuckets[ Bucket( name ) ];
+        entry.next.store( head.load( std::memory_order_relaxed ), std::memory_order_relaxed );
+        head.store( &entry, std::memory_order_release );
+        fSize.store( id + 1, std::memory_order_release );
+        return id;
+      }
+
+      //! Name of an ID that Add handed out
+      const std::string& GetName( const unsigned int id ) const
+      {
+        unsigned int offset;
+        const unsigned int chunk = Locate( id, offset );
+        return fChunks[chunk].load( std::memory_order_acquire )[offset].name;
+      }
+
+    private:
+      static const unsigned int kFirstChunk = 64;   ///< Size of the first chunk; chunk c holds kFirstChunk << c names
+      static const unsigned int kNChunks    = 26;   ///< Enough chunks for every ID an unsigned int can hold
+      static const unsigned int kNBuckets   = 1024; ///< Hash buckets for lookups by name
+
+      //! Chunk of an ID, and its index in that chunk
+      static unsigned int Locate( const unsigned int id, unsigned int& offset )
+      {
+        unsigned int chunk = 0;
+        offset = id;
+        while( offset >= ( kFirstChunk << chunk ) )
+        {
+          offset -= kFirstChunk << chunk;
+          ++chunk;
+        }
+        return chunk;
+      }
+
+      static unsigned int Bucket( const std::string& name ) { return std::hash<std::string>()( name ) % kNBuckets; }
+
+      std::atomic<unsigned int> fSize;                   ///< Number of names, the next ID to hand out
+      std::atomic<NameEntry*> fChunks[kNChunks];         ///< Entries by ID, NULL for chunks not needed yet
+      std::atomic<const NameEntry*> fBuckets[kNBuckets]; ///< First entry of each hash bucket
+  };
+
+  NameTable& GetNameTable()
+  {
+    static NameTable table;
+    return table;
+  }
+
+  //! Taken only to add a name
+  std::mutex& GetInternMutex()
+  {
+    static std::mutex m;
+    return m;
+  }
+#else
+  typedef std::map<std::string, unsigned int> NameTable;
+
+  //! name -> ID
+  NameTable& GetNameTable()
+  {
+    static NameTable table;
+    return table;
+  }
+
+  //! ID -> name.  A deque never moves its elements, so names stay put as the table grows.
+  std::deque<std::string>& GetNames()
+  {
+    static std::deque<std::string> names;
+    return names;
+  }
+#endif
+}
+
+const unsigned int MUErrorBandHandle::kInvalidID;
+
+#if __cplusplus >= 201103L
+MUErrorBandHandle MUErrorBandHandle::Intern( const std::string& name )
+{
+  NameTable& table = GetNameTable();
+  const unsigned int found = table.Find( name );
+  if( found != kInvalidID )
+    return MUErrorBandHandle( found );
+
+  //! Miss: add the name.  Another thread may have added it while this one waited.
+  std::lock_guard<std::mutex> lock( GetInternMutex() );
+  const unsigned int again = table.Find( name );
+  if( again != kInvalidID )
+    return MUErrorBandHandle( again );
+
+  return MUErrorBandHandle( table.Add( name ) );
+}
+
+MUErrorBandHandle MUErrorBandHandle::Find( const std::string& name )
+{
+  const unsigned int id = GetNameTable().Find( name );
+  return ( id == kInvalidID ) ? MUErrorBandHandle() : MUErrorBandHandle( id );
+}
+
+std::string MUErrorBandHandle::GetName() const
+{
+  if( !IsValid() )
+    return std::string();
+
+  return GetNameTable().GetName( fID );
+}
+#else
+MUErrorBandHandle MUErrorBandHandle::Intern( const std::string& name )
+{
+  MUQueryLock lock;
+  NameTable& table = GetNameTable();
+  NameTable::const_iterator i = table.find( name );
+  if( i != table.end() )
+    return MUErrorBandHandle( i->second );
+
+  const unsigned int id = GetNames().size();
+  GetNames().push_back( name );
+  table[name] = id;
+  return MUErrorBandHandle( id );
+}
+
+MUErrorBandHandle MUErrorBandHandle::Find( const std::string& name )
+{
+  MUQueryLock lock;
+  const NameTable& table = GetNameTable();
+  NameTable::const_iterator i = table.find( name );
+  if( i == table.end() )
+    return MUErrorBandHandle();
+
+  return MUErrorBandHandle( i->second );
+}
+
+std::string MUErrorBandHandle::GetName() const
+{
+  if( !IsValid() )
+    return std::string();
+
+  MUQueryLock lock;
+  return GetNames()[fID];
+}
+#endif
+
+#endif
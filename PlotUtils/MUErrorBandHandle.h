@@ -0,0 +1,135 @@
+#ifndef MNV_MUErrorBandHandle_H
+#define MNV_MUErrorBandHandle_H 1
+
+#include "PlotUtils/MUTaskPool.h"
+
+#include <map>
+#include <string>
+#include <vector>
+#if __cplusplus >= 201103L
+#include <atomic>
+#endif
+
+namespace PlotUtils
+{
+
+	/*! @brief A pre-resolved error band name.
+
+		Band names are interned once into a process-wide table and a handle only keeps the index
+		into that table.  Looking a band up by handle is a vector access instead of a string map search.
+		A handle is not tied to one histogram: the handle for "Flux" fills the "Flux" band of every
+		MUH1D, MUH2D and MUH3D that has one.
+
+		Resolve handles before the event loop.  Names are only ever appended to the table, so looking them up
+		takes no lock; only interning a new name takes one.  Without C++11 both take MUQueryLock.
+		*/
+	class MUErrorBandHandle
+	{
+		public:
+			//! Default constructor (invalid handle)
+			MUErrorBandHandle( ) : fID( kInvalidID ) {};
+
+			//! Get the handle for a name, adding the name to the table if it is new
+			static MUErrorBandHandle Intern( const std::string& name );
+
+			//! Get the handle for a name already in the table, or an invalid handle
+			static MUErrorBandHandle Find( const std::string& name );
+
+			//! Does this handle refer to a name?
+			bool IsValid() const { return fID != kInvalidID; };
+
+			//! Index of the name in the table
+			unsigned int GetID() const { return fID; };
+
+			//! The name this handle refers to (empty if invalid)
+			std::string GetName() const;
+
+			bool operator==( const MUErrorBandHandle& other ) const { return fID == other.fID; };
+			bool operator!=( const MUErrorBandHandle& other ) const { return fID != other.fID; };
+
+			static const unsigned int kInvalidID = 0xFFFFFFFF; ///< ID of an invalid handle
+
+		private:
+			explicit MUErrorBandHandle( const unsigned int id ) : fID( id ) {};
+
+			unsigned int fID; ///< Index of the name in the table
+	}; //end of MUErrorBandHandle
+
+	/*! @brief Flat lookup from interned band name to the error band a histogram owns.
+
+		The histogram's name->band map stays the owner and what gets written to file.  This is a
+		transient cache over it, rebuilt on the first lookup after Invalidate().  Copies start out
+		empty, so a copied histogram never sees the bands of the original.
+
+		Lookups may run on many threads at once; the first one after Invalidate() rebuilds under
+		MUQueryLock while the others wait.  Invalidate() itself goes with a change to the map, so not
+		while other threads look bands up.
+		*/
+	template<class BAND>
+	class MUErrorBandIndex
+	{
+		public:
+			MUErrorBandIndex( ) : fCurrent( false ) {};
+			MUErrorBandIndex( const MUErrorBandIndex& ) : fCurrent( false ) {};
+			MUErrorBandIndex& operator=( const MUErrorBandIndex& ) { Invalidate(); return *this; };
+
+			//! The band map changed, rebuild before the next lookup
+			void Invalidate() { fCurrent = false; fBands.clear(); };
+
+			//! Band for this handle in the map, or NULL if the map has no such band
+			BAND* Find( const MUErrorBandHandle& band, const std::map<std::string, BAND*>& bands ) const
+			{
+				if( !IsCurrent() )
+					Rebuild( bands );
+				return ( band.GetID() < fBands.size() ) ? fBands[ band.GetID() ] : 0;
+			};
+
+			//! Band with this name in the map, or NULL if the map has no such band
+			BAND* Find( const std::string& name, const std::map<std::string, BAND*>& bands ) const
+			{
+				//! Every name in the map is interned by the rebuild, so do that before looking the name up
+				if( !IsCurrent() )
+					Rebuild( bands );
+				return Find( MUErrorBandHandle::Find( name ), bands );
+			};
+
+		private:
+#if __cplusplus >= 201103L
+			bool IsCurrent() const { return fCurrent.load( std::memory_order_acquire ); };
+#else
+			bool IsCurrent() const { return fCurrent; };
+#endif
+
+			void Rebuild( const std::map<std::string, BAND*>& bands ) const
+			{
+				MUQueryLock lock;
+				//! Another thread may have rebuilt while this one waited
+				if( IsCurrent() )
+					return;
+
+				fBands.clear();
+				for( typename std::map<std::string, BAND*>::const_iterator i = bands.begin(); i != bands.end(); ++i )
+				{
+					const unsigned int id = MUErrorBandHandle::Intern( i->first ).GetID();
+					if( fBands.size() <= id )
+						fBands.resize( id + 1, 0 );
+					fBands[id] = i->second;
+				}
+#if __cplusplus >= 201103L
+				fCurrent.store( true, std::memory_order_release );
+#else
+				fCurrent = true;
+#endif
+			};
+
+			mutable std::vector<BAND*> fBands; ///< Bands by interned name ID, NULL where there is none
+#if __cplusplus >= 201103L
+			mutable std::atomic<bool> fCurrent; ///< Does fBands reflect the band map?
+#else
+			mutable bool fCurrent;             ///< Does fBands reflect the band map?
+#endif
+	}; //end of MUErrorBandIndex
+
+} //end of PlotUtils
+
+#endif
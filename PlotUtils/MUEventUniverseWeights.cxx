@@ -0,0 +1,64 @@
+#ifndef MNV_MUEventUniverseWeights_cxx
+#define MNV_MUEventUniverseWeights_cxx 1
+
+#include "PlotUtils/MUEventUniverseWeights.h"
+
+using namespace PlotUtils;
+
+MUEventUniverseWeights::MUEventUniverseWeights( )
+{ }
+
+void MUEventUniverseWeights::Clear()
+{
+  fValues.clear();
+  fVert.clear();
+  fLat.clear();
+  fUncorr.clear();
+}
+
+void MUEventUniverseWeights::AddVertWeights( const MUErrorBandHandle& band, const double *weights, const unsigned int nUniverses, const double cvWeightFromMe /* = 1. */ )
+{
+  VertEntry entry;
+  entry.band = band;
+  entry.offset = fValues.size();
+  entry.nUniverses = nUniverses;
+  entry.cvWeightFromMe = cvWeightFromMe;
+  fValues.insert( fValues.end(), weights, weights + nUniverses );
+  fVert.push_back( entry );
+}
+
+void MUEventUniverseWeights::AddVertWeights( const MUErrorBandHandle& band, const std::vector<double>& weights, const double cvWeightFromMe /* = 1. */ )
+{
+  AddVertWeights( band, weights.empty() ? 0 : &weights[0], weights.size(), cvWeightFromMe );
+}
+
+void MUEventUniverseWeights::AddLatShifts( const MUErrorBandHandle& band, const double *shifts, const unsigned int nUniverses, const double *weights /* = 0 */ )
+{
+  LatEntry entry;
+  entry.band = band;
+  entry.offset = fValues.size();
+  entry.nUniverses = nUniverses;
+  entry.weightsOffset = -1;
+  fValues.insert( fValues.end(), shifts, shifts + nUniverses );
+  if( weights )
+  {
+    entry.weightsOffset = fValues.size();
+    fValues.insert( fValues.end(), weights, weights + nUniverses );
+  }
+  fLat.push_back( entry );
+}
+
+void MUEventUniverseWeights::AddLatShifts( const MUErrorBandHandle& band, const std::vector<double>& shifts )
+{
+  AddLatShifts( band, shifts.empty() ? 0 : &shifts[0], shifts.size() );
+}
+
+void MUEventUniverseWeights::AddUncorrError( const MUErrorBandHandle& band, const double err )
+{
+  UncorrEntry entry;
+  entry.band = band;
+  entry.err = err;
+  fUncorr.push_back( entry );
+}
+
+#endif
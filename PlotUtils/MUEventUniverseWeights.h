@@ -0,0 +1,89 @@
+#ifndef MNV_MUEventUniverseWeights_H
+#define MNV_MUEventUniverseWeights_H 1
+
+#include "PlotUtils/MUErrorBandHandle.h"
+
+#include <vector>
+
+namespace PlotUtils
+{
+
+	/*! @brief Everything the error bands of a histogram need to know about one event.
+
+		Holds the universe weights of each vertical error band, the universe shifts (and optional
+		weights) of each lateral error band and the error of each uncorrelated error, keyed by band handle.
+		All weights and shifts share one buffer, so refilling the same object for every event does not allocate.
+
+		Pass it to MUH1D::FillAll to fill the CV and every band with a single bin search.
+		*/
+	class MUEventUniverseWeights
+	{
+		public:
+			//! Weights of one vertical error band
+			struct VertEntry
+			{
+				MUErrorBandHandle band;  ///< Band to fill
+				unsigned int offset;     ///< Position of the first weight in the shared buffer
+				unsigned int nUniverses; ///< Number of weights
+				double cvWeightFromMe;   ///< Part of the CV weight that came from this error source
+			};
+
+			//! Shifts of one lateral error band
+			struct LatEntry
+			{
+				MUErrorBandHandle band;  ///< Band to fill
+				unsigned int offset;     ///< Position of the first shift in the shared buffer
+				unsigned int nUniverses; ///< Number of shifts
+				int weightsOffset;       ///< Position of the first extra weight in the shared buffer, or -1 for none
+			};
+
+			//! Error of one uncorrelated error
+			struct UncorrEntry
+			{
+				MUErrorBandHandle band;  ///< Uncorrelated error to fill
+				double err;              ///< Error of this event
+			};
+
+			//! Default constructor
+			MUEventUniverseWeights( );
+
+			//! Forget all bands, keeping the memory for the next event
+			void Clear();
+
+			//! Set the weights of a vertical error band for this event
+			void AddVertWeights( const MUErrorBandHandle& band, const double *weights, const unsigned int nUniverses, const double cvWeightFromMe = 1. );
+
+			//! Set the weights of a vertical error band for this event from a vector
+			void AddVertWeights( const MUErrorBandHandle& band, const std::vector<double>& weights, const double cvWeightFromMe = 1. );
+
+			//! Set the shifts (and optionally extra weights) of a lateral error band for this event
+			void AddLatShifts( const MUErrorBandHandle& band, const double *shifts, const unsigned int nUniverses, const double *weights = 0 );
+
+			//! Set the shifts of a lateral error band for this event from a vector
+			void AddLatShifts( const MUErrorBandHandle& band, const std::vector<double>& shifts );
+
+			//! Set the error of an uncorrelated error for this event
+			void AddUncorrError( const MUErrorBandHandle& band, const double err );
+
+			//! The vertical error bands set for this event
+			const std::vector<VertEntry>& GetVertEntries() const { return fVert; };
+
+			//! The lateral error bands set for this event
+			const std::vector<LatEntry>& GetLatEntries() const { return fLat; };
+
+			//! The uncorrelated errors set for this event
+			const std::vector<UncorrEntry>& GetUncorrEntries() const { return fUncorr; };
+
+			//! Pointer into the shared weights/shifts buffer
+			const double* GetValues( const unsigned int offset ) const { return &fValues[offset]; };
+
+		private:
+			std::vector<double> fValues;       ///< Weights and shifts of all bands
+			std::vector<VertEntry> fVert;      ///< Vertical error bands
+			std::vector<LatEntry> fLat;        ///< Lateral error bands
+			std::vector<UncorrEntry> fUncorr;  ///< Uncorrelated errors
+	}; //end of MUEventUniverseWeights
+
+} //end of PlotUtils
+
+#endif
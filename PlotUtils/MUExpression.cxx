@@ -0,0 +1,606 @@
+#ifndef MNV_MUExpression_cxx
+#define MNV_MUExpression_cxx 1
+
+#include "PlotUtils/MUExpression.h"
+#include "PlotUtils/MUH1D.h"
+#include "PlotUtils/MUH2D.h"
+#include "PlotUtils/MUUniverseStore.h"
+
+#include "TArrayD.h"
+#include "TDirectory.h"
+#include "TString.h"
+
+#include <algorithm>
+#include <math.h>
+#include <iostream>
+
+using namespace PlotUtils;
+
+namespace
+{
+  //! What differs between evaluating into a MUH1D and into a MUH2D
+  struct Traits1D
+  {
+    typedef MUH1D MUH;
+    typedef TH1D Hist;
+    typedef MUVertErrorBand Vert;
+    typedef MULatErrorBand Lat;
+    static const int kDim = 1;
+
+    //! MUH1D::Add puts the central value of the addend into the universes of bands it lacks
+    static const bool kAddFillsMissingBands = true;
+
+    static const char* Where() { return "MUExpression::Eval1D"; }
+    static const char* HistName() { return "TH1D"; }
+    static const char* MUHName() { return "MUH1D"; }
+
+    static MUH* MakeResult( const Hist& cv, const MUH *like )
+    {
+      return like ? new MUH1D( cv, like->GetNormBinWidth() ) : new MUH1D( cv );
+    }
+
+    static std::vector<std::string> GetUncorrNames( const MUH *h ) { return h->GetUncorrErrorNames(); }
+
+    static const TH1* GetUncorr( const MUH *h, const std::string& name ) { return h->HasUncorrError( name ) ? h->GetUncorrError( name ) : 0; }
+
+    static void PushUncorr( MUH *h, const std::string& name, const Hist& err )
+    {
+      Hist *uncorr = new Hist( err );
+      uncorr->SetName( ( std::string( h->GetName() ) + "_" + name ).c_str() );
+      h->PushUncorrError( name, uncorr );
+    }
+
+    static bool HasCustomMatrices( const MUH *h ) { return h->GetNSysErrorMatrices() || h->GetNRemovedSysErrorMatrices(); }
+  };
+
+  struct Traits2D
+  {
+    typedef MUH2D MUH;
+    typedef TH2D Hist;
+    typedef MUVertErrorBand2D Vert;
+    typedef MULatErrorBand2D Lat;
+    static const int kDim = 2;
+
+    //! MUH2D::Add fails if the addend lacks a band
+    static const bool kAddFillsMissingBands = false;
+
+    static const char* Where() { return "MUExpression::Eval2D"; }
+    static const char* HistName() { return "TH2D"; }
+    static const char* MUHName() { return "MUH2D"; }
+
+    static MUH* MakeResult( const Hist& cv, const MUH *like )
+    {
+      return like ? new MUH2D( cv, like->GetNormBinWidthX(), like->GetNormBinWidthY() ) : new MUH2D( cv );
+    }
+
+    //! MUH2D has no uncorrelated errors
+    static std::vector<std::string> GetUncorrNames( const MUH* ) { return std::vector<std::string>(); }
+
+    static const TH1* GetUncorr( const MUH*, const std::string& ) { return 0; }
+
+    static void PushUncorr( MUH*, const std::string&, const Hist& ) { }
+
+    static bool HasCustomMatrices( const MUH *h ) { return !h->GetSysErrorMatricesNames().empty(); }
+  };
+
+  //! Content of a global bin, and its squared error the way the MUUniverseStore kernels take it (|content| without Sumw2)
+  void GetBinValue( const TH1 *h, const int bin, double& content, double& error2 )
+  {
+    content = h->GetBinContent( bin );
+    const TArrayD *sumw2 = h->GetSumw2();
+    error2 = sumw2->fN ? sumw2->fArray[bin] : fabs( content );
+  }
+
+  //! Evaluates the nodes of an MUExpression into a new MUH1D or MUH2D
+  template<class T>
+  class Evaluator
+  {
+    public:
+      typedef typename T::MUH MUH;
+      typedef typename T::Hist Hist;
+      typedef MUExpression::Node Node;
+
+      //! Which histogram of each MUH a pass computes
+      enum EChannel { kCV, kVert, kLat, kUncorr };
+
+      Evaluator( const std::vector<Node>& nodes ) :
+        fNodes( nodes ),
+        fMUH( nodes.size(), (const MUH*)0 ),
+        fIsMUH( nodes.size(), 0 )
+      { }
+
+      ~Evaluator()
+      {
+        Delete( fOwnedCV );
+      }
+
+      MUH* Eval( const char* name )
+      {
+        if( !Check() )
+          return 0;
+
+        //! With no step between histograms there is nothing to fuse, so do exactly what the methods do
+        bool binary = false;
+        for( unsigned int i = 0; i != fNodes.size(); ++i )
+          binary |= ( MUExpression::kAdd == fNodes[i].fOp || MUExpression::kMultiply == fNodes[i].fOp || MUExpression::kDivide == fNodes[i].fOp );
+        if( !binary )
+          return EvalScales( name );
+
+        //! The result has the bands of the leftmost histogram, the one the step-by-step version copies
+        unsigned int spine = fNodes.size() - 1;
+        while( MUExpression::kLeaf != fNodes[spine].fOp )
+          spine = fNodes[spine].fA;
+        const MUH *like = fMUH[spine];
+
+        std::vector<char> lacks;
+        if( !EvalChannel( kCV, "", fCV, lacks, fOwnedCV ) )
+          return 0;
+        const Hist *cv = dynamic_cast<const Hist*>( fCV.back() );
+        if( !cv )
+        {
+          std::cout << "Warning [" << T::Where() << "] : The leftmost histogram is a " << fCV.back()->ClassName() << ", not a " << T::HistName() << ". Doing nothing." << std::endl;
+          return 0;
+        }
+
+        MUH *result = T::MakeResult( *cv, like );
+        result->SetName( name );
+        if( !like )
+          return result;
+
+        if( T::HasCustomMatrices( like ) )
+          std::cout << "Warning [" << T::Where() << "] : Customized error matrices were found (errors that come from neither Vertical nor Lateral Error Bands). They will be cleared." << std::endl;
+
+        bool ok = true;
+        const std::vector<std::string> vertNames = like->GetVertErrorBandNames();
+        for( std::vector<std::string>::const_iterator it = vertNames.begin(); ok && it != vertNames.end(); ++it )
+          ok = EvalBand<typename T::Vert>( kVert, *it, like->GetVertErrorBand( *it ), result );
+
+        const std::vector<std::string> latNames = like->GetLatErrorBandNames();
+        for( std::vector<std::string>::const_iterator it = latNames.begin(); ok && it != latNames.end(); ++it )
+          ok = EvalBand<typename T::Lat>( kLat, *it, like->GetLatErrorBand( *it ), result );
+
+        const std::vector<std::string> uncorrNames = T::GetUncorrNames( like );
+        for( std::vector<std::string>::const_iterator it = uncorrNames.begin(); ok && it != uncorrNames.end(); ++it )
+        {
+          std::vector<const TH1*> vals;
+          std::vector<TH1*> owned;
+          ok = EvalChannel( kUncorr, *it, vals, lacks, owned );
+          if( ok )
+            T::PushUncorr( result, *it, dynamic_cast<const Hist&>( *vals.back() ) );
+          Delete( owned );
+        }
+
+        if( !ok )
+        {
+          delete result;
+          return 0;
+        }
+        return result;
+      }
+
+    private:
+      //! All histograms are there, of the right dimension and binning
+      bool Check()
+      {
+        int nCells = -1;
+        for( unsigned int i = 0; i != fNodes.size(); ++i )
+        {
+          if( MUExpression::kLeaf != fNodes[i].fOp )
+          {
+            fMUH[i] = fMUH[ fNodes[i].fA ];
+            fIsMUH[i] = fIsMUH[ fNodes[i].fA ];
+            continue;
+          }
+
+          const TH1 *h = fNodes[i].fHist;
+          if( !h || T::kDim != h->GetDimension() || ( 0 <= nCells && nCells != h->GetNcells() ) )
+          {
+            std::cout << "Warning [" << T::Where() << "] : Histogram " << ( h ? h->GetName() : "NULL" ) << " does not have the dimension or binning of the others. Doing nothing." << std::endl;
+            return false;
+          }
+          nCells = h->GetNcells();
+          fMUH[i] = dynamic_cast<const MUH*>( h );
+          fIsMUH[i] = ( 0 != fMUH[i] );
+        }
+        return true;
+      }
+
+      //! A chain of Scales of one histogram: copy it and scale the copy
+      MUH* EvalScales( const char *name ) const
+      {
+        const TH1 *leaf = fNodes[0].fHist;
+        const Hist *hist = dynamic_cast<const Hist*>( leaf );
+        if( !hist )
+        {
+          std::cout << "Warning [" << T::Where() << "] : Histogram " << leaf->GetName() << " is a " << leaf->ClassName() << ", not a " << T::HistName() << ". Doing nothing." << std::endl;
+          return 0;
+        }
+
+        MUH *result = fMUH[0] ? new MUH( *fMUH[0] ) : T::MakeResult( *hist, 0 );
+        result->SetName( name );
+        for( unsigned int i = 1; i != fNodes.size(); ++i )
+          result->Scale( fNodes[i].fC1, fNodes[i].fOption.c_str() );
+        return result;
+      }
+
+      //! The histogram a leaf has in a channel, NULL if it lacks it
+      const TH1* GetLeafChannel( const unsigned int i, const EChannel channel, const std::string& name ) const
+      {
+        const MUH *h = fMUH[i];
+        switch( channel )
+        {
+          case kCV:     return fNodes[i].fHist;
+          case kVert:   return ( h && h->HasVertErrorBand( name ) ) ? h->GetVertErrorBand( name ) : 0;
+          case kLat:    return ( h && h->HasLatErrorBand( name ) ) ? h->GetLatErrorBand( name ) : 0;
+          case kUncorr: return h ? T::GetUncorr( h, name ) : 0;
+        }
+        return 0;
+      }
+
+      /*! The central value of every node in a channel, computed with the TH1 calls the MUH methods make.
+          A node whose left operand lacks the channel lacks it too, and has its value from the CV channel instead.
+          @param[out] vals Value of each node, the result last
+          @param[out] lacks Does each node lack the channel?
+          @param[out] owned Histograms made here, for the caller to delete
+          */
+      bool EvalChannel( const EChannel channel, const std::string& name, std::vector<const TH1*>& vals, std::vector<char>& lacks, std::vector<TH1*>& owned ) const
+      {
+        //! Intermediate histograms are the expression's own, not the current directory's
+        TDirectory::TContext detached( gDirectory, 0 );
+
+        const unsigned int n = fNodes.size();
+        vals.assign( n, (const TH1*)0 );
+        lacks.assign( n, 0 );
+        for( unsigned int i = 0; i != n; ++i )
+        {
+          const Node& node = fNodes[i];
+          if( MUExpression::kLeaf == node.fOp )
+          {
+            vals[i] = GetLeafChannel( i, channel, name );
+            if( !vals[i] )
+            {
+              lacks[i] = 1;
+              vals[i] = fCV[i];
+            }
+            continue;
+          }
+
+          if( lacks[node.fA] )
+          {
+            lacks[i] = 1;
+            vals[i] = fCV[i];
+            continue;
+          }
+
+          //! Like the methods, add only a MUH to a MUH
+          if( kCV == channel && MUExpression::kAdd == node.fOp && fIsMUH[node.fA] && !fIsMUH[node.fB] )
+          {
+            std::cout << "Warning [" << T::Where() << "] : Unable to add histogram because it could not be cast to an " << T::MUHName() << ".  Doing nothing." << std::endl;
+            return false;
+          }
+
+          if( MUExpression::kScale != node.fOp && lacks[node.fB] && fIsMUH[node.fB] )
+          {
+            if( MUExpression::kAdd == node.fOp && T::kAddFillsMissingBands )
+              std::cout << "Warning [" << T::Where() << "] : Additive " << T::MUHName() << " lacks " << ChannelName( channel ) << " " << name << ".  Add central value to all universes." << std::endl;
+            else
+            {
+              std::cout << "Warning [" << T::Where() << "] : Could not combine " << T::MUHName() << "s because they all don't have the " << name << " " << ChannelName( channel ) << ". Doing nothing." << std::endl;
+              return false;
+            }
+          }
+
+          //! MUH1D::Add averages uncorrelated errors flagged kIsAverage in its own way
+          if( kUncorr == channel && MUExpression::kAdd == node.fOp && !lacks[node.fB] && vals[node.fA]->TestBit( TH1::kIsAverage ) && vals[node.fB]->TestBit( TH1::kIsAverage ) )
+          {
+            std::cout << "Warning [" << T::Where() << "] : Uncorrelated error " << name << " is an average.  Use MUH1D::Add for it. Doing nothing." << std::endl;
+            return false;
+          }
+
+          TH1 *h = Copy( vals[node.fA] );
+          owned.push_back( h );
+          switch( node.fOp )
+          {
+            case MUExpression::kAdd:      h->Add( vals[node.fB], node.fC1 ); break;
+            case MUExpression::kMultiply: h->Multiply( vals[node.fA], vals[node.fB], node.fC1, node.fC2 ); break;
+            case MUExpression::kDivide:   h->Divide( vals[node.fA], vals[node.fB], node.fC1, node.fC2, node.fOption.c_str() ); break;
+            case MUExpression::kScale:    h->Scale( node.fC1, node.fOption.c_str() ); break;
+          }
+          vals[i] = h;
+        }
+        return true;
+      }
+
+      //! Add band name of the leftmost histogram to the result, its universes computed in one pass
+      template<class BAND>
+      bool EvalBand( const EChannel channel, const std::string& name, const BAND *likeBand, MUH *result ) const
+      {
+        std::vector<const TH1*> vals;
+        std::vector<char> lacks;
+        std::vector<TH1*> owned;
+        bool ok = EvalChannel( channel, name, vals, lacks, owned );
+        if( ok )
+        {
+          TDirectory::TContext detached( gDirectory, 0 ); //views are owned by the band, not a directory
+          BAND *band = new BAND( std::string( result->GetName() ) + "_" + name, dynamic_cast<const Hist*>( vals.back() ), likeBand->GetNHists() );
+          band->SetUseSpreadError( likeBand->GetUseSpreadError() );
+          ok = FillUniverses<BAND>( channel, name, vals, lacks, band->GetUniverseStore() );
+          if( ok )
+            result->PushErrorBand( name, band );
+          else
+            delete band;
+        }
+        Delete( owned );
+        return ok;
+      }
+
+      /*! Compute all universes of the result into out, bin by bin.  Each step works on a row of universes,
+          with the arithmetic of the MUUniverseStore method the band method calls, so the bits are the same.
+          */
+      template<class BAND>
+      bool FillUniverses( const EChannel channel, const std::string& name, const std::vector<const TH1*>& vals, const std::vector<char>& lacks, MUUniverseStore& out ) const
+      {
+        const unsigned int n = fNodes.size();
+        const unsigned int root = n - 1;
+        const unsigned int nBins = out.GetNBins();
+        const unsigned int nUniverses = out.GetNUniverses();
+
+        //! Universes of the leaves, and what each step needs to know about its options
+        std::vector<const MUUniverseStore*> stores( n, (const MUUniverseStore*)0 );
+        std::vector< std::vector<double> > widthFactors( n );
+        std::vector<char> binomial( n, 0 ), noSumw2( n, 0 );
+        for( unsigned int i = 0; i != n; ++i )
+        {
+          const Node& node = fNodes[i];
+          if( lacks[i] )
+            continue;
+          if( MUExpression::kLeaf == node.fOp )
+          {
+            stores[i] = &dynamic_cast<const BAND*>( vals[i] )->GetUniverseStore();
+            if( stores[i]->GetNUniverses() != nUniverses || stores[i]->GetNBins() != nBins )
+            {
+              std::cout << "Warning [" << T::Where() << "] : " << ChannelName( channel ) << " " << name << " of " << node.fHist->GetName() << " has " << stores[i]->GetNUniverses() << " universes, not " << nUniverses << ". Doing nothing." << std::endl;
+              return false;
+            }
+          }
+          else if( MUExpression::kScale == node.fOp )
+          {
+            TString opt( node.fOption );
+            opt.ToLower();
+            noSumw2[i] = opt.Contains( "nosw2" );
+            if( opt.Contains( "width" ) )
+              widthFactors[i] = MUUniverseStore::GetWidthScaleFactors( vals[i], node.fC1 );
+          }
+          else if( MUExpression::kDivide == node.fOp )
+            binomial[i] = MUUniverseStore::IsBinomialOption( node.fOption.c_str() );
+        }
+        if( 0 == nUniverses )
+          return true;
+
+        //! One row of universes per step, small enough to stay in cache
+        std::vector<double> sumw( n * nUniverses ), sumw2( n * nUniverses );
+        std::vector<double> flat( nUniverses ), flat2( nUniverses );
+        std::vector<const double*> row( n, (const double*)0 ), row2( n, (const double*)0 );
+
+        for( unsigned int bin = 0; bin != nBins; ++bin )
+        {
+          for( unsigned int i = 0; i != n; ++i )
+          {
+            const Node& node = fNodes[i];
+            if( lacks[i] )
+              continue;
+            if( MUExpression::kLeaf == node.fOp )
+            {
+              row[i]  = stores[i]->GetSumwRow( bin );
+              row2[i] = stores[i]->GetSumw2Row( bin );
+              continue;
+            }
+
+            double *w  = ( root == i ) ? out.GetSumwRow( bin )  : &sumw[ i * nUniverses ];
+            double *w2 = ( root == i ) ? out.GetSumw2Row( bin ) : &sumw2[ i * nUniverses ];
+            const double *a = row[node.fA], *a2 = row2[node.fA];
+            const double c1 = node.fC1, c2 = node.fC2;
+
+            //! An operand that lacks the band has its central value in every universe
+            const double *b = 0, *b2 = 0;
+            double content = 0., error2 = 0.;
+            if( MUExpression::kScale != node.fOp )
+            {
+              if( lacks[node.fB] )
+              {
+                GetBinValue( vals[node.fB], bin, content, error2 );
+                std::fill( flat.begin(), flat.end(), content );
+                std::fill( flat2.begin(), flat2.end(), error2 );
+                b = &flat[0];
+                b2 = &flat2[0];
+              }
+              else
+              {
+                b = row[node.fB];
+                b2 = row2[node.fB];
+              }
+            }
+
+            switch( node.fOp )
+            {
+              case MUExpression::kScale:
+                {
+                  //! MUUniverseStore::Scale, or ScaleBins for "width"
+                  const double c = widthFactors[i].empty() ? c1 : widthFactors[i][bin];
+                  const double csq = c*c;
+                  for( unsigned int k = 0; k != nUniverses; ++k )
+                  {
+                    w[k]  = a[k] * c;
+                    w2[k] = noSumw2[i] ? a2[k] : a2[k] * csq;
+                  }
+                }
+                break;
+              case MUExpression::kAdd:
+                {
+                  //! MUUniverseStore::Add, or AddToAll for an addend that lacks the band
+                  const double c1sq = c1*c1;
+                  if( lacks[node.fB] )
+                  {
+                    const double addContent = c1 * content;
+                    const double addError2 = c1sq * error2;
+                    for( unsigned int k = 0; k != nUniverses; ++k )
+                    {
+                      w[k]  = a[k]  + addContent;
+                      w2[k] = a2[k] + addError2;
+                    }
+                  }
+                  else
+                  {
+                    for( unsigned int k = 0; k != nUniverses; ++k )
+                    {
+                      w[k]  = a[k]  + c1 * b[k];
+                      w2[k] = a2[k] + c1sq * b2[k];
+                    }
+                  }
+                }
+                break;
+              case MUExpression::kMultiply:
+                MUUniverseStore::MultiplyArrays( w, w2, a, a2, b, b2, c1, c2, nUniverses );
+                break;
+              case MUExpression::kDivide:
+                MUUniverseStore::DivideArrays( w, w2, a, a2, b, b2, c1, c2, binomial[i], nUniverses );
+                break;
+            }
+            row[i]  = w;
+            row2[i] = w2;
+          }
+        }
+        return true;
+      }
+
+      //! A copy of the histogram part of h, without universes
+      static TH1* Copy( const TH1 *h )
+      {
+        const Hist *hist = dynamic_cast<const Hist*>( h );
+        if( hist )
+          return new Hist( *hist );
+        return (TH1*)h->Clone();
+      }
+
+      static void Delete( std::vector<TH1*>& hists )
+      {
+        for( std::vector<TH1*>::iterator it = hists.begin(); it != hists.end(); ++it )
+          delete *it;
+        hists.clear();
+      }
+
+      static const char* ChannelName( const EChannel channel )
+      {
+        switch( channel )
+        {
+          case kVert:   return "vertical error band";
+          case kLat:    return "lateral error band";
+          case kUncorr: return "uncorrelated error";
+          default:      return "central value";
+        }
+      }
+
+      const std::vector<Node>& fNodes;
+      std::vector<const MUH*> fMUH;     ///< The MUH each node is made from (its leftmost leaf), or NULL
+      std::vector<char> fIsMUH;         ///< Is the leftmost leaf of each node a MUH?
+      std::vector<const TH1*> fCV;      ///< Central value of each node
+      std::vector<TH1*> fOwnedCV;       ///< Central values made here
+  };
+}
+
+//======================================================================
+// MUExpression
+//======================================================================
+MUExpression::MUExpression( const TH1* h )
+{
+  Node leaf;
+  leaf.fOp = kLeaf;
+  leaf.fA = leaf.fB = -1;
+  leaf.fC1 = leaf.fC2 = 1.;
+  leaf.fHist = h;
+  fNodes.push_back( leaf );
+}
+
+MUExpression MUExpression::Combine( const MUExpression& b, const Node& step ) const
+{
+  //! The nodes of this, then those of b with their operands moved past ours, then the step on both results
+  MUExpression result( *this );
+  const int offset = fNodes.size();
+  for( std::vector<Node>::const_iterator it = b.fNodes.begin(); it != b.fNodes.end(); ++it )
+  {
+    Node node = *it;
+    if( 0 <= node.fA )
+      node.fA += offset;
+    if( 0 <= node.fB )
+      node.fB += offset;
+    result.fNodes.push_back( node );
+  }
+
+  Node last = step;
+  last.fA = offset - 1;
+  last.fB = result.fNodes.size() - 1;
+  result.fNodes.push_back( last );
+  return result;
+}
+
+MUExpression MUExpression::Add( const MUExpression& b, const double c1 /* = 1. */ ) const
+{
+  Node step;
+  step.fOp = kAdd;
+  step.fC1 = c1;
+  step.fC2 = 1.;
+  step.fHist = 0;
+  return Combine( b, step );
+}
+
+MUExpression MUExpression::Multiply( const MUExpression& b, const double c1 /* = 1. */, const double c2 /* = 1. */ ) const
+{
+  Node step;
+  step.fOp = kMultiply;
+  step.fC1 = c1;
+  step.fC2 = c2;
+  step.fHist = 0;
+  return Combine( b, step );
+}
+
+MUExpression MUExpression::Divide( const MUExpression& b, const double c1 /* = 1. */, const double c2 /* = 1. */, Option_t* option /* = "" */ ) const
+{
+  Node step;
+  step.fOp = kDivide;
+  step.fC1 = c1;
+  step.fC2 = c2;
+  step.fOption = option;
+  step.fHist = 0;
+  return Combine( b, step );
+}
+
+MUExpression MUExpression::Scale( const double c1, Option_t* option /* = "" */ ) const
+{
+  Node step;
+  step.fOp = kScale;
+  step.fC1 = c1;
+  step.fC2 = 1.;
+  step.fOption = option;
+  step.fHist = 0;
+
+  //! A Scale has one operand, so there are no nodes to take from another expression
+  MUExpression result( *this );
+  step.fA = fNodes.size() - 1;
+  step.fB = -1;
+  result.fNodes.push_back( step );
+  return result;
+}
+
+MUH1D* MUExpression::Eval1D( const char* name ) const
+{
+  Evaluator<Traits1D> evaluator( fNodes );
+  return evaluator.Eval( name );
+}
+
+MUH2D* MUExpression::Eval2D( const char* name ) const
+{
+  Evaluator<Traits2D> evaluator( fNodes );
+  return evaluator.Eval( name );
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef MNV_MUExpression_H
+#define MNV_MUExpression_H 1
+
+#include "Rtypes.h"
+
+#include <string>
+#include <vector>
+
+class TH1;
+
+namespace PlotUtils
+{
+
+	class MUH1D;
+	class MUH2D;
+
+	/*! @brief A formula of MUH1Ds (or MUH2Ds), plain histograms and numbers, evaluated without intermediate histograms.
+
+		A cross section is typically ( data - bkg*scale ) / ( eff * flux * nTargets ).  Done with Add, Multiply,
+		Divide and Scale, every step copies all universes of every error band and passes over them again.
+		An MUExpression only records the steps:
+
+		@code
+		MUExpression xs = ( MUExpression( data ) - MUExpression( bkg ) * scale ) / ( MUExpression( eff ) * flux * nTargets );
+		MUH1D *h = xs.Eval1D( "xs" );
+		@endcode
+
+		Eval1D then computes each error band in one pass over the bins.  All steps are applied to the row of
+		universes of a bin while it is in cache, and the result is written once.  The central values (of the
+		histogram, of each band and of the uncorrelated errors) are one histogram per band rather than one per
+		universe, and are computed with the TH1 calls the MUH1D methods make.  Every step does exactly the
+		arithmetic of the method it stands for, so the result has the same bits as the step-by-step version.
+
+		Each step acts like the MUH1D/MUH2D method on a copy of its left operand:
+		- a + b, a - b and Add( b, c1 ) are Add( b, c1 ).  For a band b lacks, MUH1D::Add adds the central value of b
+		  to all universes (with a warning), and MUH2D::Add fails.  b must be a MUH1D or MUH2D, as for the methods.
+		- a * b and Multiply( b, c1, c2 ) are Multiply, or MultiplySingle if b is a plain histogram.
+		- a / b and Divide( b, c1, c2, option ) are Divide, or DivideSingle if b is a plain histogram.
+		- a * c, a / c and Scale( c, option ) are Scale, options "width" and "nosw2" included.
+		The result has the error bands (and uncorrelated errors) of the leftmost histogram.  If an MUH1D or MUH2D
+		divides or multiplies it, that histogram must have all those bands, as the methods require.
+
+		The expression keeps pointers to its histograms, which must live until it is evaluated.
+		*/
+	class MUExpression
+	{
+		public:
+			//! A histogram: a MUH1D or MUH2D with its error bands, or a plain histogram with the same value in every universe
+			MUExpression( const TH1* h );
+
+			//! Add( b, 1 )
+			MUExpression operator+( const MUExpression& b ) const { return Add( b, 1. ); };
+
+			//! Add( b, -1 )
+			MUExpression operator-( const MUExpression& b ) const { return Add( b, -1. ); };
+
+			//! Multiply( b )
+			MUExpression operator*( const MUExpression& b ) const { return Multiply( b ); };
+
+			//! Divide( b )
+			MUExpression operator/( const MUExpression& b ) const { return Divide( b ); };
+
+			//! Scale( c )
+			MUExpression operator*( const double c ) const { return Scale( c ); };
+
+			//! Scale( 1/c )
+			MUExpression operator/( const double c ) const { return Scale( 1. / c ); };
+
+			//! This plus c1 times b
+			MUExpression Add( const MUExpression& b, const double c1 = 1. ) const;
+
+			//! c1 times this times c2 times b
+			MUExpression Multiply( const MUExpression& b, const double c1 = 1., const double c2 = 1. ) const;
+
+			//! c1 times this over c2 times b ("B" for binomial errors)
+			MUExpression Divide( const MUExpression& b, const double c1 = 1., const double c2 = 1., Option_t* option = "" ) const;
+
+			//! c1 times this ("width" to divide by the bin widths too)
+			MUExpression Scale( const double c1, Option_t* option = "" ) const;
+
+			/*! Evaluate into a new MUH1D (caller owns the memory)
+				@param[in] name Name of the result
+				@return NULL if the operands do not fit together, e.g. different binnings or missing error bands
+				*/
+			MUH1D* Eval1D( const char* name ) const;
+
+			//! Evaluate into a new MUH2D (caller owns the memory), NULL if the operands do not fit together
+			MUH2D* Eval2D( const char* name ) const;
+
+			//! Number of histograms and steps in the formula
+			unsigned int GetNNodes() const { return fNodes.size(); };
+
+			//! The kinds of node
+			enum EOp { kLeaf, kAdd, kMultiply, kDivide, kScale };
+
+			//! One histogram or step of the formula
+			struct Node
+			{
+				int fOp;              ///< EOp
+				int fA;               ///< Left operand, an earlier node (-1 for a histogram)
+				int fB;               ///< Right operand, an earlier node (-1 for a histogram or Scale)
+				double fC1;           ///< Coefficient of the left operand (the scale for Scale)
+				double fC2;           ///< Coefficient of the right operand
+				std::string fOption;  ///< Option of Divide or Scale
+				const TH1 *fHist;     ///< The histogram of a leaf
+			};
+
+			//! All nodes, operands before the steps that use them, the result last
+			const std::vector<Node>& GetNodes() const { return fNodes; };
+
+		private:
+			//! A new step on this and b
+			MUExpression Combine( const MUExpression& b, const Node& step ) const;
+
+			std::vector<Node> fNodes; ///< All nodes, operands before the steps that use them, the result last
+	}; //end of MUExpression
+
+	//! Scale( c ) of a
+	inline MUExpression operator*( const double c, const MUExpression& a ) { return a.Scale( c ); }
+
+} //end of PlotUtils
+
+#endif
@@ -0,0 +1,468 @@
+#ifndef MNV_MUFillShard_cxx
+#define MNV_MUFillShard_cxx 1
+
+#include "PlotUtils/MUFillShard.h"
+#include "HistogramUtils.h" //for IsNotPhysicalShift and StatOverflows
+
+#include "TH1.h"
+#include "TArrayD.h"
+
+#include <algorithm>
+#if __cplusplus >= 201103L
+#include <mutex>
+#endif
+
+using namespace PlotUtils;
+
+//======================================================================
+// MUFillShard::Sums
+//======================================================================
+const unsigned int MUFillShard::kNThreadSlots;
+
+void MUFillShard::Sums::Resize( const unsigned int nCells, const bool shared /* = false */ )
+{
+  sumw.assign( nCells, 0. );
+  sumw2.assign( nCells, 0. );
+  std::fill( stats, stats + 11, 0. );
+  entries = 0.;
+  threadStats.assign( shared ? kNThreadSlots : 0, ThreadStats() );
+}
+
+void MUFillShard::Sums::GetTotals( double *totalStats, double& totalEntries ) const
+{
+  std::copy( stats, stats + 11, totalStats );
+  totalEntries = entries;
+  for( std::vector<ThreadStats>::const_iterator t = threadStats.begin(); t != threadStats.end(); ++t )
+  {
+    for( unsigned int i = 0; i != 11; ++i )
+      totalStats[i] += t->stats[i];
+    totalEntries += t->entries;
+  }
+}
+
+void MUFillShard::Sums::AddTo( TH1* h ) const
+{
+  //! Take the stats before the bins change, or a histogram that recomputes its stats from the bins would count us twice
+  double hstats[13] = {0.};
+  h->GetStats( hstats );
+  double totalStats[11], totalEntries;
+  GetTotals( totalStats, totalEntries );
+  for( unsigned int i = 0; i != 11; ++i )
+    hstats[i] += totalStats[i];
+
+  //! TH1::Fill turns on Sumw2 at the first weight that is not 1, so do the same
+  if( 0 == h->GetSumw2N() && sumw2 != sumw )
+    h->Sumw2();
+
+  TArrayD *hsumw2 = h->GetSumw2N() ? h->GetSumw2() : 0;
+  for( unsigned int bin = 0; bin != sumw.size(); ++bin )
+  {
+    if( sumw[bin] != 0. )
+      h->AddBinContent( bin, sumw[bin] );
+    if( hsumw2 )
+      hsumw2->fArray[bin] += sumw2[bin];
+  }
+
+  h->PutStats( hstats );
+  h->SetEntries( h->GetEntries() + totalEntries );
+}
+
+//======================================================================
+// MUFillShard
+//======================================================================
+MUFillShard::MUFillShard( const TH1* cv, const bool shared /* = false */ ) :
+  fShared( shared ),
+  fStatOverflows( MUHist::StatOverflows( *cv ) ),
+  fDimension( cv->GetDimension() ),
+  fNCells( cv->GetNcells() ),
+  fXLocator( cv->GetXaxis() ),
+  fYLocator( cv->GetYaxis() ),
+  fZLocator( cv->GetZaxis() )
+{
+  fCV.Resize( fNCells, fShared );
+}
+
+void MUFillShard::SetIndex( std::vector<int>& byID, const MUErrorBandHandle& band, const int index )
+{
+  if( byID.size() <= band.GetID() )
+    byID.resize( band.GetID() + 1, -1 );
+  byID[ band.GetID() ] = index;
+}
+
+void MUFillShard::AddVertErrorBand( const MUErrorBandHandle& band, const unsigned int nUniverses )
+{
+  fVert.push_back( Band() );
+  fVert.back().band = band;
+  fVert.back().cv.Resize( fNCells, fShared );
+  fVert.back().universes.Resize( fNCells, nUniverses );
+  SetIndex( fVertByID, band, fVert.size() - 1 );
+}
+
+void MUFillShard::AddLatErrorBand( const MUErrorBandHandle& band, const unsigned int nUniverses )
+{
+  fLat.push_back( Band() );
+  fLat.back().band = band;
+  fLat.back().cv.Resize( fNCells, fShared );
+  fLat.back().universes.Resize( fNCells, nUniverses );
+  SetIndex( fLatByID, band, fLat.size() - 1 );
+}
+
+void MUFillShard::AddUncorrError( const MUErrorBandHandle& band )
+{
+  fUncorr.push_back( UncorrError() );
+  fUncorr.back().band = band;
+  fUncorr.back().content.assign( fNCells, 0. );
+  fUncorr.back().err.assign( fNCells, 0. );
+  SetIndex( fUncorrByID, band, fUncorr.size() - 1 );
+}
+
+void MUFillShard::Reset()
+{
+  fCV.Resize( fNCells, fShared );
+  for( std::vector<Band>::iterator i = fVert.begin(); i != fVert.end(); ++i )
+  {
+    i->cv.Resize( fNCells, fShared );
+    i->universes.Reset();
+  }
+  for( std::vector<Band>::iterator i = fLat.begin(); i != fLat.end(); ++i )
+  {
+    i->cv.Resize( fNCells, fShared );
+    i->universes.Reset();
+  }
+  for( std::vector<UncorrError>::iterator i = fUncorr.begin(); i != fUncorr.end(); ++i )
+  {
+    i->content.assign( fNCells, 0. );
+    i->err.assign( fNCells, 0. );
+  }
+}
+
+int MUFillShard::FindBin( const double xval, const double yval, const double zval, bool& inRange ) const
+{
+  const int nx = fXLocator.GetNbins();
+  const int bx = fXLocator.FindBin( xval );
+  inRange = ( 0 < bx && bx <= nx );
+  if( fDimension < 2 )
+    return bx;
+
+  const int ny = fYLocator.GetNbins();
+  const int by = fYLocator.FindBin( yval );
+  inRange = inRange && ( 0 < by && by <= ny );
+  if( fDimension < 3 )
+    return bx + (nx+2)*by;
+
+  const int bz = fZLocator.FindBin( zval );
+  inRange = inRange && ( 0 < bz && bz <= fZLocator.GetNbins() );
+  return bx + (nx+2)*( by + (ny+2)*bz );
+}
+
+void MUFillShard::FillSums( Sums& sums, const int bin, const bool inRange, const double w, const double xval, const double yval, const double zval )
+{
+  Add( &sums.sumw[bin], w );
+  Add( &sums.sumw2[bin], w*w );
+
+  //! In a shared shard every fill would hit the same entries and statistics, so each thread keeps its own
+  double *entries = &sums.entries, *s = sums.stats;
+  bool atomic = false;
+  if( fShared )
+  {
+    const int slot = GetThreadSlot();
+    if( 0 <= slot )
+    {
+      entries = &sums.threadStats[slot].entries;
+      s = sums.threadStats[slot].stats;
+    }
+    else
+      atomic = true;
+  }
+
+  if( atomic )
+  {
+    MUUniverseStore::AtomicAdd( entries, 1. );
+    if( !inRange && !fStatOverflows )
+      return;
+    const double values[11] = { w, w*w, w*xval, w*xval*xval, w*yval, w*yval*yval, w*xval*yval, w*zval, w*zval*zval, w*xval*zval, w*yval*zval };
+    const unsigned int n = ( fDimension < 2 ) ? 4 : ( fDimension < 3 ) ? 7 : 11;
+    for( unsigned int i = 0; i != n; ++i )
+      MUUniverseStore::AtomicAdd( s+i, values[i] );
+    return;
+  }
+
+  *entries += 1.;
+  if( !inRange && !fStatOverflows )
+    return;
+
+  s[0] += w;
+  s[1] += w*w;
+  s[2] += w*xval;
+  s[3] += w*xval*xval;
+  if( fDimension < 2 )
+    return;
+  s[4] += w*yval;
+  s[5] += w*yval*yval;
+  s[6] += w*xval*yval;
+  if( fDimension < 3 )
+    return;
+  s[7]  += w*zval;
+  s[8]  += w*zval*zval;
+  s[9]  += w*xval*zval;
+  s[10] += w*yval*zval;
+}
+
+void MUFillShard::Fill( const double xval, const double cvweight )
+{
+  bool inRange;
+  const int bin = FindBin( xval, 0., 0., inRange );
+  FillSums( fCV, bin, inRange, cvweight, xval, 0., 0. );
+}
+
+void MUFillShard::Fill( const double xval, const double yval, const double cvweight )
+{
+  bool inRange;
+  const int bin = FindBin( xval, yval, 0., inRange );
+  FillSums( fCV, bin, inRange, cvweight, xval, yval, 0. );
+}
+
+void MUFillShard::Fill( const double xval, const double yval, const double zval, const double cvweight )
+{
+  bool inRange;
+  const int bin = FindBin( xval, yval, zval, inRange );
+  FillSums( fCV, bin, inRange, cvweight, xval, yval, zval );
+}
+
+bool MUFillShard::FillVert( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *weights, const double cvweight, const double cvWeightFromMe )
+{
+  const int index = FindIndex( fVertByID, band );
+  if( index < 0 )
+    return false;
+  Band& vert = fVert[index];
+
+  //! All universes are filled in the same bin as the CV
+  bool inRange;
+  const int bin = FindBin( xval, yval, zval, inRange );
+  FillSums( vert.cv, bin, inRange, cvweight, xval, yval, zval );
+  if( fShared )
+    vert.universes.FillAtomic( bin, weights, cvweight / cvWeightFromMe );
+  else
+    vert.universes.Fill( bin, weights, cvweight / cvWeightFromMe );
+
+  return true;
+}
+
+bool MUFillShard::FillLat( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *xshifts, const double *yshifts, const double *zshifts, const double cvweight, const bool fillcv, const double *weights )
+{
+  const int index = FindIndex( fLatByID, band );
+  if( index < 0 )
+    return false;
+  Band& lat = fLat[index];
+
+  if( fillcv )
+  {
+    bool inRange;
+    const int bin = FindBin( xval, yval, zval, inRange );
+    FillSums( lat.cv, bin, inRange, cvweight, xval, yval, zval );
+  }
+
+  //! Same as the lateral error bands: locate the universes one axis at a time, in chunks small enough for the stack
+  const unsigned int nUniverses = lat.universes.GetNUniverses();
+  const int xcells = fXLocator.GetNbins() + 2;
+  const int ycells = fYLocator.GetNbins() + 2;
+  const unsigned int chunk = 256;
+  int xbins[chunk], ybins[chunk], zbins[chunk];
+  for( unsigned int first = 0; first < nUniverses; first += chunk )
+  {
+    const unsigned int n = std::min( nUniverses - first, chunk );
+    fXLocator.FindBins( xval, xshifts + first, n, xbins );
+    if( 2 <= fDimension )
+      fYLocator.FindBins( yval, yshifts + first, n, ybins );
+    if( 3 <= fDimension )
+      fZLocator.FindBins( zval, zshifts + first, n, zbins );
+
+    for( unsigned int j = 0; j != n; ++j )
+    {
+      const unsigned int i = first + j;
+      if( MUHist::IsNotPhysicalShift( xshifts[i] ) )
+        continue;
+      if( 2 <= fDimension && MUHist::IsNotPhysicalShift( yshifts[i] ) )
+        continue;
+      if( 3 <= fDimension && MUHist::IsNotPhysicalShift( zshifts[i] ) )
+        continue;
+
+      int bin = xbins[j];
+      if( 3 <= fDimension )
+        bin += xcells*( ybins[j] + ycells*zbins[j] );
+      else if( 2 <= fDimension )
+        bin += xcells*ybins[j];
+
+      const double wgtU = weights ? cvweight*weights[i] : cvweight;
+      if( fShared )
+        lat.universes.FillAtomic( bin, i, wgtU );
+      else
+        lat.universes.Fill( bin, i, wgtU );
+    }
+  }
+
+  return true;
+}
+
+bool MUFillShard::FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double *weights, const double cvweight /* = 1.0 */, const double cvWeightFromMe /* = 1. */ )
+{
+  return FillVert( band, xval, 0., 0., weights, cvweight, cvWeightFromMe );
+}
+
+bool MUFillShard::FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double *weights, const double cvweight /* = 1.0 */, const double cvWeightFromMe /* = 1. */ )
+{
+  return FillVert( band, xval, yval, 0., weights, cvweight, cvWeightFromMe );
+}
+
+bool MUFillShard::FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *weights, const double cvweight /* = 1.0 */, const double cvWeightFromMe /* = 1. */ )
+{
+  return FillVert( band, xval, yval, zval, weights, cvweight, cvWeightFromMe );
+}
+
+bool MUFillShard::FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double *shifts, const double cvweight /* = 1.0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+  return FillLat( band, xval, 0., 0., shifts, 0, 0, cvweight, fillcv, weights );
+}
+
+bool MUFillShard::FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double *xshifts, const double *yshifts, const double cvweight /* = 1.0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+  return FillLat( band, xval, yval, 0., xshifts, yshifts, 0, cvweight, fillcv, weights );
+}
+
+bool MUFillShard::FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *xshifts, const double *yshifts, const double *zshifts, const double cvweight /* = 1.0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+  return FillLat( band, xval, yval, zval, xshifts, yshifts, zshifts, cvweight, fillcv, weights );
+}
+
+bool MUFillShard::FillUncorrError( const MUErrorBandHandle& band, const double xval, const double err, const double cvweight /* = 1.0 */ )
+{
+  const int index = FindIndex( fUncorrByID, band );
+  if( index < 0 )
+    return false;
+
+  bool inRange;
+  const int bin = FindBin( xval, 0., 0., inRange );
+  Add( &fUncorr[index].content[bin], cvweight );
+  Add( &fUncorr[index].err[bin], err );
+
+  return true;
+}
+
+#if __cplusplus >= 201103L
+namespace
+{
+  //! Which thread slots are taken
+  std::mutex& GetSlotMutex()
+  {
+    static std::mutex m;
+    return m;
+  }
+
+  std::vector<bool>& GetSlotsUsed()
+  {
+    static std::vector<bool> used( MUFillShard::kNThreadSlots, false );
+    return used;
+  }
+
+  //! The slot of one thread, taken at its first fill of a shared shard and given back when it exits
+  struct ThreadSlot
+  {
+    int fSlot;
+
+    ThreadSlot() : fSlot( -1 )
+    {
+      std::lock_guard<std::mutex> lock( GetSlotMutex() );
+      std::vector<bool>& used = GetSlotsUsed();
+      std::vector<bool>::iterator free = std::find( used.begin(), used.end(), false );
+      if( free != used.end() )
+      {
+        *free = true;
+        fSlot = free - used.begin();
+      }
+    }
+
+    ~ThreadSlot()
+    {
+      if( fSlot < 0 )
+        return;
+      std::lock_guard<std::mutex> lock( GetSlotMutex() );
+      GetSlotsUsed()[fSlot] = false;
+    }
+  };
+}
+
+int MUFillShard::GetThreadSlot()
+{
+  static thread_local ThreadSlot slot;
+  return slot.fSlot;
+}
+#else
+int MUFillShard::GetThreadSlot()
+{
+  return -1;
+}
+#endif
+
+//======================================================================
+// MUFillShardSet
+//======================================================================
+void MUFillShardSet::Set( const unsigned int slot, MUFillShard* shard )
+{
+  if( fShards.size() <= slot )
+    fShards.resize( slot + 1, 0 );
+  delete fShards[slot];
+  fShards[slot] = shard;
+}
+
+void MUFillShardSet::Clear()
+{
+  for( std::vector<MUFillShard*>::iterator i = fShards.begin(); i != fShards.end(); ++i )
+    delete *i;
+  fShards.clear();
+  delete fShared;
+  fShared = 0;
+}
+
+void MUFillShardSet::SetShared( MUFillShard* shard )
+{
+  delete fShared;
+  fShared = shard;
+}
+
+void MUFillShardSet::Swap( MUFillShardSet& other )
+{
+  fShards.swap( other.fShards );
+  std::swap( fShared, other.fShared );
+}
+
+//======================================================================
+// MUFillShardLock
+//======================================================================
+#if __cplusplus >= 201103L
+namespace
+{
+  std::mutex& GetShardMutex()
+  {
+    static std::mutex m;
+    return m;
+  }
+}
+
+MUFillShardLock::MUFillShardLock( )
+{
+  GetShardMutex().lock();
+}
+
+MUFillShardLock::~MUFillShardLock( )
+{
+  GetShardMutex().unlock();
+}
+#else
+MUFillShardLock::MUFillShardLock( )
+{ }
+
+MUFillShardLock::~MUFillShardLock( )
+{ }
+#endif
+
+#endif
@@ -0,0 +1,246 @@
+#ifndef MNV_MUFillShard_H
+#define MNV_MUFillShard_H 1
+
+#include "PlotUtils/MUErrorBandHandle.h"
+#include "PlotUtils/MUUniverseStore.h"
+#include "PlotUtils/MUBinLocator.h"
+
+#include <vector>
+
+class TH1;
+
+namespace PlotUtils
+{
+
+	/*! @brief One worker's private accumulator for an MUH1D, MUH2D or MUH3D and all of its error bands.
+
+		TH1::Fill is not thread safe, so worker threads never touch the histogram itself.  Each worker slot
+		gets a shard from GetFillShard( slot ), fills it with the same calls it would make on the histogram,
+		and MergeFillShards adds every shard back in increasing slot order.  Bands are found by handle only.
+
+		A shard holds flat sums, not TH1 objects: the CV, the CV of each error band and all universes.
+		As long as events are given to slots the same way on every run (e.g. by entry range), the merged
+		result is bit-for-bit the same however the threads were scheduled.
+
+		A shared shard (MUH3D::GetSharedFillShard) is one shard that all threads fill at the same time, using
+		atomic adds on the bins and universes.  It costs no more memory than the histogram itself, which matters
+		for 3D histograms with hundreds of universes, but the order of the adds, and so the last bits of the result,
+		depend on scheduling.  The entries and fill statistics, which every fill touches, are kept per thread
+		and only summed when the shard is merged.
+
+		The binning is fixed when the shard is created, so axes that can extend are not extended.  So is whether
+		under/overflow fills enter the statistics: the shard uses the setting the histogram had at that time.
+		*/
+	class MUFillShard
+	{
+		public:
+			//! Most threads that keep their own entries and statistics in a shared shard.  Threads beyond this add atomically.
+			static const unsigned int kNThreadSlots = 64;
+
+			//! Entries and statistics of one thread, padded so that no two threads share a cache line
+			struct ThreadStats
+			{
+				double stats[11];          ///< In-range sums, in the order of TH1::GetStats
+				double entries;            ///< Number of fills
+				double pad[8];             ///< Padding
+			};
+
+			//! Sums of weights of one histogram, laid out like the TH1 they are merged into
+			struct Sums
+			{
+				std::vector<double> sumw;  ///< Sum of weights in each global bin
+				std::vector<double> sumw2; ///< Sum of squared weights in each global bin
+				double stats[11];          ///< In-range sums, in the order of TH1::GetStats
+				double entries;            ///< Number of fills
+				std::vector<ThreadStats> threadStats; ///< Entries and statistics by thread slot, for a shared shard only
+
+				//! Set the number of global bins and zero everything.  A shared shard also gets a ThreadStats per slot.
+				void Resize( const unsigned int nCells, const bool shared = false );
+
+				//! stats and entries plus those of all threads
+				void GetTotals( double *totalStats, double& totalEntries ) const;
+
+				//! Add everything to a histogram with the same binning, as if it had been filled directly
+				void AddTo( TH1* h ) const;
+			};
+
+			//! CV sums and universes of one error band
+			struct Band
+			{
+				MUErrorBandHandle band;    ///< Band in the owning histogram
+				Sums cv;                   ///< CV of the band
+				MUUniverseStore universes; ///< All universes of the band
+			};
+
+			//! Content and summed error of one uncorrelated error
+			struct UncorrError
+			{
+				MUErrorBandHandle band;      ///< Uncorrelated error in the owning histogram
+				std::vector<double> content; ///< Sum of CV weights in each global bin
+				std::vector<double> err;     ///< Sum of errors in each global bin
+			};
+
+			/*! Shard with the binning of this histogram and no error bands
+				@param[in] cv Histogram to take the binning from
+				@param[in] shared Will many threads fill this shard at once?  If so, adds to bins and universes are atomic.
+				*/
+			explicit MUFillShard( const TH1* cv, const bool shared = false );
+
+			//! Is this shard filled by many threads at once?
+			bool IsShared() const { return fShared; };
+
+			//! Add a vertical error band to fill
+			void AddVertErrorBand( const MUErrorBandHandle& band, const unsigned int nUniverses );
+
+			//! Add a lateral error band to fill
+			void AddLatErrorBand( const MUErrorBandHandle& band, const unsigned int nUniverses );
+
+			//! Add an uncorrelated error to fill
+			void AddUncorrError( const MUErrorBandHandle& band );
+
+			//! Zero everything, keeping the bands
+			void Reset();
+
+			//! Fill the CV of a 1D histogram
+			void Fill( const double xval, const double cvweight );
+			//! Fill the CV of a 2D histogram
+			void Fill( const double xval, const double yval, const double cvweight );
+			//! Fill the CV of a 3D histogram
+			void Fill( const double xval, const double yval, const double zval, const double cvweight );
+
+			//! Fill a vertical error band of a 1D histogram (same arguments as MUH1D::FillVertErrorBand)
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double *weights, const double cvweight = 1.0, const double cvWeightFromMe = 1. );
+			//! Fill a vertical error band of a 2D histogram (same arguments as MUH2D::FillVertErrorBand)
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double *weights, const double cvweight = 1.0, const double cvWeightFromMe = 1. );
+			//! Fill a vertical error band of a 3D histogram (same arguments as MUH3D::FillVertErrorBand)
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *weights, const double cvweight = 1.0, const double cvWeightFromMe = 1. );
+
+			//! Fill a lateral error band of a 1D histogram (same arguments as MUH1D::FillLatErrorBand)
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double *shifts, const double cvweight = 1.0, const bool fillcv = true, const double *weights = 0 );
+			//! Fill a lateral error band of a 2D histogram (same arguments as MUH2D::FillLatErrorBand)
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double *xshifts, const double *yshifts, const double cvweight = 1.0, const bool fillcv = true, const double *weights = 0 );
+			//! Fill a lateral error band of a 3D histogram (same arguments as MUH3D::FillLatErrorBand)
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *xshifts, const double *yshifts, const double *zshifts, const double cvweight = 1.0, const bool fillcv = true, const double *weights = 0 );
+
+			//! Fill an uncorrelated error of a 1D histogram (same arguments as MUH1D::FillUncorrError)
+			bool FillUncorrError( const MUErrorBandHandle& band, const double xval, const double err, const double cvweight = 1.0 );
+
+			//! Sums of the CV
+			const Sums& GetCV() const { return fCV; };
+
+			//! The vertical error bands
+			const std::vector<Band>& GetVertErrorBands() const { return fVert; };
+
+			//! The lateral error bands
+			const std::vector<Band>& GetLatErrorBands() const { return fLat; };
+
+			//! The uncorrelated errors
+			const std::vector<UncorrError>& GetUncorrErrors() const { return fUncorr; };
+
+		private:
+			//! Global bin of a point and whether it is inside all axes
+			int FindBin( const double xval, const double yval, const double zval, bool& inRange ) const;
+
+			//! *target += value, atomically if the shard is shared
+			void Add( double *target, const double value ) const
+			{
+				if( fShared )
+					MUUniverseStore::AtomicAdd( target, value );
+				else
+					*target += value;
+			};
+
+			/*! Slot of the calling thread, from 0 to kNThreadSlots-1, or -1 if all are taken (or without C++11 threads).
+				A thread keeps its slot until it exits, and slots of threads that exited are given out again.
+				*/
+			static int GetThreadSlot();
+
+			//! Do to the sums what TH1::Fill does to a histogram
+			void FillSums( Sums& sums, const int bin, const bool inRange, const double w, const double xval, const double yval, const double zval );
+
+			//! Fill the CV and universes of a vertical error band
+			bool FillVert( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *weights, const double cvweight, const double cvWeightFromMe );
+
+			//! Fill the CV and universes of a lateral error band
+			bool FillLat( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *xshifts, const double *yshifts, const double *zshifts, const double cvweight, const bool fillcv, const double *weights );
+
+			//! Find a band by handle in one of the lookups, or -1
+			static int FindIndex( const std::vector<int>& byID, const MUErrorBandHandle& band ) { return ( band.GetID() < byID.size() ) ? byID[ band.GetID() ] : -1; };
+
+			//! Record the index of a band in one of the lookups
+			static void SetIndex( std::vector<int>& byID, const MUErrorBandHandle& band, const int index );
+
+			bool fShared;              ///< Do all adds have to be atomic?
+			bool fStatOverflows;       ///< Do under/overflow fills enter the statistics, as in the owning histogram?
+			int fDimension;            ///< Dimension of the histogram
+			unsigned int fNCells;      ///< Number of global bins, including under/overflow
+			MUBinLocator fXLocator;    ///< x binning
+			MUBinLocator fYLocator;    ///< y binning
+			MUBinLocator fZLocator;    ///< z binning
+			Sums fCV;                  ///< CV sums
+			std::vector<Band> fVert;   ///< Vertical error bands
+			std::vector<Band> fLat;    ///< Lateral error bands
+			std::vector<UncorrError> fUncorr; ///< Uncorrelated errors
+			std::vector<int> fVertByID;   ///< Index into fVert by handle ID, -1 where there is none
+			std::vector<int> fLatByID;    ///< Index into fLat by handle ID, -1 where there is none
+			std::vector<int> fUncorrByID; ///< Index into fUncorr by handle ID, -1 where there is none
+	}; //end of MUFillShard
+
+	/*! @brief The fill shards of one histogram, by worker slot.
+
+		Owns the shards.  Like MUErrorBandIndex, copies start out empty: a copied histogram never
+		merges the shards of the original.
+		*/
+	class MUFillShardSet
+	{
+		public:
+			MUFillShardSet( ) : fShared( 0 ) {};
+			MUFillShardSet( const MUFillShardSet& ) : fShared( 0 ) {};
+			MUFillShardSet& operator=( const MUFillShardSet& ) { Clear(); return *this; };
+			~MUFillShardSet() { Clear(); };
+
+			//! One more than the highest slot that was ever set
+			unsigned int GetNSlots() const { return fShards.size(); };
+
+			//! Shard of a slot, or NULL if it has none
+			MUFillShard* Get( const unsigned int slot ) const { return ( slot < fShards.size() ) ? fShards[slot] : 0; };
+
+			//! Give a slot its shard, taking ownership
+			void Set( const unsigned int slot, MUFillShard* shard );
+
+			//! The shard all threads share, or NULL if there is none
+			MUFillShard* GetShared() const { return fShared; };
+
+			//! Set the shard all threads share, taking ownership
+			void SetShared( MUFillShard* shard );
+
+			//! Delete all shards, including the shared one
+			void Clear();
+
+			//! Exchange all shards with another set, e.g. when the histogram owning them is moved
+			void Swap( MUFillShardSet& other );
+
+		private:
+			std::vector<MUFillShard*> fShards; ///< Shard of each slot, NULL for slots never used
+			MUFillShard* fShared;              ///< Shard all threads share, or NULL
+	}; //end of MUFillShardSet
+
+	/*! @brief Serializes shard creation while in scope.
+
+		All histograms share one lock, which is only taken when a worker asks for its shard, not per fill.
+		Without C++11 threads this does nothing.
+		*/
+	class MUFillShardLock
+	{
+		public:
+			MUFillShardLock( );
+			~MUFillShardLock( );
+
+		private:
+			MUFillShardLock( const MUFillShardLock& );
+			MUFillShardLock& operator=( const MUFillShardLock& );
+	}; //end of MUFillShardLock
+
+} //end of PlotUtils
+
+#endif
@@ -2,15 +2,185 @@
 #define MNV_MUH1D_cxx 1
 
 #include "PlotUtils/MUH1D.h"
+#include "PlotUtils/MUTaskPool.h"
 #include "HistogramUtils.h"
 
 #include <TMath.h>
 #include <TDirectory.h>
+#include <TList.h>
+#include <algorithm>
 
 using namespace PlotUtils;
 
 ClassImp(MUH1D);
 
+namespace
+{
+  //! Computes the covariance matrices (or variances) of a batch of systematics, one systematic per task
+  class SysErrorJob : public MUTaskPool::Job
+  {
+    public:
+      SysErrorJob( const MUH1D *hist, const std::vector<std::string>& names, const bool areaNorm, const bool matrices ) :
+        fHist( hist ), fNames( names ), fAreaNorm( areaNorm ), fMatrices( matrices ), fFirst( 0 )
+      { }
+
+      //! Start a batch of n systematics from first
+      void SetBatch( const unsigned int first, const unsigned int n )
+      {
+        fFirst = first;
+        if( fMatrices )
+          fMx.resize( n );
+        else
+          fVar.resize( n );
+      }
+
+      void Run( const unsigned int i )
+      {
+        if( fMatrices )
+        {
+          const TMatrixD mx( fHist->GetSysErrorMatrix( fNames[i], false, fAreaNorm ) );
+          fMx[ i - fFirst ].ResizeTo( mx );
+          fMx[ i - fFirst ] = mx;
+        }
+        else
+          fVar[ i - fFirst ] = fHist->GetSysErrorVariance( fNames[i], false, fAreaNorm );
+      }
+
+      std::vector<TMatrixD> fMx;                ///< Matrix of each systematic in the batch
+      std::vector< std::vector<double> > fVar;  ///< Variances of each systematic in the batch
+
+    private:
+      const MUH1D *fHist;
+      const std::vector<std::string>& fNames;
+      const bool fAreaNorm;
+      const bool fMatrices;
+      unsigned int fFirst;
+  };
+
+  /*! Add the covariance matrices (or just the variances) of these systematics to covmx (or var), in the order of names.
+      The systematics are computed on a MUTaskPool, one matrix per thread at a time, and added in order, so the sum
+      has the same bits as a serial loop.
+      */
+  void SumSysErrors( const MUH1D *hist, const std::vector<std::string>& names, const bool areaNorm, TMatrixD *covmx, std::vector<double> *var )
+  {
+    //! Threads only pay off once there are about a million multiply-adds to share
+    const double nCells = hist->GetNcells();
+    double work = 0.;
+    for( std::vector<std::string>::const_iterator i = names.begin(); i != names.end(); ++i )
+    {
+      unsigned int nUniverses = 1;
+      if( hist->HasVertErrorBand( *i ) )
+        nUniverses = hist->GetVertErrorBand( *i )->GetNHists();
+      else if( hist->HasLatErrorBand( *i ) )
+        nUniverses = hist->GetLatErrorBand( *i )->GetNHists();
+      work += nCells * ( covmx ? nCells : 1. ) * nUniverses;
+    }
+    unsigned int nThreads = ( 1e6 < work ) ? MUTaskPool::GetNThreads() : 1;
+
+    //! Big matrices are computed one at a time instead, each on all threads (MUUniverseStore::CalcCovariance)
+    if( covmx && MUCovarianceCache::GetMaxRows() < nCells )
+      nThreads = 1;
+    const unsigned int batchSize = covmx ? nThreads : names.size();
+
+    SysErrorJob job( hist, names, areaNorm, 0 != covmx );
+    for( unsigned int first = 0; first < names.size(); first += batchSize )
+    {
+      const unsigned int last = std::min( (unsigned int)names.size(), first + batchSize );
+      job.SetBatch( first, last - first );
+      MUTaskPool::Run( job, first, last, nThreads );
+
+      for( unsigned int i = 0; i != last - first; ++i )
+      {
+        if( covmx )
+          *covmx += job.fMx[i];
+        else
+        {
+          for( unsigned int k = 0; k != var->size(); ++k )
+            (*var)[k] += job.fVar[i][k];
+        }
+      }
+    }
+  }
+
+  /*! Divides or multiplies the error bands of a MUH1D, one band per task.
+      Each band only reads the bands of the same name in the operands, so the bands can be done on several threads.
+      */
+  class BandArithmeticJob : public MUTaskPool::Job
+  {
+    public:
+      enum EOp { kDivide, kDivideSingle, kMultiply, kMultiplySingle };
+
+      BandArithmeticJob( const EOp op, const TH1 *single, const Double_t c1, const Double_t c2, Option_t *option = "" ) :
+        fOp( op ), fSingle( single ), fC1( c1 ), fC2( c2 ), fOption( option ), fWork( 0. )
+      { }
+
+      //! Queue band = err1 op err2 (err2 is unused for the Single ops)
+      void AddBand( MULatErrorBand *band, const MULatErrorBand *err1, const MULatErrorBand *err2 )
+      {
+        fLat.push_back( band );
+        fLat1.push_back( err1 );
+        fLat2.push_back( err2 );
+        fWork += double( band->GetNcells() ) * band->GetNHists();
+      }
+
+      void AddBand( MUVertErrorBand *band, const MUVertErrorBand *err1, const MUVertErrorBand *err2 )
+      {
+        fVert.push_back( band );
+        fVert1.push_back( err1 );
+        fVert2.push_back( err2 );
+        fWork += double( band->GetNcells() ) * band->GetNHists();
+      }
+
+      //! Do all queued bands, lateral first, on threads once there are about a million bins to share.
+      //! Returns the result of the last band like the serial loops did, or success if there are no bands.
+      Bool_t RunAll( const Bool_t success )
+      {
+        const unsigned int n = fLat.size() + fVert.size();
+        if( 0 == n )
+          return success;
+        fResults.assign( n, 0 );
+        MUTaskPool::Run( *this, 0, n, ( 1e6 < fWork ) ? 0 : 1 );
+        return fResults.back();
+      }
+
+      void Run( const unsigned int i )
+      {
+        if( i < fLat.size() )
+          fResults[i] = Apply( fLat[i], fLat1[i], fLat2[i] );
+        else
+        {
+          const unsigned int j = i - fLat.size();
+          fResults[i] = Apply( fVert[j], fVert1[j], fVert2[j] );
+        }
+      }
+
+    private:
+      template<class BAND>
+      Bool_t Apply( BAND *band, const BAND *err1, const BAND *err2 ) const
+      {
+        switch( fOp )
+        {
+          case kDivide:         return band->Divide( err1, err2, fC1, fC2, fOption );
+          case kDivideSingle:   return band->DivideSingle( err1, fSingle, fC1, fC2, fOption );
+          case kMultiply:       return band->Multiply( err1, err2, fC1, fC2 );
+          case kMultiplySingle: return band->MultiplySingle( err1, fSingle, fC1, fC2 );
+        }
+        return kFALSE;
+      }
+
+      const EOp fOp;
+      const TH1 *fSingle;
+      const Double_t fC1, fC2;
+      Option_t *fOption;
+      double fWork;                                 ///< Bins x universes of all queued bands
+      std::vector<MULatErrorBand*> fLat;
+      std::vector<const MULatErrorBand*> fLat1, fLat2;
+      std::vector<MUVertErrorBand*> fVert;
+      std::vector<const MUVertErrorBand*> fVert1, fVert2;
+      std::vector<char> fResults;                   ///< Result of each band (not vector<bool>, which threads cannot write separately)
+  };
+}
+
 //==================================================================================
 // CONSTRUCTORS
 //==================================================================================
@@ -84,15 +254,20 @@ MUH1D& MUH1D::operator=( const MUH1D& h )
   for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
     delete it->second;
   fVertErrorBandMap.clear();
+  fVertErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
     delete it->second;
   fLatErrorBandMap.clear();
+  fLatErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   //delete and clear all uncorr errors
   for( std::map<std::string, TH1D*>::iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
     delete it->second;
   fUncorrErrorMap.clear();
+  fUncorrErrorIndex.Invalidate();
 
 
   // Then deeop copy the variables
@@ -101,6 +276,77 @@ MUH1D& MUH1D::operator=( const MUH1D& h )
   return *this;
 }
 
+TObject* MUH1D::Clone( const char* newname /*= ""*/ ) const
+{
+  // A class derived from MUH1D is cloned by ROOT, which knows all of its members
+  if( IsA() != MUH1D::Class() )
+    return TH1D::Clone( newname );
+
+  // The copy constructor shares the universes instead of copying them
+  MUH1D *h = new MUH1D( *this );
+
+  // TH1::Clone also clones the attached functions, which the copy constructor does not
+  TList *functions = GetListOfFunctions();
+  for( int i = 0; functions && i < functions->GetSize(); ++i )
+    h->GetListOfFunctions()->Add( functions->At(i)->Clone() );
+
+  if( newname && strlen(newname) )
+    h->SetName( newname );
+  return h;
+}
+
+#if __cplusplus >= 201103L
+MUH1D::MUH1D( MUH1D&& h ) noexcept :
+  TH1D()
+{
+  // Take the bins and the error bands instead of copying them
+  MUHist::MoveHistogram( *this, h );
+  MoveFrom( h );
+}
+
+MUH1D& MUH1D::operator=( MUH1D&& h ) noexcept
+{
+  // If this is me, there is nothing to move
+  if( this == &h )
+    return *this;
+
+  // Take the bins of h
+  MUHist::MoveHistogram( *this, h );
+
+  // Delete all error bands, uncorrelated errors and matrices
+  ClearAllErrorBands();
+  fFillShards.Clear();
+
+  MoveFrom( h );
+
+  return *this;
+}
+
+void MUH1D::MoveFrom( MUH1D& h )
+{
+  fNormBinWidth = h.fNormBinWidth;
+
+  // The maps hold pointers, so swapping them hands over every band and matrix as it is
+  fVertErrorBandMap.swap( h.fVertErrorBandMap );
+  fLatErrorBandMap.swap( h.fLatErrorBandMap );
+  fUncorrErrorMap.swap( h.fUncorrErrorMap );
+  fSysErrorMatrix.swap( h.fSysErrorMatrix );
+  fRemovedSysErrorMatrix.swap( h.fRemovedSysErrorMatrix );
+
+  // Fills still in the shards belong to the bands, so they go along
+  fFillShards.Swap( h.fFillShards );
+
+  fVertErrorBandIndex.Invalidate();
+  fLatErrorBandIndex.Invalidate();
+  h.fVertErrorBandIndex.Invalidate();
+  h.fLatErrorBandIndex.Invalidate();
+  fUncorrErrorIndex.Invalidate();
+  h.fUncorrErrorIndex.Invalidate();
+  fCacheVersion.Touch();
+  h.fCacheVersion.Touch();
+}
+#endif
+
 void MUH1D::DeepCopy( const MUH1D& h )
 {
   // Set bin norm width
@@ -116,15 +362,20 @@ void MUH1D::DeepCopy( const MUH1D& h )
   std::vector<std::string> vertNames = h.GetVertErrorBandNames();
   for( std::vector<std::string>::iterator name = vertNames.begin(); name != vertNames.end(); ++name )
     fVertErrorBandMap[*name] = new MUVertErrorBand( *h.GetVertErrorBand(*name) );
+  fVertErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   std::vector<std::string> latNames = h.GetLatErrorBandNames();
   for( std::vector<std::string>::iterator name = latNames.begin(); name != latNames.end(); ++name )
     fLatErrorBandMap[*name] = new MULatErrorBand( *h.GetLatErrorBand(*name) );
+  fLatErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   //copy all uncorr errors
   std::vector<std::string> uncorrNames = h.GetUncorrErrorNames();
   for( std::vector<std::string>::iterator name = uncorrNames.begin(); name != uncorrNames.end(); ++name )
     fUncorrErrorMap[*name] = new TH1D( *h.GetUncorrError(*name) );
+  fUncorrErrorIndex.Invalidate();
 
   //copy all "special" error matrices
   //todo: These were unfortunately named.  There is not always a clear distinction between these "special" error matrices and those derived from error bands.
@@ -244,18 +495,16 @@ void MUH1D::RenameHistosAndErrorBands( const std::string& name )
   {
     MUVertErrorBand* tmp_band = this->GetVertErrorBand(*itName);
     std::string band_name = std::string(name + "_" + *itName);
+    //! renames the universes too
     tmp_band->SetName( band_name.c_str() );
-    for (unsigned int i=0; i < tmp_band->GetNHists(); ++i)
-      tmp_band->GetHist(i)->SetName( Form("%s_universe%d",band_name.c_str(),i) );
   }
 
   for (std::vector<std::string>::iterator itName = lat_errBandNames.begin(); itName != lat_errBandNames.end(); ++itName) 
   {
     MULatErrorBand* tmp_band = this->GetLatErrorBand(*itName);
     std::string band_name = std::string(name + "_" + *itName);
+    //! renames the universes too
     tmp_band->SetName( band_name.c_str() );
-    for (unsigned int i=0; i < tmp_band->GetNHists(); ++i)
-      tmp_band->GetHist(i)->SetName( Form("%s_universe%d",band_name.c_str(),i) );
   }
 
   for (std::vector<std::string>::iterator itName = uncorr_errBandNames.begin(); itName != uncorr_errBandNames.end(); ++itName)
@@ -277,14 +526,19 @@ void MUH1D::ClearAllErrorBands()
   for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
     delete it->second;
   fVertErrorBandMap.clear();
+  fVertErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
     delete it->second;
   fLatErrorBandMap.clear();
+  fLatErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   for( std::map<std::string, TH1D*>::iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
     delete it->second;
   fUncorrErrorMap.clear();
+  fUncorrErrorIndex.Invalidate();
 
 }
 
@@ -310,6 +564,8 @@ bool MUH1D::AddLatErrorBand( const std::string& name, const int nhists /* = -1 *
     fLatErrorBandMap[name] = new MULatErrorBand( errName, (TH1D*)this, nhists );
   else
     fLatErrorBandMap[name] = new MULatErrorBand( errName, (TH1D*)this );
+  fLatErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   gDirectory->cd(oldDir);
 
@@ -335,6 +591,8 @@ bool MUH1D::AddLatErrorBand( const std::string& name, const std::vector<TH1D*>&
 
   // Set the ErrorBand
   fLatErrorBandMap[name] = new MULatErrorBand( errName, (TH1D*)this, base );
+  fLatErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   gDirectory->cd(oldDir);
 
@@ -400,6 +658,8 @@ bool MUH1D::AddVertErrorBand( const std::string& name, const int nhists /* = -1
     fVertErrorBandMap[name] = new MUVertErrorBand( errName, (TH1D*)this, nhists );
   else
     fVertErrorBandMap[name] = new MUVertErrorBand( errName, (TH1D*)this );
+  fVertErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   gDirectory->cd(oldDir);
 
@@ -425,6 +685,8 @@ bool MUH1D::AddVertErrorBand( const std::string& name, const std::vector<TH1D*>&
 
   // Set the ErrorBand
   fVertErrorBandMap[name] = new MUVertErrorBand( errName, (TH1D*)this, base );
+  fVertErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   gDirectory->cd(oldDir);
 
@@ -451,6 +713,7 @@ bool MUH1D::AddUncorrError( const std::string& name )
 
   // Set the ErrorBand in the map
   fUncorrErrorMap[name] = uncorrHist;
+  fUncorrErrorIndex.Invalidate();
 
   return true;
 }
@@ -483,6 +746,7 @@ bool MUH1D::AddUncorrError( const std::string& name, const TH1D *hist, bool errI
 
   // Set the ErrorBand in the map
   fUncorrErrorMap[name] = uncorrHist;
+  fUncorrErrorIndex.Invalidate();
 
   return true;
 }
@@ -509,6 +773,7 @@ bool MUH1D::AddUncorrErrorAndFillWithCV( const std::string& name )
 
   // Set the ErrorBand in the map
   fUncorrErrorMap[name] = uncorrHist;
+  fUncorrErrorIndex.Invalidate();
 
   return true;
 }
@@ -588,29 +853,20 @@ bool MUH1D::AddMissingErrorBandsAndFillWithCV( const MUH1D& ref )
 
 bool MUH1D::HasLatErrorBand( const std::string& name ) const
 {
-  // Check the MULatErrorBands
-  if( fLatErrorBandMap.find( name ) != fLatErrorBandMap.end() )
-    return true;
-
-  return false;
+  //! Check the MULatErrorBands
+  return fLatErrorBandIndex.Find( name, fLatErrorBandMap ) != NULL;
 }
 
 bool MUH1D::HasVertErrorBand( const std::string& name ) const
 {
-  // Check the MUVertErrorBands
-  if( fVertErrorBandMap.find( name ) != fVertErrorBandMap.end() )
-    return true;
-
-  return false;
+  //! Check the MUVertErrorBands
+  return fVertErrorBandIndex.Find( name, fVertErrorBandMap ) != NULL;
 }
 
 bool MUH1D::HasUncorrError( const std::string& name ) const
 {
   // Check the uncorr errors
-  if( fUncorrErrorMap.find( name ) != fUncorrErrorMap.end() )
-    return true;
-
-  return false;
+  return fUncorrErrorIndex.Find( name, fUncorrErrorMap ) != NULL;
 }
 
 
@@ -651,75 +907,126 @@ bool MUH1D::HasRemovedErrorMatrix( const std::string& name ) const
 
 MULatErrorBand* MUH1D::GetLatErrorBand( const std::string& name )
 {
-  std::map<std::string, MULatErrorBand*>::iterator i = fLatErrorBandMap.find( name );
-  if( i == fLatErrorBandMap.end() )
-  {
+  MULatErrorBand *band = fLatErrorBandIndex.Find( name, fLatErrorBandMap );
+  if( !band )
     Warning( "MUH1D::GetLatErrorBand", "There is no lateral error band with name \"%s\".  Returning NULL.", name.c_str());
-    return NULL;
-  }
 
-  return i->second;
+  return band;
 }
 
 MUVertErrorBand* MUH1D::GetVertErrorBand( const std::string& name )
 {
-  std::map<std::string, MUVertErrorBand*>::iterator i = fVertErrorBandMap.find( name );
-  if( i == fVertErrorBandMap.end() )
-  {
+  MUVertErrorBand *band = fVertErrorBandIndex.Find( name, fVertErrorBandMap );
+  if( !band )
     Warning( "MUH1D::GetVertErrorBand", "There is no vertical error band with name \"%s\".  Returning NULL.", name.c_str());
-    return NULL;
-  }
 
-  return i->second;
+  return band;
 }
 
 
 const MULatErrorBand* MUH1D::GetLatErrorBand( const std::string& name ) const
 {
-  std::map<std::string, MULatErrorBand*>::const_iterator i = fLatErrorBandMap.find( name );
-  if( i == fLatErrorBandMap.end() )
-  {
+  MULatErrorBand *band = fLatErrorBandIndex.Find( name, fLatErrorBandMap );
+  if( !band )
     Warning( "MUH1D::GetLatErrorBand", "There is no lateral error band with name \"%s\".  Returning NULL.", name.c_str());
-    return NULL;
-  }
 
-  return i->second;
+  return band;
 }
 
 const MUVertErrorBand* MUH1D::GetVertErrorBand( const std::string& name ) const
 {
-  std::map<std::string, MUVertErrorBand*>::const_iterator i = fVertErrorBandMap.find( name );
-  if( i == fVertErrorBandMap.end() )
-  {
+  MUVertErrorBand *band = fVertErrorBandIndex.Find( name, fVertErrorBandMap );
+  if( !band )
     Warning( "MUH1D::GetVertErrorBand", "There is no vertical error band with name \"%s\".  Returning NULL.", name.c_str());
-    return NULL;
+
+  return band;
+}
+
+MUErrorBandHandle MUH1D::GetVertErrorBandHandle( const std::string& name ) const
+{
+  if( !fVertErrorBandIndex.Find( name, fVertErrorBandMap ) )
+  {
+    Warning( "MUH1D::GetVertErrorBandHandle", "There is no vertical error band with name \"%s\".  Returning an invalid handle.", name.c_str());
+    return MUErrorBandHandle();
   }
 
-  return i->second;
+  return MUErrorBandHandle::Find( name );
 }
 
-TH1D* MUH1D::GetUncorrError( const std::string& name )
+MUErrorBandHandle MUH1D::GetLatErrorBandHandle( const std::string& name ) const
 {
-  std::map<std::string, TH1D*>::const_iterator i = fUncorrErrorMap.find( name );
-  if( i == fUncorrErrorMap.end() )
+  if( !fLatErrorBandIndex.Find( name, fLatErrorBandMap ) )
   {
-    Warning( "MUH1D::GetUncorrError", "There is no uncorrelated error with name \"%s\".  Returning NULL.", name.c_str());
-    return NULL;
+    Warning( "MUH1D::GetLatErrorBandHandle", "There is no lateral error band with name \"%s\".  Returning an invalid handle.", name.c_str());
+    return MUErrorBandHandle();
   }
 
-  return i->second;
+  return MUErrorBandHandle::Find( name );
 }
 
-const TH1D* MUH1D::GetUncorrError( const std::string& name ) const
+MUErrorBandHandle MUH1D::GetUncorrErrorHandle( const std::string& name ) const
 {
-  std::map<std::string, TH1D*>::const_iterator i = fUncorrErrorMap.find( name );
-  if( i == fUncorrErrorMap.end() )
+  if( !fUncorrErrorIndex.Find( name, fUncorrErrorMap ) )
   {
-    Warning( "MUH1D::GetUncorrError", "There is no uncorrelated error with name \"%s\".  Returning NULL.", name.c_str());
-    return NULL;
+    Warning( "MUH1D::GetUncorrErrorHandle", "There is no uncorrelated error with name \"%s\".  Returning an invalid handle.", name.c_str());
+    return MUErrorBandHandle();
   }
 
-  return i->second;
+  return MUErrorBandHandle::Find( name );
+}
+
+MUVertErrorBand* MUH1D::GetVertErrorBand( const MUErrorBandHandle& band )
+{
+  MUVertErrorBand *errBand = fVertErrorBandIndex.Find( band, fVertErrorBandMap );
+  if( !errBand )
+    Warning( "MUH1D::GetVertErrorBand", "There is no vertical error band with name \"%s\".  Returning NULL.", band.GetName().c_str());
+
+  return errBand;
+}
+
+const MUVertErrorBand* MUH1D::GetVertErrorBand( const MUErrorBandHandle& band ) const
+{
+  MUVertErrorBand *errBand = fVertErrorBandIndex.Find( band, fVertErrorBandMap );
+  if( !errBand )
+    Warning( "MUH1D::GetVertErrorBand", "There is no vertical error band with name \"%s\".  Returning NULL.", band.GetName().c_str());
+
+  return errBand;
+}
+
+MULatErrorBand* MUH1D::GetLatErrorBand( const MUErrorBandHandle& band )
+{
+  MULatErrorBand *errBand = fLatErrorBandIndex.Find( band, fLatErrorBandMap );
+  if( !errBand )
+    Warning( "MUH1D::GetLatErrorBand", "There is no lateral error band with name \"%s\".  Returning NULL.", band.GetName().c_str());
+
+  return errBand;
+}
+
+const MULatErrorBand* MUH1D::GetLatErrorBand( const MUErrorBandHandle& band ) const
+{
+  MULatErrorBand *errBand = fLatErrorBandIndex.Find( band, fLatErrorBandMap );
+  if( !errBand )
+    Warning( "MUH1D::GetLatErrorBand", "There is no lateral error band with name \"%s\".  Returning NULL.", band.GetName().c_str());
+
+  return errBand;
+}
+
+TH1D* MUH1D::GetUncorrError( const std::string& name )
+{
+  TH1D *hist = fUncorrErrorIndex.Find( name, fUncorrErrorMap );
+  if( !hist )
+    Warning( "MUH1D::GetUncorrError", "There is no uncorrelated error with name \"%s\".  Returning NULL.", name.c_str());
+
+  return hist;
+}
+
+const TH1D* MUH1D::GetUncorrError( const std::string& name ) const
+{
+  TH1D *hist = fUncorrErrorIndex.Find( name, fUncorrErrorMap );
+  if( !hist )
+    Warning( "MUH1D::GetUncorrError", "There is no uncorrelated error with name \"%s\".  Returning NULL.", name.c_str());
+
+  return hist;
 }
 
 TH1D MUH1D::GetUncorrErrorAsHist( const std::string& name, bool asFrac ) const
@@ -861,6 +1168,8 @@ MULatErrorBand* MUH1D::PopLatErrorBand( const std::string& name )
   //get a pointer to the error band and remove it from the MUH1D's vector
   MULatErrorBand* rval = i->second;
   fLatErrorBandMap.erase(i);
+  fLatErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   return rval;
 }
@@ -879,6 +1188,8 @@ MUVertErrorBand* MUH1D::PopVertErrorBand( const std::string& name )
   //get a pointer to the error band and remove it from the MUH1D's vector
   MUVertErrorBand* rval = i->second;
   fVertErrorBandMap.erase(i);
+  fVertErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
 
   return rval;
 }
@@ -895,6 +1206,7 @@ TH1D* MUH1D::PopUncorrError( const std::string& name )
   //get a pointer to the uncorr error and remove it from the MUH1D's vector
   TH1D* rval = i->second;
   fUncorrErrorMap.erase(i);
+  fUncorrErrorIndex.Invalidate();
 
   return rval;
 } 
@@ -910,6 +1222,8 @@ bool MUH1D::PushErrorBand( const std::string& name, MUVertErrorBand* err )
     delete PopVertErrorBand(name);
   }
   fVertErrorBandMap[name] = err;
+  fVertErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
   return true;
 }
 
@@ -921,6 +1235,8 @@ bool MUH1D::PushErrorBand( const std::string& name, MULatErrorBand* err )
     delete PopLatErrorBand(name);
   }
   fLatErrorBandMap[name] = err;
+  fLatErrorBandIndex.Invalidate();
+  fCacheVersion.Touch();
   return true;
 }
 
@@ -936,6 +1252,7 @@ bool MUH1D::PushUncorrError( const std::string& name, TH1D* err )
     err->Sumw2();
 
   fUncorrErrorMap[name] = err;
+  fUncorrErrorIndex.Invalidate();
   return true;
 }
 
@@ -1041,6 +1358,53 @@ bool MUH1D::FillLatErrorBand( const std::string& name, const double val, const d
   return false;
 }
 
+bool MUH1D::FillLatErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *vals, const double *shifts, const double *cvweights /* = 0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+  //! Try to fill a lateral error band
+  MULatErrorBand *lat = GetLatErrorBand( name );
+  if( lat )
+    return lat->FillBatch( nEvents, vals, shifts, cvweights, fillcv, weights );
+
+  Warning( "MUH1D::FillLatErrorBandBatch", "Could not find a lateral error band to fill with name = %s", name.c_str());
+  return false;
+}
+
+bool MUH1D::FillVertErrorBand( const MUErrorBandHandle& band, const double val, const double * weights, const double cvweight /* = 1.0 */, double cvWeightFromMe /*= 1.*/ )
+{
+  MUVertErrorBand *vert = GetVertErrorBand( band );
+  if( vert )
+    return vert->Fill( val, weights, cvweight, cvWeightFromMe );
+
+  return false;
+}
+
+bool MUH1D::FillVertErrorBand( const MUErrorBandHandle& band, const double val, const double weightDown, const double weightUp, const double cvweight /* = 1.0 */, double cvWeightFromMe /*= 1.*/ )
+{
+  MUVertErrorBand *vert = GetVertErrorBand( band );
+  if( vert )
+    return vert->Fill( val, weightDown, weightUp, cvweight, cvWeightFromMe );
+
+  return false;
+}
+
+bool MUH1D::FillLatErrorBand( const MUErrorBandHandle& band, const double val, const double * shifts, const double cvweight /* = 1.0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+  MULatErrorBand *lat = GetLatErrorBand( band );
+  if( lat )
+    return lat->Fill( val, shifts, cvweight, fillcv, weights );
+
+  return false;
+}
+
+bool MUH1D::FillLatErrorBand( const MUErrorBandHandle& band, const double val, const double shiftDown, const double shiftUp, const double cvweight /* = 1.0 */, const bool fillcv /* = true */ )
+{
+  MULatErrorBand *lat = GetLatErrorBand( band );
+  if( lat )
+    return lat->Fill( val, shiftDown, shiftUp, cvweight, fillcv );
+
+  return false;
+}
+
 
 bool MUH1D::FillVertErrorBand( const std::string& name, const double val, const std::vector<double>& weights, const double cvweight /* = 1.0 */, double cvWeightFromMe /*= 1.*/)
 {
@@ -1069,6 +1433,17 @@ bool MUH1D::FillVertErrorBand( const std::string& name, const double val, const
   return false;
 }
 
+bool MUH1D::FillVertErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *vals, const double *weights, const double *cvweights /* = 0 */, const double *cvWeightsFromMe /* = 0 */ )
+{
+  //! Try to fill a vertical error band
+  MUVertErrorBand *vert = GetVertErrorBand( name );
+  if( vert )
+    return vert->FillBatch( nEvents, vals, weights, cvweights, cvWeightsFromMe );
+
+  Warning( "MUH1D::FillVertErrorBandBatch", "Could not find a vertical error band to fill with name = %s", name.c_str());
+  return false;
+}
+
 
 bool MUH1D::FillUncorrError( const std::string& name, const double val, const double err, const double cvweight /*= 1.0*/ )
 {
@@ -1080,7 +1455,13 @@ bool MUH1D::FillUncorrError( const std::string& name, const double val, const do
   }
 
   //find the bin
-  int bin = hist->FindBin(val);
+  FillUncorrErrorAtBin( hist, hist->FindBin(val), err, cvweight );
+
+  return true;
+}
+
+void MUH1D::FillUncorrErrorAtBin( TH1D *hist, const int bin, const double err, const double cvweight )
+{
   //add to bin content, which doesn't change error
   hist->AddBinContent( bin, cvweight );
   //add to bin error so that binErr/binContent = avg( err/cvweight ) always
@@ -1092,8 +1473,188 @@ bool MUH1D::FillUncorrError( const std::string& name, const double val, const do
   double stats[4] = {0.};
   this->GetStats(stats);
   hist->PutStats(stats);
+}
 
-  return true;
+bool MUH1D::FillAll( const double val, const double cvweight, const MUEventUniverseWeights& event )
+{
+  //fill the CV and find the bin once for all error bands, which share our binning
+  int bin = this->TH1D::Fill( val, cvweight );
+  if( bin == -1 )
+    bin = FindBin( val );
+
+  bool rval = true;
+  unsigned int nVertFilled = 0, nLatFilled = 0, nUncorrFilled = 0;
+
+  const std::vector<MUEventUniverseWeights::VertEntry>& vertEntries = event.GetVertEntries();
+  for( std::vector<MUEventUniverseWeights::VertEntry>::const_iterator i = vertEntries.begin(); i != vertEntries.end(); ++i )
+  {
+    MUVertErrorBand *vert = fVertErrorBandIndex.Find( i->band, fVertErrorBandMap );
+    if( !vert || vert->GetNHists() != i->nUniverses )
+    {
+      Warning( "MUH1D::FillAll", "Could not fill vertical error band \"%s\" with %d universes.", i->band.GetName().c_str(), i->nUniverses );
+      rval = false;
+      continue;
+    }
+    vert->FillAtBin( bin, val, event.GetValues( i->offset ), cvweight, i->cvWeightFromMe );
+    ++nVertFilled;
+  }
+
+  const std::vector<MUEventUniverseWeights::LatEntry>& latEntries = event.GetLatEntries();
+  for( std::vector<MUEventUniverseWeights::LatEntry>::const_iterator i = latEntries.begin(); i != latEntries.end(); ++i )
+  {
+    MULatErrorBand *lat = fLatErrorBandIndex.Find( i->band, fLatErrorBandMap );
+    if( !lat || lat->GetNHists() != i->nUniverses )
+    {
+      Warning( "MUH1D::FillAll", "Could not fill lateral error band \"%s\" with %d universes.", i->band.GetName().c_str(), i->nUniverses );
+      rval = false;
+      continue;
+    }
+    const double *weights = ( i->weightsOffset < 0 ) ? 0 : event.GetValues( i->weightsOffset );
+    lat->FillAtBin( bin, val, event.GetValues( i->offset ), cvweight, true, weights );
+    ++nLatFilled;
+  }
+
+  const std::vector<MUEventUniverseWeights::UncorrEntry>& uncorrEntries = event.GetUncorrEntries();
+  for( std::vector<MUEventUniverseWeights::UncorrEntry>::const_iterator i = uncorrEntries.begin(); i != uncorrEntries.end(); ++i )
+  {
+    TH1D *hist = fUncorrErrorIndex.Find( i->band, fUncorrErrorMap );
+    if( !hist )
+    {
+      Warning( "MUH1D::FillAll", "Could not find an uncorrelated error to fill with name = %s", i->band.GetName().c_str() );
+      rval = false;
+      continue;
+    }
+    FillUncorrErrorAtBin( hist, bin, i->err, cvweight );
+    ++nUncorrFilled;
+  }
+
+  //bands event does not list are filled as if all universes were the CV (weights 1, shifts 0, error 0),
+  //so that their CVs stay the CV of this MUH1D.  Only looked for when not every band of a kind was filled.
+  if( nVertFilled != fVertErrorBandMap.size() )
+  {
+    for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+    {
+      bool listed = false;
+      for( std::vector<MUEventUniverseWeights::VertEntry>::const_iterator i = vertEntries.begin(); i != vertEntries.end() && !listed; ++i )
+        listed = ( fVertErrorBandIndex.Find( i->band, fVertErrorBandMap ) == it->second );
+      if( listed )
+        continue;
+      const std::vector<double> weights( it->second->GetNHists(), 1. );
+      it->second->FillAtBin( bin, val, weights.empty() ? 0 : &weights[0], cvweight );
+    }
+  }
+
+  if( nLatFilled != fLatErrorBandMap.size() )
+  {
+    for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+    {
+      bool listed = false;
+      for( std::vector<MUEventUniverseWeights::LatEntry>::const_iterator i = latEntries.begin(); i != latEntries.end() && !listed; ++i )
+        listed = ( fLatErrorBandIndex.Find( i->band, fLatErrorBandMap ) == it->second );
+      if( listed )
+        continue;
+      const std::vector<double> shifts( it->second->GetNHists(), 0. );
+      it->second->FillAtBin( bin, val, shifts.empty() ? 0 : &shifts[0], cvweight );
+    }
+  }
+
+  if( nUncorrFilled != fUncorrErrorMap.size() )
+  {
+    for( std::map<std::string, TH1D*>::iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
+    {
+      bool listed = false;
+      for( std::vector<MUEventUniverseWeights::UncorrEntry>::const_iterator i = uncorrEntries.begin(); i != uncorrEntries.end() && !listed; ++i )
+        listed = ( fUncorrErrorIndex.Find( i->band, fUncorrErrorMap ) == it->second );
+      if( !listed )
+        FillUncorrErrorAtBin( it->second, bin, 0., cvweight );
+    }
+  }
+
+  return rval;
+}
+
+
+MUFillShard& MUH1D::GetFillShard( const unsigned int slot )
+{
+  MUFillShardLock lock;
+  MUFillShard *shard = fFillShards.Get( slot );
+  if( shard )
+    return *shard;
+
+  //the shard gets every band we have now
+  shard = new MUFillShard( this );
+  for( std::map<std::string, MUVertErrorBand*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+    shard->AddVertErrorBand( MUErrorBandHandle::Intern( i->first ), i->second->GetNHists() );
+  for( std::map<std::string, MULatErrorBand*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+    shard->AddLatErrorBand( MUErrorBandHandle::Intern( i->first ), i->second->GetNHists() );
+  for( std::map<std::string, TH1D*>::const_iterator i = fUncorrErrorMap.begin(); i != fUncorrErrorMap.end(); ++i )
+    shard->AddUncorrError( MUErrorBandHandle::Intern( i->first ) );
+
+  fFillShards.Set( slot, shard );
+  return *shard;
+}
+
+void MUH1D::MergeFillShards()
+{
+  //always in slot order, so the sums come out the same however the threads ran
+  for( unsigned int slot = 0; slot != fFillShards.GetNSlots(); ++slot )
+  {
+    const MUFillShard *shard = fFillShards.Get( slot );
+    if( !shard )
+      continue;
+
+    shard->GetCV().AddTo( this );
+
+    const std::vector<MUFillShard::Band>& vertBands = shard->GetVertErrorBands();
+    for( std::vector<MUFillShard::Band>::const_iterator i = vertBands.begin(); i != vertBands.end(); ++i )
+    {
+      MUVertErrorBand *vert = GetVertErrorBand( i->band );
+      if( !vert )
+      {
+        Warning( "MUH1D::MergeFillShards", "Vertical error band \"%s\" was removed while filling.  Its shard contents are lost.", i->band.GetName().c_str() );
+        continue;
+      }
+      i->cv.AddTo( vert );
+      vert->GetUniverseStore().Add( i->universes );
+    }
+
+    const std::vector<MUFillShard::Band>& latBands = shard->GetLatErrorBands();
+    for( std::vector<MUFillShard::Band>::const_iterator i = latBands.begin(); i != latBands.end(); ++i )
+    {
+      MULatErrorBand *lat = GetLatErrorBand( i->band );
+      if( !lat )
+      {
+        Warning( "MUH1D::MergeFillShards", "Lateral error band \"%s\" was removed while filling.  Its shard contents are lost.", i->band.GetName().c_str() );
+        continue;
+      }
+      i->cv.AddTo( lat );
+      lat->GetUniverseStore().Add( i->universes );
+    }
+
+    const std::vector<MUFillShard::UncorrError>& uncorrErrors = shard->GetUncorrErrors();
+    for( std::vector<MUFillShard::UncorrError>::const_iterator i = uncorrErrors.begin(); i != uncorrErrors.end(); ++i )
+    {
+      TH1D *hist = fUncorrErrorIndex.Find( i->band, fUncorrErrorMap );
+      if( !hist )
+      {
+        Warning( "MUH1D::MergeFillShards", "Uncorrelated error \"%s\" was removed while filling.  Its shard contents are lost.", i->band.GetName().c_str() );
+        continue;
+      }
+      //same as FillUncorrErrorAtBin: content adds up, and so does the error
+      for( unsigned int bin = 0; bin != i->content.size(); ++bin )
+      {
+        if( i->content[bin] == 0. && i->err[bin] == 0. )
+          continue;
+        hist->AddBinContent( bin, i->content[bin] );
+        hist->SetBinError( bin, i->err[bin] + hist->GetBinError(bin) );
+      }
+      double stats[4] = {0.};
+      this->GetStats(stats);
+      hist->PutStats(stats);
+    }
+  }
+
+  fFillShards.Clear();
 }
 
 
@@ -1114,6 +1675,7 @@ TH1D MUH1D::GetCVHistoWithStatError() const
   TH1D err = GetStatError( false );
 
   // Create a copy of this histogram and rename it
+  TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
   TH1D rval( *this );
   std::string tmpName( std::string( GetName() ) + "_CV_WithStatErr" );
   rval.SetName( tmpName.c_str() );
@@ -1130,6 +1692,7 @@ TH1D MUH1D::GetCVHistoWithError( bool includeStat /* = true */ , bool cov_area_n
   TH1D err = GetTotalError( includeStat , false, cov_area_normalize);
 
   // Create a copy of this histogram and rename it
+  TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
   TH1D rval( *this );
   std::string tmpName( std::string( GetName() ) + "_CV_WithErr" );
   rval.SetName( tmpName.c_str() );
@@ -1146,6 +1709,7 @@ TH1D MUH1D::GetTotalError(
     bool cov_area_normalize /*= false */) const
 {
   // Make a copy of this histogram as a TH1D and rename it
+  TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
   TH1D err( *this );
   err.Reset();
   std::string tmpName( std::string(GetName()) + "_TotalError");
@@ -1154,12 +1718,12 @@ TH1D MUH1D::GetTotalError(
   const int highBin = GetNbinsX() + 1;
   const int lowBin = 0;
 
-  // Get the Total Error Matrix
-  TMatrixD errMatrix = GetTotalErrorMatrix(includeStat, asFrac, cov_area_normalize);
+  // Get the total variance of each bin; the covariances are not needed
+  const std::vector<double> errVar = GetTotalErrorVariance(includeStat, asFrac, cov_area_normalize);
 
   for( int iBin = lowBin; iBin <= highBin; ++iBin )
   {
-    double derr = errMatrix[iBin][iBin];
+    double derr = errVar[iBin];
     err.SetBinContent( iBin, ( derr > 0 ) ? sqrt(derr): 0. );
   }
 
@@ -1183,14 +1747,31 @@ TMatrixD MUH1D::GetTotalErrorMatrix(
   const int lowBin = 0;
   TMatrixD covmx(highBin+1,highBin+1);
 
-  std::vector<std::string> names = GetSysErrorMatricesNames();
-  for (std::vector<std::string>::const_iterator itName = names.begin() ; itName != names.end() ; ++itName)
+  // The sum of the systematic matrices only changes when an error band or matrix does
+  const int variant = cov_area_normalize ? 1 : 0;
+  const ULong64_t version = GetCacheVersion();
+  if( !fTotalCovCache.Get( variant, version, covmx ) )
   {
-    covmx += GetSysErrorMatrix(*itName, false, cov_area_normalize);
+    //uncorrelated errors are not cached, see below
+    std::vector<std::string> names;
+    const std::vector<std::string> allNames = GetSysErrorMatricesNames();
+    for (std::vector<std::string>::const_iterator itName = allNames.begin() ; itName != allNames.end() ; ++itName)
+    {
+      if( fUncorrErrorMap.find( *itName ) == fUncorrErrorMap.end() )
+        names.push_back( *itName );
+    }
+
+    //the bands are independent, so they are computed in parallel and summed in order
+    SumSysErrors( this, names, cov_area_normalize, &covmx, 0 );
+    fTotalCovCache.Put( variant, version, covmx );
   }
 
+  //uncorrelated errors are cheap and are not tracked by the cache version
+  for( std::map<std::string, TH1D*>::const_iterator i = fUncorrErrorMap.begin(); i != fUncorrErrorMap.end(); ++i )
+    MUHist::GetErrorsAsDiagonal( i->second ).AddTo( covmx );
+
   if (includeStat)
-    covmx += GetStatErrorMatrix();
+    GetStatErrorCovariance().AddTo( covmx );
 
   if (asFrac)
   {
@@ -1211,6 +1792,96 @@ TMatrixD MUH1D::GetTotalErrorMatrix(
   return covmx;
 }
 
+ULong64_t MUH1D::GetCacheVersion() const
+{
+  // Every change gets a larger stamp than any before it, so the largest stamp moves whenever anything changes
+  ULong64_t version = fCacheVersion.Get();
+  for( std::map<std::string, MUVertErrorBand*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+    version = std::max( version, i->second->GetCacheVersion() );
+  for( std::map<std::string, MULatErrorBand*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+    version = std::max( version, i->second->GetCacheVersion() );
+  return version;
+}
+
+MUCovarianceCache::Stats MUH1D::GetCovCacheStats() const
+{
+  MUCovarianceCache::Stats stats = fTotalCovCache.GetStats();
+  for( std::map<std::string, MUVertErrorBand*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+  {
+    const MUCovarianceCache::Stats band = i->second->GetCovCacheStats();
+    stats.hits += band.hits;
+    stats.misses += band.misses;
+  }
+  for( std::map<std::string, MULatErrorBand*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+  {
+    const MUCovarianceCache::Stats band = i->second->GetCovCacheStats();
+    stats.hits += band.hits;
+    stats.misses += band.misses;
+  }
+  return stats;
+}
+
+std::vector<double> MUH1D::GetTotalErrorVariance(
+    bool includeStat /*= true*/, 
+    bool asFrac /*= false*/, 
+    bool cov_area_normalize /*= false*/ ) const
+{
+  std::vector<double> var( GetNcells(), 0. );
+
+  //the bands are independent, so they are computed in parallel and summed in order
+  SumSysErrors( this, GetSysErrorMatricesNames(), cov_area_normalize, 0, &var );
+
+  if (includeStat)
+  {
+    for( unsigned int i = 0; i != var.size(); ++i )
+      var[i] += GetBinError(i) * GetBinError(i);
+  }
+
+  if (asFrac)
+  {
+    for( unsigned int i = 0; i != var.size(); ++i )
+    {
+      const double cv = GetBinContent(i);
+      var[i] = ( cv != 0. ) ? var[i]/(cv * cv) : 0.;
+    }
+  }
+
+  return var;
+}
+
+MULowRankCovariance MUH1D::GetTotalErrorLowRank(
+    bool includeStat /*= true*/, 
+    bool asFrac /*= false*/, 
+    bool cov_area_normalize /*= false*/ ) const
+{
+  MULowRankCovariance cov( GetNcells() );
+  cov.SetCV( this );
+
+  for( std::map<std::string, MUVertErrorBand*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+    cov.Add( i->second->CalcLowRankCovMx( cov_area_normalize ) );
+  for( std::map<std::string, MULatErrorBand*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+    cov.Add( i->second->CalcLowRankCovMx( cov_area_normalize ) );
+
+  //uncorrelated errors only have a diagonal
+  for( std::map<std::string, TH1D*>::const_iterator i = fUncorrErrorMap.begin(); i != fUncorrErrorMap.end(); ++i )
+    MUHist::GetErrorsAsDiagonal( i->second ).AddTo( cov );
+
+  //matrices pushed by hand are small, since they are 1D, and are factored by eigenvectors
+  for( std::map<std::string, TMatrixD*>::const_iterator i = fSysErrorMatrix.begin(); i != fSysErrorMatrix.end(); ++i )
+  {
+    if ( !HasEnding(i->first, "_asShape") )
+      cov.AddMatrix( GetSysErrorMatrix( i->first, false, cov_area_normalize ) );
+  }
+
+  if (includeStat)
+    GetStatErrorCovariance().AddTo( cov );
+
+  if (asFrac)
+    cov.MakeFractional();
+
+  return cov;
+}
+
 TMatrixD MUH1D::GetTotalCorrelationMatrix( bool cov_area_normalize /*= false*/ ) const
 {
   TMatrixD covmx = GetTotalErrorMatrix(false, false, cov_area_normalize);
@@ -1310,6 +1981,7 @@ bool MUH1D::PushCovMatrix(
   TMatrixD* temp = new TMatrixD(covmx.GetNrows(), covmx.GetNcols() );
   *temp = covmx;
   fSysErrorMatrix[fname] = temp;
+  fCacheVersion.Touch();
 
   return true;
 }
@@ -1369,6 +2041,48 @@ TMatrixD MUH1D::GetSysErrorMatrix(const std::string& name, bool asFrac /*= false
   return covmx;
 }
 
+std::vector<double> MUH1D::GetSysErrorVariance(const std::string& name, bool asFrac /*= false*/, bool cov_area_normalize /*= false*/) const
+{
+  if (HasEnding(name,"_asShape") )
+    std::cout << "Warning [MUH1D::GetSysErrorVariance]: You are calling the error Matrix: " << name <<".\nAssuming the error Band wanted is: " << name.substr(0,name.length()-8) << " with cov_area_normalize = true" << std::endl;
+
+  const std::string name_condition = ( (cov_area_normalize) && !(HasEnding(name,"_asShape")) )?  "_asShape" : "";
+  const std::string fname = name + name_condition ; 
+  const std::string errName = HasEnding(fname,"_asShape") ? fname.substr(0,fname.length()-8) : fname;
+
+  std::vector<double> var( GetNcells(), 0. );
+
+  if ( HasErrorMatrix( fname ) )
+  {
+    const TMatrixD& covmx = *(fSysErrorMatrix.find(fname)->second);
+    for( int i = 0; i < GetNcells() && i < covmx.GetNrows() && i < covmx.GetNcols(); ++i )
+      var[i] = covmx[i][i];
+  }
+  else if( fLatErrorBandMap.find( errName ) != fLatErrorBandMap.end() )
+    var = fLatErrorBandMap.find( errName )->second->CalcVariance( ( HasEnding(fname,"_asShape") ) );
+  else if( fVertErrorBandMap.find( errName ) != fVertErrorBandMap.end() )
+    var = fVertErrorBandMap.find( errName )->second->CalcVariance( ( HasEnding(fname,"_asShape") ) );
+  else if( fUncorrErrorMap.find( errName ) != fUncorrErrorMap.end() )
+  {
+    const TH1D *h = fUncorrErrorMap.find( errName )->second;
+    for( unsigned int i = 0; i != var.size(); ++i )
+      var[i] = h->GetBinError(i) * h->GetBinError(i);
+  }
+  else
+    std::cout << "Warning [MUH1D::GetSysErrorVariance]: There is no Covariance Matrix with name " << fname << ".Returning zeros." << std::endl;
+
+  if (asFrac)
+  {
+    for( unsigned int i = 0; i != var.size(); ++i )
+    {
+      const double cv = GetBinContent(i);
+      var[i] = ( cv != 0. ) ? var[i]/(cv * cv) : 0.;
+    }
+  }
+
+  return var;
+}
+
 bool MUH1D::RemoveSysErrorMatrix(const std::string& name)
 {
   const std::string shapeName = name + "_asShape";
@@ -1392,6 +2106,7 @@ bool MUH1D::RemoveSysErrorMatrix(const std::string& name)
     fRemovedSysErrorMatrix[shapeName] = fSysErrorMatrix[shapeName];
     fSysErrorMatrix.erase( fSysErrorMatrix.find( shapeName ) );
   }
+  fCacheVersion.Touch();
 
   return true;
 }
@@ -1419,6 +2134,7 @@ bool MUH1D::UnRemoveSysErrorMatrix(const std::string& name)
     fSysErrorMatrix[name] = fRemovedSysErrorMatrix[shapeName];
     fRemovedSysErrorMatrix.erase( fRemovedSysErrorMatrix.find( shapeName ) );
   }
+  fCacheVersion.Touch();
   return true;
 }
 
@@ -1438,29 +2154,24 @@ void MUH1D::ClearSysErrorMatrices()
       delete i->second;
   }
   fRemovedSysErrorMatrix.clear();
+  fCacheVersion.Touch();
 }
 
 TMatrixD MUH1D::GetStatErrorMatrix( bool asFrac /* =false */ ) const
 {
-  const int highBin = GetNbinsX() + 1;
-  const int lowBin = 0;
-  TMatrixD covmx(highBin+1,highBin+1);
+  return GetStatErrorCovariance( asFrac ).GetMatrix();
+}
 
+MUDiagonalCovariance MUH1D::GetStatErrorCovariance( bool asFrac /* =false */ ) const
+{
   // stat error
-  for (int iBin=lowBin; iBin<=highBin; ++iBin )
-    covmx[iBin][iBin]= GetBinError(iBin);
+  MUDiagonalCovariance cov( GetNcells() );
+  cov.AddErrors( this );
 
   if (asFrac)
-  { 
-    for( int iBin = lowBin; iBin <= highBin; ++iBin )
-    {
-      double binCon = GetBinContent(iBin);
-      double binErr = ( binCon != 0. ? covmx[iBin][iBin]/binCon : 0. ); 
-      covmx[iBin][iBin] = binErr;
-    }
-  }
+    cov.MakeFractional( this );
 
-  return covmx*covmx;
+  return cov;
 }
 
 //------------------------------------------------------------------------
@@ -1469,6 +2180,7 @@ TMatrixD MUH1D::GetStatErrorMatrix( bool asFrac /* =false */ ) const
 TH1D MUH1D::GetStatError( bool asFrac /* = false */ ) const
 {
   // Make a copy of this histogram as a TH1D and rename it
+  TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
   TH1D err( *this );
   err.Reset();
   std::string tmpName( std::string(GetName()) + "_StatError");
@@ -1607,7 +2319,9 @@ Bool_t MUH1D::Divide( const MUH1D* h1, const MUH1D* h2, Double_t c1 /*= 1*/, Dou
   // Call the TH1D Divide
   success = this->TH1D::Divide( (TH1D*)h1, (TH1D*)h2, c1, c2, option );
 
-  // Call Divide for all lateral error bands
+  BandArithmeticJob job( BandArithmeticJob::kDivide, 0, c1, c2, option );
+
+  // Queue the lateral error bands
   for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
   {
     const MULatErrorBand* err1 = h1->GetLatErrorBand( it->first );
@@ -1617,10 +2331,10 @@ Bool_t MUH1D::Divide( const MUH1D* h1, const MUH1D* h2, Double_t c1 /*= 1*/, Dou
       Error("Divide", "Could not divide MUH1Ds because they all don't have the %s MULatErrorBand", it->first.c_str());
       return kFALSE;
     }
-    success = it->second->Divide( err1, err2, c1, c2, option );
+    job.AddBand( it->second, err1, err2 );
   }
 
-  // Divide the vertical error bands
+  // Queue the vertical error bands
   for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
   {
     const MUVertErrorBand* err1 = h1->GetVertErrorBand( it->first );
@@ -1630,9 +2344,12 @@ Bool_t MUH1D::Divide( const MUH1D* h1, const MUH1D* h2, Double_t c1 /*= 1*/, Dou
       Error("Divide", "Could not divide MUH1Ds because they all don't have the %s MUVertErrorBand", it->first.c_str());
       return kFALSE;
     }
-    success = it->second->Divide( err1, err2, c1, c2, option );
+    job.AddBand( it->second, err1, err2 );
   }
 
+  // Do all bands at once, on several threads if they are big
+  success = job.RunAll( success );
+
   // Divide the uncorr errors
   for( std::map<std::string, TH1D*>::iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
   {
@@ -1666,7 +2383,9 @@ void MUH1D::DivideSingle( const MUH1D* h1, const TH1* h2, Double_t c1 /*= 1*/, D
   // Call the TH1D Divide
   this->TH1D::Divide( (TH1D*)h1, h2, c1, c2, option );
 
-  // Call Divide for all lateral error bands
+  BandArithmeticJob job( BandArithmeticJob::kDivideSingle, h2, c1, c2, option );
+
+  // Queue the lateral error bands
   for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
   {
     const MULatErrorBand* err1 = h1->GetLatErrorBand( it->first );
@@ -1675,10 +2394,10 @@ void MUH1D::DivideSingle( const MUH1D* h1, const TH1* h2, Double_t c1 /*= 1*/, D
       Error("Divide", "Could not divide MUH1Ds because they all don't have the %s MULatErrorBand", it->first.c_str());
       return;
     }
-    it->second->DivideSingle( err1, h2, c1, c2, option );
+    job.AddBand( it->second, err1, 0 );
   }
 
-  // Divide the vertical error bands
+  // Queue the vertical error bands
   for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
   {
     const MUVertErrorBand* err1 = h1->GetVertErrorBand( it->first );
@@ -1687,9 +2406,12 @@ void MUH1D::DivideSingle( const MUH1D* h1, const TH1* h2, Double_t c1 /*= 1*/, D
       Error("Divide", "Could not divide MUH1Ds because they all don't have the %s MUVertErrorBand", it->first.c_str());
       return;
     }
-    it->second->DivideSingle( err1, h2, c1, c2, option );
+    job.AddBand( it->second, err1, 0 );
   }
 
+  // Do all bands at once, on several threads if they are big
+  job.RunAll( kTRUE );
+
   // Divide the uncorr errors
   for( std::map<std::string, TH1D*>::iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
   {
@@ -1720,7 +2442,9 @@ Bool_t MUH1D::Multiply( const MUH1D* h1, const MUH1D* h2, Double_t c1 /*= 1*/, D
   // Call the TH1D Multiply 
   success = this->TH1D::Multiply( (TH1D*)h1, (TH1D*)h2, c1, c2 );
 
-  // Call Multiply for all lateral error bands
+  BandArithmeticJob job( BandArithmeticJob::kMultiply, 0, c1, c2 );
+
+  // Queue the lateral error bands
   for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
   {
     const MULatErrorBand* err1 = h1->GetLatErrorBand( it->first );
@@ -1730,10 +2454,10 @@ Bool_t MUH1D::Multiply( const MUH1D* h1, const MUH1D* h2, Double_t c1 /*= 1*/, D
       Error("Multiply", "Could not multiply MUH1Ds because they all don't have the %s MULatErrorBand", it->first.c_str());
       return kFALSE;
     }
-    success = it->second->Multiply( err1, err2, c1, c2 );
+    job.AddBand( it->second, err1, err2 );
   }
 
-  // multiply the vertical error bands
+  // Queue the vertical error bands
   for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
   {
     const MUVertErrorBand* err1 = h1->GetVertErrorBand( it->first );
@@ -1743,9 +2467,12 @@ Bool_t MUH1D::Multiply( const MUH1D* h1, const MUH1D* h2, Double_t c1 /*= 1*/, D
       Error("Multiply", "Could not multiply MUH1Ds because they all don't have the %s MUVertErrorBand", it->first.c_str());
       return kFALSE;
     }
-    success = it->second->Multiply( err1, err2, c1, c2 );
+    job.AddBand( it->second, err1, err2 );
   }
 
+  // Do all bands at once, on several threads if they are big
+  success = job.RunAll( success );
+
   // multiply the uncorr errors
   for( std::map<std::string, TH1D*>::iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
   {
@@ -1780,7 +2507,9 @@ void MUH1D::MultiplySingle( const MUH1D* h1, const TH1* h2, const Double_t c1 /*
   // Call the TH1D Multiply
   this->TH1D::Multiply( (TH1D*)h1, h2, c1, c2 );
 
-  // Call Multiply for all lateral error bands
+  BandArithmeticJob job( BandArithmeticJob::kMultiplySingle, h2, c1, c2 );
+
+  // Queue the lateral error bands
   for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
   {
     const MULatErrorBand* err1 = h1->GetLatErrorBand( it->first );
@@ -1789,10 +2518,10 @@ void MUH1D::MultiplySingle( const MUH1D* h1, const TH1* h2, const Double_t c1 /*
       Error("MultiplySingle", "Could not multiply MUH1Ds because they all don't have the %s MULatErrorBand", it->first.c_str());
       return;
     }
-    it->second->MultiplySingle( err1, h2, c1, c2 );
+    job.AddBand( it->second, err1, 0 );
   }
 
-  // Call Multiply for all vertical error bands
+  // Queue the vertical error bands
   for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
   {
     const MUVertErrorBand* err1 = h1->GetVertErrorBand( it->first );
@@ -1801,9 +2530,12 @@ void MUH1D::MultiplySingle( const MUH1D* h1, const TH1* h2, const Double_t c1 /*
       Error("MultiplySingle", "Could not multiply MUH1Ds because they all don't have the %s MUVertErrorBand", it->first.c_str());
       return;
     }
-    it->second->MultiplySingle( err1, h2, c1, c2 );
+    job.AddBand( it->second, err1, 0 );
   }
 
+  // Do all bands at once, on several threads if they are big
+  job.RunAll( kTRUE );
+
   // multiply the uncorr errors
   for( std::map<std::string, TH1D*>::iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
   {
@@ -1946,69 +2678,88 @@ Bool_t MUH1D::Add( const TH1* h1, const Double_t c1 /*= 1.*/ )
 
 TH1* MUH1D::Rebin(  Int_t ngroup /*= 2*/, const char *newname /*= ""*/, const Double_t *xbins /*= 0*/ )
 {
-  // If a clone is specified or necessary (because bins have been specified) then give up for now
-  if( (newname && strlen(newname) > 0) || xbins )
+  // With a newname rebin a copy, which shares the universes until it is rebinned, as TH1::Rebin would
+  if( newname && strlen(newname) > 0 )
   {
-    Error( "Rebin", "MUH1D's Rebin does not know how to create clones yet.  You can't specify a newname or new xbins." );
-    throw 1;
+    MUH1D *rval = new MUH1D( *this );
+    rval->SetName( newname );
+    if( !rval->Rebin( ngroup, "", xbins ) )
+    {
+      delete rval;
+      return NULL;
+    }
+    return rval;
   }
 
-  // Call TH1D's Rebin and store the return value, which we return if everything went well
-  TH1 *rval = this->TH1D::Rebin( ngroup );
+  // With xbins, ngroup is the number of new bins, as for TH1::Rebin
+  TAxis newAxis;
+  if( xbins )
+    newAxis.Set( ngroup, xbins );
+  else if( !MURebinMap::GroupAxis( GetXaxis(), ngroup, newAxis ) )
+    return NULL;
 
-  //we only need the rebin warning once
-  const int oldVerbosity = gErrorIgnoreLevel;
-  gErrorIgnoreLevel = kError;
+  // The map is worked out once and used for everything
+  if( !ApplyRebinMap( MURebinMap( this, &newAxis ) ) )
+    return NULL;
 
-  // Call Rebin for all lateral error bands
-  for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+  return this;
+}
+
+bool MUH1D::ApplyRebinMap( const MURebinMap& map )
+{
+  // Check everything first, so a failure leaves this MUH1D as it was
+  const unsigned int nBins = GetNcells();
+  bool fits = ( map.GetNOldBins() == nBins );
+  for( std::map<std::string, MULatErrorBand*>::const_iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+    fits = fits && (unsigned int)it->second->GetNcells() == nBins;
+  for( std::map<std::string, MUVertErrorBand*>::const_iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+    fits = fits && (unsigned int)it->second->GetNcells() == nBins;
+  for( std::map<std::string, TH1D*>::const_iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
+    fits = fits && (unsigned int)it->second->GetNcells() == nBins;
+  for( std::map<std::string, TMatrixD*>::const_iterator it = fSysErrorMatrix.begin(); it != fSysErrorMatrix.end(); ++it )
+    fits = fits && ( 0 == it->second || (unsigned int)it->second->GetNrows() == nBins );
+  for( std::map<std::string, TMatrixD*>::const_iterator it = fRemovedSysErrorMatrix.begin(); it != fRemovedSysErrorMatrix.end(); ++it )
+    fits = fits && ( 0 == it->second || (unsigned int)it->second->GetNrows() == nBins );
+  if( !fits )
   {
-    TH1 *tmpErrBand = it->second->Rebin( ngroup );
+    Error( "Rebin", "Could not rebin MUH1D %s because the rebin map or one of its errors does not have its %d bins", GetName(), nBins );
+    return false;
+  }
 
-    if( NULL == tmpErrBand )
-    {
-      Error("Rebin", "Could not rebin MUH1Ds because Rebin failed for MULatErrorBand %s ", it->first.c_str());
-      gErrorIgnoreLevel = oldVerbosity;
-      return NULL;
-    }
-  }//done adding Lat errors
+  map.Apply( (TH1*)this );
 
-  // Call Rebin for all vertical error bands
-  for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
-  {
-    TH1 *tmpErrBand = it->second->Rebin( ngroup );
+  for( std::map<std::string, MULatErrorBand*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+    it->second->ApplyRebinMap( map );
 
-    if( NULL == tmpErrBand )
-    {
-      Error("Rebin", "Could not rebin MUH1Ds because Rebin failed for MUVertErrorBand %s ", it->first.c_str());
-      gErrorIgnoreLevel = oldVerbosity;
-      return NULL;
-    }
-  }//done adding Vert errors
+  for( std::map<std::string, MUVertErrorBand*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+    it->second->ApplyRebinMap( map );
 
-  // Call Rebin for all uncorrelated errors
   for( std::map<std::string, TH1D*>::iterator it = fUncorrErrorMap.begin(); it != fUncorrErrorMap.end(); ++it )
-  {
-    TH1 *tmpErrBand = it->second->Rebin( ngroup );
+    map.Apply( it->second );
 
-    if( NULL == tmpErrBand )
+  // The special error matrices are rebinned exactly, including the removed ones
+  for( std::map<std::string, TMatrixD*>::iterator it = fSysErrorMatrix.begin(); it != fSysErrorMatrix.end(); ++it )
+  {
+    if( 0 != it->second )
     {
-      Error("Rebin", "Could not rebin MUH1Ds because Rebin failed for uncorrelated error %s ", it->first.c_str());
-      gErrorIgnoreLevel = oldVerbosity;
-      return NULL;
+      const TMatrixD rebinned = map.Apply( *it->second );
+      it->second->ResizeTo( rebinned );
+      *it->second = rebinned;
     }
-  }//done adding uncorr errors
+  }
 
-  // Do we have special errors in the systemics?
-  if ( !( fSysErrorMatrix.empty() ) || !( fRemovedSysErrorMatrix.empty() ) )
+  for( std::map<std::string, TMatrixD*>::iterator it = fRemovedSysErrorMatrix.begin(); it != fRemovedSysErrorMatrix.end(); ++it )
   {
-    Warning("MUH1D::Rebin", "Customized error matrices were found (errors that come from neither Vertical nor Lateral Error Bands). They will be cleared.");
-    ClearSysErrorMatrices( );
+    if( 0 != it->second )
+    {
+      const TMatrixD rebinned = map.Apply( *it->second );
+      it->second->ResizeTo( rebinned );
+      *it->second = rebinned;
+    }
   }
 
-  gErrorIgnoreLevel = oldVerbosity;
-
-  return rval;
+  fCacheVersion.Touch();
+  return true;
 }
 
 
@@ -9,6 +9,11 @@
 
 #include "PlotUtils/MUVertErrorBand.h"
 #include "PlotUtils/MULatErrorBand.h"
+#include "PlotUtils/MUErrorBandHandle.h"
+#include "PlotUtils/MUFillShard.h"
+#include "PlotUtils/MUCovarianceCache.h"
+#include "PlotUtils/MUDiagonalCovariance.h"
+#include "PlotUtils/MUEventUniverseWeights.h"
 
 #include <string>
 #include <vector>
@@ -31,6 +36,12 @@ namespace PlotUtils
 
 		TH1D::Sumw2() is always called in the constructor.
 
+		Once filled (or read from a file), a histogram may be queried from many threads at once through its const
+		methods: GetErrorBand, CalcCovMx, GetTotalError, GetTotalErrorMatrix, GetCVHistoWithError and the like.
+		Their lazy updates (band index, universe views, caches) take locks, and the histograms they return are not
+		added to gDirectory.  Call ROOT::EnableThreadSafety() first so ROOT itself keeps gDirectory per thread.
+		Nothing may change the histogram or its bands while it is being queried.  The same holds for MUH2D and MUH3D.
+
 		@author Brian Tice, Gabriel Perdue
 		*/
 	class MUH1D: public TH1D
@@ -62,10 +73,31 @@ namespace PlotUtils
 			//! Deep assignment
 			MUH1D& operator=( const MUH1D& h );
 
+			/*! Copy with the copy constructor, so the universes of every error band are shared with this one
+				until either is modified, instead of streamed into new buffers like TH1::Clone would.
+				A class derived from MUH1D is cloned with TH1D::Clone, so it is not sliced.
+				*/
+			virtual TObject* Clone( const char* newname = "" ) const;
+
+#if __cplusplus >= 201103L
+			/*! Move constructor: takes the bins, error bands and matrices of h instead of copying them, leaving h with none.
+				The TH1D part changes hands with MUHist::MoveHistogram, so a std::vector of MUH1D moves instead of copying when it grows.
+				*/
+			MUH1D( MUH1D&& h ) noexcept;
+
+			//! Move assignment, as the move constructor
+			MUH1D& operator=( MUH1D&& h ) noexcept;
+#endif
+
 		private:
 			//! A helper function which set variables for the deep copy and assignment
 			void DeepCopy( const MUH1D& h );
 
+#if __cplusplus >= 201103L
+			//! A helper function which takes the variables of h for the move constructor and assignment
+			void MoveFrom( MUH1D& h );
+#endif
+
 			//! A helper function to check if this string has that ending
 			bool HasEnding (std::string const &fullString, std::string const &ending) const;
 
@@ -169,6 +201,22 @@ namespace PlotUtils
 			//! Get a const pointer to this uncorrelated error
 			const TH1D* GetUncorrError( const std::string& name ) const;
 
+			//! Get a handle to this MUVertErrorBand for repeated fills and lookups (invalid handle if there is no such band)
+			MUErrorBandHandle GetVertErrorBandHandle( const std::string& name ) const;
+			//! Get a handle to this MULatErrorBand for repeated fills and lookups (invalid handle if there is no such band)
+			MUErrorBandHandle GetLatErrorBandHandle( const std::string& name ) const;
+			//! Get a handle to this uncorrelated error for MUEventUniverseWeights (invalid handle if there is no such error)
+			MUErrorBandHandle GetUncorrErrorHandle( const std::string& name ) const;
+
+			//! Get a pointer to the MUVertErrorBand with this handle
+			MUVertErrorBand* GetVertErrorBand( const MUErrorBandHandle& band );
+			//! Get a const pointer to the MUVertErrorBand with this handle
+			const MUVertErrorBand* GetVertErrorBand( const MUErrorBandHandle& band ) const;
+			//! Get a pointer to the MULatErrorBand with this handle
+			MULatErrorBand* GetLatErrorBand( const MUErrorBandHandle& band );
+			//! Get a const pointer to the MULatErrorBand with this handle
+			const MULatErrorBand* GetLatErrorBand( const MUErrorBandHandle& band ) const;
+
 			//! How many MULatErrorBands are there?
 			size_t GetNLatErrorBands() const { return fLatErrorBandMap.size(); };
 			//! How many MUVertErrorBands are there?
@@ -225,6 +273,19 @@ namespace PlotUtils
 			bool FillLatErrorBand( const std::string& name, const double val, const double * shifts, const double cvweight = 1.0, const bool fillcv = true, const double *weights = 0 );
 			//! Fill the shifts of an MULatErrorBand's 2 universes with these 2 shifts (must have 2)
 			bool FillLatErrorBand( const std::string& name, const double val, const double shiftDown, const double shiftUp, const double cvweight = 1.0, const bool fillcv = true );
+			/*! Fill the shifts of an MULatErrorBand's universes for many events with one band lookup
+				shifts and weights are nEvents x nUniverses, one row per event; cvweights and weights may be NULL
+				*/
+			bool FillLatErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *vals, const double *shifts, const double *cvweights = 0, const bool fillcv = true, const double *weights = 0 );
+
+			//! Fill the weights of an MUVertErrorBand's universes from array, finding the band by handle
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double val, const double * weights, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			//! Fill the weights of an MUVertErrorBand's 2 universes with these 2 weights (must have 2), finding the band by handle
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double val, const double weightDown, const double weightUp, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			//! Fill the shifts of an MULatErrorBand's universes from array, finding the band by handle
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double val, const double * shifts, const double cvweight = 1.0, const bool fillcv = true, const double *weights = 0 );
+			//! Fill the shifts of an MULatErrorBand's 2 universes with these 2 shifts (must have 2), finding the band by handle
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double val, const double shiftDown, const double shiftUp, const double cvweight = 1.0, const bool fillcv = true );
 
 			//! Fill the weights of an MUVertErrorBand's universes from a vector
 			bool FillVertErrorBand( const std::string& name, const double val, const std::vector<double>& weights, const double cvweight  = 1.0, double cvWeightFromMe = 1.);
@@ -232,10 +293,35 @@ namespace PlotUtils
 			bool FillVertErrorBand( const std::string& name, const double val, const double * weights, const double cvweight  = 1.0, double cvWeightFromMe = 1.);
 			//! Fill the weights of an MUVertErrorBand's 2 universes with these 2 weights (must have 2)
 			bool FillVertErrorBand( const std::string& name, const double val, const double weightDown, const double weightUp, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			/*! Fill the weights of an MUVertErrorBand's universes for many events with one band lookup
+				weights is nEvents x nUniverses, one row per event; cvweights and cvWeightsFromMe may be NULL (all 1)
+				*/
+			bool FillVertErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *vals, const double *weights, const double *cvweights = 0, const double *cvWeightsFromMe = 0 );
 
 			//! Fill the uncorrelated error
 			bool FillUncorrError( const std::string& name, const double val, const double err, const double cvweight = 1.0 );
 
+			/*! Fill the CV and every error band, finding the bin only once.
+				Bands are expected to have the same binning as this MUH1D, which is how AddVertErrorBand and friends make them.
+				A band not listed in event is filled as if all its universes were the CV (weights 1, shifts 0, uncorrelated error 0),
+				so its CV stays the CV of this MUH1D.  Each band should be listed at most once.
+				@param[in] val Value to fill
+				@param[in] cvweight Central value weight
+				@param[in] event Weights, shifts and errors of this event, by band handle
+				@return false if a band in event was not found or has the wrong number of universes (the others are still filled)
+				*/
+			bool FillAll( const double val, const double cvweight, const MUEventUniverseWeights& event );
+
+			/*! Get the fill shard of a worker slot, creating it on first use.  Safe to call from many threads at once.
+				Fill the shard instead of this histogram from that worker, then call MergeFillShards once all workers are done.
+				Add all error bands before the first shard is created.
+				@param[in] slot Worker slot (e.g. the slot RDataFrame::ForeachSlot passes, or your own thread index)
+				*/
+			MUFillShard& GetFillShard( const unsigned int slot );
+
+			//! Add all fill shards into this histogram and its error bands in slot order, then delete them.  Not thread safe.
+			void MergeFillShards();
+
 			//! Fill the weights of these ErrorBands' universes (defunct for now)
 			//bool FillErrorBands( const std::map<std::string, std::vector<double> >& weightMap, const double val, const double cvweight  = 1.0  );
 
@@ -260,8 +346,25 @@ namespace PlotUtils
 			//! Get a TH1D filled with the stat error ONLY
 			TH1D GetStatError( bool asFrac = false ) const;
 
-			//! Get the Total Covariance Matrix
+			/*! Get the Total Covariance Matrix
+				The error bands are independent, so their matrices are computed on a MUTaskPool (see MUTaskPool::SetNThreads)
+				and added in a fixed order: the result does not depend on the number of threads.
+				*/
 			TMatrixD GetTotalErrorMatrix(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+			//! Get just the diagonal of GetTotalErrorMatrix, without building any matrix (also on a MUTaskPool)
+			std::vector<double> GetTotalErrorVariance(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+			/*! GetTotalErrorMatrix kept as the universes of all error bands plus a diagonal, see MULowRankCovariance.
+				Needs O(nBins * nUniverses) memory instead of O(nBins^2), so it works for binnings too big for GetTotalErrorMatrix.
+				*/
+			MULowRankCovariance GetTotalErrorLowRank(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+
+			/*! Stamp that changes whenever an error band or the set of error matrices changes.
+				The sum of the systematic matrices in GetTotalErrorMatrix is cached against it.
+				*/
+			ULong64_t GetCacheVersion() const;
+
+			//! Hits and misses of the covariance caches of this histogram and all its error bands
+			MUCovarianceCache::Stats GetCovCacheStats() const;
 			//! Get Total Correlation Matrix
 			TMatrixD GetTotalCorrelationMatrix(bool cov_area_normalize = false ) const;
 
@@ -273,9 +376,13 @@ namespace PlotUtils
 
 			//! Get Statistical Error Matrix
 			TMatrixD GetStatErrorMatrix( bool asFrac = false ) const;
+			//! Get the statistical errors as a diagonal covariance, without building the matrix
+			MUDiagonalCovariance GetStatErrorCovariance( bool asFrac = false ) const;
 
 			//! Get a single Systematical Matrix from the map
 			TMatrixD GetSysErrorMatrix(const std::string& name, bool asFrac = false, bool cov_area_normalize = false) const; 
+			//! Get just the diagonal of GetSysErrorMatrix, without building the matrix
+			std::vector<double> GetSysErrorVariance(const std::string& name, bool asFrac = false, bool cov_area_normalize = false) const;
 
 			//! Remove a Systematic Error from the Total Systematic Container
 			bool RemoveSysErrorMatrix(const std::string& name);
@@ -292,6 +399,7 @@ namespace PlotUtils
 			/*! Get an MUH1D which has its bin content and errors normalized to bin width so it looks smooth
 				@param[in] normBinWidth bin width to normalize to.  normalization = normBinWidth / thisBinWidth.  (nonpositive means use MUH1D's default if set)
 				@return A copy of this MUH1D which has its bin content/error normalized to bin width
+				@note This copies every universe.  MUH1DView( h ).BinNormalize() reads the same numbers without the copy.
 				*/
 			MUH1D GetBinNormalizedCopy( Double_t normBinWidth = -1. ) const;
 
@@ -330,10 +438,15 @@ namespace PlotUtils
 			//! Our own implementation of the TH1::Add used by hadd
 			virtual Bool_t Add( const TH1* h1, const Double_t c1 = 1. );
 
-			//! Rebin and propagate to error bands
-			//! @note newname and xbins arguments will not work for MUH1D yet, but I wanted to overwrite the TH1D version of this function
+			/*! Rebin and propagate to error bands, uncorrelated errors and error matrices, as TH1::Rebin:
+				groups of ngroup bins, or ngroup bins with edges xbins.  With a newname a rebinned copy is returned
+				and this MUH1D is left alone.  Error matrices C become M*C*M^T (see MURebinMap).
+				*/
 			virtual TH1* Rebin(  Int_t ngroup = 2, const char *newname = "", const Double_t *xbins = 0 );
 
+			//! Rebin everything with a map made for this binning, false (and unchanged) if it does not fit
+			bool ApplyRebinMap( const MURebinMap& map );
+
 			//! Reset and propagate to error bands.  clear error matrices.
 			void Reset( Option_t *option = "" );
 
@@ -350,6 +463,12 @@ namespace PlotUtils
 			//! Strores a map from name to error band for MUVertErrorBands
 			std::map<std::string, MUVertErrorBand*> fVertErrorBandMap;
 
+			//! Lookup of the MULatErrorBands by interned name, built from fLatErrorBandMap on demand
+			MUErrorBandIndex<MULatErrorBand> fLatErrorBandIndex; //!
+
+			//! Lookup of the MUVertErrorBands by interned name, built from fVertErrorBandMap on demand
+			MUErrorBandIndex<MUVertErrorBand> fVertErrorBandIndex; //!
+
 			//! Stores a map from name of Systematics Error Matrices 
 			std::map<std::string, TMatrixD*> fSysErrorMatrix;
 
@@ -359,6 +478,21 @@ namespace PlotUtils
 			//! Stores a map from name to histogram that stored uncorrelated errors
 			std::map<std::string, TH1D*> fUncorrErrorMap;
 
+			//! Lookup of the uncorrelated errors by interned name, built from fUncorrErrorMap on demand
+			MUErrorBandIndex<TH1D> fUncorrErrorIndex; //!
+
+			//! Per-worker accumulators handed out by GetFillShard
+			MUFillShardSet fFillShards; //!
+
+			//! Stamp of the last change to the error bands or error matrices held here
+			mutable MUCacheVersion fCacheVersion; //!
+
+			//! Sum of the systematic covariance matrices, absolute and shape-only
+			mutable MUCovarianceCache fTotalCovCache; //!
+
+			//! Add one event's error to an uncorrelated error in a known bin
+			void FillUncorrErrorAtBin( TH1D *hist, const int bin, const double err, const double cvweight );
+
 			//! Stores the width to which we will normalize bins (e.g. n Events per fNormBinWidth GeV)
 			//! If negative, then refuse to normalize to bin width (appropriate for ratios, efficiencies)
 			Double_t fNormBinWidth;
@@ -2,9 +2,175 @@
 #define MNV_MUH2D_cxx 1
 
 #include "PlotUtils/MUH2D.h"
+#include "PlotUtils/MUTaskPool.h"
+#include "PlotUtils/MULinearMap.h"
+#include "PlotUtils/HistogramUtils.h"
+
+#include <TDirectory.h>
+#include <TList.h>
+#include <algorithm>
+#include <cstring>
 
 using namespace PlotUtils;
 
+namespace
+{
+	//! Computes the covariance matrices (or variances) of a batch of systematics, one systematic per task
+	class SysErrorJob : public MUTaskPool::Job
+	{
+		public:
+			SysErrorJob( const MUH2D *hist, const std::vector<std::string>& names, const bool areaNorm, const bool matrices ) :
+				fHist( hist ), fNames( names ), fAreaNorm( areaNorm ), fMatrices( matrices ), fFirst( 0 )
+			{ }
+
+			//! Start a batch of n systematics from first
+			void SetBatch( const unsigned int first, const unsigned int n )
+			{
+				fFirst = first;
+				if( fMatrices )
+					fMx.resize( n );
+				else
+					fVar.resize( n );
+			}
+
+			void Run( const unsigned int i )
+			{
+				if( fMatrices )
+				{
+					const TMatrixD mx( fHist->GetSysErrorMatrix( fNames[i], false, fAreaNorm ) );
+					fMx[ i - fFirst ].ResizeTo( mx );
+					fMx[ i - fFirst ] = mx;
+				}
+				else
+					fVar[ i - fFirst ] = fHist->GetSysErrorVariance( fNames[i], false, fAreaNorm );
+			}
+
+			std::vector<TMatrixD> fMx;                ///< Matrix of each systematic in the batch
+			std::vector< std::vector<double> > fVar;  ///< Variances of each systematic in the batch
+
+		private:
+			const MUH2D *fHist;
+			const std::vector<std::string>& fNames;
+			const bool fAreaNorm;
+			const bool fMatrices;
+			unsigned int fFirst;
+	};
+
+	/*! Add the covariance matrices (or just the variances) of these systematics to covmx (or var), in the order of names.
+			The systematics are computed on a MUTaskPool, one matrix per thread at a time, and added in order, so the sum
+			has the same bits as a serial loop.
+			*/
+	void SumSysErrors( const MUH2D *hist, const std::vector<std::string>& names, const bool areaNorm, TMatrixD *covmx, std::vector<double> *var )
+	{
+		//! Threads only pay off once there are about a million multiply-adds to share
+		const double nCells = hist->GetNcells();
+		double work = 0.;
+		for( std::vector<std::string>::const_iterator i = names.begin(); i != names.end(); ++i )
+		{
+			unsigned int nUniverses = 1;
+			if( hist->HasVertErrorBand( *i ) )
+				nUniverses = hist->GetVertErrorBand( *i )->GetNHists();
+			else if( hist->HasLatErrorBand( *i ) )
+				nUniverses = hist->GetLatErrorBand( *i )->GetNHists();
+			work += nCells * ( covmx ? nCells : 1. ) * nUniverses;
+		}
+		unsigned int nThreads = ( 1e6 < work ) ? MUTaskPool::GetNThreads() : 1;
+
+		//! Big matrices are computed one at a time instead, each on all threads (MUUniverseStore::CalcCovariance)
+		if( covmx && MUCovarianceCache::GetMaxRows() < nCells )
+			nThreads = 1;
+		const unsigned int batchSize = covmx ? nThreads : names.size();
+
+		SysErrorJob job( hist, names, areaNorm, 0 != covmx );
+		for( unsigned int first = 0; first < names.size(); first += batchSize )
+		{
+			const unsigned int last = std::min( (unsigned int)names.size(), first + batchSize );
+			job.SetBatch( first, last - first );
+			MUTaskPool::Run( job, first, last, nThreads );
+
+			for( unsigned int i = 0; i != last - first; ++i )
+			{
+				if( covmx )
+					*covmx += job.fMx[i];
+				else
+				{
+					for( unsigned int k = 0; k != var->size(); ++k )
+						(*var)[k] += job.fVar[i][k];
+				}
+			}
+		}
+	}
+
+	/*! Divides or multiplies the error bands of a MUH2D, one band per task.
+		Each band only reads the bands of the same name in the operands, so the bands can be done on several threads.
+		*/
+	class BandArithmeticJob : public MUTaskPool::Job
+	{
+		public:
+			enum EOp { kDivide, kDivideSingle, kMultiply };
+
+			BandArithmeticJob( const EOp op, const TH2 *single, const Double_t c1, const Double_t c2, Option_t *option = "" ) :
+				fOp( op ), fSingle( single ), fC1( c1 ), fC2( c2 ), fOption( option ), fWork( 0. )
+			{ }
+
+			//! Queue band = err1 op err2 (err2 is unused for DivideSingle)
+			void AddBand( MUVertErrorBand2D *band, const MUVertErrorBand2D *err1, const MUVertErrorBand2D *err2 )
+			{
+				fVert.push_back( band );
+				fVert1.push_back( err1 );
+				fVert2.push_back( err2 );
+				fWork += double( band->GetNcells() ) * band->GetNHists();
+			}
+
+			void AddBand( MULatErrorBand2D *band, const MULatErrorBand2D *err1, const MULatErrorBand2D *err2 )
+			{
+				fLat.push_back( band );
+				fLat1.push_back( err1 );
+				fLat2.push_back( err2 );
+				fWork += double( band->GetNcells() ) * band->GetNHists();
+			}
+
+			//! Do all queued bands, vertical first, on threads once there are about a million bins to share
+			void RunAll()
+			{
+				MUTaskPool::Run( *this, 0, fVert.size() + fLat.size(), ( 1e6 < fWork ) ? 0 : 1 );
+			}
+
+			void Run( const unsigned int i )
+			{
+				if( i < fVert.size() )
+					Apply( fVert[i], fVert1[i], fVert2[i] );
+				else
+				{
+					const unsigned int j = i - fVert.size();
+					Apply( fLat[j], fLat1[j], fLat2[j] );
+				}
+			}
+
+		private:
+			template<class BAND>
+			void Apply( BAND *band, const BAND *err1, const BAND *err2 ) const
+			{
+				switch( fOp )
+				{
+					case kDivide:       band->Divide( err1, err2, fC1, fC2, fOption ); break;
+					case kDivideSingle: band->DivideSingle( err1, fSingle, fC1, fC2, fOption ); break;
+					case kMultiply:     band->Multiply( err1, err2, fC1, fC2 ); break;
+				}
+			}
+
+			const EOp fOp;
+			const TH2 *fSingle;
+			const Double_t fC1, fC2;
+			Option_t *fOption;
+			double fWork;                                  ///< Bins x universes of all queued bands
+			std::vector<MUVertErrorBand2D*> fVert;
+			std::vector<const MUVertErrorBand2D*> fVert1, fVert2;
+			std::vector<MULatErrorBand2D*> fLat;
+			std::vector<const MULatErrorBand2D*> fLat1, fLat2;
+	};
+}
+
 //==================================================================================
 // CONSTRUCTORS
 //==================================================================================
@@ -98,10 +264,14 @@ MUH2D& MUH2D::operator=( const MUH2D& h )
 	for( std::map<std::string, MUVertErrorBand2D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
 		delete it->second;
 	fVertErrorBandMap.clear();
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	for( std::map<std::string, MULatErrorBand2D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
 		delete it->second;
 	fLatErrorBandMap.clear();
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	//! Then deep copy the variables
 	DeepCopy(h);
@@ -109,6 +279,86 @@ MUH2D& MUH2D::operator=( const MUH2D& h )
 	return *this;
 }
 
+TObject* MUH2D::Clone( const char* newname /*= ""*/ ) const
+{
+	//! A class derived from MUH2D is cloned by ROOT, which knows all of its members
+	if( IsA() != MUH2D::Class() )
+		return TH2D::Clone( newname );
+
+	//! The copy constructor shares the universes instead of copying them
+	MUH2D *h = new MUH2D( *this );
+
+	//! TH1::Clone also clones the attached functions, which the copy constructor does not
+	TList *functions = GetListOfFunctions();
+	for( int i = 0; functions && i < functions->GetSize(); ++i )
+		h->GetListOfFunctions()->Add( functions->At(i)->Clone() );
+
+	if( newname && strlen(newname) )
+		h->SetName( newname );
+	return h;
+}
+
+#if __cplusplus >= 201103L
+MUH2D::MUH2D( MUH2D&& h ) noexcept :
+	TH2D()
+{
+	//! Take the bins and the error bands instead of copying them
+	MUHist::MoveHistogram( *this, h );
+	MoveFrom( h );
+}
+
+MUH2D& MUH2D::operator=( MUH2D&& h ) noexcept
+{
+	//! If this is me, there is nothing to move
+	if( this == &h )
+		return *this;
+
+	//! Take the bins of h
+	MUHist::MoveHistogram( *this, h );
+
+	//! Delete all vert and lat error bands and matrices
+	for( std::map<std::string, MUVertErrorBand2D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+		delete it->second;
+	fVertErrorBandMap.clear();
+	for( std::map<std::string, MULatErrorBand2D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+		delete it->second;
+	fLatErrorBandMap.clear();
+	for( std::map<std::string, TMatrixD*>::iterator it = fSysErrorMatrix.begin(); it != fSysErrorMatrix.end(); ++it )
+		delete it->second;
+	fSysErrorMatrix.clear();
+	for( std::map<std::string, TMatrixD*>::iterator it = fRemovedSysErrorMatrix.begin(); it != fRemovedSysErrorMatrix.end(); ++it )
+		delete it->second;
+	fRemovedSysErrorMatrix.clear();
+	fFillShards.Clear();
+
+	MoveFrom( h );
+
+	return *this;
+}
+
+void MUH2D::MoveFrom( MUH2D& h )
+{
+	fNormBinWidthX = h.fNormBinWidthX;
+	fNormBinWidthY = h.fNormBinWidthY;
+
+	//! The maps hold pointers, so swapping them hands over every band and matrix as it is
+	fVertErrorBandMap.swap( h.fVertErrorBandMap );
+	fLatErrorBandMap.swap( h.fLatErrorBandMap );
+	fSysErrorMatrix.swap( h.fSysErrorMatrix );
+	fRemovedSysErrorMatrix.swap( h.fRemovedSysErrorMatrix );
+
+	//! Fills still in the shards belong to the bands, so they go along
+	fFillShards.Swap( h.fFillShards );
+
+	fVertErrorBandIndex.Invalidate();
+	fLatErrorBandIndex.Invalidate();
+	h.fVertErrorBandIndex.Invalidate();
+	h.fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
+	h.fCacheVersion.Touch();
+}
+#endif
+
 void MUH2D::DeepCopy( const MUH2D& h )
 {
 	//! Set bin norm width
@@ -119,10 +369,14 @@ void MUH2D::DeepCopy( const MUH2D& h )
 	std::vector<std::string> vertNames = h.GetVertErrorBandNames();
 	for( std::vector<std::string>::iterator name = vertNames.begin(); name != vertNames.end(); ++name )
 		fVertErrorBandMap[*name] = new MUVertErrorBand2D( *h.GetVertErrorBand(*name) );
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	std::vector<std::string> latNames = h.GetLatErrorBandNames();
 	for( std::vector<std::string>::iterator name = latNames.begin(); name != latNames.end(); ++name )
 		fLatErrorBandMap[*name] = new MULatErrorBand2D( *h.GetLatErrorBand(*name) );
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 }
 
 //--------------------------------------------------------
@@ -176,45 +430,9 @@ MUH1D * MUH2D::ProjectionX(const char* name /*= "_px"*/, Int_t firstybin /*= 0*/
 	TH1D *cv_px = this->TH2D::ProjectionX(name, firstybin, lastybin, option); 
 	MUH1D *h_px = new MUH1D( *cv_px );
 
-	//! Getting Vertical Names
-	std::vector<std::string> vertNames = GetVertErrorBandNames();
-	for( unsigned int i = 0; i != vertNames.size(); ++i )
-	{
-		std::vector<TH1D*> vert_hists;
-		const MUVertErrorBand2D *errBand = GetVertErrorBand(vertNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH2D *h_universe = dynamic_cast<const TH2D*>( errBand->GetHist(j) );
-			TH1D *h_universe_px = h_universe->ProjectionX( Form("%s_%s_universe%i", name, vertNames[i].c_str(), j), firstybin, lastybin, option );
-			vert_hists.push_back(h_universe_px);
-		}
-		h_px->AddVertErrorBand(vertNames[i], vert_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = vert_hists.begin() ; itHist != vert_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
-
-	//! Getting Lateral Names
-	std::vector<std::string> latNames = GetLatErrorBandNames();
-	for( unsigned int i = 0; i != latNames.size(); ++i )
-	{
-		std::vector<TH1D*> lat_hists;
-		const MULatErrorBand2D *errBand = GetLatErrorBand(latNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH2D *h_universe = dynamic_cast<const TH2D*>( errBand->GetHist(j) );
-			TH1D *h_universe_px = h_universe->ProjectionX( Form("%s_%s_universe%i", name, latNames[i].c_str(), j), firstybin, lastybin, option );
-			lat_hists.push_back(h_universe_px);
-		}
-		h_px->AddLatErrorBand(latNames[i], lat_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = lat_hists.begin() ; itHist != lat_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
+	//! Project all universes of each error band in one pass, straight into the bands of the projection
+	const int firstBins[3] = { 0, firstybin, 0 }, lastBins[3] = { -1, lastybin, -1 };
+	MULinearMap::Projection( this, h_px, "x", firstBins, lastBins ).ApplyToErrorBands( *this, *h_px );
 
 	return h_px;
 }
@@ -224,45 +442,9 @@ MUH1D * MUH2D::ProjectionY(const char* name /*= "_py"*/, Int_t firstxbin /*= 0*/
 	TH1D *cv_py = TH2D::ProjectionY(name, firstxbin, lastxbin, option); 
 	MUH1D *h_py = new MUH1D( *cv_py );
 
-	//! Getting Vertical Names
-	std::vector<std::string> vertNames = GetVertErrorBandNames();
-	for( unsigned int i = 0; i != vertNames.size(); ++i )
-	{
-		std::vector<TH1D*> vert_hists;
-		const MUVertErrorBand2D *errBand = GetVertErrorBand(vertNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH2D *h_universe = dynamic_cast<const TH2D*>( errBand->GetHist(j) );
-			TH1D *h_universe_py = h_universe->ProjectionY( Form("%s_%s_universe%i", name, vertNames[i].c_str(), j), firstxbin, lastxbin, option );
-			vert_hists.push_back(h_universe_py);
-		}
-		h_py->AddVertErrorBand(vertNames[i], vert_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = vert_hists.begin() ; itHist != vert_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
-
-	//! Getting Lateral Names
-	std::vector<std::string> latNames = GetLatErrorBandNames();
-	for( unsigned int i = 0; i != latNames.size(); ++i )
-	{
-		std::vector<TH1D*> lat_hists;
-		const MULatErrorBand2D *errBand = GetLatErrorBand(latNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH2D *h_universe = dynamic_cast<const TH2D*>( errBand->GetHist(j) );
-			TH1D *h_universe_py = h_universe->ProjectionY( Form("%s_%s_universe%i", name, latNames[i].c_str(), j), firstxbin, lastxbin, option );
-			lat_hists.push_back(h_universe_py);
-		}
-		h_py->AddLatErrorBand(latNames[i], lat_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = lat_hists.begin() ; itHist != lat_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
+	//! Project all universes of each error band in one pass, straight into the bands of the projection
+	const int firstBins[3] = { firstxbin, 0, 0 }, lastBins[3] = { lastxbin, -1, -1 };
+	MULinearMap::Projection( this, h_py, "y", firstBins, lastBins ).ApplyToErrorBands( *this, *h_py );
 
 	return h_py;
 }
@@ -284,6 +466,8 @@ bool MUH2D::AddVertErrorBand( const std::string& name, const int nhists /* = -1
 		fVertErrorBandMap[name] = new MUVertErrorBand2D( errName, (TH2D*)this, nhists );
 	else
 		fVertErrorBandMap[name] = new MUVertErrorBand2D( errName, (TH2D*)this );
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -302,6 +486,8 @@ bool MUH2D::AddVertErrorBand( const std::string& name, const std::vector<TH2D*>&
 
 	//!Set the ErrorBand
 	fVertErrorBandMap[name] = new MUVertErrorBand2D( errName, (TH2D*)this, base );
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -353,6 +539,8 @@ bool MUH2D::AddLatErrorBand( const std::string& name, const int nhists /* = -1 *
 		fLatErrorBandMap[name] = new MULatErrorBand2D( errName, (TH2D*)this, nhists );
 	else
 		fLatErrorBandMap[name] = new MULatErrorBand2D( errName, (TH2D*)this );
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -371,6 +559,8 @@ bool MUH2D::AddLatErrorBand( const std::string& name, const std::vector<TH2D*>&
 
 	//!Set the ErrorBand
 	fLatErrorBandMap[name] = new MULatErrorBand2D( errName, (TH2D*)this, base );
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -405,6 +595,34 @@ bool MUH2D::AddLatErrorBandAndFillWithCV( const std::string& name, const unsigne
 	return ok; 
 }
 
+bool MUH2D::PushErrorBand( const std::string& name, MUVertErrorBand2D* err )
+{
+	std::map<std::string, MUVertErrorBand2D*>::iterator it = fVertErrorBandMap.find( name );
+	if( it != fVertErrorBandMap.end() )
+	{
+		std::cout << "Warning [MUH2D::PushErrorBand] : I already had vert error band " << name << ".  I'm deleting it and adding the new one." << std::endl;
+		delete it->second;
+	}
+	fVertErrorBandMap[name] = err;
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
+	return true;
+}
+
+bool MUH2D::PushErrorBand( const std::string& name, MULatErrorBand2D* err )
+{
+	std::map<std::string, MULatErrorBand2D*>::iterator it = fLatErrorBandMap.find( name );
+	if( it != fLatErrorBandMap.end() )
+	{
+		std::cout << "Warning [MUH2D::PushErrorBand] : I already had lat error band " << name << ".  I'm deleting it and adding the new one." << std::endl;
+		delete it->second;
+	}
+	fLatErrorBandMap[name] = err;
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
+	return true;
+}
+
 
 bool MUH2D::FillVertErrorBand( const std::string& name, const double xval, const double yval, const std::vector<double>& weights, const double cvweight /* = 1.0 */, double cvWeightFromMe /*= 1.*/ )
 {
@@ -433,6 +651,17 @@ bool MUH2D::FillVertErrorBand( const std::string& name, const double xval, const
 	return false;
 }
 
+bool MUH2D::FillVertErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *xvals, const double *yvals, const double *weights, const double *cvweights /* = 0 */, const double *cvWeightsFromMe /* = 0 */ )
+{
+	//! Try to fill a vertical error band
+	MUVertErrorBand2D *vert = GetVertErrorBand( name );
+	if( vert )
+		return vert->FillBatch( nEvents, xvals, yvals, weights, cvweights, cvWeightsFromMe );
+
+	std::cout << "Warning [MUH2D::FillVertErrorBandBatch] : Could not find a vertical error band to fill with name = " << name << std::endl;
+	return false;
+}
+
 bool MUH2D::FillLatErrorBand( const std::string& name, const double xval, const double yval, const std::vector<double>& xshifts, const std::vector<double>& yshifts, const double cvweight  /*= 1.0*/, const bool fillcv /*= true*/, const double* weights /*= 0*/  )
 {
 	return FillLatErrorBand( name, xval, yval, &(xshifts[0]), &(yshifts[0]), cvweight, fillcv, weights );
@@ -462,71 +691,217 @@ bool MUH2D::FillLatErrorBand( const std::string& name, const double xval, const
 	return false;
 }
 
+bool MUH2D::FillLatErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *xvals, const double *yvals, const double *xshifts, const double *yshifts, const double *cvweights /* = 0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+	//! Try to fill a lateral error band
+	MULatErrorBand2D *lat = GetLatErrorBand( name );
+	if( lat )
+		return lat->FillBatch( nEvents, xvals, yvals, xshifts, yshifts, cvweights, fillcv, weights );
 
-MUVertErrorBand2D* MUH2D::GetVertErrorBand( const std::string& name )
+	std::cout << "Warning [MUH2D::FillLatErrorBandBatch] : Could not find a lateral error band to fill with name = " << name << std::endl;
+	return false;
+}
+
+bool MUH2D::FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double * weights, const double cvweight /* = 1.0 */, double cvWeightFromMe /*= 1.*/ )
+{
+	MUVertErrorBand2D *vert = GetVertErrorBand( band );
+	if( vert )
+		return vert->Fill( xval, yval, weights, cvweight, cvWeightFromMe );
+
+	return false;
+}
+
+bool MUH2D::FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double weightDown, const double weightUp, const double cvweight /* = 1.0 */, double cvWeightFromMe /*= 1.*/ )
+{
+	MUVertErrorBand2D *vert = GetVertErrorBand( band );
+	if( vert )
+		return vert->Fill( xval, yval, weightDown, weightUp, cvweight, cvWeightFromMe );
+
+	return false;
+}
+
+bool MUH2D::FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double *xshifts, const double *yshifts, const double cvweight /* = 1.0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+	MULatErrorBand2D *lat = GetLatErrorBand( band );
+	if( lat )
+		return lat->Fill( xval, yval, xshifts, yshifts, cvweight, fillcv, weights );
+
+	return false;
+}
+
+bool MUH2D::FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double xshiftDown, const double xshiftUp, const double yshiftDown, const double yshiftUp, const double cvweight /* = 1.0 */, const bool fillcv /* = true */ )
+{
+	MULatErrorBand2D *lat = GetLatErrorBand( band );
+	if( lat )
+		return lat->Fill( xval, yval, xshiftDown, xshiftUp, yshiftDown, yshiftUp, cvweight, fillcv );
+
+	return false;
+}
+
+MUFillShard& MUH2D::GetFillShard( const unsigned int slot )
+{
+	MUFillShardLock lock;
+	MUFillShard *shard = fFillShards.Get( slot );
+	if( shard )
+		return *shard;
+
+	//! The shard gets every band we have now
+	shard = new MUFillShard( this );
+	for( std::map<std::string, MUVertErrorBand2D*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+		shard->AddVertErrorBand( MUErrorBandHandle::Intern( i->first ), i->second->GetNHists() );
+	for( std::map<std::string, MULatErrorBand2D*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+		shard->AddLatErrorBand( MUErrorBandHandle::Intern( i->first ), i->second->GetNHists() );
+
+	fFillShards.Set( slot, shard );
+	return *shard;
+}
+
+void MUH2D::MergeFillShards()
 {
-	std::map<std::string, MUVertErrorBand2D*>::iterator i = fVertErrorBandMap.find( name );
-	if( i == fVertErrorBandMap.end() )
+	//! Always in slot order, so the sums come out the same however the threads ran
+	for( unsigned int slot = 0; slot != fFillShards.GetNSlots(); ++slot )
 	{
-		std::cout << "Warning [MUH2D::GetVertErrorBand] : There is no vertical error band with name \"" << name << "\".  Returning NULL." << std::endl;
-		return NULL;
+		const MUFillShard *shard = fFillShards.Get( slot );
+		if( !shard )
+			continue;
+
+		shard->GetCV().AddTo( this );
+
+		const std::vector<MUFillShard::Band>& vertBands = shard->GetVertErrorBands();
+		for( std::vector<MUFillShard::Band>::const_iterator i = vertBands.begin(); i != vertBands.end(); ++i )
+		{
+			MUVertErrorBand2D *vert = GetVertErrorBand( i->band );
+			if( !vert )
+			{
+				std::cout << "Warning [MUH2D::MergeFillShards] : Vertical error band \"" << i->band.GetName() << "\" was removed while filling.  Its shard contents are lost." << std::endl;
+				continue;
+			}
+			i->cv.AddTo( vert );
+			vert->GetUniverseStore().Add( i->universes );
+		}
+
+		const std::vector<MUFillShard::Band>& latBands = shard->GetLatErrorBands();
+		for( std::vector<MUFillShard::Band>::const_iterator i = latBands.begin(); i != latBands.end(); ++i )
+		{
+			MULatErrorBand2D *lat = GetLatErrorBand( i->band );
+			if( !lat )
+			{
+				std::cout << "Warning [MUH2D::MergeFillShards] : Lateral error band \"" << i->band.GetName() << "\" was removed while filling.  Its shard contents are lost." << std::endl;
+				continue;
+			}
+			i->cv.AddTo( lat );
+			lat->GetUniverseStore().Add( i->universes );
+		}
 	}
 
-	return i->second;
+	fFillShards.Clear();
+}
+
+
+MUVertErrorBand2D* MUH2D::GetVertErrorBand( const std::string& name )
+{
+	MUVertErrorBand2D *band = fVertErrorBandIndex.Find( name, fVertErrorBandMap );
+	if( !band )
+		std::cout << "Warning [MUH2D::GetVertErrorBand] : There is no vertical error band with name \"" << name << "\".  Returning NULL." << std::endl;
+
+	return band;
 }
 
 const MUVertErrorBand2D* MUH2D::GetVertErrorBand( const std::string& name ) const
 {
-	std::map<std::string, MUVertErrorBand2D*>::const_iterator i = fVertErrorBandMap.find( name );
-	if( i == fVertErrorBandMap.end() )
-	{
+	MUVertErrorBand2D *band = fVertErrorBandIndex.Find( name, fVertErrorBandMap );
+	if( !band )
 		std::cout << "Warning [MUH2D::GetVertErrorBand] : There is no vertical error band with name \"" << name << "\".  Returning NULL." << std::endl;
-		return NULL;
+
+	return band;
+}
+
+MUErrorBandHandle MUH2D::GetVertErrorBandHandle( const std::string& name ) const
+{
+	if( !fVertErrorBandIndex.Find( name, fVertErrorBandMap ) )
+	{
+		std::cout << "Warning [MUH2D::GetVertErrorBandHandle] : There is no vertical error band with name \"" << name << "\".  Returning an invalid handle." << std::endl;
+		return MUErrorBandHandle();
 	}
 
-	return i->second;
+	return MUErrorBandHandle::Find( name );
 }
 
-MULatErrorBand2D* MUH2D::GetLatErrorBand( const std::string& name )
+MUErrorBandHandle MUH2D::GetLatErrorBandHandle( const std::string& name ) const
 {
-	std::map<std::string, MULatErrorBand2D*>::iterator i = fLatErrorBandMap.find( name );
-	if( i == fLatErrorBandMap.end() )
+	if( !fLatErrorBandIndex.Find( name, fLatErrorBandMap ) )
 	{
-		std::cout << "Warning [MUH2D::GetLatErrorBand] : There is no lateral error band with name \"" << name << "\".  Returning NULL." << std::endl;
-		return NULL;
+		std::cout << "Warning [MUH2D::GetLatErrorBandHandle] : There is no lateral error band with name \"" << name << "\".  Returning an invalid handle." << std::endl;
+		return MUErrorBandHandle();
 	}
 
-	return i->second;
+	return MUErrorBandHandle::Find( name );
+}
+
+MUVertErrorBand2D* MUH2D::GetVertErrorBand( const MUErrorBandHandle& band )
+{
+	MUVertErrorBand2D *errBand = fVertErrorBandIndex.Find( band, fVertErrorBandMap );
+	if( !errBand )
+		std::cout << "Warning [MUH2D::GetVertErrorBand] : There is no vertical error band with name \"" << band.GetName() << "\".  Returning NULL." << std::endl;
+
+	return errBand;
+}
+
+const MUVertErrorBand2D* MUH2D::GetVertErrorBand( const MUErrorBandHandle& band ) const
+{
+	MUVertErrorBand2D *errBand = fVertErrorBandIndex.Find( band, fVertErrorBandMap );
+	if( !errBand )
+		std::cout << "Warning [MUH2D::GetVertErrorBand] : There is no vertical error band with name \"" << band.GetName() << "\".  Returning NULL." << std::endl;
+
+	return errBand;
+}
+
+MULatErrorBand2D* MUH2D::GetLatErrorBand( const MUErrorBandHandle& band )
+{
+	MULatErrorBand2D *errBand = fLatErrorBandIndex.Find( band, fLatErrorBandMap );
+	if( !errBand )
+		std::cout << "Warning [MUH2D::GetLatErrorBand] : There is no lateral error band with name \"" << band.GetName() << "\".  Returning NULL." << std::endl;
+
+	return errBand;
+}
+
+const MULatErrorBand2D* MUH2D::GetLatErrorBand( const MUErrorBandHandle& band ) const
+{
+	MULatErrorBand2D *errBand = fLatErrorBandIndex.Find( band, fLatErrorBandMap );
+	if( !errBand )
+		std::cout << "Warning [MUH2D::GetLatErrorBand] : There is no lateral error band with name \"" << band.GetName() << "\".  Returning NULL." << std::endl;
+
+	return errBand;
+}
+
+MULatErrorBand2D* MUH2D::GetLatErrorBand( const std::string& name )
+{
+	MULatErrorBand2D *band = fLatErrorBandIndex.Find( name, fLatErrorBandMap );
+	if( !band )
+		std::cout << "Warning [MUH2D::GetLatErrorBand] : There is no lateral error band with name \"" << name << "\".  Returning NULL." << std::endl;
+
+	return band;
 }
 
 const MULatErrorBand2D* MUH2D::GetLatErrorBand( const std::string& name ) const
 {
-	std::map<std::string, MULatErrorBand2D*>::const_iterator i = fLatErrorBandMap.find( name );
-	if( i == fLatErrorBandMap.end() )
-	{
+	MULatErrorBand2D *band = fLatErrorBandIndex.Find( name, fLatErrorBandMap );
+	if( !band )
 		std::cout << "Warning [MUH2D::GetLatErrorBand] : There is no lateral error band with name \"" << name << "\".  Returning NULL." << std::endl;
-		return NULL;
-	}
 
-	return i->second;
+	return band;
 }
 
 bool MUH2D::HasLatErrorBand( const std::string& name ) const
 {
 	//! Check the MULatErrorBands
-	if( fLatErrorBandMap.find( name ) != fLatErrorBandMap.end() )
-		return true;
-
-	return false;
+	return fLatErrorBandIndex.Find( name, fLatErrorBandMap ) != NULL;
 }
 
 bool MUH2D::HasVertErrorBand( const std::string& name ) const
 {
 	//! Check the MUVertErrorBands
-	if( fVertErrorBandMap.find( name ) != fVertErrorBandMap.end() )
-		return true;
-
-	return false;
+	return fVertErrorBandIndex.Find( name, fVertErrorBandMap ) != NULL;
 }
 
 bool MUH2D::HasErrorBand( const std::string& name ) const
@@ -641,28 +1016,57 @@ TMatrixD MUH2D::GetSysErrorMatrix(const std::string& name, bool asFrac /*= false
 	return covmx;
 }
 
-TMatrixD MUH2D::GetStatErrorMatrix( bool asFrac /* =false */ ) const
+std::vector<double> MUH2D::GetSysErrorVariance(const std::string& name, bool asFrac /*= false*/, bool cov_area_normalize /*= false*/) const
 {
-	const int highBinX = GetNbinsX() + 1;
-	const int highBinY = GetNbinsY() + 1;
-	const int highBin  = GetBin( highBinX, highBinY );
-	const int lowBin = 0;
-	TMatrixD covmx(highBin+1,highBin+1);
-	//! stat error
-	for (int iBin=lowBin; iBin<=highBin; ++iBin )
-		covmx[iBin][iBin]= GetBinError(iBin);
+	if (HasEnding(name,"_asShape") )
+		std::cout << "Warning [MUH2D::GetSysErrorVariance]: You are calling the error Matrix: " << name <<".\nAssuming the error Band wanted is: " << name.substr(0,name.length()-8) << " with cov_area_normalize = true" << std::endl;
+
+	const std::string name_condition = ( (cov_area_normalize) && !(HasEnding(name,"_asShape")) )?  "_asShape" : "";
+	const std::string fname = name + name_condition ; 
+	const std::string errName = HasEnding(fname,"_asShape") ? fname.substr(0,fname.length()-8) : fname;
+
+	std::vector<double> var( GetNcells(), 0. );
+
+	if ( HasErrorMatrix( fname ) )
+	{
+		const TMatrixD& covmx = *(fSysErrorMatrix.find(fname)->second);
+		for( int i = 0; i < GetNcells() && i < covmx.GetNrows() && i < covmx.GetNcols(); ++i )
+			var[i] = covmx[i][i];
+	}
+	else if( fLatErrorBandMap.find( errName ) != fLatErrorBandMap.end() )
+		var = fLatErrorBandMap.find( errName )->second->CalcVariance( ( HasEnding(fname,"_asShape") ) );
+	else if( fVertErrorBandMap.find( errName ) != fVertErrorBandMap.end() )
+		var = fVertErrorBandMap.find( errName )->second->CalcVariance( ( HasEnding(fname,"_asShape") ) );
+	else
+		std::cout << "Warning [MUH2D::GetSysErrorVariance]: There is no Covariance Matrix with name " << fname << ".Returning zeros." << std::endl;
 
 	if (asFrac)
-	{ 
-		for( int iBin = lowBin; iBin <= highBin; ++iBin )
+	{
+		for( unsigned int i = 0; i != var.size(); ++i )
 		{
-			double binCon = GetBinContent(iBin);
-			double binErr = ( binCon != 0. ? covmx[iBin][iBin]/binCon : 0. ); 
-			covmx[iBin][iBin] = binErr;
+			const double cv = GetBinContent(i);
+			var[i] = ( cv != 0. ) ? var[i]/(cv * cv) : 0.;
 		}
 	}
 
-	return covmx*covmx;
+	return var;
+}
+
+TMatrixD MUH2D::GetStatErrorMatrix( bool asFrac /* =false */ ) const
+{
+	return GetStatErrorCovariance( asFrac ).GetMatrix();
+}
+
+MUDiagonalCovariance MUH2D::GetStatErrorCovariance( bool asFrac /* =false */ ) const
+{
+	//! stat error
+	MUDiagonalCovariance cov( GetNcells() );
+	cov.AddErrors( this );
+
+	if (asFrac)
+		cov.MakeFractional( this );
+
+	return cov;
 }
 
 //------------------------------------------------------------------------
@@ -681,14 +1085,18 @@ TMatrixD MUH2D::GetTotalErrorMatrix(
 	const int lowBin = 0;
 	TMatrixD covmx(highBin+1,highBin+1);
 
-	std::vector<std::string> names = GetSysErrorMatricesNames();
-	for (std::vector<std::string>::const_iterator itName = names.begin() ; itName != names.end() ; ++itName)
+	//! The sum of the systematic matrices only changes when an error band or matrix does
+	const int variant = cov_area_normalize ? 1 : 0;
+	const ULong64_t version = GetCacheVersion();
+	if( !fTotalCovCache.Get( variant, version, covmx ) )
 	{
-		covmx += GetSysErrorMatrix(*itName, false, cov_area_normalize);
+		//! The bands are independent, so they are computed in parallel and summed in order
+		SumSysErrors( this, GetSysErrorMatricesNames(), cov_area_normalize, &covmx, 0 );
+		fTotalCovCache.Put( variant, version, covmx );
 	}
 
 	if (includeStat)
-		covmx += GetStatErrorMatrix();
+		GetStatErrorCovariance().AddTo( covmx );
 
 	if (asFrac)
 	{
@@ -709,6 +1117,85 @@ TMatrixD MUH2D::GetTotalErrorMatrix(
 	return covmx;
 }
 
+ULong64_t MUH2D::GetCacheVersion() const
+{
+	//! Every change gets a larger stamp than any before it, so the largest stamp moves whenever anything changes
+	ULong64_t version = fCacheVersion.Get();
+	for( std::map<std::string, MUVertErrorBand2D*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+		version = std::max( version, i->second->GetCacheVersion() );
+	for( std::map<std::string, MULatErrorBand2D*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+		version = std::max( version, i->second->GetCacheVersion() );
+	return version;
+}
+
+MUCovarianceCache::Stats MUH2D::GetCovCacheStats() const
+{
+	MUCovarianceCache::Stats stats = fTotalCovCache.GetStats();
+	for( std::map<std::string, MUVertErrorBand2D*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+	{
+		const MUCovarianceCache::Stats band = i->second->GetCovCacheStats();
+		stats.hits += band.hits;
+		stats.misses += band.misses;
+	}
+	for( std::map<std::string, MULatErrorBand2D*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+	{
+		const MUCovarianceCache::Stats band = i->second->GetCovCacheStats();
+		stats.hits += band.hits;
+		stats.misses += band.misses;
+	}
+	return stats;
+}
+
+std::vector<double> MUH2D::GetTotalErrorVariance(
+		bool includeStat /*= true*/, 
+		bool asFrac /*= false*/, 
+		bool cov_area_normalize /*= false*/ ) const
+{
+	std::vector<double> var( GetNcells(), 0. );
+
+	//! The bands are independent, so they are computed in parallel and summed in order
+	SumSysErrors( this, GetSysErrorMatricesNames(), cov_area_normalize, 0, &var );
+
+	if (includeStat)
+	{
+		for( unsigned int i = 0; i != var.size(); ++i )
+			var[i] += GetBinError(i) * GetBinError(i);
+	}
+
+	if (asFrac)
+	{
+		for( unsigned int i = 0; i != var.size(); ++i )
+		{
+			const double cv = GetBinContent(i);
+			var[i] = ( cv != 0. ) ? var[i]/(cv * cv) : 0.;
+		}
+	}
+
+	return var;
+}
+
+MULowRankCovariance MUH2D::GetTotalErrorLowRank(
+		bool includeStat /*= true*/, 
+		bool asFrac /*= false*/, 
+		bool cov_area_normalize /*= false*/ ) const
+{
+	MULowRankCovariance cov( GetNcells() );
+	cov.SetCV( this );
+
+	for( std::map<std::string, MUVertErrorBand2D*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+		cov.Add( i->second->CalcLowRankCovMx( cov_area_normalize ) );
+	for( std::map<std::string, MULatErrorBand2D*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+		cov.Add( i->second->CalcLowRankCovMx( cov_area_normalize ) );
+
+	if (includeStat)
+		GetStatErrorCovariance().AddTo( cov );
+
+	if (asFrac)
+		cov.MakeFractional();
+
+	return cov;
+}
+
 TMatrixD MUH2D::GetTotalCorrelationMatrix( bool cov_area_normalize /*= false*/ ) const
 {
 	TMatrixD covmx = GetTotalErrorMatrix(false, false, cov_area_normalize);
@@ -731,6 +1218,7 @@ TH2D MUH2D::GetTotalError(
 		bool cov_area_normalize /*= false */) const
 {
 	//! Make a copy of this histogram as a TH1D and rename it
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH2D err( *this );
 	err.Reset();
 	std::string tmpName( std::string(GetName()) + "_TotalError");
@@ -742,12 +1230,12 @@ TH2D MUH2D::GetTotalError(
 	const int highBin  = GetBin( highBinX, highBinY );
 	const int lowBin = 0;
 
-	//!Get the Total Error Matrix
-	TMatrixD errMatrix = GetTotalErrorMatrix(includeStat, asFrac, cov_area_normalize);
+	//!Get the total variance of each bin; the covariances are not needed
+	const std::vector<double> errVar = GetTotalErrorVariance(includeStat, asFrac, cov_area_normalize);
 
 	for( int iBin = lowBin; iBin <= highBin; ++iBin )
 	{
-		double derr = errMatrix[iBin][iBin];
+		double derr = errVar[iBin];
 		err.SetBinContent( iBin, ( derr > 0 ) ? sqrt(derr): 0. );
 	}
 
@@ -760,6 +1248,7 @@ TH2D MUH2D::GetTotalError(
 TH2D MUH2D::GetStatError( bool asFrac /* = false */ ) const
 {
 	//! Make a copy of this histogram as a TH1D and rename it
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH2D err( *this );
 	err.Reset();
 	std::string tmpName( std::string(GetName()) + "_StatError");
@@ -800,6 +1289,7 @@ TH2D MUH2D::GetCVHistoWithError( bool includeStat /* = true */ , bool cov_area_n
 	TH2D err = GetTotalError( includeStat , false, cov_area_normalize);
 
 	//! Create a copy of this histogram and rename it
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH2D rval( *this );
 	std::string tmpName( std::string( GetName() ) + "_CV_WithErr" );
 	rval.SetName( tmpName.c_str() );
@@ -822,6 +1312,7 @@ TH2D MUH2D::GetCVHistoWithStatError() const
 	TH2D err = GetStatError( false );
 
 	//! Create a copy of this histogram and rename it
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH2D rval( *this );
 	std::string tmpName( std::string( GetName() ) + "_CV_WithStatErr" );
 	rval.SetName( tmpName.c_str() );
@@ -850,6 +1341,96 @@ void MUH2D::Scale( Double_t c1 /*= 1.*/, Option_t* option /*=""*/ )
 		it->second->Scale( c1, option );
 }
 
+TH2* MUH2D::Rebin2D( Int_t nxgroup /*= 2*/, Int_t nygroup /*= 2*/, const char* newname /*= ""*/ )
+{
+	TAxis newX, newY;
+	if( !MURebinMap::GroupAxis( GetXaxis(), nxgroup, newX ) || !MURebinMap::GroupAxis( GetYaxis(), nygroup, newY ) )
+		return NULL;
+	return RebinTo( &newX, &newY, newname );
+}
+
+MUH2D* MUH2D::Rebin2D( Int_t nxbins, const Double_t* xbins, Int_t nybins, const Double_t* ybins, const char* newname /*= ""*/ )
+{
+	TAxis newX, newY;
+	if( xbins )
+		newX.Set( nxbins, xbins );
+	if( ybins )
+		newY.Set( nybins, ybins );
+	return RebinTo( xbins ? &newX : 0, ybins ? &newY : 0, newname );
+}
+
+MUH2D* MUH2D::RebinTo( const TAxis* newX, const TAxis* newY, const char* newname )
+{
+	//! With a newname rebin a copy, which shares the universes until it is rebinned, as TH2::Rebin2D would
+	MUH2D *rval = this;
+	if( newname && strlen(newname) > 0 )
+	{
+		rval = new MUH2D( *this );
+		rval->SetName( newname );
+	}
+
+	//! The map is worked out once and used for everything
+	if( !rval->ApplyRebinMap( MURebinMap( rval, newX, newY ) ) )
+	{
+		if( rval != this )
+			delete rval;
+		return NULL;
+	}
+	return rval;
+}
+
+bool MUH2D::ApplyRebinMap( const MURebinMap& map )
+{
+	//! Check everything first, so a failure leaves this MUH2D as it was
+	const unsigned int nBins = GetNcells();
+	bool fits = ( map.GetNOldBins() == nBins );
+	for( std::map<std::string, MUVertErrorBand2D*>::const_iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+		fits = fits && (unsigned int)it->second->GetNcells() == nBins;
+	for( std::map<std::string, MULatErrorBand2D*>::const_iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+		fits = fits && (unsigned int)it->second->GetNcells() == nBins;
+	for( std::map<std::string, TMatrixD*>::const_iterator it = fSysErrorMatrix.begin(); it != fSysErrorMatrix.end(); ++it )
+		fits = fits && ( 0 == it->second || (unsigned int)it->second->GetNrows() == nBins );
+	for( std::map<std::string, TMatrixD*>::const_iterator it = fRemovedSysErrorMatrix.begin(); it != fRemovedSysErrorMatrix.end(); ++it )
+		fits = fits && ( 0 == it->second || (unsigned int)it->second->GetNrows() == nBins );
+	if( !fits )
+	{
+		std::cout << "Warning [MUH2D::ApplyRebinMap] : The rebin map or one of the errors of " << GetName() << " does not have its " << nBins << " bins.  Not rebinning." << std::endl;
+		return false;
+	}
+
+	map.Apply( (TH1*)this );
+
+	for( std::map<std::string, MUVertErrorBand2D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+		it->second->ApplyRebinMap( map );
+
+	for( std::map<std::string, MULatErrorBand2D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+		it->second->ApplyRebinMap( map );
+
+	//! The special error matrices are rebinned exactly, including the removed ones
+	for( std::map<std::string, TMatrixD*>::iterator it = fSysErrorMatrix.begin(); it != fSysErrorMatrix.end(); ++it )
+	{
+		if( 0 != it->second )
+		{
+			const TMatrixD rebinned = map.Apply( *it->second );
+			it->second->ResizeTo( rebinned );
+			*it->second = rebinned;
+		}
+	}
+
+	for( std::map<std::string, TMatrixD*>::iterator it = fRemovedSysErrorMatrix.begin(); it != fRemovedSysErrorMatrix.end(); ++it )
+	{
+		if( 0 != it->second )
+		{
+			const TMatrixD rebinned = map.Apply( *it->second );
+			it->second->ResizeTo( rebinned );
+			*it->second = rebinned;
+		}
+	}
+
+	fCacheVersion.Touch();
+	return true;
+}
+
 void MUH2D::Add( const TH2* h1, const Double_t c1 /*= 1.*/ )
 {
 	//! Try to cast the input TH2 to a MUH2D
@@ -914,7 +1495,9 @@ void MUH2D::Multiply( const MUH2D* h1, const MUH2D* h2, Double_t c1 /*= 1*/, Dou
 	//! Call the TH1D Multiply 
 	this->TH2D::Multiply( (TH2D*)h1, (TH2D*)h2, c1, c2 );
 
-	//! Scale the vertical error bands
+	BandArithmeticJob job( BandArithmeticJob::kMultiply, 0, c1, c2 );
+
+	//! Queue the vertical error bands
 	for( std::map<std::string, MUVertErrorBand2D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
 	{
 		const MUVertErrorBand2D* err1 = h1->GetVertErrorBand( it->first );
@@ -924,10 +1507,10 @@ void MUH2D::Multiply( const MUH2D* h1, const MUH2D* h2, Double_t c1 /*= 1*/, Dou
 			Error("Multiply", "Could not divide MUH2Ds because they all don't have the %s MUVertErrorBand2D", it->first.c_str());
 			return;
 		}
-		it->second->Multiply( err1, err2, c1, c2 );
+		job.AddBand( it->second, err1, err2 );
 	}
 
-	//! Scale the lateral error bands
+	//! Queue the lateral error bands
 	for( std::map<std::string, MULatErrorBand2D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
 	{
 		const MULatErrorBand2D* err1 = h1->GetLatErrorBand( it->first );
@@ -937,9 +1520,12 @@ void MUH2D::Multiply( const MUH2D* h1, const MUH2D* h2, Double_t c1 /*= 1*/, Dou
 			Error("Multiply", "Could not divide MUH2Ds because they all don't have the %s MULatErrorBand2D", it->first.c_str());
 			return;
 		}
-		it->second->Multiply( err1, err2, c1, c2 );
+		job.AddBand( it->second, err1, err2 );
 	}
 
+	//! Do all bands at once, on several threads if they are big
+	job.RunAll();
+
 	return;
 }
 
@@ -950,7 +1536,9 @@ void MUH2D::Divide( const MUH2D* h1, const MUH2D* h2, Double_t c1 /*= 1*/, Doubl
 	//! Call the TH1D Divide
 	this->TH2D::Divide( (TH2D*)h1, (TH2D*)h2, c1, c2, option );
 
-	//! Scale the vertical error bands
+	BandArithmeticJob job( BandArithmeticJob::kDivide, 0, c1, c2, option );
+
+	//! Queue the vertical error bands
 	for( std::map<std::string, MUVertErrorBand2D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
 	{
 		const MUVertErrorBand2D* err1 = h1->GetVertErrorBand( it->first );
@@ -960,10 +1548,10 @@ void MUH2D::Divide( const MUH2D* h1, const MUH2D* h2, Double_t c1 /*= 1*/, Doubl
 			Error("Divide", "Could not divide MUH2Ds because they all don't have the %s MUVertErrorBand2D", it->first.c_str());
 			return;
 		}
-		it->second->Divide( err1, err2, c1, c2, option );
+		job.AddBand( it->second, err1, err2 );
 	}
 
-	//! Scale the lateral error bands
+	//! Queue the lateral error bands
 	for( std::map<std::string, MULatErrorBand2D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
 	{
 		const MULatErrorBand2D* err1 = h1->GetLatErrorBand( it->first );
@@ -973,9 +1561,12 @@ void MUH2D::Divide( const MUH2D* h1, const MUH2D* h2, Double_t c1 /*= 1*/, Doubl
 			Error("Divide", "Could not divide MUH2Ds because they all don't have the %s MULatErrorBand2D", it->first.c_str());
 			return;
 		}
-		it->second->Divide( err1, err2, c1, c2, option );
+		job.AddBand( it->second, err1, err2 );
 	}
 
+	//! Do all bands at once, on several threads if they are big
+	job.RunAll();
+
 	return;
 }
 
@@ -984,7 +1575,9 @@ void MUH2D::DivideSingle( const MUH2D* h1, const TH2* h2, Double_t c1 /*= 1*/, D
 	//! Call the TH1D Divide
 	this->TH2D::Divide( (TH2D*)h1, h2, c1, c2, option );
 
-	//! Scale the vertical error bands
+	BandArithmeticJob job( BandArithmeticJob::kDivideSingle, h2, c1, c2, option );
+
+	//! Queue the vertical error bands
 	for( std::map<std::string, MUVertErrorBand2D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
 	{
 		const MUVertErrorBand2D* err1 = h1->GetVertErrorBand( it->first );
@@ -993,10 +1586,10 @@ void MUH2D::DivideSingle( const MUH2D* h1, const TH2* h2, Double_t c1 /*= 1*/, D
 			Error("Divide", "Could not divide MUH2Ds because they all don't have the %s MUVertErrorBand2D", it->first.c_str());
 			return;
 		}
-		it->second->DivideSingle( err1, h2, c1, c2, option );
+		job.AddBand( it->second, err1, 0 );
 	}
 
-	//! Scale the lateral error bands
+	//! Queue the lateral error bands
 	for( std::map<std::string, MULatErrorBand2D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
 	{
 		const MULatErrorBand2D* err1 = h1->GetLatErrorBand( it->first );
@@ -1005,9 +1598,12 @@ void MUH2D::DivideSingle( const MUH2D* h1, const TH2* h2, Double_t c1 /*= 1*/, D
 			Error("Divide", "Could not divide MUH2Ds because they all don't have the %s MULatErrorBand2D", it->first.c_str());
 			return;
 		}
-		it->second->DivideSingle( err1, h2, c1, c2, option );
+		job.AddBand( it->second, err1, 0 );
 	}
 
+	//! Do all bands at once, on several threads if they are big
+	job.RunAll();
+
 	return;
 }
 
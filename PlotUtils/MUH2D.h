@@ -8,6 +8,10 @@
 #include "PlotUtils/MUH1D.h"
 #include "PlotUtils/MUVertErrorBand2D.h"
 #include "PlotUtils/MULatErrorBand2D.h"
+#include "PlotUtils/MUErrorBandHandle.h"
+#include "PlotUtils/MUFillShard.h"
+#include "PlotUtils/MUCovarianceCache.h"
+#include "PlotUtils/MUDiagonalCovariance.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -49,10 +53,31 @@ namespace PlotUtils
 			//! Deep assignment
 			MUH2D& operator=( const MUH2D& h );
 
+			/*! Copy with the copy constructor, so the universes of every error band are shared with this one
+				until either is modified, instead of streamed into new buffers like TH1::Clone would.
+				A class derived from MUH2D is cloned with TH2D::Clone, so it is not sliced.
+				*/
+			virtual TObject* Clone( const char* newname = "" ) const;
+
+#if __cplusplus >= 201103L
+			/*! Move constructor: takes the bins, error bands and matrices of h instead of copying them, leaving h with none.
+				The TH2D part changes hands with MUHist::MoveHistogram, so a std::vector of MUH2D moves instead of copying when it grows.
+				*/
+			MUH2D( MUH2D&& h ) noexcept;
+
+			//! Move assignment, as the move constructor
+			MUH2D& operator=( MUH2D&& h ) noexcept;
+#endif
+
 		private:
 			//! A helper function which set variables for the deep copy and assignment
 			void DeepCopy( const MUH2D& h );
 
+#if __cplusplus >= 201103L
+			//! A helper function which takes the variables of h for the move constructor and assignment
+			void MoveFrom( MUH2D& h );
+#endif
+
 		public:
 			/*! Quiet warnings about hidden overloaded virtual functions.
 				It is not clear if this is the behavior we want (may prefer
@@ -105,6 +130,11 @@ namespace PlotUtils
 			//! Add a new MULattErrorBand and fill its universes with the CV 
 			bool AddLatErrorBandAndFillWithCV( const std::string& name, const unsigned int nhists );
 
+			//! Add this vert error band (with memory ownership) to the MUH2D
+			bool PushErrorBand( const std::string& name, MUVertErrorBand2D* errBand );
+			//! Add this lat error band (with memory ownership) to the MUH2D
+			bool PushErrorBand( const std::string& name, MULatErrorBand2D* errBand );
+
 
 			//! Fill the weights of an MUVertErrorBand's universes from a vector
 			bool FillVertErrorBand( const std::string& name, const double xval, const double yval, const std::vector<double>& weights, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
@@ -112,6 +142,10 @@ namespace PlotUtils
 			bool FillVertErrorBand( const std::string& name, const double xval, const double yval, const double * weights, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
 			//! Fill the weights of an MUVertErrorBand's 2 universes with these 2 weights (must have 2)
 			bool FillVertErrorBand( const std::string& name, const double xval, const double yval, const double weightDown, const double weightUp, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			/*! Fill the weights of an MUVertErrorBand's universes for many events with one band lookup
+				weights is nEvents x nUniverses, one row per event; cvweights and cvWeightsFromMe may be NULL (all 1)
+				*/
+			bool FillVertErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *xvals, const double *yvals, const double *weights, const double *cvweights = 0, const double *cvWeightsFromMe = 0 );
 
 			//! Fill the weights of a MULatErrorBand's universes from a vector
 			bool FillLatErrorBand( const std::string& name, const double xval, const double yval, const std::vector<double>& xshifts, const std::vector<double>& yshifts, const double cvweight  = 1.0, const bool fillcv = true, const double* weights = 0 );
@@ -119,6 +153,29 @@ namespace PlotUtils
 			bool FillLatErrorBand( const std::string& name, const double xval, const double yval, const double *xshifts, const double *yshifts, const double cvweight  = 1.0, const bool fillcv = true, const double* weights = 0 );
 			//! Fill the weights of an MULatErrorBand's 2 universes with these 2 weights (must have 2)
 			bool FillLatErrorBand( const std::string& name, const double xval, const double yval, const double xshiftDown, const double xshiftUp, const double yshiftDown, const double yshiftUp, const double cvweight = 1.0, const bool fillcv = true );
+			/*! Fill the shifts of an MULatErrorBand's universes for many events with one band lookup
+				shifts and weights are nEvents x nUniverses, one row per event; cvweights and weights may be NULL
+				*/
+			bool FillLatErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *xvals, const double *yvals, const double *xshifts, const double *yshifts, const double *cvweights = 0, const bool fillcv = true, const double *weights = 0 );
+
+			//! Fill the weights of an MUVertErrorBand's universes from array, finding the band by handle
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double * weights, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			//! Fill the weights of an MUVertErrorBand's 2 universes with these 2 weights (must have 2), finding the band by handle
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double weightDown, const double weightUp, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			//! Fill the shifts of an MULatErrorBand's universes from array, finding the band by handle
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double *xshifts, const double *yshifts, const double cvweight = 1.0, const bool fillcv = true, const double *weights = 0 );
+			//! Fill the shifts of an MULatErrorBand's 2 universes with these 2 shifts (must have 2), finding the band by handle
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double xshiftDown, const double xshiftUp, const double yshiftDown, const double yshiftUp, const double cvweight = 1.0, const bool fillcv = true );
+
+			/*! Get the fill shard of a worker slot, creating it on first use.  Safe to call from many threads at once.
+				Fill the shard instead of this histogram from that worker, then call MergeFillShards once all workers are done.
+				Add all error bands before the first shard is created.
+				@param[in] slot Worker slot (e.g. the slot RDataFrame::ForeachSlot passes, or your own thread index)
+				*/
+			MUFillShard& GetFillShard( const unsigned int slot );
+
+			//! Add all fill shards into this histogram and its error bands in slot order, then delete them.  Not thread safe.
+			void MergeFillShards();
 
 			//! Get a pointer to this MUVertErrorBand
 			MUVertErrorBand2D* GetVertErrorBand( const std::string& name );
@@ -130,6 +187,20 @@ namespace PlotUtils
 			//! Get a const pointer to this MULatErrorBand
 			const MULatErrorBand2D* GetLatErrorBand( const std::string& name ) const;
 
+			//! Get a handle to this MUVertErrorBand for repeated fills and lookups (invalid handle if there is no such band)
+			MUErrorBandHandle GetVertErrorBandHandle( const std::string& name ) const;
+			//! Get a handle to this MULatErrorBand for repeated fills and lookups (invalid handle if there is no such band)
+			MUErrorBandHandle GetLatErrorBandHandle( const std::string& name ) const;
+
+			//! Get a pointer to the MUVertErrorBand with this handle
+			MUVertErrorBand2D* GetVertErrorBand( const MUErrorBandHandle& band );
+			//! Get a const pointer to the MUVertErrorBand with this handle
+			const MUVertErrorBand2D* GetVertErrorBand( const MUErrorBandHandle& band ) const;
+			//! Get a pointer to the MULatErrorBand with this handle
+			MULatErrorBand2D* GetLatErrorBand( const MUErrorBandHandle& band );
+			//! Get a const pointer to the MULatErrorBand with this handle
+			const MULatErrorBand2D* GetLatErrorBand( const MUErrorBandHandle& band ) const;
+
 			/*! Get a new TH2D which is the central value histogram with statistical error only
 				@return copy of a TH2D
 				*/
@@ -148,16 +219,37 @@ namespace PlotUtils
 			//! Get a TH2D filled with the stat error ONLY
 			TH2D GetStatError( bool asFrac = false ) const;
 
-			//! Get the Total Covariance Matrix
+			/*! Get the Total Covariance Matrix
+				The error bands are independent, so their matrices are computed on a MUTaskPool (see MUTaskPool::SetNThreads)
+				and added in a fixed order: the result does not depend on the number of threads.
+				*/
 			TMatrixD GetTotalErrorMatrix(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+			//! Get just the diagonal of GetTotalErrorMatrix, without building any matrix (also on a MUTaskPool)
+			std::vector<double> GetTotalErrorVariance(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+			/*! GetTotalErrorMatrix kept as the universes of all error bands plus a diagonal, see MULowRankCovariance.
+				Needs O(nBins * nUniverses) memory instead of O(nBins^2), so it works for binnings too big for GetTotalErrorMatrix.
+				*/
+			MULowRankCovariance GetTotalErrorLowRank(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+
+			/*! Stamp that changes whenever an error band or the set of error matrices changes.
+				The sum of the systematic matrices in GetTotalErrorMatrix is cached against it.
+				*/
+			ULong64_t GetCacheVersion() const;
+
+			//! Hits and misses of the covariance caches of this histogram and all its error bands
+			MUCovarianceCache::Stats GetCovCacheStats() const;
 			//! Get Total Correlation Matrix
 			TMatrixD GetTotalCorrelationMatrix(bool cov_area_normalize = false ) const;
 
 			//! Get Statistical Error Matrix
 			TMatrixD GetStatErrorMatrix( bool asFrac = false ) const;
+			//! Get the statistical errors as a diagonal covariance, without building the matrix
+			MUDiagonalCovariance GetStatErrorCovariance( bool asFrac = false ) const;
 
 			//! Get a single Systematical Matrix from the map
 			TMatrixD GetSysErrorMatrix(const std::string& name, bool asFrac = false, bool cov_area_normalize = false) const; 
+			//! Get just the diagonal of GetSysErrorMatrix, without building the matrix
+			std::vector<double> GetSysErrorVariance(const std::string& name, bool asFrac = false, bool cov_area_normalize = false) const;
 			//! Get a vector of the names of all error bands
 			std::vector<std::string> GetVertErrorBandNames() const;
 
@@ -172,6 +264,19 @@ namespace PlotUtils
 			//! When calling scale we need to scale all of the error bands histos
 			virtual void Scale( Double_t c1 = 1., Option_t *option = "" );
 
+			/*! Rebin in groups of nxgroup x nygroup bins and propagate to error bands and error matrices, as TH2::Rebin2D.
+				With a newname a rebinned copy is returned and this MUH2D is left alone.  Error matrices C become M*C*M^T (see MURebinMap).
+				*/
+			virtual TH2* Rebin2D( Int_t nxgroup = 2, Int_t nygroup = 2, const char* newname = "" );
+
+			/*! As Rebin2D, to nxbins bins with edges xbins on x (NULL keeps the x axis) and nybins bins with edges ybins on y
+				@return This MUH2D, or the rebinned copy if newname is given.  NULL if it could not rebin.
+				*/
+			MUH2D* Rebin2D( Int_t nxbins, const Double_t* xbins, Int_t nybins, const Double_t* ybins, const char* newname = "" );
+
+			//! Rebin everything with a map made for this binning, false (and unchanged) if it does not fit
+			bool ApplyRebinMap( const MURebinMap& map );
+
 			/*! Replace this MUH2D's contents with the result of a division of two other MUH2Ds
 			*/
 			virtual void Divide( const MUH2D* h1, const MUH2D* h2, Double_t c1 = 1, Double_t c2 = 1, Option_t* option="" );
@@ -198,6 +303,9 @@ namespace PlotUtils
 			virtual ~MUH2D() {};
 
 		private:
+			//! Rebin this (or a copy named newname) to new axes, NULL keeping an axis
+			MUH2D* RebinTo( const TAxis* newX, const TAxis* newY, const char* newname );
+
 			//! A helper function to check if this string has that ending
 			bool HasEnding (std::string const &fullString, std::string const &ending) const;
 
@@ -213,6 +321,21 @@ namespace PlotUtils
 			//! Strores a map from name to error band for MUVertErrorBands
 			std::map<std::string, MUVertErrorBand2D*> fVertErrorBandMap;
 
+			//! Lookup of the MULatErrorBands by interned name, built from fLatErrorBandMap on demand
+			MUErrorBandIndex<MULatErrorBand2D> fLatErrorBandIndex; //!
+
+			//! Lookup of the MUVertErrorBands by interned name, built from fVertErrorBandMap on demand
+			MUErrorBandIndex<MUVertErrorBand2D> fVertErrorBandIndex; //!
+
+			//! Per-worker accumulators handed out by GetFillShard
+			MUFillShardSet fFillShards; //!
+
+			//! Stamp of the last change to the error bands or error matrices held here
+			mutable MUCacheVersion fCacheVersion; //!
+
+			//! Sum of the systematic covariance matrices, absolute and shape-only
+			mutable MUCovarianceCache fTotalCovCache; //!
+
 			//! Stores the width to which we will normalize bins (e.g. n Events per fNormBinWidth GeV)
 			//! If negative, then refuse to normalize to bin width (appropriate for ratios, efficiencies)
 			Double_t fNormBinWidthX;
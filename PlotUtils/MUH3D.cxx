@@ -2,9 +2,175 @@
 #define MNV_MUH3D_cxx 1
 
 #include "PlotUtils/MUH3D.h"
+#include "PlotUtils/MUTaskPool.h"
+#include "PlotUtils/MULinearMap.h"
+#include "PlotUtils/HistogramUtils.h"
+
+#include <TDirectory.h>
+#include <TList.h>
+#include <algorithm>
+#include <cstring>
 
 using namespace PlotUtils;
 
+namespace
+{
+	//! Computes the covariance matrices (or variances) of a batch of systematics, one systematic per task
+	class SysErrorJob : public MUTaskPool::Job
+	{
+		public:
+			SysErrorJob( const MUH3D *hist, const std::vector<std::string>& names, const bool areaNorm, const bool matrices ) :
+				fHist( hist ), fNames( names ), fAreaNorm( areaNorm ), fMatrices( matrices ), fFirst( 0 )
+			{ }
+
+			//! Start a batch of n systematics from first
+			void SetBatch( const unsigned int first, const unsigned int n )
+			{
+				fFirst = first;
+				if( fMatrices )
+					fMx.resize( n );
+				else
+					fVar.resize( n );
+			}
+
+			void Run( const unsigned int i )
+			{
+				if( fMatrices )
+				{
+					const TMatrixD mx( fHist->GetSysErrorMatrix( fNames[i], false, fAreaNorm ) );
+					fMx[ i - fFirst ].ResizeTo( mx );
+					fMx[ i - fFirst ] = mx;
+				}
+				else
+					fVar[ i - fFirst ] = fHist->GetSysErrorVariance( fNames[i], false, fAreaNorm );
+			}
+
+			std::vector<TMatrixD> fMx;                ///< Matrix of each systematic in the batch
+			std::vector< std::vector<double> > fVar;  ///< Variances of each systematic in the batch
+
+		private:
+			const MUH3D *fHist;
+			const std::vector<std::string>& fNames;
+			const bool fAreaNorm;
+			const bool fMatrices;
+			unsigned int fFirst;
+	};
+
+	/*! Add the covariance matrices (or just the variances) of these systematics to covmx (or var), in the order of names.
+			The systematics are computed on a MUTaskPool, one matrix per thread at a time, and added in order, so the sum
+			has the same bits as a serial loop.
+			*/
+	void SumSysErrors( const MUH3D *hist, const std::vector<std::string>& names, const bool areaNorm, TMatrixD *covmx, std::vector<double> *var )
+	{
+		//! Threads only pay off once there are about a million multiply-adds to share
+		const double nCells = hist->GetNcells();
+		double work = 0.;
+		for( std::vector<std::string>::const_iterator i = names.begin(); i != names.end(); ++i )
+		{
+			unsigned int nUniverses = 1;
+			if( hist->HasVertErrorBand( *i ) )
+				nUniverses = hist->GetVertErrorBand( *i )->GetNHists();
+			else if( hist->HasLatErrorBand( *i ) )
+				nUniverses = hist->GetLatErrorBand( *i )->GetNHists();
+			work += nCells * ( covmx ? nCells : 1. ) * nUniverses;
+		}
+		unsigned int nThreads = ( 1e6 < work ) ? MUTaskPool::GetNThreads() : 1;
+
+		//! Big matrices are computed one at a time instead, each on all threads (MUUniverseStore::CalcCovariance)
+		if( covmx && MUCovarianceCache::GetMaxRows() < nCells )
+			nThreads = 1;
+		const unsigned int batchSize = covmx ? nThreads : names.size();
+
+		SysErrorJob job( hist, names, areaNorm, 0 != covmx );
+		for( unsigned int first = 0; first < names.size(); first += batchSize )
+		{
+			const unsigned int last = std::min( (unsigned int)names.size(), first + batchSize );
+			job.SetBatch( first, last - first );
+			MUTaskPool::Run( job, first, last, nThreads );
+
+			for( unsigned int i = 0; i != last - first; ++i )
+			{
+				if( covmx )
+					*covmx += job.fMx[i];
+				else
+				{
+					for( unsigned int k = 0; k != var->size(); ++k )
+						(*var)[k] += job.fVar[i][k];
+				}
+			}
+		}
+	}
+
+	/*! Divides or multiplies the error bands of a MUH3D, one band per task.
+		Each band only reads the bands of the same name in the operands, so the bands can be done on several threads.
+		*/
+	class BandArithmeticJob : public MUTaskPool::Job
+	{
+		public:
+			enum EOp { kDivide, kDivideSingle, kMultiply };
+
+			BandArithmeticJob( const EOp op, const TH3 *single, const Double_t c1, const Double_t c2, Option_t *option = "" ) :
+				fOp( op ), fSingle( single ), fC1( c1 ), fC2( c2 ), fOption( option ), fWork( 0. )
+			{ }
+
+			//! Queue band = err1 op err2 (err2 is unused for DivideSingle)
+			void AddBand( MUVertErrorBand3D *band, const MUVertErrorBand3D *err1, const MUVertErrorBand3D *err2 )
+			{
+				fVert.push_back( band );
+				fVert1.push_back( err1 );
+				fVert2.push_back( err2 );
+				fWork += double( band->GetNcells() ) * band->GetNHists();
+			}
+
+			void AddBand( MULatErrorBand3D *band, const MULatErrorBand3D *err1, const MULatErrorBand3D *err2 )
+			{
+				fLat.push_back( band );
+				fLat1.push_back( err1 );
+				fLat2.push_back( err2 );
+				fWork += double( band->GetNcells() ) * band->GetNHists();
+			}
+
+			//! Do all queued bands, vertical first, on threads once there are about a million bins to share
+			void RunAll()
+			{
+				MUTaskPool::Run( *this, 0, fVert.size() + fLat.size(), ( 1e6 < fWork ) ? 0 : 1 );
+			}
+
+			void Run( const unsigned int i )
+			{
+				if( i < fVert.size() )
+					Apply( fVert[i], fVert1[i], fVert2[i] );
+				else
+				{
+					const unsigned int j = i - fVert.size();
+					Apply( fLat[j], fLat1[j], fLat2[j] );
+				}
+			}
+
+		private:
+			template<class BAND>
+			void Apply( BAND *band, const BAND *err1, const BAND *err2 ) const
+			{
+				switch( fOp )
+				{
+					case kDivide:       band->Divide( err1, err2, fC1, fC2, fOption ); break;
+					case kDivideSingle: band->DivideSingle( err1, fSingle, fC1, fC2, fOption ); break;
+					case kMultiply:     band->Multiply( err1, err2, fC1, fC2 ); break;
+				}
+			}
+
+			const EOp fOp;
+			const TH3 *fSingle;
+			const Double_t fC1, fC2;
+			Option_t *fOption;
+			double fWork;                                  ///< Bins x universes of all queued bands
+			std::vector<MUVertErrorBand3D*> fVert;
+			std::vector<const MUVertErrorBand3D*> fVert1, fVert2;
+			std::vector<MULatErrorBand3D*> fLat;
+			std::vector<const MULatErrorBand3D*> fLat1, fLat2;
+	};
+}
+
 //==================================================================================
 // CONSTRUCTORS
 //==================================================================================
@@ -105,10 +271,14 @@ MUH3D& MUH3D::operator=( const MUH3D& h )
 	for( std::map<std::string, MUVertErrorBand3D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
 		delete it->second;
 	fVertErrorBandMap.clear();
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	for( std::map<std::string, MULatErrorBand3D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
 		delete it->second;
 	fLatErrorBandMap.clear();
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	//! Then deep copy the variables
 	DeepCopy(h);
@@ -116,6 +286,87 @@ MUH3D& MUH3D::operator=( const MUH3D& h )
 	return *this;
 }
 
+TObject* MUH3D::Clone( const char* newname /*= ""*/ ) const
+{
+	//! A class derived from MUH3D is cloned by ROOT, which knows all of its members
+	if( IsA() != MUH3D::Class() )
+		return TH3D::Clone( newname );
+
+	//! The copy constructor shares the universes instead of copying them
+	MUH3D *h = new MUH3D( *this );
+
+	//! TH1::Clone also clones the attached functions, which the copy constructor does not
+	TList *functions = GetListOfFunctions();
+	for( int i = 0; functions && i < functions->GetSize(); ++i )
+		h->GetListOfFunctions()->Add( functions->At(i)->Clone() );
+
+	if( newname && strlen(newname) )
+		h->SetName( newname );
+	return h;
+}
+
+#if __cplusplus >= 201103L
+MUH3D::MUH3D( MUH3D&& h ) noexcept :
+	TH3D()
+{
+	//! Take the bins and the error bands instead of copying them
+	MUHist::MoveHistogram( *this, h );
+	MoveFrom( h );
+}
+
+MUH3D& MUH3D::operator=( MUH3D&& h ) noexcept
+{
+	//! If this is me, there is nothing to move
+	if( this == &h )
+		return *this;
+
+	//! Take the bins of h
+	MUHist::MoveHistogram( *this, h );
+
+	//! Delete all vert and lat error bands and matrices
+	for( std::map<std::string, MUVertErrorBand3D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+		delete it->second;
+	fVertErrorBandMap.clear();
+	for( std::map<std::string, MULatErrorBand3D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+		delete it->second;
+	fLatErrorBandMap.clear();
+	for( std::map<std::string, TMatrixD*>::iterator it = fSysErrorMatrix.begin(); it != fSysErrorMatrix.end(); ++it )
+		delete it->second;
+	fSysErrorMatrix.clear();
+	for( std::map<std::string, TMatrixD*>::iterator it = fRemovedSysErrorMatrix.begin(); it != fRemovedSysErrorMatrix.end(); ++it )
+		delete it->second;
+	fRemovedSysErrorMatrix.clear();
+	fFillShards.Clear();
+
+	MoveFrom( h );
+
+	return *this;
+}
+
+void MUH3D::MoveFrom( MUH3D& h )
+{
+	fNormBinWidthX = h.fNormBinWidthX;
+	fNormBinWidthY = h.fNormBinWidthY;
+	fNormBinWidthZ = h.fNormBinWidthZ;
+
+	//! The maps hold pointers, so swapping them hands over every band and matrix as it is
+	fVertErrorBandMap.swap( h.fVertErrorBandMap );
+	fLatErrorBandMap.swap( h.fLatErrorBandMap );
+	fSysErrorMatrix.swap( h.fSysErrorMatrix );
+	fRemovedSysErrorMatrix.swap( h.fRemovedSysErrorMatrix );
+
+	//! Fills still in the shards belong to the bands, so they go along
+	fFillShards.Swap( h.fFillShards );
+
+	fVertErrorBandIndex.Invalidate();
+	fLatErrorBandIndex.Invalidate();
+	h.fVertErrorBandIndex.Invalidate();
+	h.fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
+	h.fCacheVersion.Touch();
+}
+#endif
+
 void MUH3D::DeepCopy( const MUH3D& h )
 {
 	//! Set bin norm width
@@ -127,10 +378,14 @@ void MUH3D::DeepCopy( const MUH3D& h )
 	std::vector<std::string> vertNames = h.GetVertErrorBandNames();
 	for( std::vector<std::string>::iterator name = vertNames.begin(); name != vertNames.end(); ++name )
 		fVertErrorBandMap[*name] = new MUVertErrorBand3D( *h.GetVertErrorBand(*name) );
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	std::vector<std::string> latNames = h.GetLatErrorBandNames();
 	for( std::vector<std::string>::iterator name = latNames.begin(); name != latNames.end(); ++name )
 		fLatErrorBandMap[*name] = new MULatErrorBand3D( *h.GetLatErrorBand(*name) );
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 }
 
 //--------------------------------------------------------
@@ -189,45 +444,9 @@ MUH1D * MUH3D::ProjectionX(const char* name /*= "_px"*/, Int_t firstybin /*= 0*/
 	TH1D *cv_px = this->TH3D::ProjectionX(name, firstybin, lastybin, firstzbin, lastzbin, option); 
 	MUH1D *h_px = new MUH1D( *cv_px );
 
-	//! Getting Vertical Names
-	std::vector<std::string> vertNames = GetVertErrorBandNames();
-	for( unsigned int i = 0; i != vertNames.size(); ++i )
-	{
-		std::vector<TH1D*> vert_hists;
-		const MUVertErrorBand3D *errBand = GetVertErrorBand(vertNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-			TH1D *h_universe_px = h_universe->ProjectionX( Form("%s_%s_universe%i", name, vertNames[i].c_str(), j), firstybin, lastybin, firstzbin, lastzbin, option );
-			vert_hists.push_back(h_universe_px);
-		}
-		h_px->AddVertErrorBand(vertNames[i], vert_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = vert_hists.begin() ; itHist != vert_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
-
-	//! Getting Lateral Names
-	std::vector<std::string> latNames = GetLatErrorBandNames();
-	for( unsigned int i = 0; i != latNames.size(); ++i )
-	{
-		std::vector<TH1D*> lat_hists;
-		const MULatErrorBand3D *errBand = GetLatErrorBand(latNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-			TH1D *h_universe_px = h_universe->ProjectionX( Form("%s_%s_universe%i", name, latNames[i].c_str(), j), firstybin, lastybin, firstzbin, lastzbin, option );
-			lat_hists.push_back(h_universe_px);
-		}
-		h_px->AddLatErrorBand(latNames[i], lat_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = lat_hists.begin() ; itHist != lat_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
+	//! Project all universes of each error band in one pass, straight into the bands of the projection
+	const int firstBins[3] = { 0, firstybin, firstzbin }, lastBins[3] = { -1, lastybin, lastzbin };
+	MULinearMap::Projection( this, h_px, "x", firstBins, lastBins ).ApplyToErrorBands( *this, *h_px );
 
 	return h_px;
 }
@@ -237,45 +456,9 @@ MUH1D * MUH3D::ProjectionY(const char* name /*= "_py"*/, Int_t firstxbin /*= 0*/
 	TH1D *cv_py = TH3D::ProjectionY(name, firstxbin, lastxbin, firstzbin, lastzbin, option); 
 	MUH1D *h_py = new MUH1D( *cv_py );
 
-	//! Getting Vertical Names
-	std::vector<std::string> vertNames = GetVertErrorBandNames();
-	for( unsigned int i = 0; i != vertNames.size(); ++i )
-	{
-		std::vector<TH1D*> vert_hists;
-		const MUVertErrorBand3D *errBand = GetVertErrorBand(vertNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-			TH1D *h_universe_py = h_universe->ProjectionY( Form("%s_%s_universe%i", name, vertNames[i].c_str(), j), firstxbin, lastxbin, firstzbin, lastzbin, option );
-			vert_hists.push_back(h_universe_py);
-		}
-		h_py->AddVertErrorBand(vertNames[i], vert_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = vert_hists.begin() ; itHist != vert_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
-
-	//! Getting Lateral Names
-	std::vector<std::string> latNames = GetLatErrorBandNames();
-	for( unsigned int i = 0; i != latNames.size(); ++i )
-	{
-		std::vector<TH1D*> lat_hists;
-		const MULatErrorBand3D *errBand = GetLatErrorBand(latNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-			TH1D *h_universe_py = h_universe->ProjectionY( Form("%s_%s_universe%i", name, latNames[i].c_str(), j), firstxbin, lastxbin, firstzbin, lastzbin, option );
-			lat_hists.push_back(h_universe_py);
-		}
-		h_py->AddLatErrorBand(latNames[i], lat_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = lat_hists.begin() ; itHist != lat_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
+	//! Project all universes of each error band in one pass, straight into the bands of the projection
+	const int firstBins[3] = { firstxbin, 0, firstzbin }, lastBins[3] = { lastxbin, -1, lastzbin };
+	MULinearMap::Projection( this, h_py, "y", firstBins, lastBins ).ApplyToErrorBands( *this, *h_py );
 
 	return h_py;
 }
@@ -285,45 +468,9 @@ MUH1D * MUH3D::ProjectionZ(const char* name /*= "_pz"*/, Int_t firstxbin /*= 0*/
 	TH1D *cv_pz = TH3D::ProjectionZ(name, firstxbin, lastxbin, firstybin, lastybin, option); 
 	MUH1D *h_pz = new MUH1D( *cv_pz );
 
-	//! Getting Vertical Names
-	std::vector<std::string> vertNames = GetVertErrorBandNames();
-	for( unsigned int i = 0; i != vertNames.size(); ++i )
-	{
-		std::vector<TH1D*> vert_hists;
-		const MUVertErrorBand3D *errBand = GetVertErrorBand(vertNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-			TH1D *h_universe_pz = h_universe->ProjectionZ( Form("%s_%s_universe%i", name, vertNames[i].c_str(), j), firstxbin, lastxbin, firstybin, lastybin, option );
-			vert_hists.push_back(h_universe_pz);
-		}
-		h_pz->AddVertErrorBand(vertNames[i], vert_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = vert_hists.begin() ; itHist != vert_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
-
-	//! Getting Lateral Names
-	std::vector<std::string> latNames = GetLatErrorBandNames();
-	for( unsigned int i = 0; i != latNames.size(); ++i )
-	{
-		std::vector<TH1D*> lat_hists;
-		const MULatErrorBand3D *errBand = GetLatErrorBand(latNames[i]);
-		int nUniverses = errBand->GetNHists();
-		for (int j = 0; j != nUniverses; ++j)
-		{
-			const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-			TH1D *h_universe_pz = h_universe->ProjectionZ( Form("%s_%s_universe%i", name, latNames[i].c_str(), j), firstxbin, lastxbin, firstybin, lastybin, option );
-			lat_hists.push_back(h_universe_pz);
-		}
-		h_pz->AddLatErrorBand(latNames[i], lat_hists);
-
-		//cleaning
-		for (std::vector<TH1D*>::iterator itHist = lat_hists.begin() ; itHist != lat_hists.end() ; ++ itHist)
-			delete *itHist;
-	}
+	//! Project all universes of each error band in one pass, straight into the bands of the projection
+	const int firstBins[3] = { firstxbin, firstybin, 0 }, lastBins[3] = { lastxbin, lastybin, -1 };
+	MULinearMap::Projection( this, h_pz, "z", firstBins, lastBins ).ApplyToErrorBands( *this, *h_pz );
 
 	return h_pz;
 }
@@ -332,98 +479,52 @@ TH1 * MUH3D::Project3D(Option_t* option /*= "x"*/) const
 {
 
 	TH1 *cv_p = TH3D::Project3D(option);
+	if( !cv_p )
+	{
+		std::cout<<"[MUH3D::Project3D]: TH3D::Project3D gave no projection for option \""<<option<<"\". Returning NULL pointer"<<std::endl;
+		return (TH1*)NULL;
+	}
 	int dim = cv_p->GetDimension();
 
-	//!Crappy way to fill the universes for MUH1D/2D
-	MUH1D *h_p1D = NULL;
-	MUH2D *h_p2D = NULL;
+	//! "yx" is y versus x, so the letters of the option name the axes of the projection from the last
+	std::string opt( option );
+	std::transform( opt.begin(), opt.end(), opt.begin(), ::tolower );
+	std::string axes;
+	for( std::string::const_iterator c = opt.begin(); c != opt.end(); ++c )
+	{
+		if( 'x' <= *c && *c <= 'z' )
+			axes.insert( axes.begin(), *c );
+	}
 
-	if (dim == 1)
+	//! Summed axes use the range set on them, or all bins with the under/overflow that "nuf" and "nof" do not leave out
+	int firstBins[3], lastBins[3];
+	const TAxis *axisList[3] = { GetXaxis(), GetYaxis(), GetZaxis() };
+	for( int d = 0; d != 3; ++d )
 	{
-		h_p1D = new MUH1D( *(dynamic_cast<TH1D*>( cv_p )) );
-		//! Getting Vertical Names
-		std::vector<std::string> vertNames = GetVertErrorBandNames();
-		for( unsigned int i = 0; i != vertNames.size(); ++i )
+		if( axisList[d]->TestBit( TAxis::kAxisRange ) )
 		{
-			std::vector<TH1D*> vert_hists;
-			const MUVertErrorBand3D *errBand = GetVertErrorBand(vertNames[i]);
-			int nUniverses = errBand->GetNHists();
-			for (int j = 0; j != nUniverses; ++j)
-			{
-				const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-				TH1D *h_universe_p = dynamic_cast<TH1D*>( h_universe->Project3D( option ) );
-				vert_hists.push_back( h_universe_p );
-			}
-			h_p1D->AddVertErrorBand(vertNames[i], vert_hists);
-
-			//cleaning
-			for (std::vector<TH1D*>::iterator itHist = vert_hists.begin() ; itHist != vert_hists.end() ; ++ itHist)
-				delete *itHist;
+			firstBins[d] = 0;
+			lastBins[d] = -1;
 		}
-
-		//! Getting Lateral Names
-		std::vector<std::string> latNames = GetLatErrorBandNames();
-		for( unsigned int i = 0; i != latNames.size(); ++i )
+		else
 		{
-			std::vector<TH1D*> lat_hists;
-			const MULatErrorBand3D *errBand = GetLatErrorBand(latNames[i]);
-			int nUniverses = errBand->GetNHists();
-			for (int j = 0; j != nUniverses; ++j)
-			{
-				const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-				TH1D *h_universe_p = dynamic_cast<TH1D*>( h_universe->Project3D( option ) );
-				lat_hists.push_back( h_universe_p );
-			}
-			h_p1D->AddLatErrorBand(latNames[i], lat_hists);
-
-			//cleaning
-			for (std::vector<TH1D*>::iterator itHist = lat_hists.begin() ; itHist != lat_hists.end() ; ++ itHist)
-				delete *itHist;
+			firstBins[d] = ( std::string::npos == opt.find( "nuf" ) ) ? 0 : 1;
+			lastBins[d] = ( std::string::npos == opt.find( "nof" ) ) ? axisList[d]->GetNbins() + 1 : axisList[d]->GetNbins();
 		}
+	}
+	const MULinearMap projection = MULinearMap::Projection( this, cv_p, axes, firstBins, lastBins );
+
+	//! Project all universes of each error band in one pass, straight into the bands of the projection
+	if (dim == 1)
+	{
+		MUH1D *h_p1D = new MUH1D( *(dynamic_cast<TH1D*>( cv_p )) );
+		projection.ApplyToErrorBands( *this, *h_p1D );
 		return dynamic_cast<TH1*>( h_p1D );
 	}//end of dim==1
 	else if (dim == 2)
 	{
-		h_p2D = new MUH2D( *(dynamic_cast<TH2D*>( cv_p )) );
-		//! Getting Vertical Names
-		std::vector<std::string> vertNames = GetVertErrorBandNames();
-		for( unsigned int i = 0; i != vertNames.size(); ++i )
-		{
-			std::vector<TH2D*> vert_hists;
-			const MUVertErrorBand3D *errBand = GetVertErrorBand(vertNames[i]);
-			int nUniverses = errBand->GetNHists();
-			for (int j = 0; j != nUniverses; ++j)
-			{
-				const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-				TH2D *h_universe_p = dynamic_cast<TH2D*>( h_universe->Project3D( option ) );
-				vert_hists.push_back( h_universe_p );
-			}
-			h_p2D->AddVertErrorBand(vertNames[i], vert_hists);
-
-			//cleaning
-			for (std::vector<TH2D*>::iterator itHist = vert_hists.begin() ; itHist != vert_hists.end() ; ++ itHist)
-				delete *itHist;
-		}
-
-		//! Getting Lateral Names
-		std::vector<std::string> latNames = GetLatErrorBandNames();
-		for( unsigned int i = 0; i != latNames.size(); ++i )
-		{
-			std::vector<TH2D*> lat_hists;
-			const MULatErrorBand3D *errBand = GetLatErrorBand(latNames[i]);
-			int nUniverses = errBand->GetNHists();
-			for (int j = 0; j != nUniverses; ++j)
-			{
-				const TH3D *h_universe = dynamic_cast<const TH3D*>( errBand->GetHist(j) );
-				TH2D *h_universe_p = dynamic_cast<TH2D*>( h_universe->Project3D( option ) );
-				lat_hists.push_back( h_universe_p );
-			}
-			h_p2D->AddLatErrorBand(latNames[i], lat_hists);
-
-			//cleaning
-			for (std::vector<TH2D*>::iterator itHist = lat_hists.begin() ; itHist != lat_hists.end() ; ++ itHist)
-				delete *itHist;
-		}
+		MUH2D *h_p2D = new MUH2D( *(dynamic_cast<TH2D*>( cv_p )) );
+		projection.ApplyToErrorBands( *this, *h_p2D );
 		return dynamic_cast<TH1*>( h_p2D );
 	}//end of dim==2
 	else
@@ -451,6 +552,8 @@ bool MUH3D::AddVertErrorBand( const std::string& name, const int nhists /* = -1
 		fVertErrorBandMap[name] = new MUVertErrorBand3D( errName, (TH3D*)this, nhists );
 	else
 		fVertErrorBandMap[name] = new MUVertErrorBand3D( errName, (TH3D*)this );
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -469,6 +572,8 @@ bool MUH3D::AddVertErrorBand( const std::string& name, const std::vector<TH3D*>&
 
 	//!Set the ErrorBand
 	fVertErrorBandMap[name] = new MUVertErrorBand3D( errName, (TH3D*)this, base );
+	fVertErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -490,6 +595,8 @@ bool MUH3D::AddLatErrorBand( const std::string& name, const int nhists /* = -1 *
 		fLatErrorBandMap[name] = new MULatErrorBand3D( errName, (TH3D*)this, nhists );
 	else
 		fLatErrorBandMap[name] = new MULatErrorBand3D( errName, (TH3D*)this );
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -508,6 +615,8 @@ bool MUH3D::AddLatErrorBand( const std::string& name, const std::vector<TH3D*>&
 
 	//!Set the ErrorBand
 	fLatErrorBandMap[name] = new MULatErrorBand3D( errName, (TH3D*)this, base );
+	fLatErrorBandIndex.Invalidate();
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -540,6 +649,17 @@ bool MUH3D::FillVertErrorBand( const std::string& name, const double xval, const
 	return false;
 }
 
+bool MUH3D::FillVertErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *xvals, const double *yvals, const double *zvals, const double *weights, const double *cvweights /* = 0 */, const double *cvWeightsFromMe /* = 0 */ )
+{
+	//! Try to fill a vertical error band
+	MUVertErrorBand3D *vert = GetVertErrorBand( name );
+	if( vert )
+		return vert->FillBatch( nEvents, xvals, yvals, zvals, weights, cvweights, cvWeightsFromMe );
+
+	std::cout << "Warning [MUH3D::FillVertErrorBandBatch] : Could not find a vertical error band to fill with name = " << name << std::endl;
+	return false;
+}
+
 bool MUH3D::FillLatErrorBand( const std::string& name, const double xval, const double yval, const double zval, const std::vector<double>& xshifts, const std::vector<double>& yshifts, const std::vector<double>& zshifts, const double cvweight  /*= 1.0*/, const bool fillcv /*= true*/, const double* weights /*= NULL*/  )
 {
 	return FillLatErrorBand( name, xval, yval, zval, &(xshifts[0]), &(yshifts[0]), &(zshifts[0]), cvweight, fillcv, weights );
@@ -569,71 +689,239 @@ bool MUH3D::FillLatErrorBand( const std::string& name, const double xval, const
 	return false;
 }
 
+bool MUH3D::FillLatErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *xvals, const double *yvals, const double *zvals, const double *xshifts, const double *yshifts, const double *zshifts, const double *cvweights /* = 0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+	//! Try to fill a lateral error band
+	MULatErrorBand3D *lat = GetLatErrorBand( name );
+	if( lat )
+		return lat->FillBatch( nEvents, xvals, yvals, zvals, xshifts, yshifts, zshifts, cvweights, fillcv, weights );
 
-MUVertErrorBand3D* MUH3D::GetVertErrorBand( const std::string& name )
+	std::cout << "Warning [MUH3D::FillLatErrorBandBatch] : Could not find a lateral error band to fill with name = " << name << std::endl;
+	return false;
+}
+
+bool MUH3D::FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double * weights, const double cvweight /* = 1.0 */, double cvWeightFromMe /*= 1.*/ )
+{
+	MUVertErrorBand3D *vert = GetVertErrorBand( band );
+	if( vert )
+		return vert->Fill( xval, yval, zval, weights, cvweight, cvWeightFromMe );
+
+	return false;
+}
+
+bool MUH3D::FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double weightDown, const double weightUp, const double cvweight /* = 1.0 */, double cvWeightFromMe /*= 1.*/ )
+{
+	MUVertErrorBand3D *vert = GetVertErrorBand( band );
+	if( vert )
+		return vert->Fill( xval, yval, zval, weightDown, weightUp, cvweight, cvWeightFromMe );
+
+	return false;
+}
+
+bool MUH3D::FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *xshifts, const double *yshifts, const double *zshifts, const double cvweight /* = 1.0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+	MULatErrorBand3D *lat = GetLatErrorBand( band );
+	if( lat )
+		return lat->Fill( xval, yval, zval, xshifts, yshifts, zshifts, cvweight, fillcv, weights );
+
+	return false;
+}
+
+bool MUH3D::FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double xshiftDown, const double xshiftUp, const double yshiftDown, const double yshiftUp, const double zshiftDown, const double zshiftUp, const double cvweight /* = 1.0 */, const bool fillcv /* = true */ )
 {
-	std::map<std::string, MUVertErrorBand3D*>::iterator i = fVertErrorBandMap.find( name );
-	if( i == fVertErrorBandMap.end() )
+	MULatErrorBand3D *lat = GetLatErrorBand( band );
+	if( lat )
+		return lat->Fill( xval, yval, zval, xshiftDown, xshiftUp, yshiftDown, yshiftUp, zshiftDown, zshiftUp, cvweight, fillcv );
+
+	return false;
+}
+
+MUFillShard& MUH3D::GetFillShard( const unsigned int slot )
+{
+	MUFillShardLock lock;
+	MUFillShard *shard = fFillShards.Get( slot );
+	if( !shard )
 	{
-		std::cout << "Warning [MUH3D::GetVertErrorBand] : There is no vertical error band with name \"" << name << "\".  Returning NULL." << std::endl;
-		return NULL;
+		shard = CreateFillShard( false );
+		fFillShards.Set( slot, shard );
+	}
+	return *shard;
+}
+
+MUFillShard& MUH3D::GetSharedFillShard()
+{
+	MUFillShardLock lock;
+	MUFillShard *shard = fFillShards.GetShared();
+	if( !shard )
+	{
+		shard = CreateFillShard( true );
+		fFillShards.SetShared( shard );
 	}
+	return *shard;
+}
+
+MUFillShard* MUH3D::CreateFillShard( const bool shared ) const
+{
+	//! The shard gets every band we have now
+	MUFillShard *shard = new MUFillShard( this, shared );
+	for( std::map<std::string, MUVertErrorBand3D*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+		shard->AddVertErrorBand( MUErrorBandHandle::Intern( i->first ), i->second->GetNHists() );
+	for( std::map<std::string, MULatErrorBand3D*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+		shard->AddLatErrorBand( MUErrorBandHandle::Intern( i->first ), i->second->GetNHists() );
 
-	return i->second;
+	return shard;
 }
 
-const MUVertErrorBand3D* MUH3D::GetVertErrorBand( const std::string& name ) const
+void MUH3D::MergeFillShards()
+{
+	//! Always in slot order, so the sums come out the same however the threads ran
+	for( unsigned int slot = 0; slot != fFillShards.GetNSlots(); ++slot )
+	{
+		if( fFillShards.Get( slot ) )
+			MergeFillShard( *fFillShards.Get( slot ) );
+	}
+	if( fFillShards.GetShared() )
+		MergeFillShard( *fFillShards.GetShared() );
+
+	fFillShards.Clear();
+}
+
+void MUH3D::MergeFillShard( const MUFillShard& shard )
 {
-	std::map<std::string, MUVertErrorBand3D*>::const_iterator i = fVertErrorBandMap.find( name );
-	if( i == fVertErrorBandMap.end() )
+	shard.GetCV().AddTo( this );
+
+	const std::vector<MUFillShard::Band>& vertBands = shard.GetVertErrorBands();
+	for( std::vector<MUFillShard::Band>::const_iterator i = vertBands.begin(); i != vertBands.end(); ++i )
 	{
+		MUVertErrorBand3D *vert = GetVertErrorBand( i->band );
+		if( !vert )
+		{
+			std::cout << "Warning [MUH3D::MergeFillShards] : Vertical error band \"" << i->band.GetName() << "\" was removed while filling.  Its shard contents are lost." << std::endl;
+			continue;
+		}
+		i->cv.AddTo( vert );
+		vert->GetUniverseStore().Add( i->universes );
+	}
+
+	const std::vector<MUFillShard::Band>& latBands = shard.GetLatErrorBands();
+	for( std::vector<MUFillShard::Band>::const_iterator i = latBands.begin(); i != latBands.end(); ++i )
+	{
+		MULatErrorBand3D *lat = GetLatErrorBand( i->band );
+		if( !lat )
+		{
+			std::cout << "Warning [MUH3D::MergeFillShards] : Lateral error band \"" << i->band.GetName() << "\" was removed while filling.  Its shard contents are lost." << std::endl;
+			continue;
+		}
+		i->cv.AddTo( lat );
+		lat->GetUniverseStore().Add( i->universes );
+	}
+}
+
+
+MUVertErrorBand3D* MUH3D::GetVertErrorBand( const std::string& name )
+{
+	MUVertErrorBand3D *band = fVertErrorBandIndex.Find( name, fVertErrorBandMap );
+	if( !band )
 		std::cout << "Warning [MUH3D::GetVertErrorBand] : There is no vertical error band with name \"" << name << "\".  Returning NULL." << std::endl;
-		return NULL;
+
+	return band;
+}
+
+const MUVertErrorBand3D* MUH3D::GetVertErrorBand( const std::string& name ) const
+{
+	MUVertErrorBand3D *band = fVertErrorBandIndex.Find( name, fVertErrorBandMap );
+	if( !band )
+		std::cout << "Warning [MUH3D::GetVertErrorBand] : There is no vertical error band with name \"" << name << "\".  Returning NULL." << std::endl;
+
+	return band;
+}
+
+MUErrorBandHandle MUH3D::GetVertErrorBandHandle( const std::string& name ) const
+{
+	if( !fVertErrorBandIndex.Find( name, fVertErrorBandMap ) )
+	{
+		std::cout << "Warning [MUH3D::GetVertErrorBandHandle] : There is no vertical error band with name \"" << name << "\".  Returning an invalid handle." << std::endl;
+		return MUErrorBandHandle();
 	}
 
-	return i->second;
+	return MUErrorBandHandle::Find( name );
 }
 
-MULatErrorBand3D* MUH3D::GetLatErrorBand( const std::string& name )
+MUErrorBandHandle MUH3D::GetLatErrorBandHandle( const std::string& name ) const
 {
-	std::map<std::string, MULatErrorBand3D*>::iterator i = fLatErrorBandMap.find( name );
-	if( i == fLatErrorBandMap.end() )
+	if( !fLatErrorBandIndex.Find( name, fLatErrorBandMap ) )
 	{
-		std::cout << "Warning [MUH3D::GetLatErrorBand] : There is no lateral error band with name \"" << name << "\".  Returning NULL." << std::endl;
-		return NULL;
+		std::cout << "Warning [MUH3D::GetLatErrorBandHandle] : There is no lateral error band with name \"" << name << "\".  Returning an invalid handle." << std::endl;
+		return MUErrorBandHandle();
 	}
 
-	return i->second;
+	return MUErrorBandHandle::Find( name );
+}
+
+MUVertErrorBand3D* MUH3D::GetVertErrorBand( const MUErrorBandHandle& band )
+{
+	MUVertErrorBand3D *errBand = fVertErrorBandIndex.Find( band, fVertErrorBandMap );
+	if( !errBand )
+		std::cout << "Warning [MUH3D::GetVertErrorBand] : There is no vertical error band with name \"" << band.GetName() << "\".  Returning NULL." << std::endl;
+
+	return errBand;
+}
+
+const MUVertErrorBand3D* MUH3D::GetVertErrorBand( const MUErrorBandHandle& band ) const
+{
+	MUVertErrorBand3D *errBand = fVertErrorBandIndex.Find( band, fVertErrorBandMap );
+	if( !errBand )
+		std::cout << "Warning [MUH3D::GetVertErrorBand] : There is no vertical error band with name \"" << band.GetName() << "\".  Returning NULL." << std::endl;
+
+	return errBand;
+}
+
+MULatErrorBand3D* MUH3D::GetLatErrorBand( const MUErrorBandHandle& band )
+{
+	MULatErrorBand3D *errBand = fLatErrorBandIndex.Find( band, fLatErrorBandMap );
+	if( !errBand )
+		std::cout << "Warning [MUH3D::GetLatErrorBand] : There is no lateral error band with name \"" << band.GetName() << "\".  Returning NULL." << std::endl;
+
+	return errBand;
+}
+
+const MULatErrorBand3D* MUH3D::GetLatErrorBand( const MUErrorBandHandle& band ) const
+{
+	MULatErrorBand3D *errBand = fLatErrorBandIndex.Find( band, fLatErrorBandMap );
+	if( !errBand )
+		std::cout << "Warning [MUH3D::GetLatErrorBand] : There is no lateral error band with name \"" << band.GetName() << "\".  Returning NULL." << std::endl;
+
+	return errBand;
+}
+
+MULatErrorBand3D* MUH3D::GetLatErrorBand( const std::string& name )
+{
+	MULatErrorBand3D *band = fLatErrorBandIndex.Find( name, fLatErrorBandMap );
+	if( !band )
+		std::cout << "Warning [MUH3D::GetLatErrorBand] : There is no lateral error band with name \"" << name << "\".  Returning NULL." << std::endl;
+
+	return band;
 }
 
 const MULatErrorBand3D* MUH3D::GetLatErrorBand( const std::string& name ) const
 {
-	std::map<std::string, MULatErrorBand3D*>::const_iterator i = fLatErrorBandMap.find( name );
-	if( i == fLatErrorBandMap.end() )
-	{
+	MULatErrorBand3D *band = fLatErrorBandIndex.Find( name, fLatErrorBandMap );
+	if( !band )
 		std::cout << "Warning [MUH3D::GetLatErrorBand] : There is no lateral error band with name \"" << name << "\".  Returning NULL." << std::endl;
-		return NULL;
-	}
 
-	return i->second;
+	return band;
 }
 
 bool MUH3D::HasLatErrorBand( const std::string& name ) const
 {
 	//! Check the MULatErrorBands
-	if( fLatErrorBandMap.find( name ) != fLatErrorBandMap.end() )
-		return true;
-
-	return false;
+	return fLatErrorBandIndex.Find( name, fLatErrorBandMap ) != NULL;
 }
 
 bool MUH3D::HasVertErrorBand( const std::string& name ) const
 {
 	//! Check the MUVertErrorBands
-	if( fVertErrorBandMap.find( name ) != fVertErrorBandMap.end() )
-		return true;
-
-	return false;
+	return fVertErrorBandIndex.Find( name, fVertErrorBandMap ) != NULL;
 }
 
 bool MUH3D::HasErrorBand( const std::string& name ) const
@@ -749,29 +1037,57 @@ TMatrixD MUH3D::GetSysErrorMatrix(const std::string& name, bool asFrac /*= false
 	return covmx;
 }
 
-TMatrixD MUH3D::GetStatErrorMatrix( bool asFrac /* =false */ ) const
+std::vector<double> MUH3D::GetSysErrorVariance(const std::string& name, bool asFrac /*= false*/, bool cov_area_normalize /*= false*/) const
 {
-	const int highBinX = GetNbinsX() + 1;
-	const int highBinY = GetNbinsY() + 1;
-	const int highBinZ = GetNbinsZ() + 1;
-	const int highBin  = GetBin( highBinX, highBinY, highBinZ );
-	const int lowBin = 0;
-	TMatrixD covmx(highBin+1,highBin+1);
-	//! stat error
-	for (int iBin=lowBin; iBin<=highBin; ++iBin )
-		covmx[iBin][iBin]= GetBinError(iBin);
+	if (HasEnding(name,"_asShape") )
+		std::cout << "Warning [MUH3D::GetSysErrorVariance]: You are calling the error Matrix: " << name <<".\nAssuming the error Band wanted is: " << name.substr(0,name.length()-8) << " with cov_area_normalize = true" << std::endl;
+
+	const std::string name_condition = ( (cov_area_normalize) && !(HasEnding(name,"_asShape")) )?  "_asShape" : "";
+	const std::string fname = name + name_condition ; 
+	const std::string errName = HasEnding(fname,"_asShape") ? fname.substr(0,fname.length()-8) : fname;
+
+	std::vector<double> var( GetNcells(), 0. );
+
+	if ( HasErrorMatrix( fname ) )
+	{
+		const TMatrixD& covmx = *(fSysErrorMatrix.find(fname)->second);
+		for( int i = 0; i < GetNcells() && i < covmx.GetNrows() && i < covmx.GetNcols(); ++i )
+			var[i] = covmx[i][i];
+	}
+	else if( fLatErrorBandMap.find( errName ) != fLatErrorBandMap.end() )
+		var = fLatErrorBandMap.find( errName )->second->CalcVariance( ( HasEnding(fname,"_asShape") ) );
+	else if( fVertErrorBandMap.find( errName ) != fVertErrorBandMap.end() )
+		var = fVertErrorBandMap.find( errName )->second->CalcVariance( ( HasEnding(fname,"_asShape") ) );
+	else
+		std::cout << "Warning [MUH3D::GetSysErrorVariance]: There is no Covariance Matrix with name " << fname << ".Returning zeros." << std::endl;
 
 	if (asFrac)
-	{ 
-		for( int iBin = lowBin; iBin <= highBin; ++iBin )
+	{
+		for( unsigned int i = 0; i != var.size(); ++i )
 		{
-			double binCon = GetBinContent(iBin);
-			double binErr = ( binCon != 0. ? covmx[iBin][iBin]/binCon : 0. ); 
-			covmx[iBin][iBin] = binErr;
+			const double cv = GetBinContent(i);
+			var[i] = ( cv != 0. ) ? var[i]/(cv * cv) : 0.;
 		}
 	}
 
-	return covmx*covmx;
+	return var;
+}
+
+TMatrixD MUH3D::GetStatErrorMatrix( bool asFrac /* =false */ ) const
+{
+	return GetStatErrorCovariance( asFrac ).GetMatrix();
+}
+
+MUDiagonalCovariance MUH3D::GetStatErrorCovariance( bool asFrac /* =false */ ) const
+{
+	//! stat error
+	MUDiagonalCovariance cov( GetNcells() );
+	cov.AddErrors( this );
+
+	if (asFrac)
+		cov.MakeFractional( this );
+
+	return cov;
 }
 
 //------------------------------------------------------------------------
@@ -791,14 +1107,18 @@ TMatrixD MUH3D::GetTotalErrorMatrix(
 	const int lowBin = 0;
 	TMatrixD covmx(highBin+1,highBin+1);
 
-	std::vector<std::string> names = GetSysErrorMatricesNames();
-	for (std::vector<std::string>::const_iterator itName = names.begin() ; itName != names.end() ; ++itName)
+	//! The sum of the systematic matrices only changes when an error band or matrix does
+	const int variant = cov_area_normalize ? 1 : 0;
+	const ULong64_t version = GetCacheVersion();
+	if( !fTotalCovCache.Get( variant, version, covmx ) )
 	{
-		covmx += GetSysErrorMatrix(*itName, false, cov_area_normalize);
+		//! The bands are independent, so they are computed in parallel and summed in order
+		SumSysErrors( this, GetSysErrorMatricesNames(), cov_area_normalize, &covmx, 0 );
+		fTotalCovCache.Put( variant, version, covmx );
 	}
 
 	if (includeStat)
-		covmx += GetStatErrorMatrix();
+		GetStatErrorCovariance().AddTo( covmx );
 
 	if (asFrac)
 	{
@@ -819,6 +1139,85 @@ TMatrixD MUH3D::GetTotalErrorMatrix(
 	return covmx;
 }
 
+ULong64_t MUH3D::GetCacheVersion() const
+{
+	//! Every change gets a larger stamp than any before it, so the largest stamp moves whenever anything changes
+	ULong64_t version = fCacheVersion.Get();
+	for( std::map<std::string, MUVertErrorBand3D*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+		version = std::max( version, i->second->GetCacheVersion() );
+	for( std::map<std::string, MULatErrorBand3D*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+		version = std::max( version, i->second->GetCacheVersion() );
+	return version;
+}
+
+MUCovarianceCache::Stats MUH3D::GetCovCacheStats() const
+{
+	MUCovarianceCache::Stats stats = fTotalCovCache.GetStats();
+	for( std::map<std::string, MUVertErrorBand3D*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+	{
+		const MUCovarianceCache::Stats band = i->second->GetCovCacheStats();
+		stats.hits += band.hits;
+		stats.misses += band.misses;
+	}
+	for( std::map<std::string, MULatErrorBand3D*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+	{
+		const MUCovarianceCache::Stats band = i->second->GetCovCacheStats();
+		stats.hits += band.hits;
+		stats.misses += band.misses;
+	}
+	return stats;
+}
+
+std::vector<double> MUH3D::GetTotalErrorVariance(
+		bool includeStat /*= true*/, 
+		bool asFrac /*= false*/, 
+		bool cov_area_normalize /*= false*/ ) const
+{
+	std::vector<double> var( GetNcells(), 0. );
+
+	//! The bands are independent, so they are computed in parallel and summed in order
+	SumSysErrors( this, GetSysErrorMatricesNames(), cov_area_normalize, 0, &var );
+
+	if (includeStat)
+	{
+		for( unsigned int i = 0; i != var.size(); ++i )
+			var[i] += GetBinError(i) * GetBinError(i);
+	}
+
+	if (asFrac)
+	{
+		for( unsigned int i = 0; i != var.size(); ++i )
+		{
+			const double cv = GetBinContent(i);
+			var[i] = ( cv != 0. ) ? var[i]/(cv * cv) : 0.;
+		}
+	}
+
+	return var;
+}
+
+MULowRankCovariance MUH3D::GetTotalErrorLowRank(
+		bool includeStat /*= true*/, 
+		bool asFrac /*= false*/, 
+		bool cov_area_normalize /*= false*/ ) const
+{
+	MULowRankCovariance cov( GetNcells() );
+	cov.SetCV( this );
+
+	for( std::map<std::string, MUVertErrorBand3D*>::const_iterator i = fVertErrorBandMap.begin(); i != fVertErrorBandMap.end(); ++i )
+		cov.Add( i->second->CalcLowRankCovMx( cov_area_normalize ) );
+	for( std::map<std::string, MULatErrorBand3D*>::const_iterator i = fLatErrorBandMap.begin(); i != fLatErrorBandMap.end(); ++i )
+		cov.Add( i->second->CalcLowRankCovMx( cov_area_normalize ) );
+
+	if (includeStat)
+		GetStatErrorCovariance().AddTo( cov );
+
+	if (asFrac)
+		cov.MakeFractional();
+
+	return cov;
+}
+
 TMatrixD MUH3D::GetTotalCorrelationMatrix( bool cov_area_normalize /*= false*/ ) const
 {
 	TMatrixD covmx = GetTotalErrorMatrix(false, false, cov_area_normalize);
@@ -841,6 +1240,7 @@ TH3D MUH3D::GetTotalError(
 		bool cov_area_normalize /*= false */) const
 {
 	//! Make a copy of this histogram as a TH1D and rename it
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH3D err( *this );
 	err.Reset();
 	std::string tmpName( std::string(GetName()) + "_TotalError");
@@ -853,12 +1253,12 @@ TH3D MUH3D::GetTotalError(
 	const int highBin  = GetBin( highBinX, highBinY, highBinZ );
 	const int lowBin = 0;
 
-	//!Get the Total Error Matrix
-	TMatrixD errMatrix = GetTotalErrorMatrix(includeStat, asFrac, cov_area_normalize);
+	//!Get the total variance of each bin; the covariances are not needed
+	const std::vector<double> errVar = GetTotalErrorVariance(includeStat, asFrac, cov_area_normalize);
 
 	for( int iBin = lowBin; iBin <= highBin; ++iBin )
 	{
-		double derr = errMatrix[iBin][iBin];
+		double derr = errVar[iBin];
 		err.SetBinContent( iBin, ( derr > 0 ) ? sqrt(derr): 0. );
 	}
 
@@ -871,6 +1271,7 @@ TH3D MUH3D::GetTotalError(
 TH3D MUH3D::GetStatError( bool asFrac /* = false */ ) const
 {
 	//! Make a copy of this histogram as a TH1D and rename it
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH3D err( *this );
 	err.Reset();
 	std::string tmpName( std::string(GetName()) + "_StatError");
@@ -913,6 +1314,7 @@ TH3D MUH3D::GetCVHistoWithError( bool includeStat /* = true */ , bool cov_area_n
 	TH3D err = GetTotalError( includeStat , false, cov_area_normalize);
 
 	//! Create a copy of this histogram and rename it
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH3D rval( *this );
 	std::string tmpName( std::string( GetName() ) + "_CV_WithErr" );
 	rval.SetName( tmpName.c_str() );
@@ -936,6 +1338,7 @@ TH3D MUH3D::GetCVHistoWithStatError() const
 	TH3D err = GetStatError( false );
 
 	//! Create a copy of this histogram and rename it
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH3D rval( *this );
 	std::string tmpName( std::string( GetName() ) + "_CV_WithStatErr" );
 	rval.SetName( tmpName.c_str() );
@@ -964,6 +1367,98 @@ void MUH3D::Scale( Double_t c1 /*= 1.*/, Option_t* option /*=""*/ )
 		it->second->Scale( c1, option );
 }
 
+TH3* MUH3D::Rebin3D( Int_t nxgroup /*= 2*/, Int_t nygroup /*= 2*/, Int_t nzgroup /*= 2*/, const char* newname /*= ""*/ )
+{
+	TAxis newX, newY, newZ;
+	if( !MURebinMap::GroupAxis( GetXaxis(), nxgroup, newX ) || !MURebinMap::GroupAxis( GetYaxis(), nygroup, newY ) || !MURebinMap::GroupAxis( GetZaxis(), nzgroup, newZ ) )
+		return NULL;
+	return RebinTo( &newX, &newY, &newZ, newname );
+}
+
+MUH3D* MUH3D::Rebin3D( Int_t nxbins, const Double_t* xbins, Int_t nybins, const Double_t* ybins, Int_t nzbins, const Double_t* zbins, const char* newname /*= ""*/ )
+{
+	TAxis newX, newY, newZ;
+	if( xbins )
+		newX.Set( nxbins, xbins );
+	if( ybins )
+		newY.Set( nybins, ybins );
+	if( zbins )
+		newZ.Set( nzbins, zbins );
+	return RebinTo( xbins ? &newX : 0, ybins ? &newY : 0, zbins ? &newZ : 0, newname );
+}
+
+MUH3D* MUH3D::RebinTo( const TAxis* newX, const TAxis* newY, const TAxis* newZ, const char* newname )
+{
+	//! With a newname rebin a copy, which shares the universes until it is rebinned, as TH3::Rebin3D would
+	MUH3D *rval = this;
+	if( newname && strlen(newname) > 0 )
+	{
+		rval = new MUH3D( *this );
+		rval->SetName( newname );
+	}
+
+	//! The map is worked out once and used for everything
+	if( !rval->ApplyRebinMap( MURebinMap( rval, newX, newY, newZ ) ) )
+	{
+		if( rval != this )
+			delete rval;
+		return NULL;
+	}
+	return rval;
+}
+
+bool MUH3D::ApplyRebinMap( const MURebinMap& map )
+{
+	//! Check everything first, so a failure leaves this MUH3D as it was
+	const unsigned int nBins = GetNcells();
+	bool fits = ( map.GetNOldBins() == nBins );
+	for( std::map<std::string, MUVertErrorBand3D*>::const_iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+		fits = fits && (unsigned int)it->second->GetNcells() == nBins;
+	for( std::map<std::string, MULatErrorBand3D*>::const_iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+		fits = fits && (unsigned int)it->second->GetNcells() == nBins;
+	for( std::map<std::string, TMatrixD*>::const_iterator it = fSysErrorMatrix.begin(); it != fSysErrorMatrix.end(); ++it )
+		fits = fits && ( 0 == it->second || (unsigned int)it->second->GetNrows() == nBins );
+	for( std::map<std::string, TMatrixD*>::const_iterator it = fRemovedSysErrorMatrix.begin(); it != fRemovedSysErrorMatrix.end(); ++it )
+		fits = fits && ( 0 == it->second || (unsigned int)it->second->GetNrows() == nBins );
+	if( !fits )
+	{
+		std::cout << "Warning [MUH3D::ApplyRebinMap] : The rebin map or one of the errors of " << GetName() << " does not have its " << nBins << " bins.  Not rebinning." << std::endl;
+		return false;
+	}
+
+	map.Apply( (TH1*)this );
+
+	for( std::map<std::string, MUVertErrorBand3D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
+		it->second->ApplyRebinMap( map );
+
+	for( std::map<std::string, MULatErrorBand3D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
+		it->second->ApplyRebinMap( map );
+
+	//! The special error matrices are rebinned exactly, including the removed ones
+	for( std::map<std::string, TMatrixD*>::iterator it = fSysErrorMatrix.begin(); it != fSysErrorMatrix.end(); ++it )
+	{
+		if( 0 != it->second )
+		{
+			const TMatrixD rebinned = map.Apply( *it->second );
+			it->second->ResizeTo( rebinned );
+			*it->second = rebinned;
+		}
+	}
+
+	for( std::map<std::string, TMatrixD*>::iterator it = fRemovedSysErrorMatrix.begin(); it != fRemovedSysErrorMatrix.end(); ++it )
+	{
+		if( 0 != it->second )
+		{
+			const TMatrixD rebinned = map.Apply( *it->second );
+			it->second->ResizeTo( rebinned );
+			*it->second = rebinned;
+		}
+	}
+
+	fCacheVersion.Touch();
+	return true;
+}
+
 void MUH3D::Add( const TH3* h1, const Double_t c1 /*= 1.*/ )
 {
 	//! Try to cast the input TH3 to a MUH3D
@@ -1028,7 +1523,9 @@ void MUH3D::Multiply( const MUH3D* h1, const MUH3D* h2, Double_t c1 /*= 1*/, Dou
 	//! Call the TH1D Multiply 
 	this->TH3D::Multiply( (TH3D*)h1, (TH3D*)h2, c1, c2 );
 
-	//! Scale the vertical error bands
+	BandArithmeticJob job( BandArithmeticJob::kMultiply, 0, c1, c2 );
+
+	//! Queue the vertical error bands
 	for( std::map<std::string, MUVertErrorBand3D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
 	{
 		const MUVertErrorBand3D* err1 = h1->GetVertErrorBand( it->first );
@@ -1038,10 +1535,10 @@ void MUH3D::Multiply( const MUH3D* h1, const MUH3D* h2, Double_t c1 /*= 1*/, Dou
 			Error("Multiply", "Could not divide MUH3Ds because they all don't have the %s MUVertErrorBand3D", it->first.c_str());
 			return;
 		}
-		it->second->Multiply( err1, err2, c1, c2 );
+		job.AddBand( it->second, err1, err2 );
 	}
 
-	//! Scale the lateral error bands
+	//! Queue the lateral error bands
 	for( std::map<std::string, MULatErrorBand3D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
 	{
 		const MULatErrorBand3D* err1 = h1->GetLatErrorBand( it->first );
@@ -1051,9 +1548,12 @@ void MUH3D::Multiply( const MUH3D* h1, const MUH3D* h2, Double_t c1 /*= 1*/, Dou
 			Error("Multiply", "Could not divide MUH3Ds because they all don't have the %s MULatErrorBand3D", it->first.c_str());
 			return;
 		}
-		it->second->Multiply( err1, err2, c1, c2 );
+		job.AddBand( it->second, err1, err2 );
 	}
 
+	//! Do all bands at once, on several threads if they are big
+	job.RunAll();
+
 	return;
 }
 
@@ -1064,7 +1564,9 @@ void MUH3D::Divide( const MUH3D* h1, const MUH3D* h2, Double_t c1 /*= 1*/, Doubl
 	//! Call the TH1D Divide
 	this->TH3D::Divide( (TH3D*)h1, (TH3D*)h2, c1, c2, option );
 
-	//! Scale the vertical error bands
+	BandArithmeticJob job( BandArithmeticJob::kDivide, 0, c1, c2, option );
+
+	//! Queue the vertical error bands
 	for( std::map<std::string, MUVertErrorBand3D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
 	{
 		const MUVertErrorBand3D* err1 = h1->GetVertErrorBand( it->first );
@@ -1074,10 +1576,10 @@ void MUH3D::Divide( const MUH3D* h1, const MUH3D* h2, Double_t c1 /*= 1*/, Doubl
 			Error("Divide", "Could not divide MUH3Ds because they all don't have the %s MUVertErrorBand3D", it->first.c_str());
 			return;
 		}
-		it->second->Divide( err1, err2, c1, c2, option );
+		job.AddBand( it->second, err1, err2 );
 	}
 
-	//! Scale the lateral error bands
+	//! Queue the lateral error bands
 	for( std::map<std::string, MULatErrorBand3D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
 	{
 		const MULatErrorBand3D* err1 = h1->GetLatErrorBand( it->first );
@@ -1087,9 +1589,12 @@ void MUH3D::Divide( const MUH3D* h1, const MUH3D* h2, Double_t c1 /*= 1*/, Doubl
 			Error("Divide", "Could not divide MUH3Ds because they all don't have the %s MULatErrorBand3D", it->first.c_str());
 			return;
 		}
-		it->second->Divide( err1, err2, c1, c2, option );
+		job.AddBand( it->second, err1, err2 );
 	}
 
+	//! Do all bands at once, on several threads if they are big
+	job.RunAll();
+
 	return;
 }
 
@@ -1098,7 +1603,9 @@ void MUH3D::DivideSingle( const MUH3D* h1, const TH3* h2, Double_t c1 /*= 1*/, D
 	//! Call the TH1D Divide
 	this->TH3D::Divide( (TH3D*)h1, h2, c1, c2, option );
 
-	//! Scale the vertical error bands
+	BandArithmeticJob job( BandArithmeticJob::kDivideSingle, h2, c1, c2, option );
+
+	//! Queue the vertical error bands
 	for( std::map<std::string, MUVertErrorBand3D*>::iterator it = fVertErrorBandMap.begin(); it != fVertErrorBandMap.end(); ++it )
 	{
 		const MUVertErrorBand3D* err1 = h1->GetVertErrorBand( it->first );
@@ -1107,10 +1614,10 @@ void MUH3D::DivideSingle( const MUH3D* h1, const TH3* h2, Double_t c1 /*= 1*/, D
 			Error("Divide", "Could not divide MUH3Ds because they all don't have the %s MUVertErrorBand3D", it->first.c_str());
 			return;
 		}
-		it->second->DivideSingle( err1, h2, c1, c2, option );
+		job.AddBand( it->second, err1, 0 );
 	}
 
-	//! Scale the lateral error bands
+	//! Queue the lateral error bands
 	for( std::map<std::string, MULatErrorBand3D*>::iterator it = fLatErrorBandMap.begin(); it != fLatErrorBandMap.end(); ++it )
 	{
 		const MULatErrorBand3D* err1 = h1->GetLatErrorBand( it->first );
@@ -1119,9 +1626,12 @@ void MUH3D::DivideSingle( const MUH3D* h1, const TH3* h2, Double_t c1 /*= 1*/, D
 			Error("Divide", "Could not divide MUH3Ds because they all don't have the %s MULatErrorBand3D", it->first.c_str());
 			return;
 		}
-		it->second->DivideSingle( err1, h2, c1, c2, option );
+		job.AddBand( it->second, err1, 0 );
 	}
 
+	//! Do all bands at once, on several threads if they are big
+	job.RunAll();
+
 	return;
 }
 
@@ -9,6 +9,10 @@
 #include "PlotUtils/MUH2D.h"
 #include "PlotUtils/MUVertErrorBand3D.h"
 #include "PlotUtils/MULatErrorBand3D.h"
+#include "PlotUtils/MUErrorBandHandle.h"
+#include "PlotUtils/MUFillShard.h"
+#include "PlotUtils/MUCovarianceCache.h"
+#include "PlotUtils/MUDiagonalCovariance.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -50,10 +54,31 @@ namespace PlotUtils
 			//! Deep assignment
 			MUH3D& operator=( const MUH3D& h );
 
+			/*! Copy with the copy constructor, so the universes of every error band are shared with this one
+				until either is modified, instead of streamed into new buffers like TH1::Clone would.
+				A class derived from MUH3D is cloned with TH3D::Clone, so it is not sliced.
+				*/
+			virtual TObject* Clone( const char* newname = "" ) const;
+
+#if __cplusplus >= 201103L
+			/*! Move constructor: takes the bins, error bands and matrices of h instead of copying them, leaving h with none.
+				The TH3D part changes hands with MUHist::MoveHistogram, so a std::vector of MUH3D moves instead of copying when it grows.
+				*/
+			MUH3D( MUH3D&& h ) noexcept;
+
+			//! Move assignment, as the move constructor
+			MUH3D& operator=( MUH3D&& h ) noexcept;
+#endif
+
 		private:
 			//! A helper function which set variables for the deep copy and assignment
 			void DeepCopy( const MUH3D& h );
 
+#if __cplusplus >= 201103L
+			//! A helper function which takes the variables of h for the move constructor and assignment
+			void MoveFrom( MUH3D& h );
+#endif
+
 		public:
 			/*! Quiet warnings about hidden overloaded virtual functions.
 				It is not clear if this is the behavior we want (may prefer
@@ -111,6 +136,10 @@ namespace PlotUtils
 			bool FillVertErrorBand( const std::string& name, const double xval, const double yval, const double zval, const double * weights, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
 			//! Fill the weights of an MUVertErrorBand's 2 universes with these 2 weights (must have 2)
 			bool FillVertErrorBand( const std::string& name, const double xval, const double yval, const double zval, const double weightDown, const double weightUp, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			/*! Fill the weights of an MUVertErrorBand's universes for many events with one band lookup
+				weights is nEvents x nUniverses, one row per event; cvweights and cvWeightsFromMe may be NULL (all 1)
+				*/
+			bool FillVertErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *xvals, const double *yvals, const double *zvals, const double *weights, const double *cvweights = 0, const double *cvWeightsFromMe = 0 );
 
 			//! Fill the weights of a MULatErrorBand's universes from a vector
 			bool FillLatErrorBand( const std::string& name, const double xval, const double yval, const double zval, const std::vector<double>& xshifts, const std::vector<double>& yshifts, const std::vector<double>& zshifts, const double cvweight  = 1.0, const bool fillcv = true, const double* weights = NULL );
@@ -118,6 +147,36 @@ namespace PlotUtils
 			bool FillLatErrorBand( const std::string& name, const double xval, const double yval, const double zval, const double *xshifts, const double *yshifts, const double *zshifts, const double cvweight  = 1.0, const bool fillcv = true, const double* weights = NULL );
 			//! Fill the weights of an MULatErrorBand's 2 universes with these 2 weights (must have 2)
 			bool FillLatErrorBand( const std::string& name, const double xval, const double yval, const double zval, const double xshiftDown, const double xshiftUp, const double yshiftDown, const double yshiftUp, const double zshiftDown, const double zshiftUp, const double cvweight = 1.0, const bool fillcv = true );
+			/*! Fill the shifts of an MULatErrorBand's universes for many events with one band lookup
+				shifts and weights are nEvents x nUniverses, one row per event; cvweights and weights may be NULL
+				*/
+			bool FillLatErrorBandBatch( const std::string& name, const unsigned int nEvents, const double *xvals, const double *yvals, const double *zvals, const double *xshifts, const double *yshifts, const double *zshifts, const double *cvweights = 0, const bool fillcv = true, const double *weights = 0 );
+
+			//! Fill the weights of an MUVertErrorBand's universes from array, finding the band by handle
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double * weights, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			//! Fill the weights of an MUVertErrorBand's 2 universes with these 2 weights (must have 2), finding the band by handle
+			bool FillVertErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double weightDown, const double weightUp, const double cvweight  = 1.0, double cvWeightFromMe = 1. );
+			//! Fill the shifts of an MULatErrorBand's universes from array, finding the band by handle
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double *xshifts, const double *yshifts, const double *zshifts, const double cvweight = 1.0, const bool fillcv = true, const double *weights = 0 );
+			//! Fill the shifts of an MULatErrorBand's 2 universes with these 2 shifts (must have 2), finding the band by handle
+			bool FillLatErrorBand( const MUErrorBandHandle& band, const double xval, const double yval, const double zval, const double xshiftDown, const double xshiftUp, const double yshiftDown, const double yshiftUp, const double zshiftDown, const double zshiftUp, const double cvweight = 1.0, const bool fillcv = true );
+
+			/*! Get the fill shard of a worker slot, creating it on first use.  Safe to call from many threads at once.
+				Fill the shard instead of this histogram from that worker, then call MergeFillShards once all workers are done.
+				Add all error bands before the first shard is created.
+				@param[in] slot Worker slot (e.g. the slot RDataFrame::ForeachSlot passes, or your own thread index)
+				*/
+			MUFillShard& GetFillShard( const unsigned int slot );
+
+			/*! Get the one fill shard all threads share, creating it on first use.  Safe to call from many threads at once.
+				Every add to it is atomic, so it needs no more memory than this histogram however many threads fill it,
+				but the result depends on the order the threads got there in the last few bits.
+				Add all error bands before the shard is created.
+				*/
+			MUFillShard& GetSharedFillShard();
+
+			//! Add all fill shards into this histogram and its error bands (per-slot shards in slot order, then the shared one), then delete them.  Not thread safe.
+			void MergeFillShards();
 
 			//! Get a pointer to this MUVertErrorBand
 			MUVertErrorBand3D* GetVertErrorBand( const std::string& name );
@@ -129,6 +188,20 @@ namespace PlotUtils
 			//! Get a const pointer to this MULatErrorBand
 			const MULatErrorBand3D* GetLatErrorBand( const std::string& name ) const;
 
+			//! Get a handle to this MUVertErrorBand for repeated fills and lookups (invalid handle if there is no such band)
+			MUErrorBandHandle GetVertErrorBandHandle( const std::string& name ) const;
+			//! Get a handle to this MULatErrorBand for repeated fills and lookups (invalid handle if there is no such band)
+			MUErrorBandHandle GetLatErrorBandHandle( const std::string& name ) const;
+
+			//! Get a pointer to the MUVertErrorBand with this handle
+			MUVertErrorBand3D* GetVertErrorBand( const MUErrorBandHandle& band );
+			//! Get a const pointer to the MUVertErrorBand with this handle
+			const MUVertErrorBand3D* GetVertErrorBand( const MUErrorBandHandle& band ) const;
+			//! Get a pointer to the MULatErrorBand with this handle
+			MULatErrorBand3D* GetLatErrorBand( const MUErrorBandHandle& band );
+			//! Get a const pointer to the MULatErrorBand with this handle
+			const MULatErrorBand3D* GetLatErrorBand( const MUErrorBandHandle& band ) const;
+
 			/*! Get a new TH3D which is the central value histogram with statistical error only
 				@return copy of a TH3D
 				*/
@@ -147,16 +220,37 @@ namespace PlotUtils
 			//! Get a TH3D filled with the stat error ONLY
 			TH3D GetStatError( bool asFrac = false ) const;
 
-			//! Get the Total Covariance Matrix
+			/*! Get the Total Covariance Matrix
+				The error bands are independent, so their matrices are computed on a MUTaskPool (see MUTaskPool::SetNThreads)
+				and added in a fixed order: the result does not depend on the number of threads.
+				*/
 			TMatrixD GetTotalErrorMatrix(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+			//! Get just the diagonal of GetTotalErrorMatrix, without building any matrix (also on a MUTaskPool)
+			std::vector<double> GetTotalErrorVariance(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+			/*! GetTotalErrorMatrix kept as the universes of all error bands plus a diagonal, see MULowRankCovariance.
+				Needs O(nBins * nUniverses) memory instead of O(nBins^2), so it works for binnings too big for GetTotalErrorMatrix.
+				*/
+			MULowRankCovariance GetTotalErrorLowRank(bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+
+			/*! Stamp that changes whenever an error band or the set of error matrices changes.
+				The sum of the systematic matrices in GetTotalErrorMatrix is cached against it.
+				*/
+			ULong64_t GetCacheVersion() const;
+
+			//! Hits and misses of the covariance caches of this histogram and all its error bands
+			MUCovarianceCache::Stats GetCovCacheStats() const;
 			//! Get Total Correlation Matrix
 			TMatrixD GetTotalCorrelationMatrix(bool cov_area_normalize = false ) const;
 
 			//! Get Statistical Error Matrix
 			TMatrixD GetStatErrorMatrix( bool asFrac = false ) const;
+			//! Get the statistical errors as a diagonal covariance, without building the matrix
+			MUDiagonalCovariance GetStatErrorCovariance( bool asFrac = false ) const;
 
 			//! Get a single Systematical Matrix from the map
 			TMatrixD GetSysErrorMatrix(const std::string& name, bool asFrac = false, bool cov_area_normalize = false) const; 
+			//! Get just the diagonal of GetSysErrorMatrix, without building the matrix
+			std::vector<double> GetSysErrorVariance(const std::string& name, bool asFrac = false, bool cov_area_normalize = false) const;
 			//! Get a vector of the names of all error bands
 			std::vector<std::string> GetVertErrorBandNames() const;
 
@@ -171,6 +265,19 @@ namespace PlotUtils
 			//! When calling scale we need to scale all of the error bands histos
 			virtual void Scale( Double_t c1 = 1., Option_t *option = "" );
 
+			/*! Rebin in groups of nxgroup x nygroup x nzgroup bins and propagate to error bands and error matrices, as TH3::Rebin3D.
+				With a newname a rebinned copy is returned and this MUH3D is left alone.  Error matrices C become M*C*M^T (see MURebinMap).
+				*/
+			virtual TH3* Rebin3D( Int_t nxgroup = 2, Int_t nygroup = 2, Int_t nzgroup = 2, const char* newname = "" );
+
+			/*! As Rebin3D, to nxbins bins with edges xbins on x (NULL keeps the x axis), and the same for y and z
+				@return This MUH3D, or the rebinned copy if newname is given.  NULL if it could not rebin.
+				*/
+			MUH3D* Rebin3D( Int_t nxbins, const Double_t* xbins, Int_t nybins, const Double_t* ybins, Int_t nzbins, const Double_t* zbins, const char* newname = "" );
+
+			//! Rebin everything with a map made for this binning, false (and unchanged) if it does not fit
+			bool ApplyRebinMap( const MURebinMap& map );
+
 			/*! Replace this MUH3D's contents with the result of a division of two other MUH3Ds
 			*/
 			virtual void Divide( const MUH3D* h1, const MUH3D* h2, Double_t c1 = 1, Double_t c2 = 1, Option_t* option="" );
@@ -199,6 +306,9 @@ namespace PlotUtils
 			virtual ~MUH3D() {};
 
 		private:
+			//! Rebin this (or a copy named newname) to new axes, NULL keeping an axis
+			MUH3D* RebinTo( const TAxis* newX, const TAxis* newY, const TAxis* newZ, const char* newname );
+
 			//! A helper function to check if this string has that ending
 			bool HasEnding (std::string const &fullString, std::string const &ending) const;
 
@@ -214,6 +324,27 @@ namespace PlotUtils
 			//! Strores a map from name to error band for MUVertErrorBands
 			std::map<std::string, MUVertErrorBand3D*> fVertErrorBandMap;
 
+			//! Lookup of the MULatErrorBands by interned name, built from fLatErrorBandMap on demand
+			MUErrorBandIndex<MULatErrorBand3D> fLatErrorBandIndex; //!
+
+			//! Lookup of the MUVertErrorBands by interned name, built from fVertErrorBandMap on demand
+			MUErrorBandIndex<MUVertErrorBand3D> fVertErrorBandIndex; //!
+
+			//! Per-worker accumulators handed out by GetFillShard and GetSharedFillShard
+			MUFillShardSet fFillShards; //!
+
+			//! Stamp of the last change to the error bands or error matrices held here
+			mutable MUCacheVersion fCacheVersion; //!
+
+			//! Sum of the systematic covariance matrices, absolute and shape-only
+			mutable MUCovarianceCache fTotalCovCache; //!
+
+			//! New shard with all our error bands
+			MUFillShard* CreateFillShard( const bool shared ) const;
+
+			//! Add one shard into this histogram and its error bands
+			void MergeFillShard( const MUFillShard& shard );
+
 			//! Stores the width to which we will normalize bins (e.g. n Events per fNormBinWidth GeV)
 			//! If negative, then refuse to normalize to bin width (appropriate for ratios, efficiencies)
 			Double_t fNormBinWidthX;
@@ -0,0 +1,499 @@
+#ifndef MNV_MUHistView_cxx
+#define MNV_MUHistView_cxx 1
+
+#include "PlotUtils/MUHistView.h"
+#include "PlotUtils/MUUniverseStore.h"
+
+#include "TAxis.h"
+#include "TDirectory.h"
+#include "TString.h"
+
+#include <algorithm>
+#include <math.h>
+#include <iostream>
+
+using namespace PlotUtils;
+
+namespace
+{
+  bool HasEnding( const std::string& fullString, const std::string& ending )
+  {
+    return ending.length() <= fullString.length()
+      && 0 == fullString.compare( fullString.length() - ending.length(), ending.length(), ending );
+  }
+
+  //! The Scale GetBinNormalizedCopy does, or a nonpositive number if it does not scale
+  double GetNormBinArea( const MUH1D& h, double normBinWidthX, double /*normBinWidthY*/ )
+  {
+    if( normBinWidthX <= 0 )
+      normBinWidthX = h.GetNormBinWidth();
+    return normBinWidthX;
+  }
+
+  double GetNormBinArea( const MUH2D& h, double normBinWidthX, double normBinWidthY )
+  {
+    if( normBinWidthX <= 0 )
+      normBinWidthX = h.GetNormBinWidthX();
+    if( normBinWidthY <= 0 )
+      normBinWidthY = h.GetNormBinWidthY();
+    return ( normBinWidthX > 0 && normBinWidthY > 0 ) ? normBinWidthX * normBinWidthY : -1.;
+  }
+
+  //! First and last bin of an axis after SetRange( first, last ), as TAxis works it out
+  void GetRange( const TAxis *axis, const int first, const int last, int& rfirst, int& rlast )
+  {
+    TAxis tmp( *axis );
+    if( first <= last )
+      tmp.SetRange( first, last );
+    rfirst = tmp.GetFirst();
+    rlast  = tmp.GetLast();
+  }
+}
+
+namespace PlotUtils
+{
+
+  template<class MUHistType>
+  MUHistView<MUHistType>::MUHistView( const MUHistType& h ) :
+    fHist( &h ),
+    fFactors( h.GetNcells(), 1. ),
+    fFirstX( 1 ), fLastX( 0 ),
+    fFirstY( 1 ), fLastY( 0 )
+  {}
+
+  template<class MUHistType>
+  MUHistView<MUHistType>& MUHistView<MUHistType>::Scale( const double c1, Option_t* option /*= ""*/ )
+  {
+    TString opt( option );
+    opt.ToLower();
+
+    Step step;
+    step.fC1 = c1;
+    step.fWidth = opt.Contains( "width" );
+    fSteps.push_back( step );
+
+    if( step.fWidth )
+    {
+      const std::vector<double> widthFactors = MUUniverseStore::GetWidthScaleFactors( fHist, c1 );
+      for( unsigned int i = 0; i != fFactors.size(); ++i )
+        fFactors[i] *= widthFactors[i];
+    }
+    else
+    {
+      for( unsigned int i = 0; i != fFactors.size(); ++i )
+        fFactors[i] *= c1;
+    }
+    return *this;
+  }
+
+  template<class MUHistType>
+  MUHistView<MUHistType>& MUHistView<MUHistType>::BinNormalize( double normBinWidthX /*= -1.*/, double normBinWidthY /*= -1.*/ )
+  {
+    const double normBinArea = GetNormBinArea( *fHist, normBinWidthX, normBinWidthY );
+    if( normBinArea > 0 )
+      Scale( normBinArea, "width" );
+    return *this;
+  }
+
+  template<class MUHistType>
+  MUHistView<MUHistType>& MUHistView<MUHistType>::SetRangeX( const int first, const int last )
+  {
+    fFirstX = first;
+    fLastX = last;
+    return *this;
+  }
+
+  template<class MUHistType>
+  MUHistView<MUHistType>& MUHistView<MUHistType>::SetRangeY( const int first, const int last )
+  {
+    if( fHist->GetDimension() < 2 )
+    {
+      std::cout << "Warning [MUHistView::SetRangeY] : " << fHist->GetName() << " has no y axis to restrict." << std::endl;
+      return *this;
+    }
+    fFirstY = first;
+    fLastY = last;
+    return *this;
+  }
+
+  template<class MUHistType>
+  bool MUHistView<MUHistType>::IsUniform() const
+  {
+    const int nbinsy = ( 1 < fHist->GetDimension() ) ? fHist->GetNbinsY() : 0;
+    const double f = fFactors[ fHist->GetBin( 1, nbinsy ? 1 : 0 ) ];
+    for( int biny = nbinsy ? 1 : 0; biny <= nbinsy; ++biny )
+    {
+      for( int binx = 1; binx <= fHist->GetNbinsX(); ++binx )
+      {
+        if( fFactors[ fHist->GetBin( binx, biny ) ] != f )
+          return false;
+      }
+    }
+    return true;
+  }
+
+  template<class MUHistType>
+  bool MUHistView<MUHistType>::NeedsOwnAreaNorm( const bool cov_area_normalize ) const
+  {
+    return cov_area_normalize && ( fFirstX <= fLastX || fFirstY <= fLastY || !IsUniform() );
+  }
+
+  template<class MUHistType>
+  Double_t MUHistView<MUHistType>::GetBinContent( const int bin ) const
+  {
+    if( bin < 0 || (unsigned int)bin >= fFactors.size() )
+      return 0.;
+    return fFactors[bin] * fHist->GetBinContent( bin );
+  }
+
+  template<class MUHistType>
+  Double_t MUHistView<MUHistType>::GetBinError( const int bin ) const
+  {
+    if( bin < 0 || (unsigned int)bin >= fFactors.size() )
+      return 0.;
+    return fabs( fFactors[bin] ) * fHist->GetBinError( bin );
+  }
+
+  template<class MUHistType>
+  Double_t MUHistView<MUHistType>::GetUniverseContent( const std::string& name, const unsigned int universe, const int bin ) const
+  {
+    const MUUniverseStore *store = 0;
+    if( fHist->HasVertErrorBand( name ) )
+      store = &fHist->GetVertErrorBand( name )->GetUniverseStore();
+    else if( fHist->HasLatErrorBand( name ) )
+      store = &fHist->GetLatErrorBand( name )->GetUniverseStore();
+
+    if( !store )
+    {
+      std::cout << "Warning [MUHistView::GetUniverseContent] : There is no error band with name " << name << ". Returning 0." << std::endl;
+      return 0.;
+    }
+    if( store->GetNUniverses() <= universe || bin < 0 || (unsigned int)bin >= fFactors.size() )
+    {
+      std::cout << "Warning [MUHistView::GetUniverseContent] : Universe " << universe << " bin " << bin << " is out of range for error band " << name << ". Returning 0." << std::endl;
+      return 0.;
+    }
+
+    return fFactors[bin] * store->GetSumwRow( bin )[universe];
+  }
+
+  template<class MUHistType>
+  Double_t MUHistView<MUHistType>::Integral( const bool includeFlows /*= false*/ ) const
+  {
+    int firstx = 0, lastx = fHist->GetNbinsX() + 1;
+    int firsty = 0, lasty = ( 1 < fHist->GetDimension() ) ? fHist->GetNbinsY() + 1 : 0;
+    if( !includeFlows )
+    {
+      GetRange( fHist->GetXaxis(), fFirstX, fLastX, firstx, lastx );
+      if( 1 < fHist->GetDimension() )
+        GetRange( fHist->GetYaxis(), fFirstY, fLastY, firsty, lasty );
+    }
+
+    Double_t sum = 0.;
+    for( int biny = firsty; biny <= lasty; ++biny )
+    {
+      for( int binx = firstx; binx <= lastx; ++binx )
+        sum += GetBinContent( fHist->GetBin( binx, biny ) );
+    }
+    return sum;
+  }
+
+  template<class MUHistType>
+  Double_t MUHistView<MUHistType>::GetAreaNormFactor( const MUHistView& data ) const
+  {
+    const Double_t integral = Integral( true );
+    if( integral == 0 )
+    {
+      std::cout << "Warning [MUHistView::GetAreaNormFactor] : MC Area Histogram is zero. No Scale Factor calculated" << std::endl;
+      return 1.;
+    }
+    return data.Integral( true ) / integral;
+  }
+
+  template<class MUHistType>
+  void MUHistView<MUHistType>::ApplyTo( TH1* h ) const
+  {
+    //! Scale is virtual, so MUH1D, MUH2D and the error bands scale their universes too
+    for( typename std::vector<Step>::const_iterator step = fSteps.begin(); step != fSteps.end(); ++step )
+      h->Scale( step->fC1, step->fWidth ? "width" : "" );
+
+    if( fFirstX <= fLastX )
+      h->GetXaxis()->SetRange( fFirstX, fLastX );
+    if( fFirstY <= fLastY )
+      h->GetYaxis()->SetRange( fFirstY, fLastY );
+  }
+
+  template<class MUHistType>
+  typename MUHistView<MUHistType>::CVType MUHistView<MUHistType>::GetCVHisto() const
+  {
+    TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
+    CVType rval( *fHist );
+    ApplyTo( &rval );
+    return rval;
+  }
+
+  template<class MUHistType>
+  typename MUHistView<MUHistType>::CVType MUHistView<MUHistType>::GetCVHistoWithStatError() const
+  {
+    CVType rval = GetCVHisto();
+    std::string tmpName( std::string( fHist->GetName() ) + "_CV_WithStatErr" );
+    rval.SetName( tmpName.c_str() );
+    return rval;
+  }
+
+  template<class MUHistType>
+  typename MUHistView<MUHistType>::CVType MUHistView<MUHistType>::GetCVHistoWithError( bool includeStat /*= true*/, bool cov_area_normalize /*= false*/ ) const
+  {
+    const std::vector<double> errVar = GetTotalErrorVariance( includeStat, false, cov_area_normalize );
+
+    CVType rval = GetCVHisto();
+    std::string tmpName( std::string( fHist->GetName() ) + "_CV_WithErr" );
+    rval.SetName( tmpName.c_str() );
+
+    for( unsigned int i = 0; i != errVar.size(); ++i )
+      rval.SetBinError( i, ( errVar[i] > 0 ) ? sqrt( errVar[i] ) : 0. );
+
+    return rval;
+  }
+
+  template<class MUHistType>
+  typename MUHistView<MUHistType>::CVType MUHistView<MUHistType>::GetTotalError( bool includeStat /*= true*/, bool asFrac /*= false*/, bool cov_area_normalize /*= false*/ ) const
+  {
+    const std::vector<double> errVar = GetTotalErrorVariance( includeStat, asFrac, cov_area_normalize );
+
+    CVType err = GetCVHisto();
+    err.Reset();
+    std::string tmpName( std::string( fHist->GetName() ) + "_TotalError" );
+    err.SetName( tmpName.c_str() );
+
+    for( unsigned int i = 0; i != errVar.size(); ++i )
+      err.SetBinContent( i, ( errVar[i] > 0 ) ? sqrt( errVar[i] ) : 0. );
+
+    //use default min/max for err
+    err.SetMinimum();
+    err.SetMaximum();
+
+    return err;
+  }
+
+  template<class MUHistType>
+  void MUHistView<MUHistType>::ApplyFactors( TMatrixD& covmx ) const
+  {
+    const int n = std::min( (int)fFactors.size(), std::min( covmx.GetNrows(), covmx.GetNcols() ) );
+    for( int i = 0; i < n; ++i )
+    {
+      for( int k = 0; k < n; ++k )
+        covmx[i][k] *= fFactors[i] * fFactors[k];
+    }
+  }
+
+  template<class MUHistType>
+  void MUHistView<MUHistType>::ApplyFactors( std::vector<double>& var ) const
+  {
+    for( unsigned int i = 0; i < var.size() && i < fFactors.size(); ++i )
+      var[i] *= fFactors[i] * fFactors[i];
+  }
+
+  template<class MUHistType>
+  void MUHistView<MUHistType>::MakeFractional( TMatrixD& covmx ) const
+  {
+    for( int i = 0; i < covmx.GetNrows(); ++i )
+    {
+      const double cv_i = GetBinContent(i);
+      for( int k = 0; k < covmx.GetNcols(); ++k )
+      {
+        const double cv_k = GetBinContent(k);
+        covmx[i][k] = ( (cv_i != 0.) && (cv_k != 0.) ) ? covmx[i][k]/(cv_i * cv_k) : 0.;
+      }
+    }
+  }
+
+  template<class MUHistType>
+  void MUHistView<MUHistType>::MakeFractional( std::vector<double>& var ) const
+  {
+    for( unsigned int i = 0; i != var.size(); ++i )
+    {
+      const double cv = GetBinContent(i);
+      var[i] = ( cv != 0. ) ? var[i]/(cv * cv) : 0.;
+    }
+  }
+
+  template<class MUHistType>
+  void MUHistView<MUHistType>::GetOwnAreaNormCov( const std::string& name, TMatrixD *covmx, std::vector<double> *var ) const
+  {
+    const std::string errName = HasEnding( name, "_asShape" ) ? name.substr( 0, name.length() - 8 ) : name;
+
+    //! A copy of the band shares its universes until the steps scale them, so only this band is copied
+    TDirectory::TContext detached( gDirectory, 0 );
+    if( fHist->HasVertErrorBand( errName ) )
+    {
+      VertBandType band( *fHist->GetVertErrorBand( errName ) );
+      ApplyTo( &band );
+      if( covmx )
+        *covmx = band.CalcCovMx( true );
+      if( var )
+        *var = band.CalcVariance( true );
+    }
+    else if( fHist->HasLatErrorBand( errName ) )
+    {
+      LatBandType band( *fHist->GetLatErrorBand( errName ) );
+      ApplyTo( &band );
+      if( covmx )
+        *covmx = band.CalcCovMx( true );
+      if( var )
+        *var = band.CalcVariance( true );
+    }
+    else
+    {
+      //! Error matrices and uncorrelated errors do not depend on the normalization
+      if( covmx )
+      {
+        *covmx = fHist->GetSysErrorMatrix( name, false, true );
+        ApplyFactors( *covmx );
+      }
+      if( var )
+      {
+        *var = fHist->GetSysErrorVariance( name, false, true );
+        ApplyFactors( *var );
+      }
+    }
+  }
+
+  template<class MUHistType>
+  TMatrixD MUHistView<MUHistType>::GetSysErrorMatrix( const std::string& name, bool asFrac /*= false*/, bool cov_area_normalize /*= false*/ ) const
+  {
+    TMatrixD covmx( fHist->GetNcells(), fHist->GetNcells() );
+    if( NeedsOwnAreaNorm( cov_area_normalize || HasEnding( name, "_asShape" ) ) )
+      GetOwnAreaNormCov( name, &covmx, 0 );
+    else
+    {
+      covmx = fHist->GetSysErrorMatrix( name, false, cov_area_normalize );
+      ApplyFactors( covmx );
+    }
+
+    if( asFrac )
+      MakeFractional( covmx );
+
+    return covmx;
+  }
+
+  template<class MUHistType>
+  std::vector<double> MUHistView<MUHistType>::GetSysErrorVariance( const std::string& name, bool asFrac /*= false*/, bool cov_area_normalize /*= false*/ ) const
+  {
+    std::vector<double> var;
+    if( NeedsOwnAreaNorm( cov_area_normalize || HasEnding( name, "_asShape" ) ) )
+      GetOwnAreaNormCov( name, 0, &var );
+    else
+    {
+      var = fHist->GetSysErrorVariance( name, false, cov_area_normalize );
+      ApplyFactors( var );
+    }
+
+    if( asFrac )
+      MakeFractional( var );
+
+    return var;
+  }
+
+  template<class MUHistType>
+  TMatrixD MUHistView<MUHistType>::GetTotalErrorMatrix( bool includeStat /*= true*/, bool asFrac /*= false*/, bool cov_area_normalize /*= false*/ ) const
+  {
+    const int nCells = fHist->GetNcells();
+    TMatrixD covmx( nCells, nCells );
+
+    if( !NeedsOwnAreaNorm( cov_area_normalize ) )
+    {
+      //! The histogram caches its sum of the error bands, so this only scales it
+      covmx = fHist->GetTotalErrorMatrix( includeStat, false, cov_area_normalize );
+      ApplyFactors( covmx );
+    }
+    else
+    {
+      //! The same sum as the histogram's, one error band at a time
+      const std::vector<std::string> names = fHist->GetSysErrorMatricesNames();
+      TMatrixD sysmx( nCells, nCells );
+      for( std::vector<std::string>::const_iterator name = names.begin(); name != names.end(); ++name )
+      {
+        GetOwnAreaNormCov( *name, &sysmx, 0 );
+        covmx += sysmx;
+      }
+
+      if( includeStat )
+      {
+        for( int i = 0; i < nCells; ++i )
+          covmx[i][i] += GetBinError(i) * GetBinError(i);
+      }
+    }
+
+    if( asFrac )
+      MakeFractional( covmx );
+
+    return covmx;
+  }
+
+  template<class MUHistType>
+  std::vector<double> MUHistView<MUHistType>::GetTotalErrorVariance( bool includeStat /*= true*/, bool asFrac /*= false*/, bool cov_area_normalize /*= false*/ ) const
+  {
+    std::vector<double> var;
+
+    if( !NeedsOwnAreaNorm( cov_area_normalize ) )
+    {
+      var = fHist->GetTotalErrorVariance( includeStat, false, cov_area_normalize );
+      ApplyFactors( var );
+    }
+    else
+    {
+      var.assign( fHist->GetNcells(), 0. );
+      const std::vector<std::string> names = fHist->GetSysErrorMatricesNames();
+      std::vector<double> sysVar;
+      for( std::vector<std::string>::const_iterator name = names.begin(); name != names.end(); ++name )
+      {
+        GetOwnAreaNormCov( *name, 0, &sysVar );
+        for( unsigned int i = 0; i < var.size() && i < sysVar.size(); ++i )
+          var[i] += sysVar[i];
+      }
+
+      if( includeStat )
+      {
+        for( unsigned int i = 0; i != var.size(); ++i )
+          var[i] += GetBinError(i) * GetBinError(i);
+      }
+    }
+
+    if( asFrac )
+      MakeFractional( var );
+
+    return var;
+  }
+
+  template<class MUHistType>
+  MUHistType* MUHistView<MUHistType>::Materialize( const char* name ) const
+  {
+    //! The copy shares the universes of the error bands until the steps scale them
+    MUHistType *rval = new MUHistType( *fHist );
+    rval->SetName( name );
+    ApplyTo( rval );
+    return rval;
+  }
+
+  template<class MUHistType>
+  typename MUHistView<MUHistType>::CVType* MUHistView<MUHistType>::Draw( Option_t* option /*= ""*/, bool includeSys /*= true*/ ) const
+  {
+    // Create a (probably) unique name for the clone to avoid potential memory leaks
+    static int nViewDraws = 0;
+    const char *cloneName = Form( "%s_viewClone_%d", fHist->GetName(), ++nViewDraws );
+
+    // Clone is a new object, which is necessary so the drawn histogram stays drawn after the function ends.
+    const CVType cv = includeSys ? GetCVHistoWithError() : GetCVHistoWithStatError();
+    CVType *clone = (CVType*)cv.Clone( cloneName );
+    clone->Draw( option );
+
+    return clone;
+  }
+
+  template class MUHistView<MUH1D>;
+  template class MUHistView<MUH2D>;
+
+} //end of PlotUtils
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef MNV_MUHistView_H
+#define MNV_MUHistView_H 1
+
+#include "PlotUtils/MUH1D.h"
+#include "PlotUtils/MUH2D.h"
+
+#include "TMatrixD.h"
+
+#include <string>
+#include <vector>
+
+namespace PlotUtils
+{
+
+	//! The histogram and error band types that go with a MUH1D or MUH2D
+	template<class MUHistType> struct MUHistViewTraits;
+
+	template<> struct MUHistViewTraits<MUH1D>
+	{
+		typedef TH1D CVType;
+		typedef MUVertErrorBand VertBandType;
+		typedef MULatErrorBand LatBandType;
+	};
+
+	template<> struct MUHistViewTraits<MUH2D>
+	{
+		typedef TH2D CVType;
+		typedef MUVertErrorBand2D VertBandType;
+		typedef MULatErrorBand2D LatBandType;
+	};
+
+	/*! @brief A MUH1D (or MUH2D) as it would look after Scale, bin width normalization and SetRange, without the copy.
+
+		GetBinNormalizedCopy and friends copy the histogram with all universes of all error bands to read back
+		a central value and a few errors.  A view only records the steps:
+
+		@code
+		MUH1DView view( *h );
+		view.BinNormalize().Scale( pot_scale ).SetRangeX( 2, 10 );
+		TH1D cv = view.GetCVHistoWithError();
+		@endcode
+
+		Scale and bin width normalization multiply each bin i by a factor f_i, and the queries apply these to what
+		the histogram already has: contents and errors get f_i, covariance matrices f_i*f_k.  The covariance matrices
+		of the histogram and its bands are cached, so drawing many views of the same histogram computes them once.
+		A range restricts the axes the way TAxis::SetRange does: it only changes what is drawn and which bins
+		Integral and area normalization sum over.
+
+		With cov_area_normalize the universes are normalized to the central value over the summed bins.  If the factors
+		differ between those bins, or a range picks the bins, the factors change the normalization.  Then each error band
+		is transformed on its own, one at a time, instead of the whole histogram.
+
+		Matrices added with PushCovMatrix are scaled by f_i*f_k like the rest, so bin width normalization changes them
+		bin by bin (MUH1D::Scale scales them by c1^2).  Everything else gives the numbers of Materialize(),
+		up to rounding.
+
+		The view keeps a reference to the histogram, which must outlive it.  Changes to the histogram show in the
+		view, except that the bin width factors are taken from the binning when the step is added.
+		*/
+	template<class MUHistType>
+	class MUHistView
+	{
+		public:
+			typedef typename MUHistViewTraits<MUHistType>::CVType CVType;
+			typedef typename MUHistViewTraits<MUHistType>::VertBandType VertBandType;
+			typedef typename MUHistViewTraits<MUHistType>::LatBandType LatBandType;
+
+			//! A view of h with no steps
+			explicit MUHistView( const MUHistType& h );
+
+			//! Add a step that multiplies by c1 ("width" to divide by the bin widths too, as TH1::Scale)
+			MUHistView& Scale( const double c1, Option_t* option = "" );
+
+			/*! Add the step GetBinNormalizedCopy takes: Scale( normBinWidth, "width" ), with the area of the bin for a MUH2D
+				@param[in] normBinWidthX,normBinWidthY Bin widths to normalize to (nonpositive means use the histogram's default, if set)
+				*/
+			MUHistView& BinNormalize( double normBinWidthX = -1., double normBinWidthY = -1. );
+
+			//! Restrict the x axis to bins first to last, as GetXaxis()->SetRange( first, last )
+			MUHistView& SetRangeX( const int first, const int last );
+
+			//! Restrict the y axis to bins first to last (MUH2D only)
+			MUHistView& SetRangeY( const int first, const int last );
+
+			//! The histogram this is a view of
+			const MUHistType& GetHist() const { return *fHist; };
+
+			//! The product of the factors of all steps, one per global bin
+			const std::vector<double>& GetBinFactors() const { return fFactors; };
+
+			//! True if all bins other than under/overflow have the same factor, so the steps do not change area normalization
+			bool IsUniform() const;
+
+			//! Content of a global bin after the steps
+			Double_t GetBinContent( const int bin ) const;
+
+			//! Statistical error of a global bin after the steps
+			Double_t GetBinError( const int bin ) const;
+
+			//! Content of a global bin in one universe of an error band, after the steps
+			Double_t GetUniverseContent( const std::string& name, const unsigned int universe, const int bin ) const;
+
+			//! Sum of the contents over the range, as TH1::Integral().  includeFlows sums all bins instead.
+			Double_t Integral( const bool includeFlows = false ) const;
+
+			//! As MUH1D::GetAreaNormFactor: the integral of data (with under/overflow) over the integral of this
+			Double_t GetAreaNormFactor( const MUHistView& data ) const;
+
+			//! The central value histogram after the steps, with its statistical errors and the range set
+			CVType GetCVHisto() const;
+
+			//! Same as GetCVHisto, named as MUH1D::GetCVHistoWithStatError names it
+			CVType GetCVHistoWithStatError() const;
+
+			//! The central value histogram after the steps, with the total error of GetTotalErrorVariance as bin errors
+			CVType GetCVHistoWithError( bool includeStat = true, bool cov_area_normalize = false ) const;
+
+			//! A histogram whose contents are the total errors after the steps
+			CVType GetTotalError( bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+
+			//! The total covariance matrix after the steps
+			TMatrixD GetTotalErrorMatrix( bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+
+			//! Just the diagonal of GetTotalErrorMatrix
+			std::vector<double> GetTotalErrorVariance( bool includeStat = true, bool asFrac = false, bool cov_area_normalize = false ) const;
+
+			//! The covariance matrix of one error band (or error matrix) after the steps
+			TMatrixD GetSysErrorMatrix( const std::string& name, bool asFrac = false, bool cov_area_normalize = false ) const;
+
+			//! Just the diagonal of GetSysErrorMatrix
+			std::vector<double> GetSysErrorVariance( const std::string& name, bool asFrac = false, bool cov_area_normalize = false ) const;
+
+			/*! Apply the steps to a copy of the histogram, with all its error bands
+				@param[in] name Name of the copy
+				@return A NEW histogram, which the caller now owns (so delete it!)
+				*/
+			MUHistType* Materialize( const char* name ) const;
+
+			/*! Draw the central value after the steps, with the total error (or the statistical error) as bin errors
+				@param[in] option see THistPainter documentation
+				@param[in] includeSys Draw the total error instead of only the statistical error
+				@return A pointer to a NEW histogram, which the caller now owns (so delete it!)
+				*/
+			CVType* Draw( Option_t* option = "", bool includeSys = true ) const;
+
+		private:
+			//! One Scale step
+			struct Step
+			{
+				double fC1;   ///< Scale
+				bool fWidth;  ///< Divide by the bin widths too
+			};
+
+			//! Apply the steps and range to h, which has the binning of the histogram
+			void ApplyTo( TH1* h ) const;
+
+			//! True if area normalization after the steps differs from area normalization before them
+			bool NeedsOwnAreaNorm( const bool cov_area_normalize ) const;
+
+			//! Multiply element i,k by f_i*f_k
+			void ApplyFactors( TMatrixD& covmx ) const;
+
+			//! Multiply element i by f_i^2
+			void ApplyFactors( std::vector<double>& var ) const;
+
+			//! Divide by the central values after the steps
+			void MakeFractional( TMatrixD& covmx ) const;
+
+			//! Divide by the central values after the steps
+			void MakeFractional( std::vector<double>& var ) const;
+
+			//! GetSysErrorMatrix or GetSysErrorVariance of a band, area normalized after the steps
+			void GetOwnAreaNormCov( const std::string& name, TMatrixD *covmx, std::vector<double> *var ) const;
+
+			const MUHistType *fHist;         ///< The histogram
+			std::vector<Step> fSteps;        ///< Scale steps in order
+			std::vector<double> fFactors;    ///< Product of the factors of all steps, one per global bin
+			int fFirstX, fLastX;             ///< Range of the x axis, if fFirstX <= fLastX
+			int fFirstY, fLastY;             ///< Range of the y axis, if fFirstY <= fLastY
+	}; //end of MUHistView
+
+	typedef MUHistView<MUH1D> MUH1DView;
+	typedef MUHistView<MUH2D> MUH2DView;
+
+} //end of PlotUtils
+
+#endif
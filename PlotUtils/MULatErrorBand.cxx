@@ -4,24 +4,27 @@
 #include "PlotUtils/MULatErrorBand.h"
 
 #include "HistogramUtils.h" //for IsNotPhysicalShift
+#include "PlotUtils/MUTaskPool.h"
 #include <algorithm>
 
 #include <TDirectory.h>
+#include <TBuffer.h>
 
 using namespace PlotUtils;
 
 ClassImp(MULatErrorBand);
 
-MULatErrorBand::MULatErrorBand( const std::string& name, const TH1D* base, const unsigned int nHists /* = 2 */ )
-: TH1D( *base )
+MULatErrorBand::MULatErrorBand( const std::string& name, const TH1D* base, const unsigned int nHists /* = 2 */ ) :
+  TH1D( *base ),
+  fViewsCurrent(false),
+  fViewsModified(false)
 {
   SetName( name.c_str() );
   SetTitle( name.c_str() );
 
   fNHists = nHists;
-  char tmpName[256];
 
-  //! initialize the good colors
+  //set the good colors
   if( fGoodColors.size() == 0 )
   {
     fGoodColors.push_back( 2 );
@@ -33,25 +36,8 @@ MULatErrorBand::MULatErrorBand( const std::string& name, const TH1D* base, const
       fGoodColors.push_back( i );
   }
 
-  //change to this's directory so children are in the same place
-  const TString oldDir = gDirectory->GetPath();
-  if(this->GetDirectory())
-    this->GetDirectory()->cd();
-
-  for( unsigned int i = 0; i < fNHists; i++ )
-  {
-    sprintf(tmpName, "%s_universe%d", name.c_str(), i );
-    TH1D *tmp = new TH1D( *base );
-    tmp->Reset();
-    tmp->SetName(tmpName);
-
-    //give the universe histos a style and color
-    tmp->SetLineColor( fGoodColors[ i % fGoodColors.size() ] );
-    tmp->SetLineStyle( i % 10 + 1 );
-
-    fHists.push_back( tmp );
-  }
-  gDirectory->cd(oldDir);
+  //! All universes start out empty in one contiguous block
+  fUniverses.Resize( GetNcells(), fNHists );
 
   if( nHists < 10 )
     fUseSpreadError = true;
@@ -60,15 +46,16 @@ MULatErrorBand::MULatErrorBand( const std::string& name, const TH1D* base, const
 
 }
 
-MULatErrorBand::MULatErrorBand( const std::string& name, const TH1D* base, const std::vector<TH1D*>& hists ):
-  TH1D (*base)
+MULatErrorBand::MULatErrorBand( const std::string& name, const TH1D* base, const std::vector<TH1D*>& hists ) :
+  TH1D (*base),
+  fViewsCurrent(false),
+  fViewsModified(false)
 {
 
   SetName( name.c_str() );
   SetTitle( name.c_str() );
 
   fNHists = hists.size();
-  char tmpName[256];
 
   //set the good colors
   if( fGoodColors.size() == 0 )
@@ -82,26 +69,12 @@ MULatErrorBand::MULatErrorBand( const std::string& name, const TH1D* base, const
       fGoodColors.push_back( i );
   }
 
-  //change to this's directory so children are in the same place
-  const TString oldDir = gDirectory->GetPath();
-  if(this->GetDirectory())
-    this->GetDirectory()->cd();
+  fUniverses.Resize( GetNcells(), fNHists );
 
   std::vector<TH1D*>::const_iterator it = hists.begin();
   int it_pos = 0;
   for( ; it != hists.end(); ++it, ++it_pos )
-  {
-    sprintf(tmpName, "%s_universe%d", name.c_str(), it_pos );
-    TH1D *tmp = new TH1D( **it );
-    tmp->SetName(tmpName);
-
-    //give the universe histos a style and color
-    tmp->SetLineColor( fGoodColors[ it_pos % fGoodColors.size() ] );
-    tmp->SetLineStyle( it_pos % 10 + 1 );
-
-    fHists.push_back( tmp );
-  }
-  gDirectory->cd(oldDir);
+    fUniverses.ImportHist( it_pos, *it );
 
   if( fNHists < 10 )
     fUseSpreadError = true;
@@ -110,15 +83,16 @@ MULatErrorBand::MULatErrorBand( const std::string& name, const TH1D* base, const
 
 }
 
-
 MULatErrorBand::MULatErrorBand( const MULatErrorBand& h ) :
-  TH1D( h )
+  TH1D( h ),
+  fViewsCurrent(false),
+  fViewsModified(false)
 {
   //!Deep copy the variables
   DeepCopy( h );
 }
 
-MULatErrorBand& MULatErrorBand::operator=( const MULatErrorBand& h )
+MULatErrorBand& MULatErrorBand::operator=( const MULatErrorBand& h ) 
 {
   //! If this is me, no copy is needed
   if( this == &h )
@@ -127,8 +101,9 @@ MULatErrorBand& MULatErrorBand::operator=( const MULatErrorBand& h )
   //! Call the base class's assignment
   TH1D::operator=(h);
 
-  //! Delete and clear the hists vector
-  for( unsigned int i = 0; i < h.fNHists; ++i )
+  //! Delete the views and any old-style hists
+  DeleteViews();
+  for( unsigned int i = 0; i < fHists.size(); ++i )
     delete fHists[i];
   fHists.clear();
   fGoodColors.clear();
@@ -138,22 +113,70 @@ MULatErrorBand& MULatErrorBand::operator=( const MULatErrorBand& h )
   return *this;
 }
 
-void MULatErrorBand::DeepCopy( const MULatErrorBand& h )
+#if __cplusplus >= 201103L
+MULatErrorBand::MULatErrorBand( MULatErrorBand&& h ) noexcept :
+  TH1D(),
+  fViewsCurrent(false),
+  fViewsModified(false)
+{
+  //! Take the bins and the universes instead of copying them
+  MUHist::MoveHistogram( *this, h );
+  MoveFrom( h );
+}
+
+MULatErrorBand& MULatErrorBand::operator=( MULatErrorBand&& h ) noexcept
+{
+  //! If this is me, there is nothing to move
+  if( this == &h )
+    return *this;
+
+  //! Take the bins of h
+  MUHist::MoveHistogram( *this, h );
+
+  //! Delete the views and any old-style hists
+  DeleteViews();
+  for( unsigned int i = 0; i < fHists.size(); ++i )
+    delete fHists[i];
+  fHists.clear();
+
+  MoveFrom( h );
+
+  return *this;
+}
+
+void MULatErrorBand::MoveFrom( MULatErrorBand& h )
 {
   fUseSpreadError = h.GetUseSpreadError();
   fNHists = h.fNHists;
+  fGoodColors.swap( h.fGoodColors );
+
+  //! The universes, their views and any old-style hists change hands as they are
+  fUniverses.Swap( h.fUniverses );
+  fUniverseViews.swap( h.fUniverseViews );
+  fHists.swap( h.fHists );
+  fViewsCurrent = h.fViewsCurrent;
+  fViewsModified = h.fViewsModified;
+  fCacheVersion.Touch();
+
+  //! Leave h a valid band without universes
+  h.fNHists = 0;
+  h.DeleteViews();
+  MUUniverseStore().Swap( h.fUniverses );
+  h.fCacheVersion.Touch();
+}
+#endif
 
-  //change to this's directory so children are in the same place
-  const TString oldDir = gDirectory->GetPath();
-  if(this->GetDirectory())
-    this->GetDirectory()->cd();
-
-  for( unsigned int i = 0; i < fNHists; ++i )
-    fHists.push_back( new TH1D(*h.GetHist(i)) );
+void MULatErrorBand::DeepCopy( const MULatErrorBand& h )
+{
+  fUseSpreadError = h.GetUseSpreadError();
+  fNHists = h.fNHists;
 
-  gDirectory->cd(oldDir);
+  //! The copy shares the buffers of the universes until one of the bands changes them
+  fUniverses = h.GetUniverseStore();
+  fViewsCurrent = false;
+  fViewsModified = false;
+  fCacheVersion.Touch();
 
-  //! meh.
   //set the good colors
   if( fGoodColors.size() == 0 )
   {
@@ -167,6 +190,119 @@ void MULatErrorBand::DeepCopy( const MULatErrorBand& h )
   }
 }
 
+MULatErrorBand::~MULatErrorBand()
+{
+  DeleteViews();
+  for( unsigned int i = 0; i < fHists.size(); ++i )
+    delete fHists[i];
+}
+
+void MULatErrorBand::SetName( const char *name )
+{
+  this->TH1D::SetName( name );
+
+  //! Keep the universe views named after the band
+  for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+    fUniverseViews[i]->SetName( Form( "%s_universe%d", GetName(), i ) );
+}
+
+void MULatErrorBand::Streamer( TBuffer &b )
+{
+  if( b.IsReading() )
+  {
+    b.ReadClassBuffer( MULatErrorBand::Class(), this );
+    fUniverses.AfterStreaming();
+    fCacheVersion.Touch();
+
+    //! Files written before version 4 hold the universes as TH1Ds
+    if( !fHists.empty() )
+      ImportUniverses();
+  }
+  else
+  {
+    //! Make sure changes made through views are written
+    SyncUniverses();
+    //! The universes may be shared with copies, so they are only in the persistent members while written
+    fUniverses.BeforeWriting();
+    b.WriteClassBuffer( MULatErrorBand::Class(), this );
+    fUniverses.AfterStreaming();
+  }
+}
+
+void MULatErrorBand::ImportUniverses() const
+{
+  MUQueryLock lock;
+
+  //! The universes are logically part of this band's state, whichever form they currently live in
+  MULatErrorBand *self = const_cast<MULatErrorBand*>( this );
+
+  //! A band read from a file written before version 4 has its universes as TH1Ds
+  if( !fHists.empty() )
+  {
+    self->fUniverses.Resize( GetNcells(), fHists.size() );
+    for( unsigned int i = 0; i < fHists.size(); ++i )
+    {
+      self->fUniverses.ImportHist( i, fHists[i] );
+      delete fHists[i];
+    }
+    self->fHists.clear();
+    fViewsCurrent = false;
+    fCacheVersion.Touch();
+  }
+
+  //! Views handed out nonconst may have been changed
+  if( fViewsModified )
+  {
+    for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+      self->fUniverses.ImportHist( i, fUniverseViews[i] );
+    fViewsModified = false;
+    fCacheVersion.Touch();
+    fViewsCurrent = true;
+  }
+}
+
+void MULatErrorBand::MaterializeViews() const
+{
+  //! Const queries on several threads may get here at once
+  MUQueryLock lock;
+
+  //! Views handed out nonconst hold the latest state themselves
+  if( fViewsModified || fViewsCurrent )
+    return;
+
+  if( fUniverseViews.size() != fNHists )
+  {
+    DeleteViews();
+    TDirectory::TContext detached( gDirectory, 0 ); //views are owned by the band, not a directory
+    for( unsigned int i = 0; i < fNHists; ++i )
+    {
+      TH1D *view = new TH1D( *this );
+      view->SetName( Form( "%s_universe%d", GetName(), i ) );
+
+      //give the universe histos a style and color
+      if( !fGoodColors.empty() )
+        view->SetLineColor( fGoodColors[ i % fGoodColors.size() ] );
+      view->SetLineStyle( i % 10 + 1 );
+
+      fUniverseViews.push_back( view );
+    }
+  }
+
+  for( unsigned int i = 0; i < fNHists; ++i )
+    fUniverses.ExportHist( i, fUniverseViews[i] );
+
+  fViewsCurrent = true;
+}
+
+void MULatErrorBand::DeleteViews() const
+{
+  for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+    delete fUniverseViews[i];
+  fUniverseViews.clear();
+  fViewsCurrent = false;
+  fViewsModified = false;
+}
+
 const TH1D *MULatErrorBand::GetHist( unsigned int i ) const
 {
   if( i >= fNHists )
@@ -174,7 +310,8 @@ const TH1D *MULatErrorBand::GetHist( unsigned int i ) const
     Warning("GetHist", "Cannot return histogram of universe %d because this object has %d universes.", i, fNHists);
     return NULL;
   }
-  return fHists[i];
+  MaterializeViews();
+  return fUniverseViews[i];
 }
 
 TH1D *MULatErrorBand::GetHist( unsigned int i )
@@ -184,61 +321,106 @@ TH1D *MULatErrorBand::GetHist( unsigned int i )
     Warning("GetHist", "Cannot return histogram of universe %d because this object has %d universes.", i, fNHists);
     return NULL;
   }
-  return fHists[i];
+  MaterializeViews();
+  fViewsModified = true;
+  return fUniverseViews[i];
+}
+
+const std::vector<TH1D*>& MULatErrorBand::GetHists() const
+{
+  MaterializeViews();
+  return fUniverseViews;
+}
+
+std::vector<TH1D*> MULatErrorBand::GetHists()
+{
+  MaterializeViews();
+  fViewsModified = true;
+  return fUniverseViews;
+}
+
+const MUUniverseStore& MULatErrorBand::GetUniverseStore() const
+{
+  SyncUniverses();
+  return fUniverses;
+}
+
+MUUniverseStore& MULatErrorBand::GetUniverseStore()
+{
+  SyncUniverses();
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
+  return fUniverses;
 }
 
 
 bool MULatErrorBand::Fill( const double val, const double *shifts, const double cvweight /* = 1.0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+  //! Use FindBin to get the CV bin 
+  return FillAtBin( FindBin( val ), val, shifts, cvweight, fillcv, weights );
+}
+
+bool MULatErrorBand::FillAtBin( const int cvbin, const double val, const double *shifts, const double cvweight /* = 1.0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
 {
   //! Fill the CV hist with the CV weight and value
   if( fillcv ) 
-    this->TH1D::Fill( val, cvweight );
+    FillCVAtBin( cvbin, val, cvweight );
+
+  //! Find the bins of all shifted values at once
+  //! Refresh the locator if the binning changed behind our back (e.g. SetBins)
+  if( !fXLocator.Matches( GetXaxis() ) )
+    fXLocator.Set( GetXaxis() );
+  SyncUniverses();
+
+  //! Work through the universes in chunks small enough for the stack
+  const unsigned int chunk = 256;
+  int bins[chunk];
+  for( unsigned int first = 0; first < fNHists; first += chunk )
+  {
+    const unsigned int n = std::min( fNHists - first, chunk );
+    fXLocator.FindBins( val, shifts + first, n, bins );
 
-  //! Use FindBin to get the CV bin 
-  int cvbin = FindBin( val );
+    for( unsigned int j = 0; j != n; ++j )
+    {
+      const unsigned int i = first + j;
+      if( MUHist::IsNotPhysicalShift( shifts[i] ) )
+        continue;
 
-  //! Add to the bin content of all the universes
-  //! Assume that the bin we will fill is close to the bin at the central value
-  //! cvBinLowEdge is meaningless for the underflow bin, as is cvBinHighEdge for the overflow
-  const int nbins = GetNbinsX();
-  const double cvBinLowEdge  = (cvbin < GetNbinsX()+1) ? GetBinLowEdge( cvbin )  : GetBinLowEdge(cvbin-1) + GetBinWidth(cvbin-1);
-  const double cvBinHighEdge = (cvbin < GetNbinsX()+1) ? GetBinLowEdge( cvbin+1) : cvBinLowEdge + GetBinWidth(cvbin-1);
-  for( unsigned int i = 0; i != fNHists; ++i )
-  {
-    if( MUHist::IsNotPhysicalShift( shifts[i] ) ) 
-      continue;
+      //! Now that we know the bin, add the shift/weight to its content
+      double wgtU = cvweight;
+      if( 0 != weights )
+        wgtU *= weights[i];
 
-    const double shiftVal = val + shifts[i];
-    int bin = cvbin;
-    if (shiftVal < val && shiftVal < cvBinLowEdge && bin>0)  {
-      //! If the shift puts the value below the low edge of the CV bin, start looking down.  If not found, then go to underflow at bin=0.
-      for( ; bin != 0; --bin )
-        if( GetBinLowEdge( bin ) < shiftVal )
-          break;
-    }  
-    else if (shiftVal > val && shiftVal > cvBinHighEdge && bin < GetNbinsX()+1) {
-      //! If the shift puts the value above the high edge of the CV bin, start looking up.  If not found, then go to underflow at bin=nbins+1
-      for( ; bin != nbins+1; ++bin )
-        if( shiftVal <  (GetBinLowEdge( bin ) + GetBinWidth( bin ) ) )
-          break;
-    }      
-
-    //! Now that we know the bin, add the shift/weight to its content
-    double wgtU = cvweight;
-    if( 0 != weights )
-      wgtU *= weights[i];
-
-    fHists[i]->AddBinContent( bin, wgtU );
-
-    const double err = fHists[i]->GetBinError(bin);
-    const double newerr2 = err*err + wgtU*wgtU;
-    const double newerr = (0.<newerr2) ? sqrt(newerr2) : 0.;
-    fHists[i]->SetBinError( bin, newerr );
+      fUniverses.Fill( bins[j], i, wgtU );
+    }
   }
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 
   return true;
 }
 
+void MULatErrorBand::FillCVAtBin( const int bin, const double val, const double w )
+{
+  //! Buffered or unweighted histograms get the full TH1::Fill treatment
+  if( fBuffer || 0 == fSumw2.fN )
+  {
+    this->TH1D::Fill( val, w );
+    return;
+  }
+
+  //! Otherwise this is TH1::Fill without the bin search
+  fEntries++;
+  fSumw2.fArray[bin] += w*w;
+  AddBinContent( bin, w );
+  if( ( bin == 0 || bin > GetNbinsX() ) && !MUHist::StatOverflows( *this ) )
+    return;
+  fTsumw   += w;
+  fTsumw2  += w*w;
+  fTsumwx  += w*val;
+  fTsumwx2 += w*val*val;
+}
+
 bool MULatErrorBand::Fill( const double val, const double shiftDown, const double shiftUp, const double cvweight /*= 1.0*/, const bool fillcv /* = true */ )
 {
   //! Throw an exception if there are nUniverses is not 2
@@ -254,19 +436,35 @@ bool MULatErrorBand::Fill( const double val, const double shiftDown, const doubl
   return Fill( val, shifts, cvweight, fillcv );
 }
 
+bool MULatErrorBand::FillBatch( const unsigned int nEvents, const double *vals, const double *shifts, const double *cvweights /* = 0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+  //! Each universe of each event may land in a different bin, so this is the single event Fill in a loop,
+  //! but the caller only looks up the band once for the whole batch
+  bool rval = true;
+  for( unsigned int i = 0; i != nEvents; ++i )
+  {
+    const size_t row = (size_t)i * fNHists;
+    const double cvweight = cvweights ? cvweights[i] : 1.;
+    rval = Fill( vals[i], shifts + row, cvweight, fillcv, weights ? weights + row : 0 ) && rval;
+  }
+
+  return rval;
+}
+
 
 TH1D MULatErrorBand::GetErrorBand( bool asFrac /* = false */, bool cov_area_normalize /* = false */) const
 {
   //! @todo what to do with underflow( bin=0 ) and overlow ( bin=nbins+1 )?
+  TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
   TH1D errBand( *this );
   errBand.Reset();
   const int lowBin = 0;
   const int highBin = GetNbinsX() + 1;
-  TMatrixD covmx( CalcCovMx(cov_area_normalize,asFrac) );
+  const std::vector<double> var = CalcVariance( cov_area_normalize, asFrac );
 
   for( int i = lowBin; i <= highBin; ++i )
   {
-    double err = (covmx[i][i]>0.)? sqrt( covmx[i][i] ): 0.; //Protect against odd sqrt(0) = NaN errors.
+    double err = (var[i]>0.)? sqrt( var[i] ): 0.; //Protect against odd sqrt(0) = NaN errors.
 
     errBand.SetBinContent( i, err );
     errBand.SetBinError(i, 0.);
@@ -276,112 +474,60 @@ TH1D MULatErrorBand::GetErrorBand( bool asFrac /* = false */, bool cov_area_norm
 
 }
 
-TMatrixD MULatErrorBand::CalcCovMx(bool area_normalize /* = false */ , bool asFrac /* = false */ ) const
+ULong64_t MULatErrorBand::GetCacheVersion() const
 {
-  //Calculating the Mean
-  TH1D hmean = TH1D(*this);
-
-  // if there's more than one varied universe, calculate the mean; if not, use the CV
-  // histo as the 'mean'
-  if(fNHists > 1)
-    hmean.Reset();
-
-  //!Storing Area Normalization Factors for the many universes
-  std::vector<double> normFactors;
-
-  for( unsigned int j = 0; j < fNHists; ++j ) 
-  {
-    if (area_normalize)
-    {
-      double area_scale = fHists[j]->Integral();
-      normFactors.push_back(area_scale/Integral());
+  //! Changes made through views count once they are synced
+  SyncUniverses();
+  return fCacheVersion.Get( this );
+}
 
-      if (fHists[j]->Integral()!=0) //just in case
-      {
-        fHists[j]->Scale(Integral()/area_scale);
-      }
-    }
+TMatrixD MULatErrorBand::CalcCovMx(bool area_normalize /* = false */ , bool asFrac /* = false */ ) const
+{
+  //! Reuse the last result of this variant if nothing changed since
+  const int variant = ( area_normalize ? 1 : 0 ) + ( asFrac ? 2 : 0 );
+  const ULong64_t version = GetCacheVersion();
+  TMatrixD cached;
+  if( fCovCache.Get( variant, version, cached ) )
+    return cached;
+
+  const TMatrixD covmx( ComputeCovMx( area_normalize, asFrac ) );
+  fCovCache.Put( variant, version, covmx );
+  return covmx;
+}
 
-    if(fNHists>1)
-      hmean.Add(fHists[j]);
-  }
+TMatrixD MULatErrorBand::ComputeCovMx( bool area_normalize, bool asFrac ) const
+{
+  const MUUniverseStore& store = GetUniverseStore();
 
-  if(fNHists>1)
-    hmean.Scale(1.0/(double) fNHists);
+  //! Area normalization scales each universe to the area of the CV, leaving the universes themselves alone
+  std::vector<double> scales( fNHists, 1. );
+  if( area_normalize )
+    scales = store.GetAreaNormScales( this );
 
   // Calculating Covariance Matrix
   //! @todo what to do with underflow( bin=0 ) and overlow ( bin=nbins+1 )?
   const int lowBin = 0; // considering underflow bin
-  const int highBin = hmean.GetNbinsX()+1; //considering overflow bin
+  const int highBin = GetNbinsX()+1; //considering overflow bin
 
   TMatrixD covmx(highBin+1, highBin+1); // this is #bins + 2(bins for under&overflow)
 
   if (fUseSpreadError)
   {
-    std::vector< std::vector<double> > binValsVec(highBin+1);
-    //calculate maximum and minum values for every bin
-    for( int i = lowBin; i <= highBin; ++i )
-    {
-      std::vector<double> binVals;
-      for( unsigned int j = 0; j < fNHists; ++j )
-      {
-        const double val = fHists[j]->GetBinContent(i);
-        if( isnan(val) )
-          Warning( "MULatErrorBand::CalcCovMx", "%s is trying to add nan val in bin %d,%d", GetName(), i, j);
-        else
-          binVals.push_back( val );
-      }
-      //get the CV value for this bin
-      const double cv = GetBinContent(i);
-      binVals.push_back( cv );
-      sort( binVals.begin(), binVals.end() );
-
-      binValsVec.at(i) =  binVals ;
-    }
-
-    //! For spread errors in only 1 universe take the full max spread
-    //! For spread errors in less than 10 universes take 1/2 the max spread
-    //! For spread errors with more than 10 universes, use the interquartile spread
+    //! Get the spread of every bin once; the covariance is their outer product
+    const std::vector<double> spreads = CalcSpreads( scales );
     for( int i = lowBin; i <= highBin; ++i )
     {
       for( int k = i; k <= highBin; ++k )
       {
-        if ( fNHists == 1 )
-          covmx[i][k] = ( (binValsVec.at(i)).back()- (binValsVec.at(i)).front() ) * ( (binValsVec.at(k)).back()- (binValsVec.at(k)).front() );
-        else if ( fNHists < 10 )
-          covmx[i][k] = ( (binValsVec.at(i)).back() - (binValsVec.at(i)).front() ) * ( (binValsVec.at(k)).back() - (binValsVec.at(k)).front() ) / 4. ;
-        else
-          covmx[i][k] = MUHist::GetInterquartileRange( binValsVec.at(i) ) * MUHist::GetInterquartileRange( binValsVec.at(k) ) * pow(MUHist::InterquartileRangeToSigma,2);
-
+        covmx[i][k] = spreads[i] * spreads[k];
         covmx[k][i] = covmx[i][k];
       }
     }
   }
   else
   {
-    //Calculating Covariance
-    for( unsigned int j = 0; j < fNHists; ++j ) 
-    {
-      for( int i = lowBin; i <= highBin; ++i )
-      {
-        double xi=fHists[j]->GetBinContent(i);      
-        double ximean=hmean.GetBinContent(i);
-        for( int k = i; k <= highBin; ++k )
-        {
-          double xk=fHists[j]->GetBinContent(k);
-          double xkmean=hmean.GetBinContent(k);
-          covmx[i][k] +=(xi-ximean)*(xk-xkmean);
-        }
-      }
-    }
-    for( int i = lowBin; i <= highBin; ++i )
-    {
-      for( int k = i; k <= highBin; ++k )
-      {
-        covmx[i][k]/=((double)fNHists);
-        covmx[k][i]=covmx[i][k];
-      }
-    }
+    //! Covariance of the universes about their mean, or about the CV when there is only one universe
+    store.CalcCovariance( covmx.GetMatrixArray(), ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
   }
   if (asFrac)
   {
@@ -401,17 +547,101 @@ TMatrixD MULatErrorBand::CalcCovMx(bool area_normalize /* = false */ , bool asFr
     }
   }
 
-  //! Getting fHists back to normal
-  if (area_normalize)
+  return covmx;
+}
+
+std::vector<double> MULatErrorBand::CalcVariance( bool area_normalize /* = false */, bool asFrac /* = false */ ) const
+{
+  const MUUniverseStore& store = GetUniverseStore();
+
+  std::vector<double> scales( fNHists, 1. );
+  if( area_normalize )
+    scales = store.GetAreaNormScales( this );
+
+  std::vector<double> var( GetNcells(), 0. );
+  if( fUseSpreadError )
   {
-    for( unsigned int j = 0; j < fNHists; ++j ) {
-      if (fHists[j]->Integral()!=0)
-      {
-        fHists[j]->Scale(normFactors[j]);
-      }
+    const std::vector<double> spreads = CalcSpreads( scales );
+    for( unsigned int i = 0; i != var.size(); ++i )
+      var[i] = spreads[i] * spreads[i];
+  }
+  else
+    store.CalcVariance( &var[0], ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
+
+  if( asFrac )
+  {
+    for( unsigned int i = 0; i != var.size(); ++i )
+    {
+      const double cv = GetBinContent(i);
+      var[i] = ( cv != 0. ) ? var[i] / ( cv * cv ) : 0.;
     }
   }
-  return covmx;
+
+  return var;
+}
+
+MULowRankCovariance MULatErrorBand::CalcLowRankCovMx( bool area_normalize /* = false */, bool asFrac /* = false */ ) const
+{
+  const MUUniverseStore& store = GetUniverseStore();
+
+  std::vector<double> scales( fNHists, 1. );
+  if( area_normalize )
+    scales = store.GetAreaNormScales( this );
+
+  MULowRankCovariance cov( GetNcells() );
+  cov.SetCV( this );
+  if( fUseSpreadError )
+  {
+    //! The spread covariance is the outer product of the spreads, so it is rank one
+    const std::vector<double> spreads = CalcSpreads( scales );
+    cov.AddColumn( &spreads[0] );
+  }
+  else
+    cov.AddUniverses( store, ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
+
+  if( asFrac )
+    cov.MakeFractional();
+
+  return cov;
+}
+
+std::vector<double> MULatErrorBand::CalcSpreads( const std::vector<double>& scales ) const
+{
+  const MUUniverseStore& store = GetUniverseStore();
+
+  std::vector<double> spreads( GetNcells() );
+  std::vector<double> binVals;
+  for( int i = 0; i < GetNcells(); ++i )
+  {
+    binVals.clear();
+    for( unsigned int j = 0; j < fNHists; ++j )
+    {
+      const double val = store.GetBinContent( i, j ) * scales[j];
+      if( isnan(val) )
+        Warning( "MULatErrorBand::CalcSpreads", "%s is trying to add nan val in bin %d,%d", GetName(), i, j);
+      else
+        binVals.push_back( val );
+    }
+    //get the CV value for this bin
+    const double cv = GetBinContent(i);
+    binVals.push_back( cv );
+    spreads[i] = MUHist::GetSpread( binVals, fNHists );
+  }
+
+  return spreads;
+}
+
+std::vector<double> MULatErrorBand::GetBinQuantiles( const int bin, const std::vector<double>& q ) const
+{
+  if( bin < 0 || GetNcells() <= bin )
+  {
+    Error("GetBinQuantiles", "Cannot return quantiles of bin %d because this object has %d bins.", bin, GetNcells());
+    return std::vector<double>( q.size(), 0. );
+  }
+
+  const double *row = GetUniverseStore().GetSumwRow( bin );
+  std::vector<double> binVals( row, row + fNHists );
+  return MUHist::GetQuantiles( binVals, q );
 }
 
 
@@ -437,12 +667,13 @@ void MULatErrorBand::DrawAll( const char *option /* = "" */, bool drawCV /* = fa
 {
 
   //! make a copy of each universe
+  const std::vector<TH1D*>& hists = GetHists();
   std::vector<TH1D*> histsCopy;
   TH1D *tallest(NULL);
   double maxVal = 0.;
   for( unsigned int i = 0; i < fNHists; ++i )
   {
-    TH1D* histCopy = (TH1D*)fHists[i]->Clone( Form( "%s_tmp", fHists[i]->GetName() ) );
+    TH1D* histCopy = (TH1D*)hists[i]->Clone( Form( "%s_tmp", hists[i]->GetName() ) );
 
     //! area normalize universe hist if desired
     if( area_normalize && histCopy->Integral()!=0 )
@@ -521,7 +752,7 @@ void MULatErrorBand::DrawAll( const char *option /* = "" */, bool drawCV /* = fa
   //! now draw the rest
   for( unsigned int i = 0; i < fNHists; ++i )
   {
-    if( tallest == fHists[i] )
+    if( tallest == hists[i] )
       continue;
     histsCopy[i]->DrawCopy( optionSAME );
   }
@@ -544,13 +775,21 @@ void MULatErrorBand::DrawAll( const char *option /* = "" */, bool drawCV /* = fa
 //=======================================================================
 
 void MULatErrorBand::Scale( Double_t c1 /*= 1.*/, Option_t *option /*= ""*/ )
-{
+{ 
   //! Scale the CVHist
   this->TH1D::Scale( c1, option );
 
-  //! Scale all universes
-  for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-    fHists[iHist]->Scale( c1, option );
+  //! Scale all universes at once, the same way TH1D::Scale would
+  SyncUniverses();
+  TString opt( option );
+  opt.ToLower();
+  const bool scaleSumw2 = !opt.Contains( "nosw2" );
+  if( opt.Contains( "width" ) )
+    fUniverses.ScaleBins( MUUniverseStore::GetWidthScaleFactors( this, c1 ), scaleSumw2 );
+  else
+    fUniverses.Scale( c1, scaleSumw2 );
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 }
 
 Bool_t MULatErrorBand::Divide( const MULatErrorBand* h1, const MULatErrorBand* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/, Option_t* option /*=""*/ )
@@ -566,11 +805,13 @@ Bool_t MULatErrorBand::Divide( const MULatErrorBand* h1, const MULatErrorBand* h
   //! @note root documentation for recent versions says TH1D::Divide returns a bool but its void in our current version of ROOT (5.30)
   this->TH1D::Divide( h1, h2, c1, c2, option);
 
-  //! Call Divide for all universes
-  for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-    fHists[iHist]->Divide( h1->GetHist(iHist), h2->GetHist(iHist), c1, c2, option );
+  //! Divide all universes at once
+  SyncUniverses();
+  const bool ok = fUniverses.Divide( h1->GetUniverseStore(), h2->GetUniverseStore(), c1, c2, MUUniverseStore::IsBinomialOption( option ) );
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 
-  return true;
+  return ok;
 }
 
 Bool_t MULatErrorBand::DivideSingle( const MULatErrorBand* h1, const TH1* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/, Option_t* option /*=""*/ )
@@ -586,13 +827,16 @@ Bool_t MULatErrorBand::DivideSingle( const MULatErrorBand* h1, const TH1* h2, Do
   //! @note root documentation says this function returns a bool but its void in our version
   this->TH1D::Divide( (TH1D*)h1, h2, c1, c2, option);
 
-  //! Call Divide for all universes
-  for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-    fHists[iHist]->Divide( h1->GetHist(iHist), h2, c1, c2, option );
+  //! Divide all universes at once
+  SyncUniverses();
+  const bool ok = fUniverses.Divide( h1->GetUniverseStore(), h2, c1, c2, MUUniverseStore::IsBinomialOption( option ) );
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 
-  return true;
+  return ok;
 }
 
+
 Bool_t MULatErrorBand::Multiply( const MULatErrorBand* h1, const MULatErrorBand* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/ )
 {
   //! Check that we all have the same number of universes.
@@ -606,11 +850,13 @@ Bool_t MULatErrorBand::Multiply( const MULatErrorBand* h1, const MULatErrorBand*
   //! @note root documentation says this function returns a bool but its void in our version
   this->TH1D::Multiply( h1, h2, c1, c2 );
 
-  //! Call Multiply for all universes
-  for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-    fHists[iHist]->Multiply( h1->GetHist(iHist), h2->GetHist(iHist), c1, c2 );
+  //! Multiply all universes at once
+  SyncUniverses();
+  const bool ok = fUniverses.Multiply( h1->GetUniverseStore(), h2->GetUniverseStore(), c1, c2 );
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 
-  return true;
+  return ok;
 }
 
 
@@ -620,33 +866,37 @@ Bool_t MULatErrorBand::MultiplySingle( const MULatErrorBand* h1, const TH1* h2,
   if( h1->GetNHists() != this->GetNHists() )
   {
     Error("MultiplySingle", "Attempt to multiply by different numbers of universes" );
-    return kFALSE;
+    return kFALSE; 
   }
 
   // Call Divide on the CVHists
   this->TH1D::Multiply( (TH1D*)h1, h2, c1, c2 );
 
-  // Call Multiply for all universes
-  for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-    fHists[iHist]->Multiply( h1->GetHist(iHist), h2, c1, c2 );
+  //! Multiply all universes at once
+  SyncUniverses();
+  const bool ok = fUniverses.Multiply( h1->GetUniverseStore(), h2, c1, c2 );
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 
-  return true;
+  return ok;
 }
 
 
 Bool_t MULatErrorBand::AddSingle( const TH1* h1, const Double_t c1 /*= 1.*/ )
 {
-
   //add to CV
   this->TH1D::Add( h1, c1 );
 
   //add to all universes
-  for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-    fHists[iHist]->Add( h1, c1 );
+  SyncUniverses();
+  const bool ok = fUniverses.AddToAll( h1, c1 );
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 
-  return true;
+  return ok;
 }
 
+
 Bool_t MULatErrorBand::Add( const MULatErrorBand* h1, const Double_t c1 /*= 1.*/ )
 {
   //! Check that we all have the same number of universes.
@@ -659,36 +909,59 @@ Bool_t MULatErrorBand::Add( const MULatErrorBand* h1, const Double_t c1 /*= 1.*/
   //! Call Add on the CVHists
   this->TH1D::Add( h1, c1 );
 
-  //! Call Add for all universes
-  for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-    fHists[iHist]->Add( h1->GetHist(iHist), c1 );
+  //! Add all universes at once
+  SyncUniverses();
+  const bool ok = fUniverses.Add( h1->GetUniverseStore(), c1 );
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 
-  return true;
+  return ok;
 }
 
 TH1* MULatErrorBand::Rebin(Int_t ngroup /*= 2*/, const char* newname /*= ""*/, const Double_t* xbins /*= 0*/ )
 {
-  // If a clone is specified or necessary (because bins have been specified) then give up for now
-  if( (newname && strlen(newname) > 0) || xbins )
+  //! With a newname rebin a copy, which shares the universes until it is rebinned, as TH1::Rebin would
+  if( newname && strlen(newname) > 0 )
   {
-    Error( "Rebin", "MULatErrorBand's Rebin does not know how to create clones yet.  You can't specify a newname or new xbins." );
-    throw 1;
+    MULatErrorBand *rval = new MULatErrorBand( *this );
+    rval->SetName( newname );
+    if( !rval->Rebin( ngroup, "", xbins ) )
+    {
+      delete rval;
+      return NULL;
+    }
+    return rval;
   }
 
-  //! Call Rebin on the CVHist
-  TH1 *rval = this->TH1D::Rebin( ngroup );
+  //! With xbins, ngroup is the number of new bins, as for TH1::Rebin
+  TAxis newAxis;
+  if( xbins )
+    newAxis.Set( ngroup, xbins );
+  else if( !MURebinMap::GroupAxis( GetXaxis(), ngroup, newAxis ) )
+    return NULL;
 
-  //we only need the rebin warning once
-  const int oldVerbosity = gErrorIgnoreLevel;
-  gErrorIgnoreLevel = kError;
+  if( !ApplyRebinMap( MURebinMap( this, &newAxis ) ) )
+    return NULL;
 
-  //! Call Rebin for all universes
-  for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-    fHists[iHist]->Rebin( ngroup );
+  return this;
+}
 
-  gErrorIgnoreLevel = oldVerbosity;
+bool MULatErrorBand::ApplyRebinMap( const MURebinMap& map )
+{
+  if( map.GetNOldBins() != (unsigned int)GetNcells() )
+  {
+    Error( "ApplyRebinMap", "The rebin map was made for %d bins, but this band has %d.  Not rebinning.", map.GetNOldBins(), GetNcells() );
+    return false;
+  }
 
-  return rval;
+  //! The views have the old binning, so they are dropped and made again when asked for
+  SyncUniverses();
+  DeleteViews();
+
+  map.Apply( (TH1*)this );
+  map.Apply( fUniverses );
+  fCacheVersion.Touch();
+  return true;
 }
 
 void MULatErrorBand::Reset( Option_t* option /* = "" */ )
@@ -697,8 +970,10 @@ void MULatErrorBand::Reset( Option_t* option /* = "" */ )
   this->TH1D::Reset(option);
 
   //reset all universes
-  for( std::vector<TH1D*>::iterator i = fHists.begin(); i != fHists.end(); ++i )
-    (*i)->Reset(option);
+  SyncUniverses();
+  fUniverses.Reset();
+  fViewsCurrent = false;
+  fCacheVersion.Touch();
 }
 
 void MULatErrorBand::SetBit( UInt_t f, Bool_t set)
@@ -706,10 +981,9 @@ void MULatErrorBand::SetBit( UInt_t f, Bool_t set)
   //Set the base class bit
   this->TH1D::SetBit(f,set);
 
-  //set all universes' bits
-  for( std::vector<TH1D*>::iterator i = fHists.begin(); i != fHists.end(); ++i )
+  //set the bit of all materialized universes; new views inherit it from the CV
+  for( std::vector<TH1D*>::iterator i = fUniverseViews.begin(); i != fUniverseViews.end(); ++i )
     (*i)->SetBit(f,set);
 }
 
-
 #endif
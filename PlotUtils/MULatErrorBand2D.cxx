@@ -3,20 +3,25 @@
 
 #include "PlotUtils/MULatErrorBand2D.h"
 #include "HistogramUtils.h"
+#include "PlotUtils/MUTaskPool.h"
 #include <algorithm>
 
+#include <TDirectory.h>
+#include <TBuffer.h>
+
 using namespace PlotUtils;
 
 ClassImp(MULatErrorBand2D);
 
 MULatErrorBand2D::MULatErrorBand2D( const std::string& name, const TH2D* base, const unsigned int nHists /* = 1000 */ ) :
-		TH2D( *base )
+	TH2D( *base ),
+	fViewsCurrent(false),
+	fViewsModified(false)
 {
 	SetName( name.c_str() );
 	SetTitle( name.c_str() );
 
-	fNHists = nHists; 
-	char tmpName[256];
+	fNHists = nHists;
 
 	//set the good colors
 	if( fGoodColors.size() == 0 )
@@ -30,19 +35,8 @@ MULatErrorBand2D::MULatErrorBand2D( const std::string& name, const TH2D* base, c
 			fGoodColors.push_back( i );
 	}
 
-	for( unsigned int i = 0; i < fNHists; i++ )
-	{
-		sprintf(tmpName, "%s_universe%d", name.c_str(), i );
-		TH2D *tmp = new TH2D( *base );
-		tmp->Reset();
-		tmp->SetName(tmpName);
-
-		//give the universe histos a style and color
-		tmp->SetLineColor( fGoodColors[ i % fGoodColors.size() ] );
-		tmp->SetLineStyle( i % 10 + 1 );
-
-		fHists.push_back( tmp );
-	}
+	//! All universes start out empty in one contiguous block
+	fUniverses.Resize( GetNcells(), fNHists );
 
 	if( nHists < 10 )
 		fUseSpreadError = true;
@@ -52,14 +46,15 @@ MULatErrorBand2D::MULatErrorBand2D( const std::string& name, const TH2D* base, c
 }
 
 MULatErrorBand2D::MULatErrorBand2D( const std::string& name, const TH2D* base, const std::vector<TH2D*>& hists ) :
-	TH2D (*base)
+	TH2D (*base),
+	fViewsCurrent(false),
+	fViewsModified(false)
 {
 
 	SetName( name.c_str() );
 	SetTitle( name.c_str() );
 
 	fNHists = hists.size();
-	char tmpName[256];
 
 	//set the good colors
 	if( fGoodColors.size() == 0 )
@@ -73,20 +68,12 @@ MULatErrorBand2D::MULatErrorBand2D( const std::string& name, const TH2D* base, c
 			fGoodColors.push_back( i );
 	}
 
+	fUniverses.Resize( GetNcells(), fNHists );
+
 	std::vector<TH2D*>::const_iterator it = hists.begin();
 	int it_pos = 0;
 	for( ; it != hists.end(); ++it, ++it_pos )
-	{
-		sprintf(tmpName, "%s_universe%d", name.c_str(), it_pos );
-		TH2D *tmp = new TH2D( **it );
-		tmp->SetName(tmpName);
-
-		//give the universe histos a style and color
-		tmp->SetLineColor( fGoodColors[ it_pos % fGoodColors.size() ] );
-		tmp->SetLineStyle( it_pos % 10 + 1 );
-
-		fHists.push_back( tmp );
-	}
+		fUniverses.ImportHist( it_pos, *it );
 
 	if( fNHists < 10 )
 		fUseSpreadError = true;
@@ -96,7 +83,9 @@ MULatErrorBand2D::MULatErrorBand2D( const std::string& name, const TH2D* base, c
 }
 
 MULatErrorBand2D::MULatErrorBand2D( const MULatErrorBand2D& h ) :
-	TH2D( h )
+	TH2D( h ),
+	fViewsCurrent(false),
+	fViewsModified(false)
 {
 	//!Deep copy the variables
 	DeepCopy( h );
@@ -111,8 +100,9 @@ MULatErrorBand2D& MULatErrorBand2D::operator=( const MULatErrorBand2D& h )
 	//! Call the base class's assignment
 	TH2D::operator=(h);
 
-	//! Delete and clear the hists vector
-	for( unsigned int i = 0; i < h.fNHists; ++i )
+	//! Delete the views and any old-style hists
+	DeleteViews();
+	for( unsigned int i = 0; i < fHists.size(); ++i )
 		delete fHists[i];
 	fHists.clear();
 	fGoodColors.clear();
@@ -122,12 +112,69 @@ MULatErrorBand2D& MULatErrorBand2D::operator=( const MULatErrorBand2D& h )
 	return *this;
 }
 
+#if __cplusplus >= 201103L
+MULatErrorBand2D::MULatErrorBand2D( MULatErrorBand2D&& h ) noexcept :
+	TH2D(),
+	fViewsCurrent(false),
+	fViewsModified(false)
+{
+	//! Take the bins and the universes instead of copying them
+	MUHist::MoveHistogram( *this, h );
+	MoveFrom( h );
+}
+
+MULatErrorBand2D& MULatErrorBand2D::operator=( MULatErrorBand2D&& h ) noexcept
+{
+	//! If this is me, there is nothing to move
+	if( this == &h )
+		return *this;
+
+	//! Take the bins of h
+	MUHist::MoveHistogram( *this, h );
+
+	//! Delete the views and any old-style hists
+	DeleteViews();
+	for( unsigned int i = 0; i < fHists.size(); ++i )
+		delete fHists[i];
+	fHists.clear();
+
+	MoveFrom( h );
+
+	return *this;
+}
+
+void MULatErrorBand2D::MoveFrom( MULatErrorBand2D& h )
+{
+	fUseSpreadError = h.GetUseSpreadError();
+	fNHists = h.fNHists;
+	fGoodColors.swap( h.fGoodColors );
+
+	//! The universes, their views and any old-style hists change hands as they are
+	fUniverses.Swap( h.fUniverses );
+	fUniverseViews.swap( h.fUniverseViews );
+	fHists.swap( h.fHists );
+	fViewsCurrent = h.fViewsCurrent;
+	fViewsModified = h.fViewsModified;
+	fCacheVersion.Touch();
+
+	//! Leave h a valid band without universes
+	h.fNHists = 0;
+	h.DeleteViews();
+	MUUniverseStore().Swap( h.fUniverses );
+	h.fCacheVersion.Touch();
+}
+#endif
+
 void MULatErrorBand2D::DeepCopy( const MULatErrorBand2D& h )
 {
 	fUseSpreadError = h.GetUseSpreadError();
 	fNHists = h.fNHists;
-	for( unsigned int i = 0; i < fNHists; ++i )
-		fHists.push_back( new TH2D(*h.GetHist(i)) );
+
+	//! The copy shares the buffers of the universes until one of the bands changes them
+	fUniverses = h.GetUniverseStore();
+	fViewsCurrent = false;
+	fViewsModified = false;
+	fCacheVersion.Touch();
 
 	//set the good colors
 	if( fGoodColors.size() == 0 )
@@ -142,82 +189,164 @@ void MULatErrorBand2D::DeepCopy( const MULatErrorBand2D& h )
 	}
 }
 
-bool MULatErrorBand2D::Fill( const double xval, const double yval, const double *xshifts, const double *yshifts, const double cvweight /*= 1.0*/, const bool fillcv /*= true*/, const double* weights /*= 0*/ )
+MULatErrorBand2D::~MULatErrorBand2D()
 {
-	//! Fill the CV hist with the CV weight and value
-	if( fillcv ) 
-		this->TH2D::Fill( xval, yval, cvweight );
+	DeleteViews();
+	for( unsigned int i = 0; i < fHists.size(); ++i )
+		delete fHists[i];
+}
+
+void MULatErrorBand2D::SetName( const char *name )
+{
+	this->TH2D::SetName( name );
 
-	//! Use FindBin to get the CV bin 
-	const int cvbin = FindBin( xval, yval );
-	int x_cvbin, y_cvbin, z_cvbin;
-	GetBinXYZ(cvbin, x_cvbin, y_cvbin, z_cvbin);
-
-	//! Add to the bin content of all the universes
-	//! Assume that the bin we will fill is close to the bin at the central value
-	//!@todo find a clever way to find the bin based on the cvbin information
-	/*
-		 const int x_nbins = GetNbinsX(), y_nbins = GetNbinsY();
-		 const double x_cvBinLowEdge  = GetBinLowEdge( x_cvbin );
-		 const double y_cvBinLowEdge  = GetBinLowEdge( y_cvbin );
-		 const double x_cvBinHighEdge = x_cvBinLowEdge + GetBinWidth( x_cvbin );
-		 const double y_cvBinHighEdge = y_cvBinLowEdge + GetBinWidth( y_cvbin );
-		 */
-	for( unsigned int i = 0; i != fNHists; ++i )
+	//! Keep the universe views named after the band
+	for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+		fUniverseViews[i]->SetName( Form( "%s_universe%d", GetName(), i ) );
+}
+
+void MULatErrorBand2D::Streamer( TBuffer &b )
+{
+	if( b.IsReading() )
 	{
-		//!@todo Check consistency of this condition
-		if( MUHist::IsNotPhysicalShift( xshifts[i] ) || MUHist::IsNotPhysicalShift( yshifts[i] ) )
-			continue;
-
-		const double x_shiftVal = xval + xshifts[i];
-		const double y_shiftVal = yval + yshifts[i];
-		//!@todo find a clever way to find the bin based on the cvbin information
-		int bin = FindBin( x_shiftVal, y_shiftVal );
-		/*
-			 int x_bin = x_cvbin, y_bin = y_cvbin;
-
-			 if( x_shiftVal < x_cvBinLowEdge )
-			 {
-		//! If the shift puts the value below the low edge of the CV bin, start looking down.  If not found, then go to underflow at bin=0.
-		for( ; x_bin != 0; --x_bin )
-		if( GetBinLowEdge( x_bin ) < x_shiftVal )
-		break;
-		}
-		else if( x_cvBinHighEdge < x_shiftVal )
-		{
-		//! If the shift puts the value above the high edge of the CV bin, start looking up.  If not found, then go to underflow at bin=nbins+1
-		for( ; x_bin != x_nbins+1; ++x_bin )
-		if( x_shiftVal <  (GetBinLowEdge( x_bin ) + GetBinWidth( x_bin ) ) )
-		break;
-		}
-		if( y_shiftVal < y_cvBinLowEdge )
-		{
-		//! If the shift puts the value below the low edge of the CV bin, start looking down.  If not found, then go to underflow at bin=0.
-		for( ; y_bin != 0; --y_bin )
-		if( GetBinLowEdge( y_bin ) < y_shiftVal )
-		break;
-		}
-		else if( y_cvBinHighEdge < y_shiftVal )
+		b.ReadClassBuffer( MULatErrorBand2D::Class(), this );
+		fUniverses.AfterStreaming();
+		fCacheVersion.Touch();
+
+		//! Files written before version 2 hold the universes as TH2Ds
+		if( !fHists.empty() )
+			ImportUniverses();
+	}
+	else
+	{
+		//! Make sure changes made through views are written
+		SyncUniverses();
+		//! The universes may be shared with copies, so they are only in the persistent members while written
+		fUniverses.BeforeWriting();
+		b.WriteClassBuffer( MULatErrorBand2D::Class(), this );
+		fUniverses.AfterStreaming();
+	}
+}
+
+void MULatErrorBand2D::ImportUniverses() const
+{
+	MUQueryLock lock;
+
+	//! The universes are logically part of this band's state, whichever form they currently live in
+	MULatErrorBand2D *self = const_cast<MULatErrorBand2D*>( this );
+
+	//! A band read from a file written before version 2 has its universes as TH2Ds
+	if( !fHists.empty() )
+	{
+		self->fUniverses.Resize( GetNcells(), fHists.size() );
+		for( unsigned int i = 0; i < fHists.size(); ++i )
 		{
-		//! If the shift puts the value above the high edge of the CV bin, start looking up.  If not found, then go to underflow at bin=nbins+1
-		for( ; y_bin != y_nbins+1; ++y_bin )
-		if( y_shiftVal <  (GetBinLowEdge( y_bin ) + GetBinWidth( y_bin ) ) )
-		break;
+			self->fUniverses.ImportHist( i, fHists[i] );
+			delete fHists[i];
 		}
+		self->fHists.clear();
+		fViewsCurrent = false;
+		fCacheVersion.Touch();
+	}
 
-		//! Now that we know the bin, add the weight to its content
-		int bin = GetBin(x_bin, y_bin);
-		*/
-		if( 0==weights )
+	//! Views handed out nonconst may have been changed
+	if( fViewsModified )
+	{
+		for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+			self->fUniverses.ImportHist( i, fUniverseViews[i] );
+		fViewsModified = false;
+		fCacheVersion.Touch();
+		fViewsCurrent = true;
+	}
+}
+
+void MULatErrorBand2D::MaterializeViews() const
+{
+	//! Const queries on several threads may get here at once
+	MUQueryLock lock;
+
+	//! Views handed out nonconst hold the latest state themselves
+	if( fViewsModified || fViewsCurrent )
+		return;
+
+	if( fUniverseViews.size() != fNHists )
+	{
+		DeleteViews();
+		TDirectory::TContext detached( gDirectory, 0 ); //views are owned by the band, not a directory
+		for( unsigned int i = 0; i < fNHists; ++i )
 		{
-			fHists[i]->AddBinContent( bin, cvweight );
+			TH2D *view = new TH2D( *this );
+			view->SetName( Form( "%s_universe%d", GetName(), i ) );
+
+			//give the universe histos a style and color
+			if( !fGoodColors.empty() )
+				view->SetLineColor( fGoodColors[ i % fGoodColors.size() ] );
+			view->SetLineStyle( i % 10 + 1 );
+
+			fUniverseViews.push_back( view );
 		}
-		else
+	}
+
+	for( unsigned int i = 0; i < fNHists; ++i )
+		fUniverses.ExportHist( i, fUniverseViews[i] );
+
+	fViewsCurrent = true;
+}
+
+void MULatErrorBand2D::DeleteViews() const
+{
+	for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+		delete fUniverseViews[i];
+	fUniverseViews.clear();
+	fViewsCurrent = false;
+	fViewsModified = false;
+}
+
+bool MULatErrorBand2D::Fill( const double xval, const double yval, const double *xshifts, const double *yshifts, const double cvweight /*= 1.0*/, const bool fillcv /*= true*/, const double* weights /*= 0*/ )
+{
+	//! Fill the CV hist with the CV weight and value
+	if( fillcv ) 
+		this->TH2D::Fill( xval, yval, cvweight );
+
+	//! Find the bins of all shifted values one axis at a time
+	//! Refresh the locators if the binning changed behind our back (e.g. Rebin or SetBins)
+	if( !fXLocator.Matches( GetXaxis() ) )
+		fXLocator.Set( GetXaxis() );
+	if( !fYLocator.Matches( GetYaxis() ) )
+		fYLocator.Set( GetYaxis() );
+	const int xcells = fXLocator.GetNbins() + 2;
+
+	SyncUniverses();
+
+	//! Work through the universes in chunks small enough for the stack
+	const unsigned int chunk = 256;
+	int xbins[chunk], ybins[chunk];
+	for( unsigned int first = 0; first < fNHists; first += chunk )
+	{
+		const unsigned int n = std::min( fNHists - first, chunk );
+		fXLocator.FindBins( xval, xshifts + first, n, xbins );
+		fYLocator.FindBins( yval, yshifts + first, n, ybins );
+
+		for( unsigned int j = 0; j != n; ++j )
 		{
-			fHists[i]->AddBinContent( bin, cvweight*weights[i] );
-		}
+			const unsigned int i = first + j;
+			//!@todo Check consistency of this condition
+			if( MUHist::IsNotPhysicalShift( xshifts[i] ) || MUHist::IsNotPhysicalShift( yshifts[i] ) )
+				continue;
 
+			const int bin = xbins[j] + xcells*ybins[j];
+			if( 0==weights )
+			{
+				fUniverses.Fill( bin, i, cvweight );
+			}
+			else
+			{
+				fUniverses.Fill( bin, i, cvweight*weights[i] );
+			}
+		}
 	}
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -238,8 +367,24 @@ bool MULatErrorBand2D::Fill( const double xval, const double yval, const double
 	return Fill( xval, yval, xshifts, yshifts, cvweight, fillcv);
 }
 
+bool MULatErrorBand2D::FillBatch( const unsigned int nEvents, const double *xvals, const double *yvals, const double *xshifts, const double *yshifts, const double *cvweights /* = 0 */, const bool fillcv /* = true */, const double *weights /* = 0 */ )
+{
+	//! Each universe of each event may land in a different bin, so this is the single event Fill in a loop,
+	//! but the caller only looks up the band once for the whole batch
+	bool rval = true;
+	for( unsigned int i = 0; i != nEvents; ++i )
+	{
+		const size_t row = (size_t)i * fNHists;
+		const double cvweight = cvweights ? cvweights[i] : 1.;
+		rval = Fill( xvals[i], yvals[i], xshifts + row, yshifts + row, cvweight, fillcv, weights ? weights + row : 0 ) && rval;
+	}
+
+	return rval;
+}
+
 TH2D MULatErrorBand2D::GetErrorBand(bool asFrac /*= false*/ , bool cov_area_normalize /*= false*/) const
 {
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH2D errBand( *this );
 	errBand.Reset();
 	const int lowBin = 0;
@@ -247,13 +392,12 @@ TH2D MULatErrorBand2D::GetErrorBand(bool asFrac /*= false*/ , bool cov_area_norm
 	const int highBinY = GetNbinsY() + 1;
 	const int highBin  = GetBin( highBinX, highBinY );
 
-	TMatrixD covmx(highBin+1,highBin+1);
-	covmx = CalcCovMx(cov_area_normalize,asFrac);
+	const std::vector<double> var = CalcVariance( cov_area_normalize, asFrac );
 
 
 	for( int i = lowBin; i <= highBin; ++i )
 	{
-		double err = (covmx[i][i]>0.)? sqrt( covmx[i][i] ): 0.; //Protect against odd sqrt(0) = NaN errors.
+		double err = (var[i]>0.)? sqrt( var[i] ): 0.; //Protect against odd sqrt(0) = NaN errors.
 
 		errBand.SetBinContent( i, err );
 		errBand.SetBinError(i, 0.);
@@ -269,7 +413,8 @@ const TH2D *MULatErrorBand2D::GetHist( unsigned int i ) const
 		Error("GetHist", "Cannot return histogram of universe %d because this object has %d universes.", i, fNHists);
 		return NULL;
 	}
-	return fHists[i];
+	MaterializeViews();
+	return fUniverseViews[i];
 }
 
 TH2D *MULatErrorBand2D::GetHist( unsigned int i )
@@ -279,122 +424,92 @@ TH2D *MULatErrorBand2D::GetHist( unsigned int i )
 		Error("GetHist", "Cannot return histogram of universe %d because this object has %d universes.", i, fNHists);
 		return NULL;
 	}
-	//! Temporary Fix to a problem when Drawing fHists[] (histogram has content but plot is blank)
-	TH2D *hist = dynamic_cast<TH2D*>(fHists[i]->Clone());
-	const int Nbins = fHists[i]->GetBin( fHists[i]->GetNbinsX()+1, fHists[i]->GetNbinsY()+1);
-	for (int i=0; i<=Nbins ; ++i)
-	{
-		hist->SetBinContent( i , hist->GetBinContent(i) );
-		hist->SetBinError( i , hist->GetBinError(i) );
-	}
+	MaterializeViews();
+	fViewsModified = true;
+	return fUniverseViews[i];
+}
 
-	return hist;
-	//return fHists[i];
+const std::vector<TH2D*>& MULatErrorBand2D::GetHists() const
+{
+	MaterializeViews();
+	return fUniverseViews;
 }
 
-TMatrixD MULatErrorBand2D::CalcCovMx(bool area_normalize, bool asFrac) const
+std::vector<TH2D*> MULatErrorBand2D::GetHists()
 {
-	//Calculating the Mean
-	TH2D hmean = TH2D(*this);
+	MaterializeViews();
+	fViewsModified = true;
+	return fUniverseViews;
+}
 
-	// if there's more than one varied universe, calculate the mean; if not, use the CV
-	// histo as the 'mean'
-	if(fNHists > 1)
-		hmean.Reset();
+const MUUniverseStore& MULatErrorBand2D::GetUniverseStore() const
+{
+	SyncUniverses();
+	return fUniverses;
+}
 
-	//!Storing Area Normalization Factors for the many universes
-	//! @todo Need to Check this! 
-	std::vector<double> normFactors;
+MUUniverseStore& MULatErrorBand2D::GetUniverseStore()
+{
+	SyncUniverses();
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
+	return fUniverses;
+}
 
-	for( unsigned int j = 0; j < fNHists; ++j ) {
-		if (area_normalize)
-		{
-			double area_scale = fHists[j]->Integral();
-			normFactors.push_back(area_scale/Integral());
+ULong64_t MULatErrorBand2D::GetCacheVersion() const
+{
+	//! Changes made through views count once they are synced
+	SyncUniverses();
+	return fCacheVersion.Get( this );
+}
 
-			if (fHists[j]->Integral()!=0) //just in case
-			{
-				fHists[j]->Scale(Integral()/area_scale);
-			}
-		}
-		if(fNHists>1)
-			hmean.Add(fHists[j]);
-	}
+TMatrixD MULatErrorBand2D::CalcCovMx(bool area_normalize, bool asFrac) const
+{
+	//! Reuse the last result of this variant if nothing changed since
+	const int variant = ( area_normalize ? 1 : 0 ) + ( asFrac ? 2 : 0 );
+	const ULong64_t version = GetCacheVersion();
+	TMatrixD cached;
+	if( fCovCache.Get( variant, version, cached ) )
+		return cached;
+
+	const TMatrixD covmx( ComputeCovMx( area_normalize, asFrac ) );
+	fCovCache.Put( variant, version, covmx );
+	return covmx;
+}
+
+TMatrixD MULatErrorBand2D::ComputeCovMx( bool area_normalize, bool asFrac ) const
+{
+	const MUUniverseStore& store = GetUniverseStore();
 
-	if(fNHists>1)
-		hmean.Scale(1.0/(double) fNHists);
+	//! Area normalization scales each universe to the area of the CV, leaving the universes themselves alone
+	std::vector<double> scales( fNHists, 1. );
+	if( area_normalize )
+		scales = store.GetAreaNormScales( this );
 
 	// Calculating Covariance Matrix
 	//! @todo what to do with underflow( bin=0 ) and overlow ( bin=nbins+1 )?
 	const int lowBin = 0; // considering underflow bin
-	const int highBin = hmean.GetBin( hmean.GetNbinsX()+1, hmean.GetNbinsY()+1 ); // considering under/overflow
+	const int highBin = GetBin( GetNbinsX()+1, GetNbinsY()+1 ); // considering under/overflow
 
 	TMatrixD covmx(highBin+1, highBin+1);
 
 	if (fUseSpreadError)
 	{
-		std::vector< std::vector<double> > binValsVec(highBin+1);
-		//calculate maximum and minum values for every bin
-		for( int i = lowBin; i <= highBin; ++i )
-		{
-			std::vector<double> binVals;
-			for( unsigned int j = 0; j < fNHists; ++j )
-			{
-				const double val = fHists[j]->GetBinContent(i);
-				binVals.push_back( val );
-			}
-			//get the CV value for this bin
-			const double cv = GetBinContent(i);
-			binVals.push_back( cv );
-			sort( binVals.begin(), binVals.end() );
-
-			binValsVec.at(i) =  binVals ;
-		}
-
-		//! For spread errors in only 1 universe take the full max spread
-		//! For spread errors in less than 10 universes take 1/2 the max spread
-		//! For spread errors with more than 10 universes, use the interquartile spread
+		//! Get the spread of every bin once; the covariance is their outer product
+		const std::vector<double> spreads = CalcSpreads( scales );
 		for( int i = lowBin; i <= highBin; ++i )
 		{
 			for( int k = i; k <= highBin; ++k )
 			{
-				if ( fNHists == 1 )
-					covmx[i][k] = ( (binValsVec.at(i)).back()- (binValsVec.at(i)).front() ) * ( (binValsVec.at(k)).back()- (binValsVec.at(k)).front() );
-				else if ( fNHists < 10 )
-					covmx[i][k] = ( (binValsVec.at(i)).back() - (binValsVec.at(i)).front() ) * ( (binValsVec.at(k)).back() - (binValsVec.at(k)).front() ) / 4. ;
-				else
-					covmx[i][k] = MUHist::GetInterquartileRange( binValsVec.at(i) ) * MUHist::GetInterquartileRange( binValsVec.at(k) ) * pow(MUHist::InterquartileRangeToSigma,2);
-
+				covmx[i][k] = spreads[i] * spreads[k];
 				covmx[k][i] = covmx[i][k];
 			}
 		}
 	}
 	else
 	{
-		//Calculating Covariance
-		for( unsigned int j = 0; j < fNHists; ++j ) 
-		{
-			for( int i = lowBin; i <= highBin; ++i )
-			{
-				double xi=fHists[j]->GetBinContent(i);
-				double ximean=hmean.GetBinContent(i);
-				for( int k = i; k <= highBin; ++k )
-				{
-					double xk=fHists[j]->GetBinContent(k);
-					double xkmean=hmean.GetBinContent(k);
-					covmx[i][k] +=(xi-ximean)*(xk-xkmean);
-				}
-			}
-		}
-
-		for( int i = lowBin; i <= highBin; ++i )
-		{
-			for( int k = i; k <= highBin; ++k )
-			{
-				covmx[i][k]/=((double)fNHists);
-				covmx[k][i]=covmx[i][k];
-			}
-		}
+		//! Covariance of the universes about their mean, or about the CV when there is only one universe
+		store.CalcCovariance( covmx.GetMatrixArray(), ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
 	}
 	if (asFrac)
 	{
@@ -414,18 +529,98 @@ TMatrixD MULatErrorBand2D::CalcCovMx(bool area_normalize, bool asFrac) const
 		}
 	}
 
-	//! Getting fHists back to normal
-	//! @todo Need to Check this
-	if (area_normalize)
+	return covmx;
+}
+
+std::vector<double> MULatErrorBand2D::CalcVariance( bool area_normalize /* = false */, bool asFrac /* = false */ ) const
+{
+	const MUUniverseStore& store = GetUniverseStore();
+
+	std::vector<double> scales( fNHists, 1. );
+	if( area_normalize )
+		scales = store.GetAreaNormScales( this );
+
+	std::vector<double> var( GetNcells(), 0. );
+	if( fUseSpreadError )
+	{
+		const std::vector<double> spreads = CalcSpreads( scales );
+		for( unsigned int i = 0; i != var.size(); ++i )
+			var[i] = spreads[i] * spreads[i];
+	}
+	else
+		store.CalcVariance( &var[0], ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
+
+	if( asFrac )
+	{
+		for( unsigned int i = 0; i != var.size(); ++i )
+		{
+			const double cv = GetBinContent(i);
+			var[i] = ( cv != 0. ) ? var[i] / ( cv * cv ) : 0.;
+		}
+	}
+
+	return var;
+}
+
+MULowRankCovariance MULatErrorBand2D::CalcLowRankCovMx( bool area_normalize /* = false */, bool asFrac /* = false */ ) const
+{
+	const MUUniverseStore& store = GetUniverseStore();
+
+	std::vector<double> scales( fNHists, 1. );
+	if( area_normalize )
+		scales = store.GetAreaNormScales( this );
+
+	MULowRankCovariance cov( GetNcells() );
+	cov.SetCV( this );
+	if( fUseSpreadError )
 	{
-		for( unsigned int j = 0; j < fNHists; ++j ) {
-			if (fHists[j]->Integral()!=0)
-			{
-				fHists[j]->Scale(normFactors[j]);
-			}
+		//! The spread covariance is the outer product of the spreads, so it is rank one
+		const std::vector<double> spreads = CalcSpreads( scales );
+		cov.AddColumn( &spreads[0] );
+	}
+	else
+		cov.AddUniverses( store, ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
+
+	if( asFrac )
+		cov.MakeFractional();
+
+	return cov;
+}
+
+std::vector<double> MULatErrorBand2D::CalcSpreads( const std::vector<double>& scales ) const
+{
+	const MUUniverseStore& store = GetUniverseStore();
+
+	std::vector<double> spreads( GetNcells() );
+	std::vector<double> binVals;
+	for( int i = 0; i < GetNcells(); ++i )
+	{
+		binVals.clear();
+		for( unsigned int j = 0; j < fNHists; ++j )
+		{
+			const double val = store.GetBinContent( i, j ) * scales[j];
+			binVals.push_back( val );
 		}
+		//get the CV value for this bin
+		const double cv = GetBinContent(i);
+		binVals.push_back( cv );
+		spreads[i] = MUHist::GetSpread( binVals, fNHists );
 	}
-	return covmx;
+
+	return spreads;
+}
+
+std::vector<double> MULatErrorBand2D::GetBinQuantiles( const int bin, const std::vector<double>& q ) const
+{
+	if( bin < 0 || GetNcells() <= bin )
+	{
+		Error("GetBinQuantiles", "Cannot return quantiles of bin %d because this object has %d bins.", bin, GetNcells());
+		return std::vector<double>( q.size(), 0. );
+	}
+
+	const double *row = GetUniverseStore().GetSumwRow( bin );
+	std::vector<double> binVals( row, row + fNHists );
+	return MUHist::GetQuantiles( binVals, q );
 }
 
 Bool_t MULatErrorBand2D::Add( const MULatErrorBand2D* h1, const Double_t c1 /*= 1.*/ )
@@ -440,11 +635,13 @@ Bool_t MULatErrorBand2D::Add( const MULatErrorBand2D* h1, const Double_t c1 /*=
 	//! Call Add on the CVHists
 	this->TH2D::Add( h1, c1 );
 
-	//! Call Add for all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Add( h1->GetHist(iHist), c1 );
+	//! Add all universes at once
+	SyncUniverses();
+	const bool ok = fUniverses.Add( h1->GetUniverseStore(), c1 );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
-	return true;
+	return ok;
 }
 
 Bool_t MULatErrorBand2D::Multiply( const MULatErrorBand2D* h1, const MULatErrorBand2D* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/ )
@@ -459,11 +656,13 @@ Bool_t MULatErrorBand2D::Multiply( const MULatErrorBand2D* h1, const MULatErrorB
 	//! Call Multiply on the CVHists
 	this->TH2D::Multiply( h1, h2, c1, c2 );
 
-	//! Call Multiply for all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Multiply( h1->GetHist(iHist), h2->GetHist(iHist), c1, c2 );
+	//! Multiply all universes at once
+	SyncUniverses();
+	const bool ok = fUniverses.Multiply( h1->GetUniverseStore(), h2->GetUniverseStore(), c1, c2 );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
-	return true;
+	return ok;
 }
 
 Bool_t MULatErrorBand2D::DivideSingle( const MULatErrorBand2D* h1, const TH2* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/, Option_t* option /*=""*/ )
@@ -478,11 +677,13 @@ Bool_t MULatErrorBand2D::DivideSingle( const MULatErrorBand2D* h1, const TH2* h2
 	//! Call Divide on the CVHists
 	this->TH2D::Divide( (TH2D*)h1, h2, c1, c2, option);
 
-	//! Call Divide for all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Divide( h1->GetHist(iHist), h2, c1, c2, option );
+	//! Divide all universes at once
+	SyncUniverses();
+	const bool ok = fUniverses.Divide( h1->GetUniverseStore(), h2, c1, c2, MUUniverseStore::IsBinomialOption( option ) );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
-	return true;
+	return ok;
 }
 
 Bool_t MULatErrorBand2D::Divide( const MULatErrorBand2D* h1, const MULatErrorBand2D* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/, Option_t* option /*=""*/ )
@@ -497,11 +698,13 @@ Bool_t MULatErrorBand2D::Divide( const MULatErrorBand2D* h1, const MULatErrorBan
 	//! Call Divide on the CVHists
 	this->TH2D::Divide( h1, h2, c1, c2, option);
 
-	//! Call Divide for all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Divide( h1->GetHist(iHist), h2->GetHist(iHist), c1, c2, option );
+	//! Divide all universes at once
+	SyncUniverses();
+	const bool ok = fUniverses.Divide( h1->GetUniverseStore(), h2->GetUniverseStore(), c1, c2, MUUniverseStore::IsBinomialOption( option ) );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
-	return true;
+	return ok;
 }
 
 void MULatErrorBand2D::Scale( Double_t c1 /*= 1.*/, Option_t *option /*= ""*/ )
@@ -509,9 +712,35 @@ void MULatErrorBand2D::Scale( Double_t c1 /*= 1.*/, Option_t *option /*= ""*/ )
 	//! Scale the CVHist
 	this->TH2D::Scale( c1, option );
 
-	//! Scale all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Scale( c1, option );
+	//! Scale all universes at once, the same way TH2D::Scale would
+	SyncUniverses();
+	TString opt( option );
+	opt.ToLower();
+	const bool scaleSumw2 = !opt.Contains( "nosw2" );
+	if( opt.Contains( "width" ) )
+		fUniverses.ScaleBins( MUUniverseStore::GetWidthScaleFactors( this, c1 ), scaleSumw2 );
+	else
+		fUniverses.Scale( c1, scaleSumw2 );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
+}
+
+bool MULatErrorBand2D::ApplyRebinMap( const MURebinMap& map )
+{
+	if( map.GetNOldBins() != (unsigned int)GetNcells() )
+	{
+		Error( "ApplyRebinMap", "The rebin map was made for %d bins, but this band has %d.  Not rebinning.", map.GetNOldBins(), GetNcells() );
+		return false;
+	}
+
+	//! The views have the old binning, so they are dropped and made again when asked for
+	SyncUniverses();
+	DeleteViews();
+
+	map.Apply( (TH1*)this );
+	map.Apply( fUniverses );
+	fCacheVersion.Touch();
+	return true;
 }
 
 #endif
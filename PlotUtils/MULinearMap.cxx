@@ -0,0 +1,430 @@
+#ifndef MNV_MULinearMap_cxx
+#define MNV_MULinearMap_cxx 1
+
+#include "PlotUtils/MULinearMap.h"
+#include "PlotUtils/MURebinMap.h"
+#include "PlotUtils/MUUniverseStore.h"
+#include "PlotUtils/MUH1D.h"
+#include "PlotUtils/MUH2D.h"
+#include "PlotUtils/MUH3D.h"
+
+#include "TAxis.h"
+#include "TH1.h"
+#include "TError.h"
+
+#include <cmath>
+
+using namespace PlotUtils;
+
+namespace
+{
+  //! The axes of a histogram in the order x, y, z
+  const TAxis* GetAxis( const TH1* h, const int axis )
+  {
+    if( 0 == axis )
+      return h->GetXaxis();
+    if( 1 == axis )
+      return h->GetYaxis();
+    return h->GetZaxis();
+  }
+
+  //! Number of bins with under/overflow of an axis the histogram has, 1 for one it does not have
+  int GetNCells( const TH1* h, const int axis )
+  {
+    return ( axis < h->GetDimension() ) ? GetAxis( h, axis )->GetNbins() + 2 : 1;
+  }
+
+  //! Index of each old bin of one axis, and the coordinate of the new bin it goes to
+  struct AxisBins
+  {
+    std::vector<int> fOld;
+    std::vector<int> fNew;
+  };
+}
+
+MULinearMap::MULinearMap() :
+  fNOldBins( 0 ),
+  fNNewBins( 0 )
+{}
+
+MULinearMap::MULinearMap( const unsigned int nOldBins, const unsigned int nNewBins ) :
+  fNOldBins( nOldBins ),
+  fNNewBins( nNewBins )
+{}
+
+MULinearMap MULinearMap::Identity( const unsigned int nBins )
+{
+  MULinearMap rval( nBins, nBins );
+  for( unsigned int bin = 0; bin != nBins; ++bin )
+    rval.AddEntry( bin, bin );
+  return rval;
+}
+
+MULinearMap MULinearMap::Diagonal( const std::vector<double>& factors )
+{
+  MULinearMap rval( factors.size(), factors.size() );
+  for( unsigned int bin = 0; bin != factors.size(); ++bin )
+    rval.AddEntry( bin, bin, factors[bin] );
+  return rval;
+}
+
+MULinearMap MULinearMap::Rebin( const MURebinMap& map )
+{
+  const std::vector<int>& newBins = map.GetNewBins();
+  MULinearMap rval( newBins.size(), map.GetNNewBins() );
+  for( unsigned int bin = 0; bin != newBins.size(); ++bin )
+    rval.AddEntry( bin, newBins[bin] );
+  return rval;
+}
+
+void MULinearMap::GetBinRange( const TH1* h, const int axis, int& first, int& last )
+{
+  const TAxis *a = GetAxis( h, axis );
+  const int nbins = a->GetNbins();
+  if( last < first && a->TestBit( TAxis::kAxisRange ) )
+  {
+    first = a->GetFirst();
+    last = a->GetLast();
+    //! SetRange( 1, nbins ) leaves 0 for both
+    if( 0 == first && 0 == last )
+    {
+      first = 1;
+      last = nbins;
+    }
+  }
+  if( first < 0 )
+    first = 0;
+  if( last < 0 || nbins + 1 < last )
+    last = nbins + 1;
+}
+
+MULinearMap MULinearMap::Projection( const TH1* h, const TH1* result, const std::string& axes, const int firstBins[3], const int lastBins[3] )
+{
+  MULinearMap rval( h->GetNcells(), result->GetNcells() );
+
+  //! Which axis of result each axis of h becomes, or -1 if it is summed over
+  const int dim = h->GetDimension();
+  int keptAs[3] = { -1, -1, -1 };
+  if( (int)axes.size() != result->GetDimension() || dim < (int)axes.size() )
+  {
+    Error( "MULinearMap::Projection", "Cannot project the %d axes of %s onto the %d axes \"%s\" of %s.  Returning an empty map.", dim, h->GetName(), result->GetDimension(), axes.c_str(), result->GetName() );
+    return rval;
+  }
+  for( unsigned int i = 0; i != axes.size(); ++i )
+  {
+    const int axis = axes[i] - 'x';
+    if( axis < 0 || dim <= axis || -1 != keptAs[axis] )
+    {
+      Error( "MULinearMap::Projection", "Illegal axes \"%s\" to project %s onto.  Returning an empty map.", axes.c_str(), h->GetName() );
+      return rval;
+    }
+    keptAs[axis] = i;
+  }
+
+  //! The bins read on each axis, with the bin of result they go to on the kept ones
+  AxisBins bins[3];
+  int newCoordScale[3] = { 0, 0, 0 };
+  for( int d = 0, scale = 1; d != 3; ++d )
+  {
+    if( d < result->GetDimension() )
+    {
+      newCoordScale[d] = scale;
+      scale *= GetNCells( result, d );
+    }
+  }
+  for( int d = 0; d != 3; ++d )
+  {
+    if( dim <= d )
+    {
+      bins[d].fOld.assign( 1, 0 );
+      bins[d].fNew.assign( 1, 0 );
+      continue;
+    }
+
+    const TAxis *a = GetAxis( h, d );
+    const int nbins = a->GetNbins();
+    if( -1 == keptAs[d] )
+    {
+      int first = firstBins[d], last = lastBins[d];
+      GetBinRange( h, d, first, last );
+      for( int bin = first; bin <= last; ++bin )
+      {
+        bins[d].fOld.push_back( bin );
+        bins[d].fNew.push_back( 0 );
+      }
+      continue;
+    }
+
+    //! A kept axis with a range set only gives the bins in it, without under/overflow
+    int first = 0, last = nbins + 1;
+    if( a->TestBit( TAxis::kAxisRange ) )
+    {
+      first = a->GetFirst();
+      last = a->GetLast();
+      if( 0 == first && 0 == last )
+      {
+        first = 1;
+        last = nbins;
+      }
+    }
+    const TAxis *newAxis = GetAxis( result, keptAs[d] );
+    for( int bin = first; bin <= last; ++bin )
+    {
+      int newBin;
+      if( 0 == bin )
+        newBin = 0;
+      else if( nbins + 1 == bin )
+        newBin = newAxis->GetNbins() + 1;
+      else
+        newBin = newAxis->FindFixBin( a->GetBinCenter( bin ) );
+      bins[d].fOld.push_back( bin );
+      bins[d].fNew.push_back( newBin * newCoordScale[ keptAs[d] ] );
+    }
+  }
+
+  const int nx = GetNCells( h, 0 ), ny = GetNCells( h, 1 );
+  for( unsigned int k = 0; k != bins[2].fOld.size(); ++k )
+  {
+    for( unsigned int j = 0; j != bins[1].fOld.size(); ++j )
+    {
+      const int oldYZ = nx * ( bins[1].fOld[j] + ny * bins[2].fOld[k] );
+      const int newYZ = bins[1].fNew[j] + bins[2].fNew[k];
+      for( unsigned int i = 0; i != bins[0].fOld.size(); ++i )
+        rval.AddEntry( bins[0].fOld[i] + oldYZ, bins[0].fNew[i] + newYZ );
+    }
+  }
+
+  return rval;
+}
+
+MULinearMap MULinearMap::Unroll( const TH1* h )
+{
+  const int nx = GetNCells( h, 0 ), ny = GetNCells( h, 1 ), nz = GetNCells( h, 2 );
+
+  //! Axes h does not have are their single bin 0, the others run over the bins without under/overflow
+  const int firstY = ( 1 < ny ) ? 1 : 0, lastY = ( 1 < ny ) ? ny - 2 : 0;
+  const int firstZ = ( 1 < nz ) ? 1 : 0, lastZ = ( 1 < nz ) ? nz - 2 : 0;
+  const int nInner = ( nx - 2 ) * ( lastY - firstY + 1 ) * ( lastZ - firstZ + 1 );
+
+  MULinearMap rval( h->GetNcells(), nInner + 2 );
+  int newBin = 1;
+  for( int binz = firstZ; binz <= lastZ; ++binz )
+  {
+    for( int biny = firstY; biny <= lastY; ++biny )
+    {
+      for( int binx = 1; binx <= nx - 2; ++binx )
+        rval.AddEntry( binx + nx * ( biny + ny * binz ), newBin++ );
+    }
+  }
+  return rval;
+}
+
+void MULinearMap::AddEntry( const int oldBin, const int newBin, const double weight /*= 1.*/ )
+{
+  if( oldBin < 0 || fNOldBins <= (unsigned int)oldBin || newBin < 0 || fNNewBins <= (unsigned int)newBin )
+  {
+    Error( "MULinearMap::AddEntry", "Entry from bin %d to bin %d is outside the map from %d to %d bins.  Not adding it.", oldBin, newBin, (int)fNOldBins, (int)fNNewBins );
+    return;
+  }
+  fOldBins.push_back( oldBin );
+  fNewBins.push_back( newBin );
+  fWeights.push_back( weight );
+}
+
+MULinearMap MULinearMap::Then( const MULinearMap& next ) const
+{
+  if( next.fNOldBins != fNNewBins )
+  {
+    Error( "MULinearMap::Then", "A map to %d bins cannot be followed by a map from %d bins.  Returning an empty map.", (int)fNNewBins, (int)next.fNOldBins );
+    return MULinearMap();
+  }
+
+  //! The entries of each map by the bin they start from
+  std::vector<unsigned int> offsets( fNOldBins + 1, 0 ), nextOffsets( next.fNOldBins + 1, 0 );
+  std::vector<unsigned int> order( fOldBins.size() ), nextOrder( next.fOldBins.size() );
+  for( unsigned int e = 0; e != fOldBins.size(); ++e )
+    ++offsets[ fOldBins[e] + 1 ];
+  for( unsigned int e = 0; e != next.fOldBins.size(); ++e )
+    ++nextOffsets[ next.fOldBins[e] + 1 ];
+  for( unsigned int bin = 0; bin != fNOldBins; ++bin )
+    offsets[bin+1] += offsets[bin];
+  for( unsigned int bin = 0; bin != next.fNOldBins; ++bin )
+    nextOffsets[bin+1] += nextOffsets[bin];
+  {
+    std::vector<unsigned int> fill( offsets.begin(), offsets.end() - 1 ), nextFill( nextOffsets.begin(), nextOffsets.end() - 1 );
+    for( unsigned int e = 0; e != fOldBins.size(); ++e )
+      order[ fill[ fOldBins[e] ]++ ] = e;
+    for( unsigned int e = 0; e != next.fOldBins.size(); ++e )
+      nextOrder[ nextFill[ next.fOldBins[e] ]++ ] = e;
+  }
+
+  //! Row by row of the product, summing into the bins of next
+  MULinearMap rval( fNOldBins, next.fNNewBins );
+  std::vector<double> row( next.fNNewBins, 0. );
+  std::vector<bool> used( next.fNNewBins, false );
+  std::vector<int> usedBins;
+  for( unsigned int bin = 0; bin != fNOldBins; ++bin )
+  {
+    for( unsigned int i = offsets[bin]; i != offsets[bin+1]; ++i )
+    {
+      const unsigned int e = order[i];
+      const int middle = fNewBins[e];
+      for( unsigned int j = nextOffsets[middle]; j != nextOffsets[middle+1]; ++j )
+      {
+        const unsigned int f = nextOrder[j];
+        const int newBin = next.fNewBins[f];
+        if( !used[newBin] )
+        {
+          used[newBin] = true;
+          usedBins.push_back( newBin );
+        }
+        row[newBin] += fWeights[e] * next.fWeights[f];
+      }
+    }
+
+    for( unsigned int i = 0; i != usedBins.size(); ++i )
+    {
+      rval.AddEntry( bin, usedBins[i], row[ usedBins[i] ] );
+      row[ usedBins[i] ] = 0.;
+      used[ usedBins[i] ] = false;
+    }
+    usedBins.clear();
+  }
+  return rval;
+}
+
+void MULinearMap::Apply( const double* in, double* out, const unsigned int nColumns /*= 1*/, const bool squared /*= false*/ ) const
+{
+  for( unsigned int e = 0; e != fOldBins.size(); ++e )
+  {
+    const double w = squared ? fWeights[e] * fWeights[e] : fWeights[e];
+    const double *src = in + (size_t)fOldBins[e] * nColumns;
+    double *dst = out + (size_t)fNewBins[e] * nColumns;
+    for( unsigned int c = 0; c != nColumns; ++c )
+      dst[c] += w * src[c];
+  }
+}
+
+bool MULinearMap::Apply( const TH1* in, TH1* out ) const
+{
+  if( (unsigned int)in->GetNcells() != fNOldBins || (unsigned int)out->GetNcells() != fNNewBins )
+  {
+    Error( "MULinearMap::Apply", "Histograms %s and %s with %d and %d bins do not fit a map from %d to %d bins.  Doing nothing.", in->GetName(), out->GetName(), in->GetNcells(), out->GetNcells(), (int)fNOldBins, (int)fNNewBins );
+    return false;
+  }
+
+  std::vector<double> sumw( fNOldBins ), sumw2( fNOldBins );
+  for( unsigned int bin = 0; bin != fNOldBins; ++bin )
+  {
+    sumw[bin] = in->GetBinContent( bin );
+    const double err = in->GetBinError( bin );
+    sumw2[bin] = err * err;
+  }
+
+  std::vector<double> newSumw( fNNewBins, 0. ), newSumw2( fNNewBins, 0. );
+  Apply( &sumw[0], &newSumw[0] );
+  Apply( &sumw2[0], &newSumw2[0], 1, true );
+
+  const Double_t entries = in->GetEntries();
+  for( unsigned int bin = 0; bin != fNNewBins; ++bin )
+  {
+    out->SetBinContent( bin, newSumw[bin] );
+    out->SetBinError( bin, sqrt( newSumw2[bin] ) );
+  }
+  out->ResetStats();
+  out->SetEntries( entries );
+  return true;
+}
+
+bool MULinearMap::Apply( const MUUniverseStore& in, MUUniverseStore& out ) const
+{
+  if( in.GetNBins() != fNOldBins )
+  {
+    Error( "MULinearMap::Apply", "Universes with %d bins do not fit a map from %d bins.  Doing nothing.", (int)in.GetNBins(), (int)fNOldBins );
+    return false;
+  }
+
+  //! Each entry adds a whole row of universes
+  const unsigned int nUniverses = in.GetNUniverses();
+  out.Resize( fNNewBins, nUniverses );
+  if( 0 == nUniverses || 0 == fNNewBins || in.IsEmpty() )
+    return true;
+  Apply( in.GetSumwRow( 0 ), out.GetSumwRow( 0 ), nUniverses );
+  Apply( in.GetSumw2Row( 0 ), out.GetSumw2Row( 0 ), nUniverses, true );
+  return true;
+}
+
+TMatrixD MULinearMap::Apply( const TMatrixD& covmx ) const
+{
+  const int nOld = fNOldBins, nNew = fNNewBins;
+  TMatrixD rval( nNew, nNew );
+  if( covmx.GetNrows() != nOld || covmx.GetNcols() != nOld )
+  {
+    Error( "MULinearMap::Apply", "Matrix of %d x %d does not have the %d bins this map is from.  Returning a zero matrix.", covmx.GetNrows(), covmx.GetNcols(), nOld );
+    return rval;
+  }
+
+  //! M*C first, one row of C per entry, then (M*C)*M^T, one column per entry
+  std::vector<double> mc( (size_t)nNew * nOld, 0. );
+  Apply( covmx.GetMatrixArray(), &mc[0], nOld );
+
+  double *r = rval.GetMatrixArray();
+  for( int row = 0; row != nNew; ++row )
+  {
+    const double *mcRow = &mc[ (size_t)row * nOld ];
+    double *rRow = r + (size_t)row * nNew;
+    for( unsigned int e = 0; e != fOldBins.size(); ++e )
+      rRow[ fNewBins[e] ] += fWeights[e] * mcRow[ fOldBins[e] ];
+  }
+  return rval;
+}
+
+template<class SourceType, class ResultType>
+bool MULinearMap::ApplyToErrorBands( const SourceType& h, ResultType& result ) const
+{
+  if( (unsigned int)h.GetNcells() != fNOldBins || (unsigned int)result.GetNcells() != fNNewBins )
+  {
+    Error( "MULinearMap::ApplyToErrorBands", "Histograms %s and %s with %d and %d bins do not fit a map from %d to %d bins.  Doing nothing.", h.GetName(), result.GetName(), h.GetNcells(), result.GetNcells(), (int)fNOldBins, (int)fNNewBins );
+    return false;
+  }
+
+  //! Each new band starts as copies of the central value of result, and its store is then overwritten
+  bool allAdded = true;
+  const std::vector<std::string> vertNames = h.GetVertErrorBandNames();
+  for( unsigned int i = 0; i != vertNames.size(); ++i )
+  {
+    const MUUniverseStore& universes = h.GetVertErrorBand( vertNames[i] )->GetUniverseStore();
+    if( !result.AddVertErrorBand( vertNames[i], universes.GetNUniverses() ) )
+    {
+      allAdded = false;
+      continue;
+    }
+    Apply( universes, result.GetVertErrorBand( vertNames[i] )->GetUniverseStore() );
+  }
+
+  const std::vector<std::string> latNames = h.GetLatErrorBandNames();
+  for( unsigned int i = 0; i != latNames.size(); ++i )
+  {
+    const MUUniverseStore& universes = h.GetLatErrorBand( latNames[i] )->GetUniverseStore();
+    if( !result.AddLatErrorBand( latNames[i], universes.GetNUniverses() ) )
+    {
+      allAdded = false;
+      continue;
+    }
+    Apply( universes, result.GetLatErrorBand( latNames[i] )->GetUniverseStore() );
+  }
+
+  return allAdded;
+}
+
+namespace PlotUtils
+{
+  template bool MULinearMap::ApplyToErrorBands<MUH1D, MUH1D>( const MUH1D&, MUH1D& ) const;
+  template bool MULinearMap::ApplyToErrorBands<MUH2D, MUH1D>( const MUH2D&, MUH1D& ) const;
+  template bool MULinearMap::ApplyToErrorBands<MUH2D, MUH2D>( const MUH2D&, MUH2D& ) const;
+  template bool MULinearMap::ApplyToErrorBands<MUH3D, MUH1D>( const MUH3D&, MUH1D& ) const;
+  template bool MULinearMap::ApplyToErrorBands<MUH3D, MUH2D>( const MUH3D&, MUH2D& ) const;
+  template bool MULinearMap::ApplyToErrorBands<MUH3D, MUH3D>( const MUH3D&, MUH3D& ) const;
+}
+
+#endif
@@ -0,0 +1,123 @@
+#ifndef MNV_MULinearMap_H
+#define MNV_MULinearMap_H 1
+
+#include "Rtypes.h"
+#include "TMatrixD.h"
+
+#include <string>
+#include <vector>
+
+class TH1;
+
+namespace PlotUtils
+{
+
+	class MURebinMap;
+	class MUUniverseStore;
+
+	/*! @brief A sparse linear map from the global bins of one histogram to those of another.
+
+		Projections, rebinning, unrolling a 2D histogram into 1D and scaling bin by bin all make each new bin a
+		weighted sum of old bins.  The map stores that as a list of entries (old bin, new bin, weight) and applies
+		it to everything a MUH1D (MUH2D, MUH3D) carries:
+
+		- the central value: contents get the weights, squared errors the squared weights;
+		- all universes of an error band in one pass over the entries, a row of universes per entry;
+		- covariance matrices as M*C*M^T, from the matrix the histogram already has, without the universes.
+
+		Maps compose: a.Then( b ) is the one map that does a, then b.  Deriving many slices of one 3D histogram
+		is then one map per slice, each a single pass over the bins it reads.
+
+		@code
+		MULinearMap px = MULinearMap::Projection( h3, cv_px, "x", first, last );
+		px.ApplyToErrorBands( *h3, *h_px );
+		TMatrixD cov_px = px.Apply( h3->GetTotalErrorMatrix() );
+		@endcode
+		*/
+	class MULinearMap
+	{
+		public:
+			//! A map from no bins to no bins
+			MULinearMap();
+
+			//! A map from nOldBins global bins to nNewBins global bins, with no entries yet
+			MULinearMap( const unsigned int nOldBins, const unsigned int nNewBins );
+
+			//! The map that keeps every one of nBins bins as it is
+			static MULinearMap Identity( const unsigned int nBins );
+
+			//! The map that multiplies global bin i by factors[i], as MUUniverseStore::ScaleBins
+			static MULinearMap Diagonal( const std::vector<double>& factors );
+
+			//! The map that rebins as map does
+			static MULinearMap Rebin( const MURebinMap& map );
+
+			/*! Sum h over the axes that are not kept, into the binning of result, as TH2::ProjectionX or TH3::Project3D do.
+				Kept bins outside a range set on their axis are left out, and the others go to the bin of result holding their center.
+				@param[in] h The histogram to project
+				@param[in] result A histogram with the binning of the projection, for instance the projection of the central value
+				@param[in] axes The axes of h that become the x (and y) axis of result, in that order: "x", "zy", ...
+				@param[in] firstBins,lastBins First and last bin to sum over on each axis of h (x, y, z), as for TH2::ProjectionX:
+					if last < first the range set on the axis is used, or all bins with under/overflow if there is none.  Ignored for kept axes.
+				*/
+			static MULinearMap Projection( const TH1* h, const TH1* result, const std::string& axes, const int firstBins[3], const int lastBins[3] );
+
+			/*! Lay the bins of a 2D (3D) histogram out in a 1D histogram of nx*ny(*nz) bins, x fastest, as for a matrix unfolding.
+				Under/overflow bins of h are left out.
+				*/
+			static MULinearMap Unroll( const TH1* h );
+
+			//! Add weight times old bin oldBin to new bin newBin.  Entries for the same bins add up.
+			void AddEntry( const int oldBin, const int newBin, const double weight = 1. );
+
+			//! The map that applies this one, then next.  Empty (with an error) if next does not start from the bins this ends in.
+			MULinearMap Then( const MULinearMap& next ) const;
+
+			//! Number of global bins mapped from
+			unsigned int GetNOldBins() const { return fNOldBins; };
+
+			//! Number of global bins mapped to
+			unsigned int GetNNewBins() const { return fNNewBins; };
+
+			//! Number of entries
+			unsigned int GetNEntries() const { return fOldBins.size(); };
+
+			/*! Add the map of in to out, for nColumns values per bin stored [bin][column]
+				@param[in] in nOldBins*nColumns values
+				@param[in,out] out nNewBins*nColumns values, added to
+				@param[in] nColumns Values per bin (universes of a row)
+				@param[in] squared Use the squared weights, for squared errors
+				*/
+			void Apply( const double* in, double* out, const unsigned int nColumns = 1, const bool squared = false ) const;
+
+			//! Set contents and errors of out to the map of those of in.  false if they do not have the bins of the map.
+			bool Apply( const TH1* in, TH1* out ) const;
+
+			//! Resize out and set all universes of it to the map of those of in.  false if in does not have the old bins.
+			bool Apply( const MUUniverseStore& in, MUUniverseStore& out ) const;
+
+			//! M*C*M^T of a matrix over the old global bins, or a zero matrix (with an error) if it does not fit
+			TMatrixD Apply( const TMatrixD& covmx ) const;
+
+			/*! Add every error band of h to result, with the map of its universes.
+				result has the new binning and must not have bands of those names yet.
+				SourceType is a MUH1D, MUH2D or MUH3D and ResultType one with no more axes.
+				@return false if the binnings do not fit the map or a band could not be added
+				*/
+			template<class SourceType, class ResultType>
+			bool ApplyToErrorBands( const SourceType& h, ResultType& result ) const;
+
+		private:
+			//! First and last bin to use on an axis, as TH2::ProjectionX works them out
+			static void GetBinRange( const TH1* h, const int axis, int& first, int& last );
+
+			unsigned int fNOldBins;        ///< Number of global bins mapped from
+			unsigned int fNNewBins;        ///< Number of global bins mapped to
+			std::vector<int> fOldBins;     ///< Old global bin of each entry
+			std::vector<int> fNewBins;     ///< New global bin of each entry
+			std::vector<double> fWeights;  ///< Weight of each entry
+	}; //end of MULinearMap
+
+} //end of PlotUtils
+
+#endif
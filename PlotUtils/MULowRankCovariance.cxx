@@ -0,0 +1,253 @@
+#ifndef MNV_MULowRankCovariance_cxx
+#define MNV_MULowRankCovariance_cxx 1
+
+#include "PlotUtils/MULowRankCovariance.h"
+#include "PlotUtils/MUUniverseStore.h"
+
+#include "TH1.h"
+#include "TMatrixDSym.h"
+#include "TMatrixDSymEigen.h"
+#include "TVectorD.h"
+
+#include <cmath>
+#include <iostream>
+
+using namespace PlotUtils;
+
+MULowRankCovariance::MULowRankCovariance( ) :
+  fNBins( 0 ),
+  fRank( 0 )
+{ }
+
+MULowRankCovariance::MULowRankCovariance( const unsigned int nBins ) :
+  fNBins( nBins ),
+  fRank( 0 ),
+  fDiag( nBins, 0. )
+{ }
+
+void MULowRankCovariance::SetCV( const TH1* h )
+{
+  fCV.assign( fNBins, 0. );
+  for( unsigned int i = 0; i != fNBins && (int)i < h->GetNcells(); ++i )
+    fCV[i] = h->GetBinContent( i );
+}
+
+void MULowRankCovariance::AddUniverses( const MUUniverseStore& store, const double *scales /* = 0 */, const double *mean /* = 0 */ )
+{
+  const unsigned int nUniverses = store.GetNUniverses();
+  if( 0 == nUniverses )
+    return;
+  if( store.GetNBins() != fNBins )
+  {
+    std::cout << "Warning [MULowRankCovariance::AddUniverses] : The store has " << store.GetNBins() << " bins, not " << fNBins << ". Doing nothing." << std::endl;
+    return;
+  }
+
+  //! Column j is (x_ij - m_i) / sqrt(nUniverses), so F F^T is what CalcCovariance sums
+  const double norm = 1. / sqrt( (double)nUniverses );
+  fFactor.resize( (size_t)( fRank + nUniverses ) * fNBins );
+  double *cols = &fFactor[ (size_t)fRank*fNBins ];
+  for( unsigned int i = 0; i != fNBins; ++i )
+  {
+    const double *row = store.GetSumwRow( i );
+    double m = 0.;
+    if( mean )
+      m = mean[i];
+    else
+    {
+      for( unsigned int u = 0; u != nUniverses; ++u )
+        m += scales ? scales[u]*row[u] : row[u];
+      m /= nUniverses;
+    }
+    for( unsigned int u = 0; u != nUniverses; ++u )
+      cols[ (size_t)u*fNBins + i ] = ( ( scales ? scales[u]*row[u] : row[u] ) - m ) * norm;
+  }
+  fRank += nUniverses;
+}
+
+void MULowRankCovariance::AddColumn( const double *v )
+{
+  fFactor.insert( fFactor.end(), v, v + fNBins );
+  ++fRank;
+}
+
+void MULowRankCovariance::AddDiagonal( const double *d )
+{
+  for( unsigned int i = 0; i != fNBins; ++i )
+    fDiag[i] += d[i];
+}
+
+void MULowRankCovariance::AddMatrix( const TMatrixD& m )
+{
+  if( m.GetNrows() != (int)fNBins || m.GetNcols() != (int)fNBins )
+  {
+    std::cout << "Warning [MULowRankCovariance::AddMatrix] : The matrix is " << m.GetNrows() << "x" << m.GetNcols() << ", not " << fNBins << "x" << fNBins << ". Doing nothing." << std::endl;
+    return;
+  }
+
+  //! m = V diag(lambda) V^T, so each eigenvector times sqrt(lambda) is a column of F
+  TMatrixDSym sym( fNBins );
+  for( unsigned int i = 0; i != fNBins; ++i )
+    for( unsigned int k = 0; k != fNBins; ++k )
+      sym[i][k] = m[i][k];
+  TMatrixDSymEigen eigen( sym );
+  const TVectorD& values = eigen.GetEigenValues();
+  const TMatrixD& vectors = eigen.GetEigenVectors();
+
+  std::vector<double> col( fNBins );
+  for( unsigned int c = 0; c != fNBins; ++c )
+  {
+    if( !( 0. < values[c] ) )
+      continue;
+    const double s = sqrt( values[c] );
+    for( unsigned int i = 0; i != fNBins; ++i )
+      col[i] = vectors[i][c] * s;
+    AddColumn( &col[0] );
+  }
+}
+
+void MULowRankCovariance::Add( const MULowRankCovariance& other )
+{
+  if( other.fNBins != fNBins )
+  {
+    std::cout << "Warning [MULowRankCovariance::Add] : Cannot add a covariance of " << other.fNBins << " bins to one of " << fNBins << " bins. Doing nothing." << std::endl;
+    return;
+  }
+
+  fFactor.insert( fFactor.end(), other.fFactor.begin(), other.fFactor.end() );
+  fRank += other.fRank;
+  if( fNBins )
+    AddDiagonal( &other.fDiag[0] );
+  if( fCV.empty() )
+    fCV = other.fCV;
+}
+
+void MULowRankCovariance::ScaleBins( const std::vector<double>& factors )
+{
+  for( unsigned int c = 0; c != fRank; ++c )
+  {
+    double *col = &fFactor[ (size_t)c*fNBins ];
+    for( unsigned int i = 0; i != fNBins; ++i )
+      col[i] *= factors[i];
+  }
+  for( unsigned int i = 0; i != fNBins; ++i )
+    fDiag[i] *= factors[i] * factors[i];
+}
+
+void MULowRankCovariance::MakeFractional()
+{
+  if( fCV.size() != fNBins )
+  {
+    std::cout << "Warning [MULowRankCovariance::MakeFractional] : There is no CV to divide by. Doing nothing." << std::endl;
+    return;
+  }
+
+  std::vector<double> factors( fNBins, 0. );
+  for( unsigned int i = 0; i != fNBins; ++i )
+    factors[i] = ( fCV[i] != 0. ) ? 1. / fCV[i] : 0.;
+  ScaleBins( factors );
+}
+
+void MULowRankCovariance::Multiply( const double *v, double *out ) const
+{
+  //! C v = F (F^T v) + D v, one pass over F for each product
+  for( unsigned int i = 0; i != fNBins; ++i )
+    out[i] = fDiag[i] * v[i];
+
+  for( unsigned int c = 0; c != fRank; ++c )
+  {
+    const double *col = &fFactor[ (size_t)c*fNBins ];
+    double t = 0.;
+    for( unsigned int i = 0; i != fNBins; ++i )
+      t += col[i] * v[i];
+    if( t == 0. )
+      continue;
+    for( unsigned int i = 0; i != fNBins; ++i )
+      out[i] += col[i] * t;
+  }
+}
+
+std::vector<double> MULowRankCovariance::Multiply( const std::vector<double>& v ) const
+{
+  std::vector<double> out( fNBins, 0. );
+  if( v.size() != fNBins )
+  {
+    std::cout << "Warning [MULowRankCovariance::Multiply] : The vector has " << v.size() << " entries, not " << fNBins << ". Returning zeros." << std::endl;
+    return out;
+  }
+  if( fNBins )
+    Multiply( &v[0], &out[0] );
+  return out;
+}
+
+std::vector<double> MULowRankCovariance::GetDiagonal() const
+{
+  std::vector<double> diag( fDiag );
+  for( unsigned int c = 0; c != fRank; ++c )
+  {
+    const double *col = &fFactor[ (size_t)c*fNBins ];
+    for( unsigned int i = 0; i != fNBins; ++i )
+      diag[i] += col[i] * col[i];
+  }
+  return diag;
+}
+
+double MULowRankCovariance::GetElement( const unsigned int i, const unsigned int k ) const
+{
+  double sum = ( i == k ) ? fDiag[i] : 0.;
+  for( unsigned int c = 0; c != fRank; ++c )
+    sum += fFactor[ (size_t)c*fNBins + i ] * fFactor[ (size_t)c*fNBins + k ];
+  return sum;
+}
+
+TMatrixD MULowRankCovariance::GetBlock( const std::vector<int>& rows, const std::vector<int>& cols ) const
+{
+  const unsigned int nRows = rows.size();
+  const unsigned int nCols = cols.size();
+  TMatrixD block( nRows, nCols );
+  if( 0 == nRows || 0 == nCols )
+    return block;
+
+  //! Gather the rows and columns of each column of F, then add their outer product to the block
+  double *b = block.GetMatrixArray();
+  std::vector<double> fr( nRows ), fc( nCols );
+  for( unsigned int c = 0; c != fRank; ++c )
+  {
+    const double *col = &fFactor[ (size_t)c*fNBins ];
+    for( unsigned int r = 0; r != nRows; ++r )
+      fr[r] = col[ rows[r] ];
+    for( unsigned int s = 0; s != nCols; ++s )
+      fc[s] = col[ cols[s] ];
+    for( unsigned int r = 0; r != nRows; ++r )
+    {
+      const double x = fr[r];
+      if( x == 0. )
+        continue;
+      double *brow = b + (size_t)r*nCols;
+      for( unsigned int s = 0; s != nCols; ++s )
+        brow[s] += x * fc[s];
+    }
+  }
+
+  for( unsigned int r = 0; r != nRows; ++r )
+    for( unsigned int s = 0; s != nCols; ++s )
+      if( rows[r] == cols[s] )
+        block[r][s] += fDiag[ rows[r] ];
+
+  return block;
+}
+
+TMatrixD MULowRankCovariance::GetBlock( const int first, const int last ) const
+{
+  std::vector<int> bins;
+  for( int i = first; i <= last; ++i )
+    bins.push_back( i );
+  return GetBlock( bins, bins );
+}
+
+TMatrixD MULowRankCovariance::GetMatrix() const
+{
+  return GetBlock( 0, (int)fNBins - 1 );
+}
+
+#endif
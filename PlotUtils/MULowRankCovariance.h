@@ -0,0 +1,118 @@
+#ifndef MNV_MULowRankCovariance_H
+#define MNV_MULowRankCovariance_H 1
+
+#include "Rtypes.h"
+#include "TMatrixD.h"
+
+#include <vector>
+
+class TH1;
+
+namespace PlotUtils
+{
+
+	class MUUniverseStore;
+
+	/*! @brief A covariance matrix kept as C = F F^T + D, without ever building the nBins x nBins matrix.
+
+		F is nBins x rank: the universes of every error band it was built from, centered and divided by
+		sqrt(nUniverses), side by side.  D is diagonal and holds whatever has no correlations between bins,
+		e.g. the statistical errors.  The covariance of an error band with nUniverses universes is exactly
+		rank nUniverses, so a 3D histogram with 1e5 bins and 1000 universes needs 800 MB instead of 80 GB.
+
+		Matrix-vector products and the diagonal cost O(nBins * rank).  Any block of C can be materialized
+		on its own, and summing the covariances of several bands just puts their columns side by side.
+
+		The CV is kept too, so that the covariance can be made fractional like GetTotalErrorMatrix( asFrac = true ).
+		*/
+	class MULowRankCovariance
+	{
+		public:
+			//! Default constructor (no bins)
+			MULowRankCovariance( );
+
+			//! Zero covariance of nBins global bins
+			explicit MULowRankCovariance( const unsigned int nBins );
+
+			//! Number of global bins, including under/overflow
+			unsigned int GetNBins() const { return fNBins; };
+
+			//! Number of columns of F
+			unsigned int GetRank() const { return fRank; };
+
+			//! Column c of F, nBins values
+			const double* GetFactorColumn( const unsigned int c ) const { return &fFactor[ (size_t)c*fNBins ]; };
+
+			//! D, the diagonal term
+			const std::vector<double>& GetDiagonalTerm() const { return fDiag; };
+
+			//! CV the covariance belongs to (empty if never set)
+			const std::vector<double>& GetCV() const { return fCV; };
+
+			//! Take the CV from the contents of a histogram with nBins global bins
+			void SetCV( const TH1* h );
+
+			/*! Add the covariance of the universes of an error band, exactly as MUUniverseStore::CalcCovariance computes it
+				@param[in] store Universes, with the same number of bins as this
+				@param[in] scales,mean As for MUUniverseStore::CalcCovariance
+				*/
+			void AddUniverses( const MUUniverseStore& store, const double *scales = 0, const double *mean = 0 );
+
+			//! Add v v^T, e.g. a fully correlated error v
+			void AddColumn( const double *v );
+
+			//! Add a diagonal matrix, e.g. statistical or uncorrelated errors squared
+			void AddDiagonal( const double *d );
+
+			/*! Add a dense symmetric matrix, through its eigenvectors.  Only meant for small matrices.
+				Negative eigenvalues, which a covariance matrix should not have, are dropped.
+				*/
+			void AddMatrix( const TMatrixD& m );
+
+			//! Add another covariance of the same bins: their columns are put side by side and their diagonals added
+			void Add( const MULowRankCovariance& other );
+
+			//! C_ik -> f_i C_ik f_k
+			void ScaleBins( const std::vector<double>& factors );
+
+			//! Divide by the CV like asFrac does: C_ik -> C_ik / (cv_i cv_k), and 0 where the CV is 0
+			void MakeFractional();
+
+			/*! out = C v, in O(nBins * rank)
+				@param[in] v nBins values
+				@param[out] out nBins values; may not be v
+				*/
+			void Multiply( const double *v, double *out ) const;
+
+			//! Multiply( v, out ) for vectors
+			std::vector<double> Multiply( const std::vector<double>& v ) const;
+
+			//! The diagonal of C, the variance of each bin
+			std::vector<double> GetDiagonal() const;
+
+			//! One element of C
+			double GetElement( const unsigned int i, const unsigned int k ) const;
+
+			/*! Materialize the block of C with these rows and columns
+				@param[in] rows Global bins of the rows of the block
+				@param[in] cols Global bins of the columns of the block
+				*/
+			TMatrixD GetBlock( const std::vector<int>& rows, const std::vector<int>& cols ) const;
+
+			//! Materialize the square block of C over global bins first to last (inclusive)
+			TMatrixD GetBlock( const int first, const int last ) const;
+
+			//! Materialize all of C, like GetTotalErrorMatrix.  Only for histograms small enough for that.
+			TMatrixD GetMatrix() const;
+
+		private:
+			unsigned int fNBins;        ///< Number of global bins
+			unsigned int fRank;         ///< Number of columns of F
+			std::vector<double> fFactor; ///< F, [column][bin]
+			std::vector<double> fDiag;   ///< D
+			std::vector<double> fCV;     ///< Content of each global bin of the CV
+	}; //end of MULowRankCovariance
+
+} //end of PlotUtils
+
+#endif
@@ -2,6 +2,7 @@
 #define MNV_MUPlotter_cxx 1
 
 #include "PlotUtils/MUPlotter.h"
+#include "PlotUtils/MUHistView.h"
 #include "HistogramUtils.h" //for IsAutoAxisLimit
 
 #include "TROOT.h"
@@ -17,6 +18,7 @@
 #include "TGaxis.h"
 #include "TList.h"
 
+#include <algorithm>
 #include <iostream>
 #include <vector>
 #include <string>
@@ -1569,22 +1571,25 @@ void MUPlotter::DrawDataMCRatio(
 		)
 {
 
-	//!make clones
-	TH1Ptr tmpData( (TH1*)dataHist->Clone("tmp_data") );
-	TH1Ptr tmpMC  ( (TH1*)mcHist  ->Clone("tmp_mc"  ) );
-
+	//!read the central values through views, so the universes are not copied
+	MUH1DView dataView( *dataHist );
+	MUH1DView mcView( *mcHist );
 	if( draw_normalized_to_bin_width )
 	{
 		if( dataHist->GetNormBinWidth() > 0 )
-			tmpData.get()->Scale( dataHist->GetNormBinWidth(), "width" );
+			dataView.BinNormalize();
 
 		if( mcHist->GetNormBinWidth() > 0 )
-			tmpMC.get()  ->Scale( mcHist  ->GetNormBinWidth(), "width" );
+			mcView.BinNormalize();
 	}
 
-
 	//scale MC to data
-	tmpMC->Scale(mcScale);
+	mcView.Scale(mcScale);
+
+	TH1Ptr tmpData( new TH1D( dataView.GetCVHistoWithStatError() ) );
+	TH1Ptr tmpMC  ( new TH1D( mcView  .GetCVHistoWithStatError() ) );
+	tmpData->SetName( "tmp_data" );
+	tmpMC  ->SetName( "tmp_mc"   );
 
 	//get the ratio
 	TH1Ptr tmpRatio( (TH1*)tmpMC->Clone("tmp_ratio") );
@@ -1740,97 +1745,151 @@ Double_t MUPlotter::Chi2DataMC(
 		return -1.;
 	}
 
-	//only consider the plotted range
-	const int lowBin  = mcHist->GetXaxis()->GetFirst();
-	const int highBin = mcHist->GetXaxis()->GetLast();
+	//get the covariance matrix: total error of one histogram, stat error of the other
+	//the covariance is linear in the MC, so scale it instead of copying all universes of the MC
+	const bool includeStatError = true;
+	const bool errorAsFraction  = false;
+	const MUH1D* sysHist  = useDataErrorMatrix ? dataHist : mcHist;
+	const MUH1D* statHist = useDataErrorMatrix ? mcHist : dataHist;
+	const double sysScale  = useDataErrorMatrix ? 1. : mcScale;
+	const double statScale = useDataErrorMatrix ? mcScale : 1.;
+	MULowRankCovariance cov = sysHist->GetTotalErrorLowRank( includeStatError, errorAsFraction, useOnlyShapeErrors );
+	cov.ScaleBins( std::vector<double>( cov.GetNBins(), sysScale ) );
+	MUDiagonalCovariance statCov( statHist->GetNcells() );
+	statCov.AddErrors( statHist, statScale );
+	statCov.AddTo( cov );
 
-	//Scaling MC to Data
-	MUH1D* tmpMCHist = (MUH1D*) mcHist->Clone("tmpMCHist");
-	tmpMCHist->Scale(mcScale);
+	const Double_t chi2 = Chi2WithCovariance( dataHist, mcHist, cov, ndf, mcScale, useOnlyShapeErrors );
 
-	// Defining Error Matrix dimensions
-	// Either use the requested range or the full error matrix with under/overflow
-	Int_t Nbins = highBin - lowBin + 1;
-	if( chi2_use_overflow_err )
-		Nbins = tmpMCHist->GetNbinsX()+2;
+	if( chi2 < 0. )
+	{
+		Warning("MUPlotter::Chi2DataMC", "Cannot invert total covariance matrix.  Using statistical errors only for Chi2 calculation.");
+
+		//the central values only, a clone of the MUH1Ds would copy all universes
+		const TH1D dataCV = dataHist->GetCVHistoWithStatError();
+		const TH1D mcCV   = mcHist  ->GetCVHistoWithStatError();
+		return Chi2DataMC( &dataCV, &mcCV, ndf, mcScale );
+	}
+
+	return chi2;
+}
 
-	//get the covariance matrix
-	TMatrixD covMatrix(Nbins, Nbins);
+Double_t MUPlotter::Chi2DataMC( 
+		const MUH2D* dataHist, 
+		const MUH2D* mcHist, 
+		Int_t& ndf,
+		const Double_t mcScale,
+		const bool useDataErrorMatrix,
+		const bool useOnlyShapeErrors 
+		)
+{
+	if ( dataHist->GetNcells() != mcHist->GetNcells() )
 	{
-		const Int_t NbinsTotal = tmpMCHist->GetNbinsX() + 2; //+2 for under/overflow
-		TMatrixD covMatrixTmp( NbinsTotal, NbinsTotal );
-		const bool includeStatError = true;
-		const bool errorAsFraction  = false;
+		Error("MUPlotter::Chi2DataMC", "The number of bins from Data and MC histograms differ. Returning -1.");
+		return -1.;
+	}
 
-		// Use Error Matrix from Data or MC?
-		if( useDataErrorMatrix )
-		{
-			covMatrixTmp = dataHist->GetTotalErrorMatrix( includeStatError, errorAsFraction, useOnlyShapeErrors);
-			covMatrixTmp += tmpMCHist->GetStatErrorMatrix( );
-		}
-		else
-		{
-			covMatrixTmp = tmpMCHist->GetTotalErrorMatrix(  includeStatError, errorAsFraction, useOnlyShapeErrors);
-			covMatrixTmp += dataHist->GetStatErrorMatrix( );
-		}
+	//the covariance is linear in the MC, so scale it instead of copying all universes of the MC
+	const MUH2D* sysHist  = useDataErrorMatrix ? dataHist : mcHist;
+	const MUH2D* statHist = useDataErrorMatrix ? mcHist : dataHist;
+	const double sysScale  = useDataErrorMatrix ? 1. : mcScale;
+	const double statScale = useDataErrorMatrix ? mcScale : 1.;
+	MULowRankCovariance cov = sysHist->GetTotalErrorLowRank( true, false, useOnlyShapeErrors );
+	cov.ScaleBins( std::vector<double>( cov.GetNBins(), sysScale ) );
+	MUDiagonalCovariance statCov( statHist->GetNcells() );
+	statCov.AddErrors( statHist, statScale );
+	statCov.AddTo( cov );
 
-		//select only covariance elements in the histogram range
-		// unless using the contributions to covariance from overflow 
-		if( chi2_use_overflow_err )
-		{
-			covMatrix = covMatrixTmp;
-		}
-		else
-		{
-			for( int i = 0; i != Nbins; ++i )
-			{
-				for( int j = 0; j != Nbins; ++j )
-				{
-					covMatrix[i][j] = covMatrixTmp[i+lowBin][j+lowBin];
-				}
-			}
-		}
+	const Double_t chi2 = Chi2WithCovariance( dataHist, mcHist, cov, ndf, mcScale, useOnlyShapeErrors );
+	if( chi2 < 0. )
+		Error("MUPlotter::Chi2DataMC", "Cannot invert total covariance matrix. Returning -1.");
 
-	}// end of block to get covarance
+	return chi2;
+}
 
-	//Now, we invert the covariance error Matrix and store the result in "errorMatrix"
-	// Note: TDecompSVD can handle singular matrices
-	TDecompSVD error(covMatrix);
-	TMatrixD errorMatrix(covMatrix);
-	if( ! error.Invert( errorMatrix ) )
+Double_t MUPlotter::Chi2DataMC( 
+		const MUH3D* dataHist, 
+		const MUH3D* mcHist, 
+		Int_t& ndf,
+		const Double_t mcScale,
+		const bool useDataErrorMatrix,
+		const bool useOnlyShapeErrors 
+		)
+{
+	if ( dataHist->GetNcells() != mcHist->GetNcells() )
 	{
-		Warning("MUPlotter::Chi2DataMC", "Cannot invert total covariance matrix.  Using statistical errors only for Chi2 calculation.");
-		return Chi2DataMC( (TH1D*)dataHist, (TH1D*)mcHist, ndf, mcScale );
+		Error("MUPlotter::Chi2DataMC", "The number of bins from Data and MC histograms differ. Returning -1.");
+		return -1.;
 	}
 
-	//Calculating chi2
-	ndf = 0;
-	Double_t chi2 = 0.;
-	// under/overflow bins not taken into account in the chi2 calculation
-	for (int i=lowBin; i<=highBin ; ++i)
+	//the covariance is linear in the MC, so scale it instead of copying all universes of the MC
+	const MUH3D* sysHist  = useDataErrorMatrix ? dataHist : mcHist;
+	const MUH3D* statHist = useDataErrorMatrix ? mcHist : dataHist;
+	const double sysScale  = useDataErrorMatrix ? 1. : mcScale;
+	const double statScale = useDataErrorMatrix ? mcScale : 1.;
+	MULowRankCovariance cov = sysHist->GetTotalErrorLowRank( true, false, useOnlyShapeErrors );
+	cov.ScaleBins( std::vector<double>( cov.GetNBins(), sysScale ) );
+	MUDiagonalCovariance statCov( statHist->GetNcells() );
+	statCov.AddErrors( statHist, statScale );
+	statCov.AddTo( cov );
+
+	const Double_t chi2 = Chi2WithCovariance( dataHist, mcHist, cov, ndf, mcScale, useOnlyShapeErrors );
+	if( chi2 < 0. )
+		Error("MUPlotter::Chi2DataMC", "Cannot invert total covariance matrix. Returning -1.");
+
+	return chi2;
+}
+
+Double_t MUPlotter::Chi2WithCovariance(
+		const TH1* dataHist,
+		const TH1* mcHist,
+		const MULowRankCovariance& cov,
+		Int_t& ndf,
+		const Double_t mcScale,
+		const bool useOnlyShapeErrors
+		)
+{
+	//only consider the plotted range
+	std::vector<int> rangeBins;
+	for( int z = mcHist->GetZaxis()->GetFirst(); z <= mcHist->GetZaxis()->GetLast(); ++z )
+		for( int y = mcHist->GetYaxis()->GetFirst(); y <= mcHist->GetYaxis()->GetLast(); ++y )
+			for( int x = mcHist->GetXaxis()->GetFirst(); x <= mcHist->GetXaxis()->GetLast(); ++x )
+				rangeBins.push_back( mcHist->GetBin( x, y, z ) );
+	std::sort( rangeBins.begin(), rangeBins.end() );
+
+	// Either use the requested range or the full error matrix with under/overflow
+	// With under/overflow their residuals are 0, which is the same as taking the range out of the inverse of the full matrix
+	std::vector<int> covBins( rangeBins );
+	if( chi2_use_overflow_err )
 	{
-		const int iErrBin = i - lowBin;
-		const Double_t x_data_i = dataHist->GetBinContent(i);
-		const Double_t x_mc_i   = tmpMCHist->GetBinContent(i);
+		covBins.clear();
+		for( int i = 0; i != mcHist->GetNcells(); ++i )
+			covBins.push_back( i );
+	}
 
-		for (int j=lowBin; j<=highBin; ++j)
-		{
-			const int jErrBin = j - lowBin;
-			const Double_t x_data_j = dataHist->GetBinContent(j);
-			const Double_t x_mc_j   = tmpMCHist->GetBinContent(j);
-			const double chi2_ij = (x_data_i - x_mc_i) * errorMatrix[iErrBin][jErrBin] * (x_data_j - x_mc_j);
-			chi2 += chi2_ij;
-		}
-		++ndf; // Is this the right way to calcualte ndf?
+	//Factor the covariance once: Woodbury for stat + universes, Cholesky or SVD otherwise
+	MUChi2Calculator calculator;
+	if( !calculator.SetCovariance( cov, covBins ) )
+		return -1.;
+
+	std::vector<double> residuals( covBins.size(), 0. );
+	std::vector<int>::const_iterator it = rangeBins.begin();
+	for( unsigned int i = 0; i != covBins.size() && it != rangeBins.end(); ++i )
+	{
+		if( covBins[i] != *it )
+			continue;
+		residuals[i] = dataHist->GetBinContent( *it ) - mcScale * mcHist->GetBinContent( *it );
+		++it;
 	}
 
+	// under/overflow bins not taken into account in the chi2 calculation
+	ndf = rangeBins.size(); // Is this the right way to calcualte ndf?
+
 	// if this is a shape comparison, subtract one degree of freedom?
 	if(useOnlyShapeErrors)
 		--ndf;
 
-	delete tmpMCHist;
-
-	return chi2;
+	return calculator.Chi2( residuals );
 }
 
 
@@ -1938,7 +1997,7 @@ void MUPlotter::DrawDataMCVariations(
 	//create as clone because it gets added to the leged?
 	TH1* tmpData(0);
 	if( draw_normalized_to_bin_width )
-		tmpData = (TH1*)dataHist->GetBinNormalizedCopy().GetCVHistoWithError(true, covAreaNormalize).Clone( Form("tmpData_%d", __LINE__) );
+		tmpData = (TH1*)MUH1DView( *dataHist ).BinNormalize().GetCVHistoWithError(true, covAreaNormalize).Clone( Form("tmpData_%d", __LINE__) );
 	else
 		tmpData = (TH1*)dataHist->GetCVHistoWithError(true, covAreaNormalize).Clone( Form("tmpData_%d", __LINE__) );
 	AddToTmp( tmpData );
@@ -2006,7 +2065,7 @@ void MUPlotter::DrawDataMCVariations(
 
 		TH1 *hst(0);
 		if( draw_normalized_to_bin_width )
-			hst = (TH1*)mnvMC->GetBinNormalizedCopy().GetCVHistoWithError(true, covAreaNormalize).Clone( Form("tmp_MCHist_%d_%d", i, __LINE__) );
+			hst = (TH1*)MUH1DView( *mnvMC ).BinNormalize().GetCVHistoWithError(true, covAreaNormalize).Clone( Form("tmp_MCHist_%d_%d", i, __LINE__) );
 		else
 			hst = (TH1*)mnvMC->GetCVHistoWithError(true, covAreaNormalize).Clone( Form("tmp_MCHist_%d_%d", i, __LINE__) );
 		AddToTmp( hst );
@@ -3317,7 +3376,7 @@ void MUPlotter::DrawStackedMC(
 		mnvhst = (MUH1D*)mcHists->At(i);
 
 		if( draw_normalized_to_bin_width )
-			hst    = (TH1*)mnvhst->GetBinNormalizedCopy().GetCVHistoWithError().Clone( Form( "tmpMC_%04d_%d", i, __LINE__) );
+			hst    = (TH1*)MUH1DView( *mnvhst ).BinNormalize().GetCVHistoWithError().Clone( Form( "tmpMC_%04d_%d", i, __LINE__) );
 		else
 			hst    = (TH1*)mnvhst->GetCVHistoWithError().Clone( Form( "tmpMC_%04d_%d", i, __LINE__) );
 		AddToTmp( hst );
@@ -3448,7 +3507,7 @@ void MUPlotter::DrawDataStackedMC(
 	// Note, Sumw2 is enforced automatically for MUH1D's.
 	TH1* tmpData(0);
 	if( draw_normalized_to_bin_width )
-		tmpData = (TH1*)dataHist->GetBinNormalizedCopy().GetCVHistoWithError().Clone( Form("tmp_data_%d", __LINE__) );
+		tmpData = (TH1*)MUH1DView( *dataHist ).BinNormalize().GetCVHistoWithError().Clone( Form("tmp_data_%d", __LINE__) );
 	else
 		tmpData = (TH1*)dataHist->GetCVHistoWithError().Clone( Form("tmp_data_%d", __LINE__) );
 	AddToTmp( tmpData );
@@ -3468,7 +3527,7 @@ void MUPlotter::DrawDataStackedMC(
 		mnvhst = (MUH1D*)mcHists->At(i);
 
 		if( draw_normalized_to_bin_width )
-			hst    = (TH1*)mnvhst->GetBinNormalizedCopy().GetCVHistoWithError().Clone( Form( "tmpMC_%04d_%d", i, __LINE__) );
+			hst    = (TH1*)MUH1DView( *mnvhst ).BinNormalize().GetCVHistoWithError().Clone( Form( "tmpMC_%04d_%d", i, __LINE__) );
 		else
 			hst    = (TH1*)mnvhst->GetCVHistoWithError().Clone( Form( "tmpMC_%04d_%d", i, __LINE__) );
 		AddToTmp( hst );
@@ -2,6 +2,9 @@
 #define MNV_MUPlotter_h 1
 
 #include "PlotUtils/MUH1D.h"
+#include "PlotUtils/MUH2D.h"
+#include "PlotUtils/MUH3D.h"
+#include "PlotUtils/MUChi2Calculator.h"
 
 #include "TDirectory.h"
 #include "TClass.h"
@@ -463,6 +466,44 @@ namespace PlotUtils
 					const bool useOnlyShapeErrors = false
 					);
 
+			//! calculate the chi2 between two histograms
+			//! using the total Error Matrix, kept as stat + universes (see MUChi2Calculator)
+			//! Bin range comes from the axis ranges of mcHist
+			Double_t Chi2DataMC( 
+					const MUH2D* dataHist, 
+					const MUH2D* mcHist, 
+					Int_t& ndf, 
+					const Double_t mcScale = 1.0,
+					const bool useDataErrorMatrix = false,
+					const bool useOnlyShapeErrors = false 
+					);
+
+			//! calculate the chi2 between two histograms
+			//! using the total Error Matrix, kept as stat + universes (see MUChi2Calculator)
+			//! Bin range comes from the axis ranges of mcHist
+			Double_t Chi2DataMC( 
+					const MUH3D* dataHist, 
+					const MUH3D* mcHist, 
+					Int_t& ndf, 
+					const Double_t mcScale = 1.0,
+					const bool useDataErrorMatrix = false,
+					const bool useOnlyShapeErrors = false 
+					);
+
+		private:
+			//! chi2 of dataHist - mcScale*mcHist over the bins in the axis ranges of mcHist
+			//! @return -1 if the covariance cannot be inverted
+			Double_t Chi2WithCovariance(
+					const TH1* dataHist,
+					const TH1* mcHist,
+					const MULowRankCovariance& cov,
+					Int_t& ndf,
+					const Double_t mcScale,
+					const bool useOnlyShapeErrors
+					);
+
+		public:
+
 
 			void AddPOTNormBox( 
 					const double dataPOT, 
@@ -0,0 +1,219 @@
+#ifndef MNV_MURebinMap_cxx
+#define MNV_MURebinMap_cxx 1
+
+#include "PlotUtils/MURebinMap.h"
+#include "PlotUtils/MUUniverseStore.h"
+
+#include "TAxis.h"
+#include "TArrayD.h"
+#include "TH1.h"
+#include "TError.h"
+
+#include <algorithm>
+
+using namespace PlotUtils;
+
+namespace
+{
+  //! All edges of an axis of nbins bins, as TAxis::GetBinLowEdge gives them
+  std::vector<double> GetEdges( const int nbins, const double xmin, const double xmax, const std::vector<double>& edges )
+  {
+    if( !edges.empty() )
+      return edges;
+    std::vector<double> rval( nbins + 1 );
+    const double width = ( xmax - xmin ) / nbins;
+    for( int i = 0; i != nbins; ++i )
+      rval[i] = xmin + i*width;
+    rval[nbins] = xmax;
+    return rval;
+  }
+}
+
+MURebinMap::MURebinMap( const TH1* h, const TAxis* newX, const TAxis* newY /*= 0*/, const TAxis* newZ /*= 0*/ ) :
+  fDimension( h->GetDimension() ),
+  fNNewBins( 1 ),
+  fAligned( true )
+{
+  const TAxis *oldAxes[3] = { h->GetXaxis(), h->GetYaxis(), h->GetZaxis() };
+  const TAxis *newAxes[3] = { newX, newY, newZ };
+
+  //! Map each axis on its own; an axis the histogram does not have is its single bin 0
+  std::vector<int> axisMaps[3];
+  int nOldCells[3], nNewCells[3];
+  for( int d = 0; d != 3; ++d )
+  {
+    if( d < fDimension )
+    {
+      fAxes[d] = MakeAxis( newAxes[d] ? newAxes[d] : oldAxes[d] );
+      axisMaps[d] = MapAxis( oldAxes[d], fAxes[d] );
+      nOldCells[d] = oldAxes[d]->GetNbins() + 2;
+      nNewCells[d] = fAxes[d].fNbins + 2;
+    }
+    else
+    {
+      axisMaps[d].assign( 1, 0 );
+      nOldCells[d] = nNewCells[d] = 1;
+    }
+    fNNewBins *= nNewCells[d];
+  }
+
+  //! Global bins in the order of TH1::GetBin
+  fNewBins.resize( nOldCells[0] * nOldCells[1] * nOldCells[2] );
+  for( int binz = 0; binz != nOldCells[2]; ++binz )
+  {
+    for( int biny = 0; biny != nOldCells[1]; ++biny )
+    {
+      for( int binx = 0; binx != nOldCells[0]; ++binx )
+      {
+        fNewBins[ binx + nOldCells[0] * ( biny + nOldCells[1] * binz ) ] =
+          axisMaps[0][binx] + nNewCells[0] * ( axisMaps[1][biny] + nNewCells[1] * axisMaps[2][binz] );
+      }
+    }
+  }
+
+  fMap = MULinearMap::Rebin( *this );
+
+  if( !fAligned )
+    Warning( "MURebinMap::MURebinMap", "Some edges of the new binning of %s are not edges of the old binning.  Each split bin goes to the new bin holding its center.", h->GetName() );
+}
+
+bool MURebinMap::GroupAxis( const TAxis* axis, const int ngroup, TAxis& rval )
+{
+  const int nbins = axis->GetNbins();
+  if( ngroup < 1 || nbins < ngroup )
+  {
+    Error( "MURebinMap::GroupAxis", "Illegal value of ngroup=%d for an axis of %d bins", ngroup, nbins );
+    return false;
+  }
+
+  const int newbins = nbins / ngroup;
+  if( 0 == axis->GetXbins()->fN )
+  {
+    rval.Set( newbins, axis->GetXmin(), axis->GetBinUpEdge( newbins * ngroup ) );
+    return true;
+  }
+
+  std::vector<double> edges( newbins + 1 );
+  for( int i = 0; i != newbins; ++i )
+    edges[i] = axis->GetBinLowEdge( i*ngroup + 1 );
+  edges[newbins] = axis->GetBinUpEdge( newbins * ngroup );
+  rval.Set( newbins, &edges[0] );
+  return true;
+}
+
+MURebinMap::Axis MURebinMap::MakeAxis( const TAxis* axis )
+{
+  Axis rval;
+  rval.fNbins = axis->GetNbins();
+  rval.fXmin = axis->GetXmin();
+  rval.fXmax = axis->GetXmax();
+  const TArrayD *xbins = axis->GetXbins();
+  if( 0 != xbins->fN )
+    rval.fEdges.assign( xbins->fArray, xbins->fArray + xbins->fN );
+  return rval;
+}
+
+std::vector<int> MURebinMap::MapAxis( const TAxis* oldAxis, const Axis& newAxis )
+{
+  const std::vector<double> edges = GetEdges( newAxis.fNbins, newAxis.fXmin, newAxis.fXmax, newAxis.fEdges );
+  const int nbins = oldAxis->GetNbins();
+
+  std::vector<int> rval( nbins + 2 );
+  rval[0] = 0;
+  rval[nbins+1] = newAxis.fNbins + 1;
+  for( int bin = 1; bin <= nbins; ++bin )
+  {
+    //! The first edge above the center closes the new bin (0 below the axis, nbins+1 above it)
+    const int newBin = std::upper_bound( edges.begin(), edges.end(), oldAxis->GetBinCenter( bin ) ) - edges.begin();
+    rval[bin] = newBin;
+
+    //! The old bin must lie within the new one
+    const double low = oldAxis->GetBinLowEdge( bin ), up = oldAxis->GetBinUpEdge( bin );
+    const double tolerance = 1e-6 * ( up - low );
+    const double newLow = ( 0 < newBin ) ? edges[newBin-1] : low;
+    const double newUp  = ( newBin <= newAxis.fNbins ) ? edges[newBin] : up;
+    if( low < newLow - tolerance || newUp + tolerance < up )
+      fAligned = false;
+  }
+  return rval;
+}
+
+bool MURebinMap::Apply( TH1* h ) const
+{
+  if( (unsigned int)h->GetNcells() != fNewBins.size() || h->GetDimension() != fDimension )
+  {
+    Error( "MURebinMap::Apply", "Histogram %s with %d bins does not have the binning this map was made for (%d bins).  Not rebinning.", h->GetName(), h->GetNcells(), (int)fNewBins.size() );
+    return false;
+  }
+
+  //! Sum contents and squared errors into the new bins, one pass each
+  const bool hasSumw2 = 0 < h->GetSumw2N();
+  TArrayD *contents = dynamic_cast<TArrayD*>( h );
+  std::vector<double> sumw( fNNewBins, 0. ), sumw2( hasSumw2 ? fNNewBins : 0, 0. );
+  if( contents )
+    fMap.Apply( contents->fArray, &sumw[0] );
+  else
+  {
+    std::vector<double> old( fNewBins.size() );
+    for( unsigned int bin = 0; bin != fNewBins.size(); ++bin )
+      old[bin] = h->GetBinContent( bin );
+    fMap.Apply( &old[0], &sumw[0] );
+  }
+  if( hasSumw2 )
+    fMap.Apply( h->GetSumw2()->fArray, &sumw2[0], 1, true );
+
+  //! The statistics of the fills do not depend on the binning, so they are kept as TH1::Rebin keeps them
+  Double_t stats[TH1::kNstat];
+  h->GetStats( stats );
+  const Double_t entries = h->GetEntries();
+
+  //! Set all axes by their edges, then give back equal-width axes their fixed binning
+  std::vector<double> edges[3];
+  for( int d = 0; d != fDimension; ++d )
+    edges[d] = GetEdges( fAxes[d].fNbins, fAxes[d].fXmin, fAxes[d].fXmax, fAxes[d].fEdges );
+  if( 1 == fDimension )
+    h->SetBins( fAxes[0].fNbins, &edges[0][0] );
+  else if( 2 == fDimension )
+    h->SetBins( fAxes[0].fNbins, &edges[0][0], fAxes[1].fNbins, &edges[1][0] );
+  else
+    h->SetBins( fAxes[0].fNbins, &edges[0][0], fAxes[1].fNbins, &edges[1][0], fAxes[2].fNbins, &edges[2][0] );
+
+  TAxis *axes[3] = { h->GetXaxis(), h->GetYaxis(), h->GetZaxis() };
+  for( int d = 0; d != fDimension; ++d )
+  {
+    if( fAxes[d].fEdges.empty() )
+      axes[d]->Set( fAxes[d].fNbins, fAxes[d].fXmin, fAxes[d].fXmax );
+  }
+
+  contents = dynamic_cast<TArrayD*>( h );
+  for( unsigned int bin = 0; bin != fNNewBins; ++bin )
+  {
+    if( contents )
+      contents->fArray[bin] = sumw[bin];
+    else
+      h->SetBinContent( bin, sumw[bin] );
+    if( hasSumw2 )
+      h->GetSumw2()->fArray[bin] = sumw2[bin];
+  }
+
+  h->PutStats( stats );
+  h->SetEntries( entries );
+  return true;
+}
+
+bool MURebinMap::Apply( MUUniverseStore& store ) const
+{
+  //! The result has a new shape, so it always gets new buffers and shared ones are left alone
+  MUUniverseStore rebinned;
+  if( !fMap.Apply( store, rebinned ) )
+    return false;
+  store.Swap( rebinned );
+  return true;
+}
+
+TMatrixD MURebinMap::Apply( const TMatrixD& covmx ) const
+{
+  return fMap.Apply( covmx );
+}
+
+#endif
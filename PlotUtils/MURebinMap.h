@@ -0,0 +1,99 @@
+#ifndef MNV_MURebinMap_H
+#define MNV_MURebinMap_H 1
+
+#include "PlotUtils/MULinearMap.h"
+
+#include "Rtypes.h"
+#include "TMatrixD.h"
+
+#include <vector>
+
+class TH1;
+class TAxis;
+
+namespace PlotUtils
+{
+
+	class MUUniverseStore;
+
+	/*! @brief Which new bin every bin of a histogram goes to when it is rebinned, worked out once.
+
+		Rebinning a MUH1D (MUH2D, MUH3D) sums the same bins in the central value, in every universe of every
+		error band and in the uncorrelated errors.  The map is built once from the old and the new axes, and
+		each of those is then one pass over the old bins: all universes of a bin are added to their new bin
+		as one row.
+
+		The new axes may have any edges, but every new edge should be an old edge, as for TH1::Rebin.  An old
+		bin split by a new edge goes wholly to the new bin holding its center (with a warning).  Old bins outside
+		the new axis go to its under/overflow.
+
+		Error matrices are rebinned exactly: with M the 0/1 matrix of the map, the new matrix is M*C*M^T.
+		The sums themselves are done by the MULinearMap of the map (GetLinearMap), as for projections.
+		*/
+	class MURebinMap
+	{
+		public:
+			/*! Map the binning of h onto new axes
+				@param[in] h Histogram with the old binning
+				@param[in] newX,newY,newZ The new axes (NULL keeps that axis of h)
+				*/
+			MURebinMap( const TH1* h, const TAxis* newX, const TAxis* newY = 0, const TAxis* newZ = 0 );
+
+			/*! Set rval to groups of ngroup bins of axis, as TH1::Rebin( ngroup ) makes them.
+				Bins left over at the top go to the overflow.
+				@return false if ngroup is not between 1 and the number of bins
+				*/
+			static bool GroupAxis( const TAxis* axis, const int ngroup, TAxis& rval );
+
+			//! Number of global bins before rebinning
+			unsigned int GetNOldBins() const { return fNewBins.size(); };
+
+			//! Number of global bins after rebinning
+			unsigned int GetNNewBins() const { return fNNewBins; };
+
+			//! The new global bin of each old global bin
+			const std::vector<int>& GetNewBins() const { return fNewBins; };
+
+			//! Is every new edge also an old edge?
+			bool IsAligned() const { return fAligned; };
+
+			//! The map as a MULinearMap, with weight 1 from each old bin to its new bin
+			const MULinearMap& GetLinearMap() const { return fMap; };
+
+			/*! Rebin a histogram with the old binning in place: new axes, contents, errors and statistics
+				@return false if h does not have the old binning
+				*/
+			bool Apply( TH1* h ) const;
+
+			//! Rebin all universes of a store with the old binning in place, false if it does not have it
+			bool Apply( MUUniverseStore& store ) const;
+
+			//! M*C*M^T of a matrix over the old global bins, or a zero matrix (with an error) if it does not fit
+			TMatrixD Apply( const TMatrixD& covmx ) const;
+
+		private:
+			//! One new axis
+			struct Axis
+			{
+				int fNbins;                  ///< Number of bins
+				double fXmin, fXmax;         ///< Range
+				std::vector<double> fEdges;  ///< Edges, or empty for bins of equal width
+			};
+
+			//! Copy an axis into plain members
+			static Axis MakeAxis( const TAxis* axis );
+
+			//! New bin of each old bin of one axis, including under/overflow
+			std::vector<int> MapAxis( const TAxis* oldAxis, const Axis& newAxis );
+
+			int fDimension;               ///< Number of axes
+			Axis fAxes[3];                ///< The new axes
+			std::vector<int> fNewBins;    ///< New global bin of each old global bin
+			unsigned int fNNewBins;       ///< Number of global bins after rebinning
+			bool fAligned;                ///< Is every new edge also an old edge?
+			MULinearMap fMap;             ///< fNewBins as a linear map
+	}; //end of MURebinMap
+
+} //end of PlotUtils
+
+#endif
@@ -0,0 +1,210 @@
+#ifndef MNV_MUTaskPool_cxx
+#define MNV_MUTaskPool_cxx 1
+
+#include "PlotUtils/MUTaskPool.h"
+
+#include <algorithm>
+#if __cplusplus >= 201103L
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+using namespace PlotUtils;
+
+namespace
+{
+  unsigned int gNThreads = 0;
+
+#if __cplusplus >= 201103L
+  //! Set while this thread runs tasks of a pool
+  thread_local bool tInWorker = false;
+
+  //! Take task indices from next until they run out
+  void RunTasks( MUTaskPool::Job* job, std::atomic<unsigned int>* next, const unsigned int last )
+  {
+    const bool wasWorker = tInWorker;
+    tInWorker = true;
+    for( unsigned int i = (*next)++; i < last; i = (*next)++ )
+      job->Run( i );
+    tInWorker = wasWorker;
+  }
+
+  /*! Threads started once and kept waiting for the next batch of tasks.  A batch is a job and a range of task
+      indices; each Run hands out one batch and the workers it asks for join in until the indices run out.
+      */
+  class WorkerPool
+  {
+    public:
+      WorkerPool( ) : fJob( 0 ), fNext( 0 ), fLast( 0 ), fNJoin( 0 ), fNActive( 0 ), fBatch( 0 ), fStop( false ) {}
+
+      ~WorkerPool( )
+      {
+        {
+          std::lock_guard<std::mutex> lock( fMutex );
+          fStop = true;
+        }
+        fWake.notify_all();
+        for( unsigned int t = 0; t != fThreads.size(); ++t )
+          fThreads[t].join();
+      }
+
+      //! Run the tasks with nHelpers workers joining the calling thread.  false, doing nothing, if another batch is running.
+      bool Run( MUTaskPool::Job& job, const unsigned int first, const unsigned int last, const unsigned int nHelpers )
+      {
+        std::unique_lock<std::mutex> busy( fBusy, std::try_to_lock );
+        if( !busy.owns_lock() )
+          return false;
+
+        {
+          std::lock_guard<std::mutex> lock( fMutex );
+          while( fThreads.size() < nHelpers )
+            fThreads.push_back( std::thread( &WorkerPool::Work, this ) );
+          fJob = &job;
+          fNext = first;
+          fLast = last;
+          fNJoin = nHelpers;
+          ++fBatch;
+        }
+        fWake.notify_all();
+
+        RunTasks( &job, &fNext, last );
+
+        //! Workers that did not wake up in time are not needed any more.  Wait for those that did.
+        std::unique_lock<std::mutex> lock( fMutex );
+        fNJoin = 0;
+        fDone.wait( lock, [this]{ return 0 == fNActive; } );
+        fJob = 0;
+        return true;
+      }
+
+    private:
+      void Work( )
+      {
+        unsigned long seen = 0;
+        std::unique_lock<std::mutex> lock( fMutex );
+        while( true )
+        {
+          fWake.wait( lock, [this, &seen]{ return fStop || fBatch != seen; } );
+          if( fStop )
+            return;
+          seen = fBatch;
+          if( 0 == fNJoin )
+            continue;
+          --fNJoin;
+          ++fNActive;
+
+          MUTaskPool::Job* job = fJob;
+          const unsigned int last = fLast;
+          lock.unlock();
+          RunTasks( job, &fNext, last );
+          lock.lock();
+          if( 0 == --fNActive )
+            fDone.notify_all();
+        }
+      }
+
+      std::mutex fBusy;                  ///< Held by the Run whose batch this is
+      std::mutex fMutex;                 ///< Guards everything below but fNext
+      std::condition_variable fWake;     ///< A new batch, or stop
+      std::condition_variable fDone;     ///< The last active worker finished
+      std::vector<std::thread> fThreads; ///< Started as needed, never more than the most helpers asked for
+      MUTaskPool::Job* fJob;             ///< Job of the current batch
+      std::atomic<unsigned int> fNext;   ///< Next task index to hand out
+      unsigned int fLast;                ///< End of the task range
+      unsigned int fNJoin;               ///< Workers still wanted for the current batch
+      unsigned int fNActive;             ///< Workers running tasks of the current batch
+      unsigned long fBatch;              ///< Counts batches, so a worker joins each at most once
+      bool fStop;                        ///< Set when the pool goes away
+  };
+
+  WorkerPool& GetWorkerPool()
+  {
+    static WorkerPool pool;
+    return pool;
+  }
+
+  std::recursive_mutex& GetQueryMutex()
+  {
+    static std::recursive_mutex m;
+    return m;
+  }
+#endif
+}
+
+//======================================================================
+// MUTaskPool
+//======================================================================
+void MUTaskPool::Run( Job& job, const unsigned int first, const unsigned int last, const unsigned int nThreads /* = 0 */ )
+{
+  if( last <= first )
+    return;
+
+#if __cplusplus >= 201103L
+  unsigned int n = nThreads ? nThreads : GetNThreads();
+  n = std::min( n, last - first );
+  if( tInWorker )
+    n = 1;
+
+  //! One task, or a nested Run, or the workers busy with another thread's batch: do the tasks here
+  if( n <= 1 || !GetWorkerPool().Run( job, first, last, n - 1 ) )
+  {
+    std::atomic<unsigned int> next( first );
+    RunTasks( &job, &next, last );
+  }
+#else
+  (void)nThreads;
+  for( unsigned int i = first; i != last; ++i )
+    job.Run( i );
+#endif
+}
+
+void MUTaskPool::SetNThreads( const unsigned int n )
+{
+  gNThreads = n;
+}
+
+unsigned int MUTaskPool::GetNThreads()
+{
+#if __cplusplus >= 201103L
+  if( gNThreads )
+    return gNThreads;
+  return std::max( 1u, std::thread::hardware_concurrency() );
+#else
+  return 1;
+#endif
+}
+
+bool MUTaskPool::IsWorkerThread()
+{
+#if __cplusplus >= 201103L
+  return tInWorker;
+#else
+  return false;
+#endif
+}
+
+//======================================================================
+// MUQueryLock
+//======================================================================
+#if __cplusplus >= 201103L
+MUQueryLock::MUQueryLock( )
+{
+  GetQueryMutex().lock();
+}
+
+MUQueryLock::~MUQueryLock( )
+{
+  GetQueryMutex().unlock();
+}
+#else
+MUQueryLock::MUQueryLock( )
+{ }
+
+MUQueryLock::~MUQueryLock( )
+{ }
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef MNV_MUTaskPool_H
+#define MNV_MUTaskPool_H 1
+
+namespace PlotUtils
+{
+
+	/*! @brief Runs independent tasks on a few worker threads and waits for them all.
+
+		The worker threads are started on first use and then wait for the next Run, so a Run costs a
+		wake-up, not a thread start.  Workers take task indices from a shared counter, so cheap and
+		expensive tasks even out.  One Run uses the workers at a time: a Run from another thread
+		while they are busy does its tasks on its own thread, as does a Run of a single task.
+		Tasks only share what the job gives them.  To sum results, keep one result per task and add
+		them in task order afterwards: the sum then has the same bits however the tasks were scheduled.
+
+		A task that itself asks for a pool (e.g. a covariance matrix big enough for CalcCovariance to
+		split up) runs it on its own thread, so nested work never starts more threads than cores.
+		Without C++11 threads every task runs on the calling thread.
+		*/
+	class MUTaskPool
+	{
+		public:
+			//! Work to do for each task index
+			class Job
+			{
+				public:
+					virtual ~Job() {};
+
+					//! Do task i.  Called once per index, from any thread.
+					virtual void Run( const unsigned int i ) = 0;
+			};
+
+			/*! Run job.Run( i ) for every i in [first, last) and return once all are done
+				@param[in] job The tasks
+				@param[in] first,last Range of task indices
+				@param[in] nThreads Most threads to use, including the calling one.  0 means GetNThreads().
+				*/
+			static void Run( Job& job, const unsigned int first, const unsigned int last, const unsigned int nThreads = 0 );
+
+			//! How many threads Run may use.  0, the default, means one per core.
+			static void SetNThreads( const unsigned int n );
+
+			//! How many threads Run will use (1 without C++11 threads)
+			static unsigned int GetNThreads();
+
+			//! Is this thread running a task of some pool?
+			static bool IsWorkerThread();
+	}; //end of MUTaskPool
+
+	/*! @brief Holds the lock for the lazy updates that const methods make, while in scope.
+
+		Rebuilding the band index of a histogram, interning band names, and refreshing the universe
+		views of an error band all change state behind a const interface.  They are rare and short,
+		so all histograms share one lock.  It is recursive, so locked code may call other locked code.
+		Without C++11 threads this does nothing.
+		*/
+	class MUQueryLock
+	{
+		public:
+			MUQueryLock( );
+			~MUQueryLock( );
+
+		private:
+			MUQueryLock( const MUQueryLock& );
+			MUQueryLock& operator=( const MUQueryLock& );
+	}; //end of MUQueryLock
+
+} //end of PlotUtils
+
+#endif
@@ -0,0 +1,1052 @@
+#ifndef MNV_MUUniverseStore_cxx
+#define MNV_MUUniverseStore_cxx 1
+
+#include "PlotUtils/MUUniverseStore.h"
+#include "PlotUtils/MUTaskPool.h"
+
+#include "TH1.h"
+#include "TAxis.h"
+#include "TArrayD.h"
+#include "TError.h"
+#include "TString.h"
+
+#include <math.h>
+#include <algorithm>
+#include <utility>
+#if __cplusplus >= 202002L
+#include <atomic>
+#endif
+#if __cplusplus >= 201103L
+#include <thread>
+#endif
+#ifdef MU_USE_CBLAS
+#include <cblas.h>
+#endif
+
+#if defined(__GNUC__) && ( defined(__x86_64__) || defined(__i386__) )
+#define MU_UNIVERSE_STORE_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+using namespace PlotUtils;
+
+//======================================================================
+// Accumulation kernels
+//======================================================================
+namespace
+{
+  typedef void (*AccumulateFn)( double*, double*, const double*, double, unsigned int );
+
+  //! sumw[i] += w[i]*c, sumw2[i] += (w[i]*c)^2 for every universe, one at a time
+  void AccumulateScalar( double *sumw, double *sumw2, const double *weights, const double applyWeight, const unsigned int n )
+  {
+    for( unsigned int i = 0; i != n; ++i )
+    {
+      const double wgtU = weights[i]*applyWeight;
+      sumw[i]  += wgtU;
+      sumw2[i] += wgtU*wgtU;
+    }
+  }
+
+#ifdef MU_UNIVERSE_STORE_X86_KERNELS
+  //! Four universes per instruction.  Compiled for AVX2 regardless of -march, only called if the CPU has it.
+  __attribute__((target("avx2")))
+  void AccumulateAVX2( double *sumw, double *sumw2, const double *weights, const double applyWeight, const unsigned int n )
+  {
+    const __m256d c = _mm256_set1_pd( applyWeight );
+    unsigned int i = 0;
+    for( ; i + 4 <= n; i += 4 )
+    {
+      const __m256d w = _mm256_mul_pd( _mm256_loadu_pd( weights + i ), c );
+      _mm256_storeu_pd( sumw + i,  _mm256_add_pd( _mm256_loadu_pd( sumw + i ), w ) );
+      _mm256_storeu_pd( sumw2 + i, _mm256_add_pd( _mm256_loadu_pd( sumw2 + i ), _mm256_mul_pd( w, w ) ) );
+    }
+    AccumulateScalar( sumw + i, sumw2 + i, weights + i, applyWeight, n - i );
+  }
+
+  //! Eight universes per instruction.  Only called if the CPU supports AVX-512F.
+  __attribute__((target("avx512f")))
+  void AccumulateAVX512( double *sumw, double *sumw2, const double *weights, const double applyWeight, const unsigned int n )
+  {
+    const __m512d c = _mm512_set1_pd( applyWeight );
+    unsigned int i = 0;
+    for( ; i + 8 <= n; i += 8 )
+    {
+      const __m512d w = _mm512_mul_pd( _mm512_loadu_pd( weights + i ), c );
+      _mm512_storeu_pd( sumw + i,  _mm512_add_pd( _mm512_loadu_pd( sumw + i ), w ) );
+      _mm512_storeu_pd( sumw2 + i, _mm512_add_pd( _mm512_loadu_pd( sumw2 + i ), _mm512_mul_pd( w, w ) ) );
+    }
+    AccumulateScalar( sumw + i, sumw2 + i, weights + i, applyWeight, n - i );
+  }
+#endif
+
+  //! Pick the widest kernel this CPU can run
+  AccumulateFn SelectAccumulateKernel( const char **name )
+  {
+#ifdef MU_UNIVERSE_STORE_X86_KERNELS
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx512f" ) )
+    {
+      *name = "avx512";
+      return &AccumulateAVX512;
+    }
+    if( __builtin_cpu_supports( "avx2" ) )
+    {
+      *name = "avx2";
+      return &AccumulateAVX2;
+    }
+#endif
+    *name = "scalar";
+    return &AccumulateScalar;
+  }
+
+  const char *gAccumulateKernelName = "scalar";
+}
+
+void MUUniverseStore::Accumulate( double *sumw, double *sumw2, const double *weights, const double applyWeight, const unsigned int n )
+{
+  //! Chosen on first use, so fills from static initializers elsewhere are safe too
+  static const AccumulateFn accumulate = SelectAccumulateKernel( &gAccumulateKernelName );
+  accumulate( sumw, sumw2, weights, applyWeight, n );
+}
+
+const char* MUUniverseStore::GetAccumulateKernelName()
+{
+  //! Make sure the selection has happened
+  Accumulate( 0, 0, 0, 0., 0 );
+  return gAccumulateKernelName;
+}
+
+void MUUniverseStore::AtomicAdd( double *target, const double value )
+{
+#if __cplusplus >= 202002L
+  std::atomic_ref<double>( *target ).fetch_add( value, std::memory_order_relaxed );
+#elif defined(__GNUC__)
+  //! Retry until no other thread changed the value between our load and our store
+  double expected;
+  __atomic_load( target, &expected, __ATOMIC_RELAXED );
+  double desired = expected + value;
+  while( !__atomic_compare_exchange( target, &expected, &desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED ) )
+    desired = expected + value;
+#else
+  *target += value;
+#endif
+}
+
+//======================================================================
+// Divide and Multiply kernels
+//======================================================================
+namespace
+{
+  /*! w = op( b1, b2 ) and w2 its squared error, element by element, for n elements.
+      e1sq and e2sq are the squared errors of b1 and b2.  w may be b1 or b2: each element is read before it is written.
+      */
+  typedef void (*BinaryRowFn)( double*, double*, const double*, const double*, const double*, const double*, double, double, size_t );
+
+  //! (c1*b1)/(c2*b2) with the errors of TH1::Divide, 0 where b2 is 0.  Written without branches, so it vectorizes.
+  void DivideScalar( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const size_t n )
+  {
+    const double c1sq = c1*c1;
+    const double absC2 = fabs( c2 );
+    for( size_t i = 0; i != n; ++i )
+    {
+      const double x1 = b1[i], s1 = e1sq[i], x2 = b2[i], s2 = e2sq[i];
+      const bool nonzero = ( x2 != 0. );
+      const double x22 = x2*x2*absC2;
+      w[i]  = nonzero ? (c1*x1)/(c2*x2) : 0.;
+      w2[i] = nonzero ? c1sq*(s1*x2*x2 + s2*x1*x1)/(x22*x22) : 0.;
+    }
+  }
+
+  //! As DivideScalar, with the binomial errors of TH1::Divide option "B"
+  void BinomialDivideScalar( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const size_t n )
+  {
+    for( size_t i = 0; i != n; ++i )
+    {
+      const double x1 = b1[i], s1 = e1sq[i], x2 = b2[i], s2 = e2sq[i];
+      const bool nonzero = ( x2 != 0. );
+      const double x2sq = x2*x2;
+      w[i]  = nonzero ? (c1*x1)/(c2*x2) : 0.;
+      w2[i] = ( nonzero && x1 != x2 ) ? fabs( ( (1. - 2.*x1/x2)*s1 + x1*x1*s2/x2sq ) / x2sq ) : 0.;
+    }
+  }
+
+  //! c1*b1*c2*b2 with the errors of TH1::Multiply
+  void MultiplyScalar( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const size_t n )
+  {
+    const double c1c2sq = (c1*c1)*(c2*c2);
+    for( size_t i = 0; i != n; ++i )
+    {
+      const double x1 = b1[i], s1 = e1sq[i], x2 = b2[i], s2 = e2sq[i];
+      w[i]  = c1*x1*c2*x2;
+      w2[i] = c1c2sq*(s1*x2*x2 + s2*x1*x1);
+    }
+  }
+
+#ifdef MU_UNIVERSE_STORE_X86_KERNELS
+  //! DivideScalar four elements at a time, in the same order of operations so the results have the same bits
+  __attribute__((target("avx2")))
+  void DivideAVX2( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const size_t n )
+  {
+    const __m256d vc1 = _mm256_set1_pd( c1 ), vc2 = _mm256_set1_pd( c2 );
+    const __m256d vc1sq = _mm256_set1_pd( c1*c1 ), vAbsC2 = _mm256_set1_pd( fabs( c2 ) );
+    const __m256d zero = _mm256_setzero_pd();
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 )
+    {
+      const __m256d x1 = _mm256_loadu_pd( b1 + i ), s1 = _mm256_loadu_pd( e1sq + i );
+      const __m256d x2 = _mm256_loadu_pd( b2 + i ), s2 = _mm256_loadu_pd( e2sq + i );
+      const __m256d nonzero = _mm256_cmp_pd( x2, zero, _CMP_NEQ_UQ );
+      const __m256d x22 = _mm256_mul_pd( _mm256_mul_pd( x2, x2 ), vAbsC2 );
+      const __m256d q = _mm256_div_pd( _mm256_mul_pd( vc1, x1 ), _mm256_mul_pd( vc2, x2 ) );
+      const __m256d num = _mm256_add_pd( _mm256_mul_pd( _mm256_mul_pd( s1, x2 ), x2 ), _mm256_mul_pd( _mm256_mul_pd( s2, x1 ), x1 ) );
+      const __m256d var = _mm256_div_pd( _mm256_mul_pd( vc1sq, num ), _mm256_mul_pd( x22, x22 ) );
+      _mm256_storeu_pd( w + i,  _mm256_and_pd( nonzero, q ) );
+      _mm256_storeu_pd( w2 + i, _mm256_and_pd( nonzero, var ) );
+    }
+    DivideScalar( w + i, w2 + i, b1 + i, e1sq + i, b2 + i, e2sq + i, c1, c2, n - i );
+  }
+
+  //! BinomialDivideScalar four elements at a time
+  __attribute__((target("avx2")))
+  void BinomialDivideAVX2( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const size_t n )
+  {
+    const __m256d vc1 = _mm256_set1_pd( c1 ), vc2 = _mm256_set1_pd( c2 );
+    const __m256d zero = _mm256_setzero_pd(), one = _mm256_set1_pd( 1. ), two = _mm256_set1_pd( 2. );
+    const __m256d signBit = _mm256_set1_pd( -0. );
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 )
+    {
+      const __m256d x1 = _mm256_loadu_pd( b1 + i ), s1 = _mm256_loadu_pd( e1sq + i );
+      const __m256d x2 = _mm256_loadu_pd( b2 + i ), s2 = _mm256_loadu_pd( e2sq + i );
+      const __m256d nonzero = _mm256_cmp_pd( x2, zero, _CMP_NEQ_UQ );
+      const __m256d differ  = _mm256_and_pd( nonzero, _mm256_cmp_pd( x1, x2, _CMP_NEQ_UQ ) );
+      const __m256d x2sq = _mm256_mul_pd( x2, x2 );
+      const __m256d q = _mm256_div_pd( _mm256_mul_pd( vc1, x1 ), _mm256_mul_pd( vc2, x2 ) );
+      const __m256d t1 = _mm256_mul_pd( _mm256_sub_pd( one, _mm256_div_pd( _mm256_mul_pd( two, x1 ), x2 ) ), s1 );
+      const __m256d t2 = _mm256_div_pd( _mm256_mul_pd( _mm256_mul_pd( x1, x1 ), s2 ), x2sq );
+      const __m256d var = _mm256_andnot_pd( signBit, _mm256_div_pd( _mm256_add_pd( t1, t2 ), x2sq ) );
+      _mm256_storeu_pd( w + i,  _mm256_and_pd( nonzero, q ) );
+      _mm256_storeu_pd( w2 + i, _mm256_and_pd( differ, var ) );
+    }
+    BinomialDivideScalar( w + i, w2 + i, b1 + i, e1sq + i, b2 + i, e2sq + i, c1, c2, n - i );
+  }
+
+  //! MultiplyScalar four elements at a time
+  __attribute__((target("avx2")))
+  void MultiplyAVX2( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const size_t n )
+  {
+    const __m256d vc1 = _mm256_set1_pd( c1 ), vc2 = _mm256_set1_pd( c2 );
+    const __m256d vc1c2sq = _mm256_set1_pd( (c1*c1)*(c2*c2) );
+    size_t i = 0;
+    for( ; i + 4 <= n; i += 4 )
+    {
+      const __m256d x1 = _mm256_loadu_pd( b1 + i ), s1 = _mm256_loadu_pd( e1sq + i );
+      const __m256d x2 = _mm256_loadu_pd( b2 + i ), s2 = _mm256_loadu_pd( e2sq + i );
+      const __m256d prod = _mm256_mul_pd( _mm256_mul_pd( _mm256_mul_pd( vc1, x1 ), vc2 ), x2 );
+      const __m256d num = _mm256_add_pd( _mm256_mul_pd( _mm256_mul_pd( s1, x2 ), x2 ), _mm256_mul_pd( _mm256_mul_pd( s2, x1 ), x1 ) );
+      _mm256_storeu_pd( w + i,  prod );
+      _mm256_storeu_pd( w2 + i, _mm256_mul_pd( vc1c2sq, num ) );
+    }
+    MultiplyScalar( w + i, w2 + i, b1 + i, e1sq + i, b2 + i, e2sq + i, c1, c2, n - i );
+  }
+#endif
+
+  //! The Divide/Multiply kernels for this CPU
+  struct BinaryKernels
+  {
+    BinaryRowFn divide;
+    BinaryRowFn binomialDivide;
+    BinaryRowFn multiply;
+  };
+
+  BinaryKernels SelectBinaryKernels()
+  {
+    BinaryKernels k;
+    k.divide = &DivideScalar;
+    k.binomialDivide = &BinomialDivideScalar;
+    k.multiply = &MultiplyScalar;
+#ifdef MU_UNIVERSE_STORE_X86_KERNELS
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) )
+    {
+      k.divide = &DivideAVX2;
+      k.binomialDivide = &BinomialDivideAVX2;
+      k.multiply = &MultiplyAVX2;
+    }
+#endif
+    return k;
+  }
+
+  const BinaryKernels& GetBinaryKernels()
+  {
+    static const BinaryKernels kernels = SelectBinaryKernels();
+    return kernels;
+  }
+
+  /*! Contents and squared errors of a histogram with nBins global bins, the squared errors as TH1::GetBinError
+      gives them (|content| without Sumw2).  False if the binning does not match.
+      */
+  bool ReadHist( const TH1* h, const unsigned int nBins, std::vector<double>& contents, std::vector<double>& errors2 )
+  {
+    if( (unsigned int)h->GetNcells() != nBins )
+      return false;
+    const TArrayD *array = dynamic_cast<const TArrayD*>( h );
+    const TArrayD *sumw2 = h->GetSumw2();
+    contents.resize( nBins );
+    errors2.resize( nBins );
+    for( unsigned int bin = 0; bin != nBins; ++bin )
+    {
+      contents[bin] = array ? array->fArray[bin] : h->GetBinContent( bin );
+      errors2[bin]  = sumw2->fN ? sumw2->fArray[bin] : fabs( contents[bin] );
+    }
+    return true;
+  }
+}
+
+//======================================================================
+// Covariance kernels
+//======================================================================
+namespace
+{
+  const unsigned int kCovTile  = 64;  //!< Bins per tile side
+  const unsigned int kCovChunk = 256; //!< Universes per pass, so that two tiles' rows stay in L2
+
+  unsigned int gNCovarianceThreads = 0;
+
+  //! out[a*4+b] += x_a . y_b over n universes for 2 rows x and 4 rows y
+  void Dot2x4Scalar( const double *x0, const double *x1, const double *y0, const double *y1, const double *y2, const double *y3, const unsigned int n, double *out )
+  {
+    double c00 = 0., c01 = 0., c02 = 0., c03 = 0., c10 = 0., c11 = 0., c12 = 0., c13 = 0.;
+    for( unsigned int u = 0; u != n; ++u )
+    {
+      c00 += x0[u]*y0[u]; c01 += x0[u]*y1[u]; c02 += x0[u]*y2[u]; c03 += x0[u]*y3[u];
+      c10 += x1[u]*y0[u]; c11 += x1[u]*y1[u]; c12 += x1[u]*y2[u]; c13 += x1[u]*y3[u];
+    }
+    out[0] += c00; out[1] += c01; out[2] += c02; out[3] += c03;
+    out[4] += c10; out[5] += c11; out[6] += c12; out[7] += c13;
+  }
+
+#ifdef MU_UNIVERSE_STORE_X86_KERNELS
+  __attribute__((target("avx2,fma")))
+  inline double HorizontalSum( const __m256d v )
+  {
+    const __m128d s = _mm_add_pd( _mm256_castpd256_pd128( v ), _mm256_extractf128_pd( v, 1 ) );
+    return _mm_cvtsd_f64( _mm_add_sd( s, _mm_unpackhi_pd( s, s ) ) );
+  }
+
+  //! Dot2x4Scalar four universes at a time.  8 accumulators + 4 rows of y + 1 of x fit in the 16 AVX2 registers.
+  __attribute__((target("avx2,fma")))
+  void Dot2x4AVX2( const double *x0, const double *x1, const double *y0, const double *y1, const double *y2, const double *y3, const unsigned int n, double *out )
+  {
+    __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd(), c02 = _mm256_setzero_pd(), c03 = _mm256_setzero_pd();
+    __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd(), c12 = _mm256_setzero_pd(), c13 = _mm256_setzero_pd();
+    unsigned int u = 0;
+    for( ; u + 4 <= n; u += 4 )
+    {
+      const __m256d b0 = _mm256_loadu_pd( y0 + u ), b1 = _mm256_loadu_pd( y1 + u );
+      const __m256d b2 = _mm256_loadu_pd( y2 + u ), b3 = _mm256_loadu_pd( y3 + u );
+      __m256d a = _mm256_loadu_pd( x0 + u );
+      c00 = _mm256_fmadd_pd( a, b0, c00 ); c01 = _mm256_fmadd_pd( a, b1, c01 );
+      c02 = _mm256_fmadd_pd( a, b2, c02 ); c03 = _mm256_fmadd_pd( a, b3, c03 );
+      a = _mm256_loadu_pd( x1 + u );
+      c10 = _mm256_fmadd_pd( a, b0, c10 ); c11 = _mm256_fmadd_pd( a, b1, c11 );
+      c12 = _mm256_fmadd_pd( a, b2, c12 ); c13 = _mm256_fmadd_pd( a, b3, c13 );
+    }
+    out[0] += HorizontalSum( c00 ); out[1] += HorizontalSum( c01 ); out[2] += HorizontalSum( c02 ); out[3] += HorizontalSum( c03 );
+    out[4] += HorizontalSum( c10 ); out[5] += HorizontalSum( c11 ); out[6] += HorizontalSum( c12 ); out[7] += HorizontalSum( c13 );
+    Dot2x4Scalar( x0 + u, x1 + u, y0 + u, y1 + u, y2 + u, y3 + u, n - u, out );
+  }
+#endif
+
+  typedef void (*Dot2x4Fn)( const double*, const double*, const double*, const double*, const double*, const double*, unsigned int, double* );
+
+  Dot2x4Fn SelectDot2x4Kernel()
+  {
+#ifdef MU_UNIVERSE_STORE_X86_KERNELS
+    __builtin_cpu_init();
+    if( __builtin_cpu_supports( "avx2" ) && __builtin_cpu_supports( "fma" ) )
+      return &Dot2x4AVX2;
+#endif
+    return &Dot2x4Scalar;
+  }
+
+  /*! The upper triangle of x x^T, one pair of tiles at a time.
+    x is nBins x nUniverses, row-major, and so is cov (nBins x nBins, zeroed by the caller).
+    Each tile of cov is written by one thread only, so the sums do not depend on the number of threads.
+    */
+  struct SyrkJob
+  {
+    const double *x;
+    double *cov;
+    unsigned int nBins;
+    unsigned int nUniverses;
+    std::vector< std::pair<unsigned int, unsigned int> > tiles; //!< (first row, first column) of every tile on or above the diagonal
+
+    //! Tiles t, t+stride, t+2*stride, ...
+    void Run( const unsigned int first, const unsigned int stride ) const
+    {
+      static const Dot2x4Fn dot2x4 = SelectDot2x4Kernel();
+      for( unsigned int t = first; t < tiles.size(); t += stride )
+      {
+        const unsigned int i0 = tiles[t].first,  i1 = std::min( i0 + kCovTile, nBins );
+        const unsigned int k0 = tiles[t].second, k1 = std::min( k0 + kCovTile, nBins );
+        for( unsigned int u0 = 0; u0 < nUniverses; u0 += kCovChunk )
+        {
+          const unsigned int nu = std::min( kCovChunk, nUniverses - u0 );
+          for( unsigned int i = i0; i < i1; i += 2 )
+          {
+            //! Odd rows and columns at the tile edge repeat the last one, and their results are dropped
+            const double *x0 = x + (size_t)i*nUniverses + u0;
+            const double *x1 = ( i+1 < i1 ) ? x0 + nUniverses : x0;
+            for( unsigned int k = k0; k < k1; k += 4 )
+            {
+              const double *y[4];
+              for( unsigned int b = 0; b != 4; ++b )
+                y[b] = x + (size_t)std::min( k+b, k1-1 )*nUniverses + u0;
+
+              double out[8] = {0.};
+              dot2x4( x0, x1, y[0], y[1], y[2], y[3], nu, out );
+              for( unsigned int a = 0; a != 2 && i+a < i1; ++a )
+                for( unsigned int b = 0; b != 4 && k+b < k1; ++b )
+                  cov[ (size_t)(i+a)*nBins + k+b ] += out[a*4+b];
+            }
+          }
+        }
+      }
+    }
+  };
+
+#if __cplusplus >= 201103L
+  void RunSyrkJob( const SyrkJob *job, const unsigned int first, const unsigned int stride )
+  {
+    job->Run( first, stride );
+  }
+#endif
+}
+
+//======================================================================
+// MUUniverseStore
+//======================================================================
+
+MUUniverseStore::MUUniverseStore( ) :
+  fNBins(0),
+  fNUniverses(0),
+  fBuffers( new Buffers )
+{ }
+
+MUUniverseStore::MUUniverseStore( const unsigned int nBins, const unsigned int nUniverses ) :
+  fNBins(0),
+  fNUniverses(0),
+  fBuffers( new Buffers )
+{
+  Resize( nBins, nUniverses );
+}
+
+MUUniverseStore::MUUniverseStore( const MUUniverseStore& other ) :
+  fNBins( other.fNBins ),
+  fNUniverses( other.fNUniverses ),
+  fBuffers( other.fBuffers )
+{
+  ++fBuffers->fRefs;
+}
+
+MUUniverseStore& MUUniverseStore::operator=( const MUUniverseStore& other )
+{
+  //! Take the new reference first, so assigning a store sharing our buffers never frees them
+  ++other.fBuffers->fRefs;
+  Release( fBuffers );
+  fBuffers = other.fBuffers;
+  fNBins = other.fNBins;
+  fNUniverses = other.fNUniverses;
+  return *this;
+}
+
+MUUniverseStore::~MUUniverseStore()
+{
+  Release( fBuffers );
+}
+
+bool MUUniverseStore::IsShared() const
+{
+#if __cplusplus >= 201103L
+  return 1 < fBuffers->fRefs.load( std::memory_order_acquire );
+#else
+  return 1 < fBuffers->fRefs;
+#endif
+}
+
+void MUUniverseStore::Unshare()
+{
+  Buffers *own = new Buffers;
+  own->fSumw  = fBuffers->fSumw;
+  own->fSumw2 = fBuffers->fSumw2;
+  Release( fBuffers );
+  fBuffers = own;
+}
+
+MUUniverseStore::Buffers* MUUniverseStore::DetachForOverwrite()
+{
+  if( !IsShared() )
+    return 0;
+
+  Buffers *old = fBuffers;
+  fBuffers = new Buffers;
+  fBuffers->fSumw.resize( old->fSumw.size() );
+  fBuffers->fSumw2.resize( old->fSumw2.size() );
+  return old;
+}
+
+void MUUniverseStore::Release( Buffers* buffers )
+{
+  if( !buffers )
+    return;
+#if __cplusplus >= 201103L
+  if( 1 == buffers->fRefs.fetch_sub( 1, std::memory_order_acq_rel ) )
+#else
+  if( 0 == --buffers->fRefs )
+#endif
+    delete buffers;
+}
+
+void MUUniverseStore::BeforeWriting()
+{
+  Detach();
+  fSumw.swap( fBuffers->fSumw );
+  fSumw2.swap( fBuffers->fSumw2 );
+}
+
+void MUUniverseStore::AfterStreaming()
+{
+  //! Whatever was read replaces the contents, so there is nothing to copy from shared buffers
+  if( IsShared() )
+  {
+    Release( fBuffers );
+    fBuffers = new Buffers;
+  }
+  fBuffers->fSumw.swap( fSumw );
+  fBuffers->fSumw2.swap( fSumw2 );
+  std::vector<double>().swap( fSumw );
+  std::vector<double>().swap( fSumw2 );
+}
+
+void MUUniverseStore::Resize( const unsigned int nBins, const unsigned int nUniverses )
+{
+  //! Everything is overwritten, so shared buffers are replaced rather than copied
+  if( IsShared() )
+  {
+    Release( fBuffers );
+    fBuffers = new Buffers;
+  }
+  fNBins = nBins;
+  fNUniverses = nUniverses;
+  fBuffers->fSumw.assign( (size_t)nBins * nUniverses, 0. );
+  fBuffers->fSumw2.assign( (size_t)nBins * nUniverses, 0. );
+}
+
+void MUUniverseStore::Swap( MUUniverseStore& other )
+{
+  std::swap( fNBins, other.fNBins );
+  std::swap( fNUniverses, other.fNUniverses );
+  std::swap( fBuffers, other.fBuffers );
+}
+
+void MUUniverseStore::SetBinContent( const int bin, const unsigned int universe, const double content, const double error2 )
+{
+  Detach();
+  const size_t i = (size_t)bin * fNUniverses + universe;
+  fBuffers->fSumw[i]  = content;
+  fBuffers->fSumw2[i] = error2;
+}
+
+void MUUniverseStore::Fill( const int bin, const double *weights, const double applyWeight /* = 1. */ )
+{
+  Accumulate( GetSumwRow( bin ), GetSumw2Row( bin ), weights, applyWeight, fNUniverses );
+}
+
+void MUUniverseStore::FillBatch( const unsigned int nEvents, const int *bins, const double *weights, const double *applyWeights /* = 0 */ )
+{
+  //! Sort (bin, event) pairs so each bin's row is loaded once and stays in cache while its events are added.
+  //! Ties are broken by event index, so events in one bin are added in the order they came.
+  std::vector< std::pair<int, unsigned int> > order( nEvents );
+  for( unsigned int i = 0; i != nEvents; ++i )
+    order[i] = std::make_pair( bins[i], i );
+  std::sort( order.begin(), order.end() );
+
+  for( unsigned int j = 0; j != nEvents; ++j )
+  {
+    const unsigned int i = order[j].second;
+    Accumulate( GetSumwRow( order[j].first ), GetSumw2Row( order[j].first ), weights + (size_t)i * fNUniverses, applyWeights ? applyWeights[i] : 1., fNUniverses );
+  }
+}
+
+void MUUniverseStore::Fill( const int bin, const unsigned int universe, const double weight )
+{
+  Detach();
+  const size_t i = (size_t)bin * fNUniverses + universe;
+  fBuffers->fSumw[i]  += weight;
+  fBuffers->fSumw2[i] += weight*weight;
+}
+
+void MUUniverseStore::FillAtomic( const int bin, const double *weights, const double applyWeight /* = 1. */ )
+{
+  double *sumw  = GetSumwRow( bin );
+  double *sumw2 = GetSumw2Row( bin );
+  for( unsigned int i = 0; i != fNUniverses; ++i )
+  {
+    const double w = weights[i]*applyWeight;
+    AtomicAdd( sumw + i, w );
+    AtomicAdd( sumw2 + i, w*w );
+  }
+}
+
+void MUUniverseStore::FillAtomic( const int bin, const unsigned int universe, const double weight )
+{
+  Detach();
+  const size_t i = (size_t)bin * fNUniverses + universe;
+  AtomicAdd( &fBuffers->fSumw[i], weight );
+  AtomicAdd( &fBuffers->fSumw2[i], weight*weight );
+}
+
+void MUUniverseStore::Reset()
+{
+  Release( DetachForOverwrite() );
+  std::fill( fBuffers->fSumw.begin(), fBuffers->fSumw.end(), 0. );
+  std::fill( fBuffers->fSumw2.begin(), fBuffers->fSumw2.end(), 0. );
+}
+
+void MUUniverseStore::Scale( const double c1, const bool scaleSumw2 /* = true */ )
+{
+  Detach();
+  std::vector<double>& sumw = fBuffers->fSumw;
+  for( std::vector<double>::iterator i = sumw.begin(); i != sumw.end(); ++i )
+    *i *= c1;
+
+  if( !scaleSumw2 )
+    return;
+
+  const double c1sq = c1*c1;
+  std::vector<double>& sumw2 = fBuffers->fSumw2;
+  for( std::vector<double>::iterator i = sumw2.begin(); i != sumw2.end(); ++i )
+    *i *= c1sq;
+}
+
+void MUUniverseStore::ScaleBins( const std::vector<double>& factors, const bool scaleSumw2 /* = true */ )
+{
+  if( factors.size() != fNBins )
+  {
+    Error( "MUUniverseStore::ScaleBins", "Got %d scale factors for %d bins.  Not scaling.", (int)factors.size(), fNBins );
+    return;
+  }
+
+  for( unsigned int bin = 0; bin != fNBins; ++bin )
+  {
+    const double c = factors[bin];
+    double *sumw  = GetSumwRow( bin );
+    double *sumw2 = GetSumw2Row( bin );
+    for( unsigned int i = 0; i != fNUniverses; ++i )
+      sumw[i] *= c;
+    if( scaleSumw2 )
+    {
+      for( unsigned int i = 0; i != fNUniverses; ++i )
+        sumw2[i] *= c*c;
+    }
+  }
+}
+
+bool MUUniverseStore::Add( const MUUniverseStore& other, const double c1 /* = 1. */ )
+{
+  if( other.fNBins != fNBins || other.fNUniverses != fNUniverses )
+  {
+    Error( "MUUniverseStore::Add", "Attempt to add stores with different shapes ( %d x %d and %d x %d )", fNBins, fNUniverses, other.fNBins, other.fNUniverses );
+    return false;
+  }
+
+  Detach();
+  std::vector<double>& sumw = fBuffers->fSumw;
+  std::vector<double>& sumw2 = fBuffers->fSumw2;
+  const std::vector<double>& otherSumw = other.fBuffers->fSumw;
+  const std::vector<double>& otherSumw2 = other.fBuffers->fSumw2;
+  const double c1sq = c1*c1;
+  for( size_t i = 0; i != sumw.size(); ++i )
+  {
+    sumw[i]  += c1   * otherSumw[i];
+    sumw2[i] += c1sq * otherSumw2[i];
+  }
+  return true;
+}
+
+bool MUUniverseStore::AddToAll( const TH1* h1, const double c1 /* = 1. */ )
+{
+  if( (unsigned int)h1->GetNcells() != fNBins )
+  {
+    Error( "MUUniverseStore::AddToAll", "Attempt to add histogram %s with %d bins to universes with %d bins", h1->GetName(), h1->GetNcells(), fNBins );
+    return false;
+  }
+
+  std::vector<double> contents, errors2;
+  ReadHist( h1, fNBins, contents, errors2 );
+
+  const double c1sq = c1*c1;
+  for( unsigned int bin = 0; bin != fNBins; ++bin )
+  {
+    const double content = c1 * contents[bin];
+    const double error2 = c1sq * errors2[bin];
+    double *sumw  = GetSumwRow( bin );
+    double *sumw2 = GetSumw2Row( bin );
+    for( unsigned int i = 0; i != fNUniverses; ++i )
+    {
+      sumw[i]  += content;
+      sumw2[i] += error2;
+    }
+  }
+  return true;
+}
+
+bool MUUniverseStore::Divide( const MUUniverseStore& h1, const MUUniverseStore& h2, const double c1 /* = 1. */, const double c2 /* = 1. */, const bool binomial /* = false */ )
+{
+  if( h1.fNBins != fNBins || h1.fNUniverses != fNUniverses || h2.fNBins != fNBins || h2.fNUniverses != fNUniverses )
+  {
+    Error( "MUUniverseStore::Divide", "Attempt to divide stores with different shapes ( %d x %d, %d x %d and %d x %d )", fNBins, fNUniverses, h1.fNBins, h1.fNUniverses, h2.fNBins, h2.fNUniverses );
+    return false;
+  }
+  if( c2 == 0. )
+  {
+    Error( "MUUniverseStore::Divide", "Coefficient of dividing histogram cannot be zero" );
+    return false;
+  }
+  if( IsEmpty() )
+    return true;
+
+  //! Every element is overwritten, so shared buffers are not copied first.  Either operand may be the old buffers.
+  const double *b1 = &h1.fBuffers->fSumw[0], *e1sq = &h1.fBuffers->fSumw2[0];
+  const double *b2 = &h2.fBuffers->fSumw[0], *e2sq = &h2.fBuffers->fSumw2[0];
+  Buffers *old = DetachForOverwrite();
+
+  //! Every element is independent, so the whole [bin][universe] buffers go through the kernel in one call
+  DivideArrays( &fBuffers->fSumw[0], &fBuffers->fSumw2[0], b1, e1sq, b2, e2sq, c1, c2, binomial, fBuffers->fSumw.size() );
+  Release( old );
+  return true;
+}
+
+bool MUUniverseStore::Divide( const MUUniverseStore& h1, const TH1* h2, const double c1 /* = 1. */, const double c2 /* = 1. */, const bool binomial /* = false */ )
+{
+  std::vector<double> contents, errors2;
+  if( h1.fNBins != fNBins || h1.fNUniverses != fNUniverses || !ReadHist( h2, fNBins, contents, errors2 ) )
+  {
+    Error( "MUUniverseStore::Divide", "Attempt to divide a store of %d x %d by histogram %s with %d bins into a store of %d x %d", h1.fNBins, h1.fNUniverses, h2->GetName(), h2->GetNcells(), fNBins, fNUniverses );
+    return false;
+  }
+  if( c2 == 0. )
+  {
+    Error( "MUUniverseStore::Divide", "Coefficient of dividing histogram cannot be zero" );
+    return false;
+  }
+
+  if( IsEmpty() )
+    return true;
+
+  //! Every element is overwritten, so shared buffers are not copied first.  h1 may be the old buffers.
+  const double *b1 = &h1.fBuffers->fSumw[0], *e1sq = &h1.fBuffers->fSumw2[0];
+  Buffers *old = DetachForOverwrite();
+
+  //! Spread each bin of h2 over a row, then divide the row of all universes at once
+  std::vector<double> den( fNUniverses ), den2( fNUniverses );
+  for( unsigned int bin = 0; bin != fNBins && fNUniverses; ++bin )
+  {
+    const size_t row = (size_t)bin * fNUniverses;
+    std::fill( den.begin(), den.end(), contents[bin] );
+    std::fill( den2.begin(), den2.end(), errors2[bin] );
+    DivideArrays( GetSumwRow( bin ), GetSumw2Row( bin ), b1 + row, e1sq + row, &den[0], &den2[0], c1, c2, binomial, fNUniverses );
+  }
+  Release( old );
+  return true;
+}
+
+bool MUUniverseStore::Multiply( const MUUniverseStore& h1, const MUUniverseStore& h2, const double c1 /* = 1. */, const double c2 /* = 1. */ )
+{
+  if( h1.fNBins != fNBins || h1.fNUniverses != fNUniverses || h2.fNBins != fNBins || h2.fNUniverses != fNUniverses )
+  {
+    Error( "MUUniverseStore::Multiply", "Attempt to multiply stores with different shapes ( %d x %d, %d x %d and %d x %d )", fNBins, fNUniverses, h1.fNBins, h1.fNUniverses, h2.fNBins, h2.fNUniverses );
+    return false;
+  }
+  if( IsEmpty() )
+    return true;
+
+  const double *b1 = &h1.fBuffers->fSumw[0], *e1sq = &h1.fBuffers->fSumw2[0];
+  const double *b2 = &h2.fBuffers->fSumw[0], *e2sq = &h2.fBuffers->fSumw2[0];
+  Buffers *old = DetachForOverwrite();
+
+  MultiplyArrays( &fBuffers->fSumw[0], &fBuffers->fSumw2[0], b1, e1sq, b2, e2sq, c1, c2, fBuffers->fSumw.size() );
+  Release( old );
+  return true;
+}
+
+bool MUUniverseStore::Multiply( const MUUniverseStore& h1, const TH1* h2, const double c1 /* = 1. */, const double c2 /* = 1. */ )
+{
+  std::vector<double> contents, errors2;
+  if( h1.fNBins != fNBins || h1.fNUniverses != fNUniverses || !ReadHist( h2, fNBins, contents, errors2 ) )
+  {
+    Error( "MUUniverseStore::Multiply", "Attempt to multiply a store of %d x %d by histogram %s with %d bins into a store of %d x %d", h1.fNBins, h1.fNUniverses, h2->GetName(), h2->GetNcells(), fNBins, fNUniverses );
+    return false;
+  }
+
+  if( IsEmpty() )
+    return true;
+
+  const double *b1 = &h1.fBuffers->fSumw[0], *e1sq = &h1.fBuffers->fSumw2[0];
+  Buffers *old = DetachForOverwrite();
+
+  std::vector<double> fac( fNUniverses ), fac2( fNUniverses );
+  for( unsigned int bin = 0; bin != fNBins && fNUniverses; ++bin )
+  {
+    const size_t row = (size_t)bin * fNUniverses;
+    std::fill( fac.begin(), fac.end(), contents[bin] );
+    std::fill( fac2.begin(), fac2.end(), errors2[bin] );
+    MultiplyArrays( GetSumwRow( bin ), GetSumw2Row( bin ), b1 + row, e1sq + row, &fac[0], &fac2[0], c1, c2, fNUniverses );
+  }
+  Release( old );
+  return true;
+}
+
+void MUUniverseStore::DivideArrays( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const bool binomial, const size_t n )
+{
+  const BinaryKernels& k = GetBinaryKernels();
+  ( binomial ? k.binomialDivide : k.divide )( w, w2, b1, e1sq, b2, e2sq, c1, c2, n );
+}
+
+void MUUniverseStore::MultiplyArrays( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const size_t n )
+{
+  GetBinaryKernels().multiply( w, w2, b1, e1sq, b2, e2sq, c1, c2, n );
+}
+
+bool MUUniverseStore::IsBinomialOption( const char* option )
+{
+  //! The same test TH1::Divide makes
+  TString opt( option );
+  opt.ToLower();
+  return opt.Contains( "b" );
+}
+
+bool MUUniverseStore::ImportHist( const unsigned int universe, const TH1* h )
+{
+  if( (unsigned int)h->GetNcells() != fNBins || fNUniverses <= universe )
+  {
+    Error( "MUUniverseStore::ImportHist", "Cannot import histogram %s with %d bins as universe %d of %d universes with %d bins", h->GetName(), h->GetNcells(), universe, fNUniverses, fNBins );
+    return false;
+  }
+
+  //! TH1D, TH2D and TH3D keep their contents in a TArrayD, so read it directly when we can
+  const TArrayD *contents = dynamic_cast<const TArrayD*>( h );
+  const TArrayD *sumw2 = h->GetSumw2();
+  for( unsigned int bin = 0; bin != fNBins; ++bin )
+  {
+    const double content = contents ? contents->fArray[bin] : h->GetBinContent( bin );
+    const double error2  = sumw2->fN ? sumw2->fArray[bin] : fabs( content );
+    SetBinContent( bin, universe, content, error2 );
+  }
+  return true;
+}
+
+bool MUUniverseStore::ExportHist( const unsigned int universe, TH1* h ) const
+{
+  if( (unsigned int)h->GetNcells() != fNBins || fNUniverses <= universe )
+  {
+    Error( "MUUniverseStore::ExportHist", "Cannot export universe %d of %d universes with %d bins to histogram %s with %d bins", universe, fNUniverses, fNBins, h->GetName(), h->GetNcells() );
+    return false;
+  }
+
+  if( 0 == h->GetSumw2N() )
+    h->Sumw2();
+
+  TArrayD *contents = dynamic_cast<TArrayD*>( h );
+  TArrayD *sumw2 = h->GetSumw2();
+  for( unsigned int bin = 0; bin != fNBins; ++bin )
+  {
+    if( contents )
+      contents->fArray[bin] = GetBinContent( bin, universe );
+    else
+      h->SetBinContent( bin, GetBinContent( bin, universe ) );
+    sumw2->fArray[bin] = GetBinError2( bin, universe );
+  }
+
+  //! Recompute the statistics from the new contents, so the view draws and reports like a filled histogram
+  h->ResetStats();
+  return true;
+}
+
+std::vector<double> MUUniverseStore::GetWidthScaleFactors( const TH1* h, const double c1 /* = 1. */ )
+{
+  //! Mirrors TH1::Scale(c1,"width"), which divides every bin (including under/overflow) by its width, area or volume
+  const int nbinsx = h->GetNbinsX() + 2;
+  const int nbinsy = ( 1 < h->GetDimension() ) ? h->GetNbinsY() + 2 : 1;
+  const int nbinsz = ( 2 < h->GetDimension() ) ? h->GetNbinsZ() + 2 : 1;
+
+  std::vector<double> factors( h->GetNcells(), c1 );
+  for( int binz = 0; binz < nbinsz; ++binz )
+  {
+    const double wz = ( 2 < h->GetDimension() ) ? h->GetZaxis()->GetBinWidth( binz ) : 1.;
+    for( int biny = 0; biny < nbinsy; ++biny )
+    {
+      const double wy = ( 1 < h->GetDimension() ) ? h->GetYaxis()->GetBinWidth( biny ) : 1.;
+      for( int binx = 0; binx < nbinsx; ++binx )
+      {
+        const double wx = h->GetXaxis()->GetBinWidth( binx );
+        factors[ h->GetBin( binx, biny, binz ) ] = c1 / ( wx*wy*wz );
+      }
+    }
+  }
+  return factors;
+}
+
+std::vector<double> MUUniverseStore::GetIntegrals( const TH1* h ) const
+{
+  //! Same bins as TH1::Integral(): the axis ranges, without under/overflow
+  const int firstx = h->GetXaxis()->GetFirst(), lastx = h->GetXaxis()->GetLast();
+  const int firsty = ( 1 < h->GetDimension() ) ? h->GetYaxis()->GetFirst() : 0;
+  const int lasty  = ( 1 < h->GetDimension() ) ? h->GetYaxis()->GetLast()  : 0;
+  const int firstz = ( 2 < h->GetDimension() ) ? h->GetZaxis()->GetFirst() : 0;
+  const int lastz  = ( 2 < h->GetDimension() ) ? h->GetZaxis()->GetLast()  : 0;
+
+  std::vector<double> integrals( fNUniverses, 0. );
+  for( int binz = firstz; binz <= lastz; ++binz )
+  {
+    for( int biny = firsty; biny <= lasty; ++biny )
+    {
+      for( int binx = firstx; binx <= lastx; ++binx )
+      {
+        const double *row = GetSumwRow( h->GetBin( binx, biny, binz ) );
+        for( unsigned int u = 0; u != fNUniverses; ++u )
+          integrals[u] += row[u];
+      }
+    }
+  }
+  return integrals;
+}
+
+std::vector<double> MUUniverseStore::GetAreaNormScales( const TH1* cv, const bool positiveOnly /* = false */ ) const
+{
+  const double cvArea = cv->Integral();
+  std::vector<double> scales = GetIntegrals( cv );
+  for( unsigned int u = 0; u != fNUniverses; ++u )
+  {
+    const bool scale = positiveOnly ? ( 0. < scales[u] ) : ( scales[u] != 0. );
+    scales[u] = scale ? cvArea / scales[u] : 1.;
+  }
+  return scales;
+}
+
+void MUUniverseStore::CalcCovariance( double *cov, const double *scales /* = 0 */, const double *mean /* = 0 */ ) const
+{
+  const unsigned int nBins = fNBins;
+  const unsigned int nUniverses = fNUniverses;
+  std::fill( cov, cov + (size_t)nBins*nBins, 0. );
+  if( 0 == nUniverses )
+    return;
+
+  //! Centered (and scaled) copy: x_ij = scales_j * content_ij - mean_i
+  std::vector<double> x( fBuffers->fSumw.size() );
+  for( unsigned int i = 0; i != nBins; ++i )
+  {
+    const double *row = GetSumwRow( i );
+    double *xrow = &x[ (size_t)i*nUniverses ];
+    double sum = 0.;
+    for( unsigned int u = 0; u != nUniverses; ++u )
+    {
+      xrow[u] = scales ? scales[u]*row[u] : row[u];
+      sum += xrow[u];
+    }
+    const double m = mean ? mean[i] : sum / nUniverses;
+    for( unsigned int u = 0; u != nUniverses; ++u )
+      xrow[u] -= m;
+  }
+
+#ifdef MU_USE_CBLAS
+  cblas_dsyrk( CblasRowMajor, CblasUpper, CblasNoTrans, nBins, nUniverses, 1./nUniverses, &x[0], nUniverses, 0., cov, nBins );
+  for( unsigned int i = 0; i != nBins; ++i )
+    for( unsigned int k = i+1; k < nBins; ++k )
+      cov[ (size_t)k*nBins + i ] = cov[ (size_t)i*nBins + k ];
+#else
+  SyrkJob job;
+  job.x = &x[0];
+  job.cov = cov;
+  job.nBins = nBins;
+  job.nUniverses = nUniverses;
+  for( unsigned int i0 = 0; i0 < nBins; i0 += kCovTile )
+    for( unsigned int k0 = i0; k0 < nBins; k0 += kCovTile )
+      job.tiles.push_back( std::make_pair( i0, k0 ) );
+
+  //! Threads only pay off once there are a few tens of millions of multiply-adds to share.
+  //! A task pool is already using the cores when this runs inside one of its tasks.
+  unsigned int nThreads = 1;
+#if __cplusplus >= 201103L
+  const double work = 0.5 * nBins * (double)nBins * nUniverses;
+  if( 2e7 < work && 1 < job.tiles.size() && !MUTaskPool::IsWorkerThread() )
+  {
+    nThreads = gNCovarianceThreads ? gNCovarianceThreads : std::thread::hardware_concurrency();
+    nThreads = std::max( 1u, std::min( nThreads, (unsigned int)job.tiles.size() ) );
+  }
+  if( 1 < nThreads )
+  {
+    std::vector<std::thread> threads;
+    for( unsigned int t = 1; t < nThreads; ++t )
+      threads.push_back( std::thread( RunSyrkJob, &job, t, nThreads ) );
+    job.Run( 0, nThreads );
+    for( unsigned int t = 0; t != threads.size(); ++t )
+      threads[t].join();
+  }
+  else
+#endif
+    job.Run( 0, nThreads );
+
+  //! Divide by the number of universes and mirror the upper triangle
+  const double norm = 1. / nUniverses;
+  for( unsigned int i = 0; i != nBins; ++i )
+  {
+    cov[ (size_t)i*nBins + i ] *= norm;
+    for( unsigned int k = i+1; k < nBins; ++k )
+    {
+      const double c = cov[ (size_t)i*nBins + k ] * norm;
+      cov[ (size_t)i*nBins + k ] = c;
+      cov[ (size_t)k*nBins + i ] = c;
+    }
+  }
+#endif
+}
+
+void MUUniverseStore::CalcVariance( double *var, const double *scales /* = 0 */, const double *mean /* = 0 */ ) const
+{
+  const unsigned int nUniverses = fNUniverses;
+  std::fill( var, var + fNBins, 0. );
+  if( 0 == nUniverses )
+    return;
+
+  for( unsigned int i = 0; i != fNBins; ++i )
+  {
+    const double *row = GetSumwRow( i );
+    double m = 0.;
+    if( mean )
+      m = mean[i];
+    else
+    {
+      for( unsigned int u = 0; u != nUniverses; ++u )
+        m += scales ? scales[u]*row[u] : row[u];
+      m /= nUniverses;
+    }
+
+    double sum = 0.;
+    for( unsigned int u = 0; u != nUniverses; ++u )
+    {
+      const double x = ( scales ? scales[u]*row[u] : row[u] ) - m;
+      sum += x*x;
+    }
+    var[i] = sum / nUniverses;
+  }
+}
+
+void MUUniverseStore::SetNCovarianceThreads( const unsigned int n )
+{
+  gNCovarianceThreads = n;
+}
+
+#endif
@@ -0,0 +1,261 @@
+#ifndef MNV_MUUniverseStore_H
+#define MNV_MUUniverseStore_H 1
+
+#include "Rtypes.h"
+
+#include <vector>
+#if __cplusplus >= 201103L
+#include <atomic>
+#endif
+
+class TH1;
+
+namespace PlotUtils
+{
+
+	/*! @brief Contiguous storage for the universes of an error band.
+
+		The sum of weights and the sum of squared weights of every universe are kept in two
+		flat buffers laid out as [bin][universe], so that all universes of one bin are
+		adjacent in memory.  A fill touches a single row instead of one TH1 per universe.
+
+		Bins use ROOT's global bin numbering, including under/overflow, so the same store
+		serves the 1D, 2D and 3D error bands.
+
+		Copies share the buffers (copy-on-write): copying a store, and so a band or a whole
+		MUH1D, costs no universe copy.  The first change to one of the copies gives it its own
+		buffers, so only the bands that are actually modified are ever duplicated.  Reading a
+		shared store from many threads is safe, and so is changing different copies on
+		different threads, but one store must still not be changed by two threads at once.
+		*/
+	class MUUniverseStore
+	{
+		public:
+			//! Default constructor (empty store)
+			MUUniverseStore( );
+
+			/*! Standard constructor
+				@param[in] nBins Number of global bins, including under/overflow (TH1::GetNcells)
+				@param[in] nUniverses Number of universes
+				*/
+			MUUniverseStore( const unsigned int nBins, const unsigned int nUniverses );
+
+			//! Copy constructor: shares the buffers of other until either store is changed
+			MUUniverseStore( const MUUniverseStore& other );
+
+			//! Assignment: shares the buffers of other until either store is changed
+			MUUniverseStore& operator=( const MUUniverseStore& other );
+
+			~MUUniverseStore();
+
+			//! Reshape the store and set all contents to zero
+			void Resize( const unsigned int nBins, const unsigned int nUniverses );
+
+			//! Exchange shape and contents with another store without copying any universe
+			void Swap( MUUniverseStore& other );
+
+			//! Number of global bins, including under/overflow
+			unsigned int GetNBins() const { return fNBins; };
+
+			//! Number of universes
+			unsigned int GetNUniverses() const { return fNUniverses; };
+
+			//! Is anything allocated?
+			bool IsEmpty() const { return fBuffers->fSumw.empty(); };
+
+			//! Does this store share its buffers with a copy?
+			bool IsShared() const;
+
+			//! Give this store its own buffers if it shares them, e.g. before handing it to threads that fill it with FillAtomic
+			void Detach() { if( IsShared() ) Unshare(); };
+
+			//! Pointer to the sum of weights of all universes in a bin (const)
+			const double* GetSumwRow( const int bin ) const { return &fBuffers->fSumw[ (size_t)bin * fNUniverses ]; };
+
+			//! Pointer to the sum of weights of all universes in a bin (nonconst).  Detaches a shared store.
+			double* GetSumwRow( const int bin ) { Detach(); return &fBuffers->fSumw[ (size_t)bin * fNUniverses ]; };
+
+			//! Pointer to the sum of squared weights of all universes in a bin (const)
+			const double* GetSumw2Row( const int bin ) const { return &fBuffers->fSumw2[ (size_t)bin * fNUniverses ]; };
+
+			//! Pointer to the sum of squared weights of all universes in a bin (nonconst).  Detaches a shared store.
+			double* GetSumw2Row( const int bin ) { Detach(); return &fBuffers->fSumw2[ (size_t)bin * fNUniverses ]; };
+
+			//! Content of a universe in a bin
+			double GetBinContent( const int bin, const unsigned int universe ) const { return fBuffers->fSumw[ (size_t)bin * fNUniverses + universe ]; };
+
+			//! Squared error of a universe in a bin
+			double GetBinError2( const int bin, const unsigned int universe ) const { return fBuffers->fSumw2[ (size_t)bin * fNUniverses + universe ]; };
+
+			//! Set the content and squared error of a universe in a bin
+			void SetBinContent( const int bin, const unsigned int universe, const double content, const double error2 );
+
+			/*! Add weights[i]*applyWeight to universe i of a bin for all universes
+				@param[in] bin Global bin to fill
+				@param[in] weights Array of one weight per universe
+				@param[in] applyWeight Common factor applied to all weights
+				*/
+			void Fill( const int bin, const double *weights, const double applyWeight = 1. );
+
+			/*! Fill many events at once.  Events are accumulated grouped by bin, in their original order within a bin,
+				so the result is identical to calling Fill for each event in turn.
+				@param[in] nEvents Number of events
+				@param[in] bins Global bin of each event
+				@param[in] weights nEvents x nUniverses weights, one row per event
+				@param[in] applyWeights Common factor for each event's weights (or NULL for 1)
+				*/
+			void FillBatch( const unsigned int nEvents, const int *bins, const double *weights, const double *applyWeights = 0 );
+
+			//! Add a weight to a single universe in a bin
+			void Fill( const int bin, const unsigned int universe, const double weight );
+
+			//! Fill( bin, weights, applyWeight ) that is safe when many threads fill the same store at once.  The store must not be shared (see Detach).
+			void FillAtomic( const int bin, const double *weights, const double applyWeight = 1. );
+
+			//! Fill( bin, universe, weight ) that is safe when many threads fill the same store at once.  The store must not be shared (see Detach).
+			void FillAtomic( const int bin, const unsigned int universe, const double weight );
+
+			//! Set all contents to zero, keeping the shape
+			void Reset();
+
+			//! Scale all universes by a constant (sumw2 by its square unless scaleSumw2 is false)
+			void Scale( const double c1, const bool scaleSumw2 = true );
+
+			//! Scale each bin of all universes by its own factor (sumw2 by its square unless scaleSumw2 is false)
+			void ScaleBins( const std::vector<double>& factors, const bool scaleSumw2 = true );
+
+			//! Add c1 times another store of the same shape
+			bool Add( const MUUniverseStore& other, const double c1 = 1. );
+
+			//! Add c1 times a histogram to every universe (its squared errors are its sumw2, or |content| without Sumw2)
+			bool AddToAll( const TH1* h1, const double c1 = 1. );
+
+			/*! Set every universe to (c1*h1)/(c2*h2) of the same universes of two stores of this shape, with the
+				errors TH1::Divide gives (binomial ones if binomial, like option "B").  Bins where h2 is 0 become 0.
+				Either store may be this one.  Works on all universes of a bin at once, with AVX2 when the CPU has it.
+				*/
+			bool Divide( const MUUniverseStore& h1, const MUUniverseStore& h2, const double c1 = 1., const double c2 = 1., const bool binomial = false );
+
+			//! As Divide, but every universe of h1 is divided by the same histogram h2
+			bool Divide( const MUUniverseStore& h1, const TH1* h2, const double c1 = 1., const double c2 = 1., const bool binomial = false );
+
+			//! Set every universe to c1*h1 times c2*h2, with the errors TH1::Multiply gives.  Either store may be this one.
+			bool Multiply( const MUUniverseStore& h1, const MUUniverseStore& h2, const double c1 = 1., const double c2 = 1. );
+
+			//! As Multiply, but every universe of h1 is multiplied by the same histogram h2
+			bool Multiply( const MUUniverseStore& h1, const TH1* h2, const double c1 = 1., const double c2 = 1. );
+
+			//! Does a TH1::Divide option ask for binomial errors ("B", in any case)?
+			static bool IsBinomialOption( const char* option );
+
+			//! Copy the contents and errors of a histogram into one universe
+			bool ImportHist( const unsigned int universe, const TH1* h );
+
+			//! Copy one universe into the contents and errors of a histogram with the same binning
+			bool ExportHist( const unsigned int universe, TH1* h ) const;
+
+			/*! Sum of each universe over the bins TH1::Integral() uses: the axis ranges of h, without under/overflow
+				@param[in] h Histogram defining the binning and ranges
+				*/
+			std::vector<double> GetIntegrals( const TH1* h ) const;
+
+			/*! Factors that bring each universe to the area of the CV
+				@param[in] cv Central value histogram whose area the universes are scaled to
+				@param[in] positiveOnly Scale only universes with a positive area (the rule of MUVertErrorBand); otherwise any universe with a non-zero area is scaled
+				@return One factor per universe, 1 for a universe that is not scaled
+				*/
+			std::vector<double> GetAreaNormScales( const TH1* cv, const bool positiveOnly = false ) const;
+
+			/*! Covariance of the universes between all pairs of bins, C_ik = sum_j (x_ij - m_i)(x_kj - m_k) / nUniverses,
+				where x_ij is scales[j] times the content of universe j in bin i and m_i is the mean of x_ij over universes.
+
+				This is a symmetric rank-nUniverses update of the centered bins x universes matrix.  It is computed
+				in cache-sized tiles, with AVX2/FMA when the CPU has them, and on several threads for big matrices
+				(unless called from a MUTaskPool task).
+				Built with -DMU_USE_CBLAS, it calls cblas_dsyrk instead.
+				@param[out] cov nBins x nBins, row-major, e.g. TMatrixD::GetMatrixArray()
+				@param[in] scales One factor per universe, or NULL for no scaling
+				@param[in] mean Subtract this in each bin instead of the mean of the universes (NULL for their mean)
+				*/
+			void CalcCovariance( double *cov, const double *scales = 0, const double *mean = 0 ) const;
+
+			/*! Just the diagonal of CalcCovariance, the variance of each bin over universes, in O(nBins * nUniverses)
+				@param[out] var nBins values
+				@param[in] scales,mean As for CalcCovariance
+				*/
+			void CalcVariance( double *var, const double *scales = 0, const double *mean = 0 ) const;
+
+			//! How many threads CalcCovariance may use.  0, the default, means one per core.
+			static void SetNCovarianceThreads( const unsigned int n );
+
+			/*! Get the factors TH1::Scale(c1,"width") applies to each global bin of a histogram
+				@param[in] h Histogram defining the binning
+				@param[in] c1 Overall scale
+				*/
+			static std::vector<double> GetWidthScaleFactors( const TH1* h, const double c1 = 1. );
+
+			/*! Add weights[i]*applyWeight to sumw[i] and its square to sumw2[i] for i < n.
+				Uses AVX-512 or AVX2 when the CPU supports them (checked once at load time), a scalar loop otherwise.
+				*/
+			static void Accumulate( double *sumw, double *sumw2, const double *weights, const double applyWeight, const unsigned int n );
+
+			//! Which Accumulate kernel was selected for this CPU ("avx512", "avx2" or "scalar")
+			static const char* GetAccumulateKernelName();
+
+			/*! w[i] = (c1*b1[i])/(c2*b2[i]) for i < n, and w2[i] its squared error as TH1::Divide computes it from the
+				squared errors e1sq and e2sq (binomial errors if binomial).  The kernel of Divide, AVX2 when the CPU has it.
+				w and w2 may be the same arrays as b1 and e1sq, or b2 and e2sq.
+				*/
+			static void DivideArrays( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const bool binomial, const size_t n );
+
+			//! w[i] = c1*b1[i]*c2*b2[i] for i < n, with the squared errors of TH1::Multiply.  The kernel of Multiply.
+			static void MultiplyArrays( double *w, double *w2, const double *b1, const double *e1sq, const double *b2, const double *e2sq, const double c1, const double c2, const size_t n );
+
+			/*! *target += value as one atomic step, so concurrent adds to the same double are never lost.
+				A compare-and-swap loop (std::atomic_ref with C++20).  Only one thread may add at a time on compilers with neither.
+				*/
+			static void AtomicAdd( double *target, const double value );
+
+			/*! Put the contents in the persistent members, for ROOT to write.  Call AfterStreaming when done.
+				Only the Streamers of the error bands need this.
+				*/
+			void BeforeWriting();
+
+			//! Take the contents back from the persistent members after ROOT has read or written them
+			void AfterStreaming();
+
+		private:
+			//! The buffers of a store and all copies sharing them
+			struct Buffers
+			{
+				Buffers() : fRefs(1) {};
+				std::vector<double> fSumw;  ///< Sum of weights, [bin][universe]
+				std::vector<double> fSumw2; ///< Sum of squared weights, [bin][universe]
+#if __cplusplus >= 201103L
+				std::atomic<unsigned int> fRefs; ///< Number of stores sharing these buffers
+#else
+				unsigned int fRefs;              ///< Number of stores sharing these buffers
+#endif
+			};
+
+			//! Give this store a copy of the shared buffers
+			void Unshare();
+
+			/*! Before overwriting every element: if the buffers are shared, switch to new ones of the same size without copying.
+				@return The old buffers, still referenced so the caller can read them, to Release when done (NULL if not shared)
+				*/
+			Buffers* DetachForOverwrite();
+
+			//! Drop one reference to buffers, deleting them with the last one
+			static void Release( Buffers* buffers );
+
+			unsigned int fNBins;        ///< Number of global bins, including under/overflow
+			unsigned int fNUniverses;   ///< Number of universes
+			std::vector<double> fSumw;  ///< Sum of weights, [bin][universe].  Only holds the contents while ROOT reads or writes them.
+			std::vector<double> fSumw2; ///< Sum of squared weights, [bin][universe].  Only holds the contents while ROOT reads or writes them.
+			Buffers *fBuffers;          //!< The contents, possibly shared with copies
+	}; //end of MUUniverseStore
+
+} //end of PlotUtils
+
+#endif
@@ -9,6 +9,11 @@
 #include "TMatrixD.h"
 #include "TMatrixDBase.h"
 
+#include "PlotUtils/MUUniverseStore.h"
+#include "PlotUtils/MUCovarianceCache.h"
+#include "PlotUtils/MULowRankCovariance.h"
+#include "PlotUtils/MURebinMap.h"
+
 #include <assert.h>
 #include <vector>
 #include <string>
@@ -33,7 +38,7 @@ namespace PlotUtils
 	{
 		public:
 			//! Default constructor 
-			MUVertErrorBand( ) : TH1D() {};
+			MUVertErrorBand( ) : TH1D(), fNHists(0), fUseSpreadError(false), fViewsCurrent(false), fViewsModified(false) {};
 
 			/*! Standard constructor 
 				@param[in] name Name the error band
@@ -51,10 +56,23 @@ namespace PlotUtils
 			//! Deep assignment operator
 			MUVertErrorBand& operator=( const MUVertErrorBand& h );
 
+#if __cplusplus >= 201103L
+			//! Move constructor: takes the bins and universes of h instead of copying them, leaving h with none
+			MUVertErrorBand( MUVertErrorBand&& h ) noexcept;
+
+			//! Move assignment operator, as the move constructor
+			MUVertErrorBand& operator=( MUVertErrorBand&& h ) noexcept;
+#endif
+
 		private:
 			//! A helper function which sets variables for the deep copy and assignment
 			void DeepCopy( const MUVertErrorBand& h );
 
+#if __cplusplus >= 201103L
+			//! A helper function which takes the variables of h for the move constructor and assignment
+			void MoveFrom( MUVertErrorBand& h );
+#endif
+
 		public:
 
 			/*! Quiet warnings about hidden overloaded virtual functions.
@@ -66,12 +84,24 @@ namespace PlotUtils
 			using TH1::Fill;
 			using TH1::Multiply;
 
-			//!Destructor (note: root cleans up histograms for us)
-			virtual ~MUVertErrorBand() {};
+			//! Destructor (deletes the materialized universe views)
+			virtual ~MUVertErrorBand();
+
+			//! Rename the error band and any materialized universe views
+			virtual void SetName( const char *name );
 
 			//! Fill the CV histo and all the universes' histos
 			virtual Int_t Fill( const double val, const double *weights, const double cvweight = 1., double cvWeightFromMe = 1.);
 
+			/*! Fill the CV histo and all the universes' histos in a bin the caller already found
+				@param[in] cvbin Global bin of val, as given by FindBin on a histogram with the same binning
+				@param[in] val Central value to fill (used for the statistics)
+				@param[in] weights Array of one weight per universe
+				@param[in] cvweight Central value weight
+				@param[in] cvWeightFromMe Part of cvweight that came from this error source
+				*/
+			Int_t FillAtBin( const int cvbin, const double val, const double *weights, const double cvweight = 1., double cvWeightFromMe = 1. );
+
 			/*! Fill the CV histo and 2 universes with these weights
 				Only works if nUniverses = 2 (assumed to be +/- nSigma)
 				@param[in] val Central value to fill
@@ -82,6 +112,15 @@ namespace PlotUtils
 				*/
 			virtual Int_t Fill( const double val, const double weightDown, const double weightUp, const double cvweight = 1.0, double cvWeightFromMe = 1. );
 
+			/*! Fill the CV histo and all universes for many events at once
+				@param[in] nEvents Number of events
+				@param[in] vals Values to fill, one per event
+				@param[in] weights nEvents x nUniverses weights, one row of universe weights per event
+				@param[in] cvweights Central value weight of each event (NULL for 1)
+				@param[in] cvWeightsFromMe Part of each CV weight that came from this error source (NULL for 1)
+				*/
+			bool FillBatch( const unsigned int nEvents, const double *vals, const double *weights, const double *cvweights = 0, const double *cvWeightsFromMe = 0 );
+
 			//! Get the error band histogram
 			virtual TH1D GetErrorBand( bool asFrac = false , bool cov_area_normalize = false) const;
 
@@ -89,13 +128,13 @@ namespace PlotUtils
 			bool GetUseSpreadError() const { return fUseSpreadError; };
 
 			//! Set the error band to come from max spread or standard dev
-			void SetUseSpreadError( bool use ) { fUseSpreadError = use; };
+			void SetUseSpreadError( bool use ) { fUseSpreadError = use; fCacheVersion.Touch(); };
 
 			//! How many histograms (universes) does this have?
 			unsigned int GetNHists() const { return fNHists; };
 
-			//! Get the universes' histograms (const)
-			const std::vector<TH1D*>& GetHists() const { return fHists; };
+			//! Get the universes' histograms (const).  These are views materialized from the universe store on demand.
+			const std::vector<TH1D*>& GetHists() const;
 
 			//! Get a specific universe's histogram (const)
 			const TH1D* GetHist(const unsigned int i) const;
@@ -103,8 +142,14 @@ namespace PlotUtils
 			//! Get a specific universe's histogram (nonconst)
 			TH1D* GetHist(const unsigned int i);
 
-			//! Get the universes' histograms (nonconst)
-			std::vector<TH1D*> GetHists() { return fHists; };
+			//! Get the universes' histograms (nonconst).  Changes made through them are picked up by the next operation on the band.
+			std::vector<TH1D*> GetHists();
+
+			//! Get the contiguous storage of all universes (const)
+			const MUUniverseStore& GetUniverseStore() const;
+
+			//! Get the contiguous storage of all universes (nonconst).  Materialized views are refreshed from it on next use.
+			MUUniverseStore& GetUniverseStore();
 		public:
 
 			//! Draw all the histograms, including CVHist if the option is present
@@ -135,9 +180,14 @@ namespace PlotUtils
 			//! Add h1*c1 to this error band
 			Bool_t Add( const MUVertErrorBand* h1, const Double_t c1 = 1. );
 
-			//! Rebin this error band
+			/*! Rebin this error band as TH1::Rebin: groups of ngroup bins, or ngroup bins with edges xbins.
+				With a newname a rebinned copy is returned and this band is left alone.
+				*/
       TH1* Rebin(Int_t ngroup = 2, const char* newname = "", const Double_t* xbins = 0);
 
+			//! Rebin the central value and all universes with a map made for this binning, false if it does not fit
+			bool ApplyRebinMap( const MURebinMap& map );
+
 			//! Reset all histograms known to this error band
 			void Reset( Option_t *option = "" );
 
@@ -147,21 +197,73 @@ namespace PlotUtils
 			void SetBit(UInt_t f) { SetBit(f, true); };
 
 
-			//! Calculate Covariance Matrix
+			/*! Calculate Covariance Matrix
+				With area_normalize, each universe is scaled to the area of the CV on the fly; the band is never modified,
+				so shape-only and absolute matrices can be computed from several threads on the same band.
+				*/
 			TMatrixD CalcCovMx(bool area_normalize = false, bool asFrac = false) const;
 
+			//! Get just the diagonal of CalcCovMx, the variance of each bin, in O(nHists * nBins)
+			std::vector<double> CalcVariance( bool area_normalize = false, bool asFrac = false ) const;
+
+			/*! The same covariance as CalcCovMx, kept as its universes instead of an nBins x nBins matrix.
+				Use it for binnings where CalcCovMx would not fit in memory.
+				*/
+			MULowRankCovariance CalcLowRankCovMx( bool area_normalize = false, bool asFrac = false ) const;
+
+			//! Stamp that changes whenever the CV, the universes or the error mode change.  CalcCovMx results are cached against it.
+			ULong64_t GetCacheVersion() const;
+
+			//! Hits and misses of the CalcCovMx cache
+			MUCovarianceCache::Stats GetCovCacheStats() const { return fCovCache.GetStats(); };
+
+			/*! Get quantiles of the universes' contents in one bin, e.g. { 0.16, 0.5, 0.84 }.
+				Found by selection in O(nHists) each (see MUHist::GetQuantiles), without sorting.
+				@param[in] bin Global bin
+				@param[in] q Fractions in [0,1]
+				*/
+			std::vector<double> GetBinQuantiles( const int bin, const std::vector<double>& q ) const;
+
 			//! Calculate Correlation Matrix
 			TMatrixD CalcCorrMx(bool area_normalize = false) const;
 
 		protected:
 			unsigned int fNHists;         ///< Number of histograms (universes)
 			bool fUseSpreadError;         ///< Are we using spread in histos to get the error
-			std::vector<TH1D*> fHists;    ///< Vector of histograms for the universes
+			std::vector<TH1D*> fHists;    ///< Universe histograms as written before version 4.  Only filled while reading old files, then moved into fUniverses.
 			std::vector<int> fGoodColors; ///< Current list of good colors to use for universe histos
+			MUUniverseStore fUniverses;   ///< Contiguous [bin][universe] contents and sumw2 of all universes
+
+			mutable std::vector<TH1D*> fUniverseViews; //!< TH1D views of the universes, materialized on demand
+			mutable bool fViewsCurrent;                //!< Do the views reflect the current contents of fUniverses?
+			mutable bool fViewsModified;               //!< Were the views handed out nonconst, so fUniverses may be behind them?
+			mutable MUCacheVersion fCacheVersion;      //!< Stamp of the last change, for the caches
+			mutable MUCovarianceCache fCovCache;       //!< CalcCovMx results by variant
 
 		private:
-			//!define a class named MUVertErrorBand, at version 3 
-			ClassDef( MUVertErrorBand, 3 ); //Create a systematic error band and covariance matrix using the many universes method where universes are defined by different weights
+			//! Bring fUniverses up to date with views that were handed out nonconst
+			void SyncUniverses() const { if( fViewsModified ) ImportUniverses(); };
+
+			//! Copy old-style hists or modified views into fUniverses
+			void ImportUniverses() const;
+
+			//! Create or refresh the TH1D views of the universes
+			void MaterializeViews() const;
+
+			//! Delete the TH1D views of the universes
+			void DeleteViews() const;
+
+			//! Calculate the covariance matrix, bypassing the cache
+			TMatrixD ComputeCovMx( bool area_normalize, bool asFrac ) const;
+
+			//! Spread of each bin over universes (times scales) and the CV, for spread errors
+			std::vector<double> CalcSpreads( const std::vector<double>& scales ) const;
+
+			//! Do what TH1D::Fill( val, w ) does to the CV histo, in a bin we already know
+			void FillCVAtBin( const int bin, const double val, const double w );
+
+			//!define a class named MUVertErrorBand, at version 4
+			ClassDef( MUVertErrorBand, 4 ); //Create a systematic error band and covariance matrix using the many universes method where universes are defined by different weights
 	}; //end of MUVertErrorBand
 
 } //end of PlotUtils
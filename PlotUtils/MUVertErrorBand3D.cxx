@@ -3,19 +3,24 @@
 
 #include "PlotUtils/MUVertErrorBand3D.h"
 #include "HistogramUtils.h"
+#include "PlotUtils/MUTaskPool.h"
 #include <algorithm>
 
+#include <TDirectory.h>
+#include <TBuffer.h>
+
 using namespace PlotUtils;
 
 
 MUVertErrorBand3D::MUVertErrorBand3D( const std::string& name, const TH3D* base, const unsigned int nHists /* = 1000 */ ) :
-	TH3D( *base )
+	TH3D( *base ),
+	fViewsCurrent(false),
+	fViewsModified(false)
 {
 	SetName( name.c_str() );
 	SetTitle( name.c_str() );
 
-	fNHists = nHists; 
-	char tmpName[256];
+	fNHists = nHists;
 
 	//set the good colors
 	if( fGoodColors.size() == 0 )
@@ -29,19 +34,8 @@ MUVertErrorBand3D::MUVertErrorBand3D( const std::string& name, const TH3D* base,
 			fGoodColors.push_back( i );
 	}
 
-	for( unsigned int i = 0; i < fNHists; i++ )
-	{
-		sprintf(tmpName, "%s_universe%d", name.c_str(), i );
-		TH3D *tmp = new TH3D( *base );
-		tmp->Reset();
-		tmp->SetName(tmpName);
-
-		//give the universe histos a style and color
-		tmp->SetLineColor( fGoodColors[ i % fGoodColors.size() ] );
-		tmp->SetLineStyle( i % 10 + 1 );
-
-		fHists.push_back( tmp );
-	}
+	//! All universes start out empty in one contiguous block
+	fUniverses.Resize( GetNcells(), fNHists );
 
 	if( nHists < 10 )
 		fUseSpreadError = true;
@@ -51,14 +45,15 @@ MUVertErrorBand3D::MUVertErrorBand3D( const std::string& name, const TH3D* base,
 }
 
 MUVertErrorBand3D::MUVertErrorBand3D( const std::string& name, const TH3D* base, const std::vector<TH3D*>& hists ) :
-	TH3D (*base)
+	TH3D (*base),
+	fViewsCurrent(false),
+	fViewsModified(false)
 {
 
 	SetName( name.c_str() );
 	SetTitle( name.c_str() );
 
 	fNHists = hists.size();
-	char tmpName[256];
 
 	//set the good colors
 	if( fGoodColors.size() == 0 )
@@ -72,20 +67,12 @@ MUVertErrorBand3D::MUVertErrorBand3D( const std::string& name, const TH3D* base,
 			fGoodColors.push_back( i );
 	}
 
+	fUniverses.Resize( GetNcells(), fNHists );
+
 	std::vector<TH3D*>::const_iterator it = hists.begin();
 	int it_pos = 0;
 	for( ; it != hists.end(); ++it, ++it_pos )
-	{
-		sprintf(tmpName, "%s_universe%d", name.c_str(), it_pos );
-		TH3D *tmp = new TH3D( **it );
-		tmp->SetName(tmpName);
-
-		//give the universe histos a style and color
-		tmp->SetLineColor( fGoodColors[ it_pos % fGoodColors.size() ] );
-		tmp->SetLineStyle( it_pos % 10 + 1 );
-
-		fHists.push_back( tmp );
-	}
+		fUniverses.ImportHist( it_pos, *it );
 
 	if( fNHists < 10 )
 		fUseSpreadError = true;
@@ -95,7 +82,9 @@ MUVertErrorBand3D::MUVertErrorBand3D( const std::string& name, const TH3D* base,
 }
 
 MUVertErrorBand3D::MUVertErrorBand3D( const MUVertErrorBand3D& h ) :
-	TH3D( h )
+	TH3D( h ),
+	fViewsCurrent(false),
+	fViewsModified(false)
 {
 	//!Deep copy the variables
 	DeepCopy( h );
@@ -110,8 +99,9 @@ MUVertErrorBand3D& MUVertErrorBand3D::operator=( const MUVertErrorBand3D& h )
 	//! Call the base class's assignment
 	TH3D::operator=(h);
 
-	//! Delete and clear the hists vector
-	for( unsigned int i = 0; i < h.fNHists; ++i )
+	//! Delete the views and any old-style hists
+	DeleteViews();
+	for( unsigned int i = 0; i < fHists.size(); ++i )
 		delete fHists[i];
 	fHists.clear();
 	fGoodColors.clear();
@@ -121,12 +111,69 @@ MUVertErrorBand3D& MUVertErrorBand3D::operator=( const MUVertErrorBand3D& h )
 	return *this;
 }
 
+#if __cplusplus >= 201103L
+MUVertErrorBand3D::MUVertErrorBand3D( MUVertErrorBand3D&& h ) noexcept :
+	TH3D(),
+	fViewsCurrent(false),
+	fViewsModified(false)
+{
+	//! Take the bins and the universes instead of copying them
+	MUHist::MoveHistogram( *this, h );
+	MoveFrom( h );
+}
+
+MUVertErrorBand3D& MUVertErrorBand3D::operator=( MUVertErrorBand3D&& h ) noexcept
+{
+	//! If this is me, there is nothing to move
+	if( this == &h )
+		return *this;
+
+	//! Take the bins of h
+	MUHist::MoveHistogram( *this, h );
+
+	//! Delete the views and any old-style hists
+	DeleteViews();
+	for( unsigned int i = 0; i < fHists.size(); ++i )
+		delete fHists[i];
+	fHists.clear();
+
+	MoveFrom( h );
+
+	return *this;
+}
+
+void MUVertErrorBand3D::MoveFrom( MUVertErrorBand3D& h )
+{
+	fUseSpreadError = h.GetUseSpreadError();
+	fNHists = h.fNHists;
+	fGoodColors.swap( h.fGoodColors );
+
+	//! The universes, their views and any old-style hists change hands as they are
+	fUniverses.Swap( h.fUniverses );
+	fUniverseViews.swap( h.fUniverseViews );
+	fHists.swap( h.fHists );
+	fViewsCurrent = h.fViewsCurrent;
+	fViewsModified = h.fViewsModified;
+	fCacheVersion.Touch();
+
+	//! Leave h a valid band without universes
+	h.fNHists = 0;
+	h.DeleteViews();
+	MUUniverseStore().Swap( h.fUniverses );
+	h.fCacheVersion.Touch();
+}
+#endif
+
 void MUVertErrorBand3D::DeepCopy( const MUVertErrorBand3D& h )
 {
 	fUseSpreadError = h.GetUseSpreadError();
 	fNHists = h.fNHists;
-	for( unsigned int i = 0; i < fNHists; ++i )
-		fHists.push_back( new TH3D(*h.GetHist(i)) );
+
+	//! The copy shares the buffers of the universes until one of the bands changes them
+	fUniverses = h.GetUniverseStore();
+	fViewsCurrent = false;
+	fViewsModified = false;
+	fCacheVersion.Touch();
 
 	//set the good colors
 	if( fGoodColors.size() == 0 )
@@ -141,6 +188,119 @@ void MUVertErrorBand3D::DeepCopy( const MUVertErrorBand3D& h )
 	}
 }
 
+MUVertErrorBand3D::~MUVertErrorBand3D()
+{
+	DeleteViews();
+	for( unsigned int i = 0; i < fHists.size(); ++i )
+		delete fHists[i];
+}
+
+void MUVertErrorBand3D::SetName( const char *name )
+{
+	this->TH3D::SetName( name );
+
+	//! Keep the universe views named after the band
+	for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+		fUniverseViews[i]->SetName( Form( "%s_universe%d", GetName(), i ) );
+}
+
+void MUVertErrorBand3D::Streamer( TBuffer &b )
+{
+	if( b.IsReading() )
+	{
+		b.ReadClassBuffer( MUVertErrorBand3D::Class(), this );
+		fUniverses.AfterStreaming();
+		fCacheVersion.Touch();
+
+		//! Files written before version 2 hold the universes as TH3Ds
+		if( !fHists.empty() )
+			ImportUniverses();
+	}
+	else
+	{
+		//! Make sure changes made through views are written
+		SyncUniverses();
+		//! The universes may be shared with copies, so they are only in the persistent members while written
+		fUniverses.BeforeWriting();
+		b.WriteClassBuffer( MUVertErrorBand3D::Class(), this );
+		fUniverses.AfterStreaming();
+	}
+}
+
+void MUVertErrorBand3D::ImportUniverses() const
+{
+	MUQueryLock lock;
+
+	//! The universes are logically part of this band's state, whichever form they currently live in
+	MUVertErrorBand3D *self = const_cast<MUVertErrorBand3D*>( this );
+
+	//! A band read from a file written before version 2 has its universes as TH3Ds
+	if( !fHists.empty() )
+	{
+		self->fUniverses.Resize( GetNcells(), fHists.size() );
+		for( unsigned int i = 0; i < fHists.size(); ++i )
+		{
+			self->fUniverses.ImportHist( i, fHists[i] );
+			delete fHists[i];
+		}
+		self->fHists.clear();
+		fViewsCurrent = false;
+		fCacheVersion.Touch();
+	}
+
+	//! Views handed out nonconst may have been changed
+	if( fViewsModified )
+	{
+		for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+			self->fUniverses.ImportHist( i, fUniverseViews[i] );
+		fViewsModified = false;
+		fCacheVersion.Touch();
+		fViewsCurrent = true;
+	}
+}
+
+void MUVertErrorBand3D::MaterializeViews() const
+{
+	//! Const queries on several threads may get here at once
+	MUQueryLock lock;
+
+	//! Views handed out nonconst hold the latest state themselves
+	if( fViewsModified || fViewsCurrent )
+		return;
+
+	if( fUniverseViews.size() != fNHists )
+	{
+		DeleteViews();
+		TDirectory::TContext detached( gDirectory, 0 ); //views are owned by the band, not a directory
+		for( unsigned int i = 0; i < fNHists; ++i )
+		{
+			TH3D *view = new TH3D( *this );
+			view->SetName( Form( "%s_universe%d", GetName(), i ) );
+
+			//give the universe histos a style and color
+			if( !fGoodColors.empty() )
+				view->SetLineColor( fGoodColors[ i % fGoodColors.size() ] );
+			view->SetLineStyle( i % 10 + 1 );
+
+			fUniverseViews.push_back( view );
+		}
+	}
+
+	for( unsigned int i = 0; i < fNHists; ++i )
+		fUniverses.ExportHist( i, fUniverseViews[i] );
+
+	fViewsCurrent = true;
+}
+
+void MUVertErrorBand3D::DeleteViews() const
+{
+	for( unsigned int i = 0; i < fUniverseViews.size(); ++i )
+		delete fUniverseViews[i];
+	fUniverseViews.clear();
+	fViewsCurrent = false;
+	fViewsModified = false;
+}
+
 bool MUVertErrorBand3D::Fill( const double xval, const double yval, const double zval, const double *weights, const double cvweight, double cvWeightFromMe)
 {
 	//! Fill the CV hist with the CV weight and value
@@ -154,10 +314,10 @@ bool MUVertErrorBand3D::Fill( const double xval, const double yval, const double
 	//! Add bin content to the bin for all the universes using their weights.
 	//! Note that all universes will be filled in the same bin as the CV hist.
 	const double applyWeight = cvweight / cvWeightFromMe;
-	for( unsigned int i = 0; i != fNHists; ++i ) 
-	{
-		fHists[i]->AddBinContent( cvbin, weights[i]*applyWeight );
-	}
+	SyncUniverses();
+	fUniverses.Fill( cvbin, weights, applyWeight );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
 	return true;
 }
@@ -177,8 +337,36 @@ bool MUVertErrorBand3D::Fill( const double xval, const double yval, const double
 	return Fill( xval, yval, zval, weights, cvweight, cvWeightFromMe );
 }
 
+bool MUVertErrorBand3D::FillBatch( const unsigned int nEvents, const double *xvals, const double *yvals, const double *zvals, const double *weights, const double *cvweights /* = 0 */, const double *cvWeightsFromMe /* = 0 */ )
+{
+	if( 0 == nEvents )
+		return true;
+
+	//! Fill the CV hist event by event and remember the bin each event went to
+	std::vector<int> bins( nEvents );
+	std::vector<double> applyWeights( nEvents );
+	for( unsigned int i = 0; i != nEvents; ++i )
+	{
+		const double cvweight = cvweights ? cvweights[i] : 1.;
+		int cvbin = this->TH3D::Fill( xvals[i], yvals[i], zvals[i], cvweight );
+		if( cvbin == -1 )
+			cvbin = FindBin( xvals[i], yvals[i], zvals[i] );
+		bins[i] = cvbin;
+		applyWeights[i] = cvWeightsFromMe ? cvweight / cvWeightsFromMe[i] : cvweight;
+	}
+
+	//! Then add all events to the universes, grouped by bin
+	SyncUniverses();
+	fUniverses.FillBatch( nEvents, &bins[0], weights, &applyWeights[0] );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
+
+	return true;
+}
+
 TH3D MUVertErrorBand3D::GetErrorBand(bool asFrac /*= false*/ , bool cov_area_normalize /*= false*/) const
 {
+	TDirectory::TContext detached( gDirectory, 0 ); //keep the copy out of gDirectory, which other threads may be using
 	TH3D errBand( *this );
 	errBand.Reset();
 	const int lowBin = 0;
@@ -187,12 +375,11 @@ TH3D MUVertErrorBand3D::GetErrorBand(bool asFrac /*= false*/ , bool cov_area_nor
 	const int highBinZ = GetNbinsZ() + 1;
 	const int highBin  = GetBin( highBinX, highBinY, highBinZ );
 
-	TMatrixD covmx(highBin+1,highBin+1);
-	covmx = CalcCovMx(cov_area_normalize,asFrac);
+	const std::vector<double> var = CalcVariance( cov_area_normalize, asFrac );
 
 	for( int i = lowBin; i <= highBin; ++i )
 	{
-		double err = (covmx[i][i]>0.)? sqrt( covmx[i][i] ): 0.; //Protect against odd sqrt(0) = NaN errors.
+		double err = (var[i]>0.)? sqrt( var[i] ): 0.; //Protect against odd sqrt(0) = NaN errors.
 
 		errBand.SetBinContent( i, err );
 		errBand.SetBinError(i, 0.);
@@ -208,7 +395,8 @@ const TH3D *MUVertErrorBand3D::GetHist( unsigned int i ) const
 		Error("GetHist", "Cannot return histogram of universe %d because this object has %d universes.", i, fNHists);
 		return NULL;
 	}
-	return fHists[i];
+	MaterializeViews();
+	return fUniverseViews[i];
 }
 
 TH3D *MUVertErrorBand3D::GetHist( unsigned int i )
@@ -218,122 +406,92 @@ TH3D *MUVertErrorBand3D::GetHist( unsigned int i )
 		Error("GetHist", "Cannot return histogram of universe %d because this object has %d universes.", i, fNHists);
 		return NULL;
 	}
-	//! Temporary Fix to a problem when Drawing fHists[] (histogram has content but plot is blank)
-	TH3D *hist = dynamic_cast<TH3D*>(fHists[i]->Clone());
-	const int Nbins = fHists[i]->GetBin( fHists[i]->GetNbinsX()+1, fHists[i]->GetNbinsY()+1, fHists[i]->GetNbinsZ()+1);
-	for (int i=0; i<=Nbins ; ++i)
-	{
-		hist->SetBinContent( i , hist->GetBinContent(i) );
-		hist->SetBinError( i , hist->GetBinError(i) );
-	}
+	MaterializeViews();
+	fViewsModified = true;
+	return fUniverseViews[i];
+}
+
+const std::vector<TH3D*>& MUVertErrorBand3D::GetHists() const
+{
+	MaterializeViews();
+	return fUniverseViews;
+}
 
-	return hist;
-	//return fHists[i];
+std::vector<TH3D*> MUVertErrorBand3D::GetHists()
+{
+	MaterializeViews();
+	fViewsModified = true;
+	return fUniverseViews;
 }
 
-TMatrixD MUVertErrorBand3D::CalcCovMx(bool area_normalize, bool asFrac) const
+const MUUniverseStore& MUVertErrorBand3D::GetUniverseStore() const
 {
-	//Calculating the Mean
-	TH3D hmean = TH3D(*this);
+	SyncUniverses();
+	return fUniverses;
+}
 
-	// if there's more than one varied universe, calculate the mean; if not, use the CV
-	// histo as the 'mean'
-	if(fNHists > 1)
-		hmean.Reset();
+MUUniverseStore& MUVertErrorBand3D::GetUniverseStore()
+{
+	SyncUniverses();
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
+	return fUniverses;
+}
 
-	//!Storing Area Normalization Factors for the many universes
-	//! @todo Need to Check this! 
-	std::vector<double> normFactors;
+ULong64_t MUVertErrorBand3D::GetCacheVersion() const
+{
+	//! Changes made through views count once they are synced
+	SyncUniverses();
+	return fCacheVersion.Get( this );
+}
 
-	for( unsigned int j = 0; j < fNHists; ++j ) {
-		if (area_normalize)
-		{
-			double area_scale = fHists[j]->Integral();
-			normFactors.push_back(area_scale/Integral());
+TMatrixD MUVertErrorBand3D::CalcCovMx(bool area_normalize, bool asFrac) const
+{
+	//! Reuse the last result of this variant if nothing changed since
+	const int variant = ( area_normalize ? 1 : 0 ) + ( asFrac ? 2 : 0 );
+	const ULong64_t version = GetCacheVersion();
+	TMatrixD cached;
+	if( fCovCache.Get( variant, version, cached ) )
+		return cached;
+
+	const TMatrixD covmx( ComputeCovMx( area_normalize, asFrac ) );
+	fCovCache.Put( variant, version, covmx );
+	return covmx;
+}
 
-			if (fHists[j]->Integral()!=0) //just in case
-			{
-				fHists[j]->Scale(Integral()/area_scale);
-			}
-		}
-		if(fNHists>1)
-			hmean.Add(fHists[j]);
-	}
+TMatrixD MUVertErrorBand3D::ComputeCovMx( bool area_normalize, bool asFrac ) const
+{
+	const MUUniverseStore& store = GetUniverseStore();
 
-	if(fNHists>1)
-		hmean.Scale(1.0/(double) fNHists);
+	//! Area normalization scales each universe to the area of the CV, leaving the universes themselves alone
+	std::vector<double> scales( fNHists, 1. );
+	if( area_normalize )
+		scales = store.GetAreaNormScales( this );
 
 	// Calculating Covariance Matrix
 	//! @todo what to do with underflow( bin=0 ) and overlow ( bin=nbins+1 )?
 	const int lowBin = 0; // considering underflow bin
-	const int highBin = hmean.GetBin( hmean.GetNbinsX()+1, hmean.GetNbinsY()+1, hmean.GetNbinsZ()+1 );// considering under/overflow
+	const int highBin = GetBin( GetNbinsX()+1, GetNbinsY()+1, GetNbinsZ()+1 );// considering under/overflow
 
 	TMatrixD covmx(highBin+1, highBin+1);
 
 	if (fUseSpreadError)
 	{
-		std::vector< std::vector<double> > binValsVec(highBin+1);
-		//calculate maximum and minum values for every bin
-		for( int i = lowBin; i <= highBin; ++i )
-		{
-			std::vector<double> binVals;
-			for( unsigned int j = 0; j < fNHists; ++j )
-			{
-				const double val = fHists[j]->GetBinContent(i);
-				binVals.push_back( val );
-			}
-			//get the CV value for this bin
-			const double cv = GetBinContent(i);
-			binVals.push_back( cv );
-			sort( binVals.begin(), binVals.end() );
-
-			binValsVec.at(i) =  binVals ;
-		}
-
-		//! For spread errors in only 1 universe take the full max spread
-		//! For spread errors in less than 10 universes take 1/2 the max spread
-		//! For spread errors with more than 10 universes, use the interquartile spread
+		//! Get the spread of every bin once; the covariance is their outer product
+		const std::vector<double> spreads = CalcSpreads( scales );
 		for( int i = lowBin; i <= highBin; ++i )
 		{
 			for( int k = i; k <= highBin; ++k )
 			{
-				if ( fNHists == 1 )
-					covmx[i][k] = ( (binValsVec.at(i)).back()- (binValsVec.at(i)).front() ) * ( (binValsVec.at(k)).back()- (binValsVec.at(k)).front() );
-				else if ( fNHists < 10 )
-					covmx[i][k] = ( (binValsVec.at(i)).back() - (binValsVec.at(i)).front() ) * ( (binValsVec.at(k)).back() - (binValsVec.at(k)).front() ) / 4. ;
-				else
-					covmx[i][k] = MUHist::GetInterquartileRange( binValsVec.at(i) ) * MUHist::GetInterquartileRange( binValsVec.at(k) ) * pow(MUHist::InterquartileRangeToSigma,2);
-
+				covmx[i][k] = spreads[i] * spreads[k];
 				covmx[k][i] = covmx[i][k];
 			}
 		}
 	}
 	else
 	{
-		//Calculating Covariance
-		for( unsigned int j = 0; j < fNHists; ++j ) 
-		{
-			for( int i = lowBin; i <= highBin; ++i )
-			{
-				double xi=fHists[j]->GetBinContent(i);
-				double ximean=hmean.GetBinContent(i);
-				for( int k = i; k <= highBin; ++k )
-				{
-					double xk=fHists[j]->GetBinContent(k);
-					double xkmean=hmean.GetBinContent(k);
-					covmx[i][k] +=(xi-ximean)*(xk-xkmean);
-				}
-			}
-		}
-
-		for( int i = lowBin; i <= highBin; ++i )
-		{
-			for( int k = i; k <= highBin; ++k )
-			{
-				covmx[i][k]/=((double)fNHists);
-				covmx[k][i]=covmx[i][k];
-			}
-		}
+		//! Covariance of the universes about their mean, or about the CV when there is only one universe
+		store.CalcCovariance( covmx.GetMatrixArray(), ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
 	}
 
 	if (asFrac)
@@ -354,18 +512,98 @@ TMatrixD MUVertErrorBand3D::CalcCovMx(bool area_normalize, bool asFrac) const
 		}
 	}
 
-	//! Getting fHists back to normal
-	//! @todo Need to Check this
-	if (area_normalize)
+	return covmx;
+}
+
+std::vector<double> MUVertErrorBand3D::CalcVariance( bool area_normalize /* = false */, bool asFrac /* = false */ ) const
+{
+	const MUUniverseStore& store = GetUniverseStore();
+
+	std::vector<double> scales( fNHists, 1. );
+	if( area_normalize )
+		scales = store.GetAreaNormScales( this );
+
+	std::vector<double> var( GetNcells(), 0. );
+	if( fUseSpreadError )
 	{
-		for( unsigned int j = 0; j < fNHists; ++j ) {
-			if (fHists[j]->Integral()!=0)
-			{
-				fHists[j]->Scale(normFactors[j]);
-			}
+		const std::vector<double> spreads = CalcSpreads( scales );
+		for( unsigned int i = 0; i != var.size(); ++i )
+			var[i] = spreads[i] * spreads[i];
+	}
+	else
+		store.CalcVariance( &var[0], ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
+
+	if( asFrac )
+	{
+		for( unsigned int i = 0; i != var.size(); ++i )
+		{
+			const double cv = GetBinContent(i);
+			var[i] = ( cv != 0. ) ? var[i] / ( cv * cv ) : 0.;
 		}
 	}
-	return covmx;
+
+	return var;
+}
+
+MULowRankCovariance MUVertErrorBand3D::CalcLowRankCovMx( bool area_normalize /* = false */, bool asFrac /* = false */ ) const
+{
+	const MUUniverseStore& store = GetUniverseStore();
+
+	std::vector<double> scales( fNHists, 1. );
+	if( area_normalize )
+		scales = store.GetAreaNormScales( this );
+
+	MULowRankCovariance cov( GetNcells() );
+	cov.SetCV( this );
+	if( fUseSpreadError )
+	{
+		//! The spread covariance is the outer product of the spreads, so it is rank one
+		const std::vector<double> spreads = CalcSpreads( scales );
+		cov.AddColumn( &spreads[0] );
+	}
+	else
+		cov.AddUniverses( store, ( area_normalize && fNHists ) ? &scales[0] : 0, ( fNHists > 1 ) ? 0 : GetArray() );
+
+	if( asFrac )
+		cov.MakeFractional();
+
+	return cov;
+}
+
+std::vector<double> MUVertErrorBand3D::CalcSpreads( const std::vector<double>& scales ) const
+{
+	const MUUniverseStore& store = GetUniverseStore();
+
+	std::vector<double> spreads( GetNcells() );
+	std::vector<double> binVals;
+	for( int i = 0; i < GetNcells(); ++i )
+	{
+		binVals.clear();
+		for( unsigned int j = 0; j < fNHists; ++j )
+		{
+			const double val = store.GetBinContent( i, j ) * scales[j];
+			binVals.push_back( val );
+		}
+		//get the CV value for this bin
+		const double cv = GetBinContent(i);
+		binVals.push_back( cv );
+		spreads[i] = MUHist::GetSpread( binVals, fNHists );
+	}
+
+	return spreads;
+}
+
+std::vector<double> MUVertErrorBand3D::GetBinQuantiles( const int bin, const std::vector<double>& q ) const
+{
+	if( bin < 0 || GetNcells() <= bin )
+	{
+		Error("GetBinQuantiles", "Cannot return quantiles of bin %d because this object has %d bins.", bin, GetNcells());
+		return std::vector<double>( q.size(), 0. );
+	}
+
+	const double *row = GetUniverseStore().GetSumwRow( bin );
+	std::vector<double> binVals( row, row + fNHists );
+	return MUHist::GetQuantiles( binVals, q );
 }
 
 Bool_t MUVertErrorBand3D::Add( const MUVertErrorBand3D* h1, const Double_t c1 /*= 1.*/ )
@@ -380,11 +618,13 @@ Bool_t MUVertErrorBand3D::Add( const MUVertErrorBand3D* h1, const Double_t c1 /*
 	//! Call Add on the CVHists
 	this->TH3D::Add( h1, c1 );
 
-	//! Call Add for all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Add( h1->GetHist(iHist), c1 );
+	//! Add all universes at once
+	SyncUniverses();
+	const bool ok = fUniverses.Add( h1->GetUniverseStore(), c1 );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
-	return true;
+	return ok;
 }
 
 Bool_t MUVertErrorBand3D::Multiply( const MUVertErrorBand3D* h1, const MUVertErrorBand3D* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/ )
@@ -400,11 +640,13 @@ Bool_t MUVertErrorBand3D::Multiply( const MUVertErrorBand3D* h1, const MUVertErr
 	//! @note root documentation says this function returns a bool but its void in our version
 	this->TH3D::Multiply( h1, h2, c1, c2 );
 
-	//! Call Multiply for all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Multiply( h1->GetHist(iHist), h2->GetHist(iHist), c1, c2 );
+	//! Multiply all universes at once
+	SyncUniverses();
+	const bool ok = fUniverses.Multiply( h1->GetUniverseStore(), h2->GetUniverseStore(), c1, c2 );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
-	return true;
+	return ok;
 }
 
 Bool_t MUVertErrorBand3D::DivideSingle( const MUVertErrorBand3D* h1, const TH3* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/, Option_t* option /*=""*/ )
@@ -420,11 +662,13 @@ Bool_t MUVertErrorBand3D::DivideSingle( const MUVertErrorBand3D* h1, const TH3*
 	//! @note root documentation says this function returns a bool but its void in our version
 	this->TH3D::Divide( (TH3D*)h1, h2, c1, c2, option);
 
-	//! Call Divide for all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Divide( h1->GetHist(iHist), h2, c1, c2, option );
+	//! Divide all universes at once
+	SyncUniverses();
+	const bool ok = fUniverses.Divide( h1->GetUniverseStore(), h2, c1, c2, MUUniverseStore::IsBinomialOption( option ) );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
-	return true;
+	return ok;
 }
 
 Bool_t MUVertErrorBand3D::Divide( const MUVertErrorBand3D* h1, const MUVertErrorBand3D* h2, Double_t c1 /*= 1*/, Double_t c2 /*= 1*/, Option_t* option /*=""*/ )
@@ -440,11 +684,13 @@ Bool_t MUVertErrorBand3D::Divide( const MUVertErrorBand3D* h1, const MUVertError
 	//! @note root documentation for recent versions says TH1D::Divide returns a bool but its void in our current version of ROOT (5.30)
 	this->TH3D::Divide( h1, h2, c1, c2, option);
 
-	//! Call Divide for all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Divide( h1->GetHist(iHist), h2->GetHist(iHist), c1, c2, option );
+	//! Divide all universes at once
+	SyncUniverses();
+	const bool ok = fUniverses.Divide( h1->GetUniverseStore(), h2->GetUniverseStore(), c1, c2, MUUniverseStore::IsBinomialOption( option ) );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
 
-	return true;
+	return ok;
 }
 
 void MUVertErrorBand3D::Scale( Double_t c1 /*= 1.*/, Option_t *option /*= ""*/ )
@@ -452,9 +698,35 @@ void MUVertErrorBand3D::Scale( Double_t c1 /*= 1.*/, Option_t *option /*= ""*/ )
 	//! Scale the CVHist
 	this->TH3D::Scale( c1, option );
 
-	//! Scale all universes
-	for( unsigned int iHist = 0; iHist != fNHists; ++iHist )
-		fHists[iHist]->Scale( c1, option );
+	//! Scale all universes at once, the same way TH3D::Scale would
+	SyncUniverses();
+	TString opt( option );
+	opt.ToLower();
+	const bool scaleSumw2 = !opt.Contains( "nosw2" );
+	if( opt.Contains( "width" ) )
+		fUniverses.ScaleBins( MUUniverseStore::GetWidthScaleFactors( this, c1 ), scaleSumw2 );
+	else
+		fUniverses.Scale( c1, scaleSumw2 );
+	fViewsCurrent = false;
+	fCacheVersion.Touch();
+}
+
+bool MUVertErrorBand3D::ApplyRebinMap( const MURebinMap& map )
+{
+	if( map.GetNOldBins() != (unsigned int)GetNcells() )
+	{
+		Error( "ApplyRebinMap", "The rebin map was made for %d bins, but this band has %d.  Not rebinning.", map.GetNOldBins(), GetNcells() );
+		return false;
+	}
+
+	//! The views have the old binning, so they are dropped and made again when asked for
+	SyncUniverses();
+	DeleteViews();
+
+	map.Apply( (TH1*)this );
+	map.Apply( fUniverses );
+	fCacheVersion.Touch();
+	return true;
 }
 
 
@@ -9,6 +9,11 @@
 #include "TMatrixD.h"
 #include "TMatrixDBase.h"
 
+#include "PlotUtils/MUUniverseStore.h"
+#include "PlotUtils/MUCovarianceCache.h"
+#include "PlotUtils/MULowRankCovariance.h"
+#include "PlotUtils/MURebinMap.h"
+
 #include <assert.h>
 #include <vector>
 #include <string>
@@ -22,7 +27,7 @@ namespace PlotUtils
 	{
 		public:
 			//! Default constructor 
-			MUVertErrorBand3D( ) : TH3D() {};
+			MUVertErrorBand3D( ) : TH3D(), fNHists(0), fUseSpreadError(false), fViewsCurrent(false), fViewsModified(false) {};
 
 			MUVertErrorBand3D( const std::string& name, const TH3D* base, const unsigned int nHists = 1000 );
 
@@ -35,10 +40,23 @@ namespace PlotUtils
 			//! Deep assignment operator
 			MUVertErrorBand3D& operator=( const MUVertErrorBand3D& h );
 
+#if __cplusplus >= 201103L
+			//! Move constructor: takes the bins and universes of h instead of copying them, leaving h with none
+			MUVertErrorBand3D( MUVertErrorBand3D&& h ) noexcept;
+
+			//! Move assignment operator, as the move constructor
+			MUVertErrorBand3D& operator=( MUVertErrorBand3D&& h ) noexcept;
+#endif
+
 		private:
 			//! A helper function which sets variables for the deep copy and assignment
 			void DeepCopy( const MUVertErrorBand3D& h );
 
+#if __cplusplus >= 201103L
+			//! A helper function which takes the variables of h for the move constructor and assignment
+			void MoveFrom( MUVertErrorBand3D& h );
+#endif
+
 		public:
 			/*! Quiet warnings about hidden overloaded virtual functions.
 				It is not clear if this is the behavior we want (may prefer
@@ -49,14 +67,26 @@ namespace PlotUtils
 			using TH3::Fill;
 			using TH3::Multiply;
 
-			//!Destructor (note: root cleans up histograms for us)
-			virtual ~MUVertErrorBand3D() {};
+			//! Destructor (deletes the materialized universe views)
+			virtual ~MUVertErrorBand3D();
+
+			//! Rename the error band and any materialized universe views
+			virtual void SetName( const char *name );
 
 			//! Fill the CV histo and all the universes' histos
 			virtual bool Fill( const double xval, const double yval, const double zval, const double *weights, const double cvweight = 1, double cvWeightFromMe = 1.);
 
 			virtual bool Fill( const double xval, const double yval, const double zval, const double weightDown, const double weightUp, const double cvweight = 1.0, double cvWeightFromMe = 1. );
 
+			/*! Fill the CV histo and all universes for many events at once
+				@param[in] nEvents Number of events
+				@param[in] xvals,yvals,zvals Values to fill, one per event
+				@param[in] weights nEvents x nUniverses weights, one row of universe weights per event
+				@param[in] cvweights Central value weight of each event (NULL for 1)
+				@param[in] cvWeightsFromMe Part of each CV weight that came from this error source (NULL for 1)
+				*/
+			bool FillBatch( const unsigned int nEvents, const double *xvals, const double *yvals, const double *zvals, const double *weights, const double *cvweights = 0, const double *cvWeightsFromMe = 0 );
+
 			//! Get the error band histogram
 			virtual TH3D GetErrorBand(bool asFrac = false , bool cov_area_normalize = false) const;
 
@@ -64,13 +94,13 @@ namespace PlotUtils
 			bool GetUseSpreadError() const { return fUseSpreadError; };
 
 			//! Set the error band to come from max spread or standard dev
-			void SetUseSpreadError( bool use ) { fUseSpreadError = use; };
+			void SetUseSpreadError( bool use ) { fUseSpreadError = use; fCacheVersion.Touch(); };
 
 			//! How many histograms (universes) does this have?
 			unsigned int GetNHists() const { return fNHists; };
 
-			//! Get the universes' histograms (const)
-			const std::vector<TH3D*>& GetHists() const { return fHists; };
+			//! Get the universes' histograms (const).  These are views materialized from the universe store on demand.
+			const std::vector<TH3D*>& GetHists() const;
 
 			//! Get a specific universe's histogram (const)
 			const TH3D* GetHist(const unsigned int i) const;
@@ -78,12 +108,42 @@ namespace PlotUtils
 			//! Get a specific universe's histogram (nonconst)
 			TH3D* GetHist(const unsigned int i);
 
-			//! Get the universes' histograms (nonconst)
-			std::vector<TH3D*> GetHists() { return fHists; };
+			//! Get the universes' histograms (nonconst).  Changes made through them are picked up by the next operation on the band.
+			std::vector<TH3D*> GetHists();
+
+			//! Get the contiguous storage of all universes (const)
+			const MUUniverseStore& GetUniverseStore() const;
 
-			//! Calculate Covariance Matrix
+			//! Get the contiguous storage of all universes (nonconst).  Materialized views are refreshed from it on next use.
+			MUUniverseStore& GetUniverseStore();
+
+			/*! Calculate Covariance Matrix
+				With area_normalize, each universe is scaled to the area of the CV on the fly; the band is never modified,
+				so shape-only and absolute matrices can be computed from several threads on the same band.
+				*/
 			TMatrixD CalcCovMx(bool area_normalize = false, bool asFrac = false) const;
 
+			//! Get just the diagonal of CalcCovMx, the variance of each bin, in O(nHists * nBins)
+			std::vector<double> CalcVariance( bool area_normalize = false, bool asFrac = false ) const;
+
+			/*! The same covariance as CalcCovMx, kept as its universes instead of an nBins x nBins matrix.
+				Use it for binnings where CalcCovMx would not fit in memory.
+				*/
+			MULowRankCovariance CalcLowRankCovMx( bool area_normalize = false, bool asFrac = false ) const;
+
+			//! Stamp that changes whenever the CV, the universes or the error mode change.  CalcCovMx results are cached against it.
+			ULong64_t GetCacheVersion() const;
+
+			//! Hits and misses of the CalcCovMx cache
+			MUCovarianceCache::Stats GetCovCacheStats() const { return fCovCache.GetStats(); };
+
+			/*! Get quantiles of the universes' contents in one bin, e.g. { 0.16, 0.5, 0.84 }.
+				Found by selection in O(nHists) each (see MUHist::GetQuantiles), without sorting.
+				@param[in] bin Global bin
+				@param[in] q Fractions in [0,1]
+				*/
+			std::vector<double> GetBinQuantiles( const int bin, const std::vector<double>& q ) const;
+
 			//! Add h1*c1 to this error band
 			Bool_t Add( const MUVertErrorBand3D* h1, const Double_t c1 = 1. );
 
@@ -101,16 +161,44 @@ namespace PlotUtils
 			//! Scale all universes by some constant using TH3D::Scale
 			void Scale( Double_t c1 = 1., Option_t *option = "" );
 
+			//! Rebin the central value and all universes with a map made for this binning, false if it does not fit
+			bool ApplyRebinMap( const MURebinMap& map );
+
 
 		protected:
 			unsigned int fNHists;         ///< Number of histograms (universes)
 			bool fUseSpreadError;         ///< Are we using spread in histos to get the error
-			std::vector<TH3D*> fHists;    ///< Vector of histograms for the universes
+			std::vector<TH3D*> fHists;    ///< Universe histograms as written before version 2.  Only filled while reading old files, then moved into fUniverses.
 			std::vector<int> fGoodColors; ///< Current list of good colors to use for universe histos
+			MUUniverseStore fUniverses;   ///< Contiguous [bin][universe] contents and sumw2 of all universes
+
+			mutable std::vector<TH3D*> fUniverseViews; //!< TH3D views of the universes, materialized on demand
+			mutable bool fViewsCurrent;                //!< Do the views reflect the current contents of fUniverses?
+			mutable bool fViewsModified;               //!< Were the views handed out nonconst, so fUniverses may be behind them?
+			mutable MUCacheVersion fCacheVersion;      //!< Stamp of the last change, for the caches
+			mutable MUCovarianceCache fCovCache;       //!< CalcCovMx results by variant
 
 		private:
-			//!define a class named MUVertErrorBand3D, at version 1 
-			ClassDef( MUVertErrorBand3D, 1 );
+			//! Bring fUniverses up to date with views that were handed out nonconst
+			void SyncUniverses() const { if( fViewsModified ) ImportUniverses(); };
+
+			//! Copy old-style hists or modified views into fUniverses
+			void ImportUniverses() const;
+
+			//! Create or refresh the TH3D views of the universes
+			void MaterializeViews() const;
+
+			//! Delete the TH3D views of the universes
+			void DeleteViews() const;
+
+			//! Calculate the covariance matrix, bypassing the cache
+			TMatrixD ComputeCovMx( bool area_normalize, bool asFrac ) const;
+
+			//! Spread of each bin over universes (times scales) and the CV, for spread errors
+			std::vector<double> CalcSpreads( const std::vector<double>& scales ) const;
+
+			//!define a class named MUVertErrorBand3D, at version 2
+			ClassDef( MUVertErrorBand3D, 2 );
 	}; //end of MUVertErrorBand3D
 
 } //end of PlotUtils
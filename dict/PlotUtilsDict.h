@@ -21,10 +21,13 @@
 #include "../PlotUtils/MUH1D.h" 
 #include "../PlotUtils/MUH2D.h" 
 #include "../PlotUtils/MUH3D.h" 
+#include "../PlotUtils/MUErrorBandHandle.h"
+#include "../PlotUtils/MUEventUniverseWeights.h"
 #include "../PlotUtils/MULatErrorBand.h"
 #include "../PlotUtils/MULatErrorBand2D.h"
 #include "../PlotUtils/MULatErrorBand3D.h"
 #include "../PlotUtils/MUPlotter.h"
+#include "../PlotUtils/MUUniverseStore.h"
 #include "../PlotUtils/MUVertErrorBand.h"
 #include "../PlotUtils/MUVertErrorBand2D.h"
 #include "../PlotUtils/MUVertErrorBand3D.h"
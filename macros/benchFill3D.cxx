@@ -0,0 +1,133 @@
+//Benchmark of the two ways to fill an MUH3D from many threads:
+//  shard  - every thread fills its own MUFillShard (GetFillShard), merged at the end
+//  shared - all threads fill one MUFillShard with atomic adds (GetSharedFillShard)
+//
+//Sharding never contends but needs one copy of all universes per thread.
+//The shared shard needs one copy in total but threads collide on popular bins.
+//
+//Usage: benchFill3D [nThreads] [nEvents] [nUniverses] [nBinsPerAxis]
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <thread>
+#include "TRandom3.h"
+#include "TStopwatch.h"
+
+#include "PlotUtils/MUApplication.h"
+#include "PlotUtils/MUH3D.h"
+
+using namespace std;
+using namespace PlotUtils;
+
+namespace
+{
+  //events are made up front so that only the filling is timed
+  struct Events
+  {
+    vector<double> x, y, z, cvweight;
+    vector<double> weights; //nEvents x nUniverses
+    vector<double> shifts;  //nEvents x nUniverses, used for all three axes
+  };
+
+  void MakeEvents( Events& ev, const unsigned int nEvents, const unsigned int nUniverses )
+  {
+    TRandom3 r(12345);
+    for( unsigned int i = 0; i != nEvents; ++i )
+    {
+      //peaked in the middle, so that the shared shard sees realistic contention
+      ev.x.push_back( r.Gaus( 5., 1.5 ) );
+      ev.y.push_back( r.Gaus( 5., 1.5 ) );
+      ev.z.push_back( r.Gaus( 5., 1.5 ) );
+      ev.cvweight.push_back( r.Gaus( 1., .1 ) );
+      for( unsigned int u = 0; u != nUniverses; ++u )
+      {
+        ev.weights.push_back( r.Gaus( 1., .05 ) );
+        ev.shifts.push_back( r.Gaus( 0., .2 ) );
+      }
+    }
+  }
+
+  //fill events [first, last) into a shard
+  void FillRange( MUFillShard& shard, const MUErrorBandHandle& flux, const MUErrorBandHandle& scale, const Events& ev, const unsigned int nUniverses, const unsigned int first, const unsigned int last )
+  {
+    for( unsigned int i = first; i != last; ++i )
+    {
+      const double *w = &ev.weights[ (size_t)i*nUniverses ];
+      const double *s = &ev.shifts[ (size_t)i*nUniverses ];
+      shard.Fill( ev.x[i], ev.y[i], ev.z[i], ev.cvweight[i] );
+      shard.FillVertErrorBand( flux, ev.x[i], ev.y[i], ev.z[i], w, ev.cvweight[i] );
+      shard.FillLatErrorBand( scale, ev.x[i], ev.y[i], ev.z[i], s, s, s, ev.cvweight[i] );
+    }
+  }
+
+  MUH3D* MakeHist( const int nBins, const unsigned int nUniverses )
+  {
+    MUH3D *h = new MUH3D( "bench", "bench", nBins, 0., 10., nBins, 0., 10., nBins, 0., 10. );
+    h->AddVertErrorBand( "Flux", nUniverses );
+    h->AddLatErrorBand( "EnergyScale", nUniverses );
+    return h;
+  }
+
+  //time filling all events from nThreads threads, in sharded or shared mode
+  double Run( const bool shared, const unsigned int nThreads, const Events& ev, const unsigned int nUniverses, const int nBins )
+  {
+    MUH3D *h = MakeHist( nBins, nUniverses );
+    const unsigned int nEvents = ev.x.size();
+
+    //resolve the handles before the threads start
+    const MUErrorBandHandle flux  = h->GetVertErrorBandHandle( "Flux" );
+    const MUErrorBandHandle scale = h->GetLatErrorBandHandle( "EnergyScale" );
+
+    TStopwatch timer;
+    vector<thread> threads;
+    for( unsigned int t = 0; t != nThreads; ++t )
+    {
+      const unsigned int first = (size_t)nEvents * t / nThreads;
+      const unsigned int last  = (size_t)nEvents * (t+1) / nThreads;
+      threads.push_back( thread( [=, &ev]() {
+        MUFillShard& shard = shared ? h->GetSharedFillShard() : h->GetFillShard( t );
+        FillRange( shard, flux, scale, ev, nUniverses, first, last );
+      } ) );
+    }
+    for( unsigned int t = 0; t != nThreads; ++t )
+      threads[t].join();
+    h->MergeFillShards();
+    timer.Stop();
+
+    const double copies = shared ? 1 : nThreads;
+    const double bytes = copies * h->GetNcells() * 2. * nUniverses * 2 * sizeof(double);
+    cout << "  " << ( shared ? "shared" : "shard " ) << " : " << timer.RealTime() << " s, "
+         << nEvents / timer.RealTime() << " events/s, "
+         << bytes / (1024.*1024.) << " MB of universe buffers, sum of weights " << h->GetSumOfWeights() << endl;
+
+    delete h;
+    return timer.RealTime();
+  }
+}
+
+int main( int argc, char *argv[] )
+{
+  PlotUtils::Initialize();
+
+  const unsigned int nThreads   = ( 1 < argc ) ? atoi( argv[1] ) : thread::hardware_concurrency();
+  const unsigned int nEvents    = ( 2 < argc ) ? atoi( argv[2] ) : 20000;
+  const unsigned int nUniverses = ( 3 < argc ) ? atoi( argv[3] ) : 500;
+  const int nBins               = ( 4 < argc ) ? atoi( argv[4] ) : 20;
+
+  cout << "Filling " << nEvents << " events into a " << nBins << "^3 MUH3D with " << nUniverses
+       << " vertical and " << nUniverses << " lateral universes" << endl;
+
+  Events ev;
+  MakeEvents( ev, nEvents, nUniverses );
+
+  for( unsigned int n = 1; n <= nThreads; n *= 2 )
+  {
+    cout << n << " threads" << endl;
+    const double tShard  = Run( false, n, ev, nUniverses, nBins );
+    const double tShared = Run( true, n, ev, nUniverses, nBins );
+    cout << "  shared / shard time = " << tShared / tShard << endl;
+  }
+
+  return 0;
+}
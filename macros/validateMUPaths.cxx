@@ -0,0 +1,722 @@
+//Checks the fast paths of PlotUtils against the plain ROOT or dense computations they replace,
+//on small fixed histograms:
+//  store - universes kept in a MUUniverseStore vs one TH1D filled per universe
+//  shard - filling through worker shards and merging vs filling the histogram directly
+//  batch - FillVertErrorBandBatch/FillLatErrorBandBatch vs filling the same events one at a time
+//  cov   - MUVertErrorBand::CalcCovMx, absolute and area normalized, vs a loop over the universe histograms
+//  lowrank - MULowRankCovariance vs the dense GetTotalErrorMatrix
+//  chi2  - MUChi2Calculator through Woodbury vs r^T C^-1 r with an SVD inverse of the dense matrix
+//  expr  - MUExpression vs the same formula done step by step with MUH1D methods
+//  arith - error band Divide/Multiply vs TH1D::Divide/Multiply of each universe
+//  rebin - MUH1D::Rebin vs TH1::Rebin of the CV and of each universe, and its error matrix vs a dense M*C*M^T
+//  proj  - MUH2D::ProjectionX vs TH2::ProjectionX of the CV and of each universe, and its error matrix vs a dense M*C*M^T
+//  bins  - MUBinLocator::FindBin/FindBins vs TAxis::FindFixBin on uniform and variable axes, at edges and out of range
+//
+//Prints one line per check with the largest difference found, and returns 1 if any check fails.
+//
+//Usage: validateMUPaths
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <cmath>
+#include "TH1D.h"
+#include "TH2D.h"
+#include "TAxis.h"
+#include "TMatrixD.h"
+#include "TDecompSVD.h"
+#include "TRandom3.h"
+
+#include "PlotUtils/MUApplication.h"
+#include "PlotUtils/MUH1D.h"
+#include "PlotUtils/MUH2D.h"
+#include "PlotUtils/MUChi2Calculator.h"
+#include "PlotUtils/MUExpression.h"
+#include "PlotUtils/MURebinMap.h"
+#include "PlotUtils/MULinearMap.h"
+#include "PlotUtils/MUBinLocator.h"
+
+using namespace std;
+using namespace PlotUtils;
+
+namespace
+{
+  const unsigned int kNEvents    = 5000;
+  const unsigned int kNUniverses = 50;
+  const int kNBins               = 20;
+
+  int gNFailures = 0;
+
+  //print a check and count it as failed if diff is above tolerance (or not a number)
+  void Report( const char *name, const double diff, const double tolerance )
+  {
+    const bool ok = ( diff <= tolerance );
+    if( !ok )
+      ++gNFailures;
+    cout << "  " << setw(40) << left << name << " max diff " << setw(12) << diff << ( ok ? "  ok" : "  FAILED" ) << endl;
+  }
+
+  //largest |a-b| relative to the larger of |a|, |b| and 1
+  double RelDiff( const double a, const double b )
+  {
+    return fabs( a - b ) / max( 1., max( fabs(a), fabs(b) ) );
+  }
+
+  //events are made once, so every check sees the same fixture
+  struct Events
+  {
+    vector<double> x, y, cvweight;
+    vector<double> weights; //kNEvents x kNUniverses
+  };
+
+  const Events& GetEvents()
+  {
+    static Events ev;
+    if( ev.x.empty() )
+    {
+      TRandom3 r(12345);
+      for( unsigned int i = 0; i != kNEvents; ++i )
+      {
+        ev.x.push_back( r.Gaus( 5., 2. ) );
+        ev.y.push_back( r.Gaus( 5., 3. ) );
+        ev.cvweight.push_back( r.Gaus( 1., .1 ) );
+        for( unsigned int u = 0; u != kNUniverses; ++u )
+          ev.weights.push_back( r.Gaus( 1., .05 ) );
+      }
+    }
+    return ev;
+  }
+
+  //an empty MUH1D with a vertical band "Flux"
+  MUH1D* MakeEmptyH1D( const char *name )
+  {
+    MUH1D *h = new MUH1D( name, name, kNBins, 0., 10. );
+    h->AddVertErrorBand( "Flux", kNUniverses );
+    return h;
+  }
+
+  //a MUH1D with a vertical band "Flux", filled with every stride-th event of the fixture
+  MUH1D* MakeH1D( const char *name, const unsigned int stride = 1 )
+  {
+    const Events& ev = GetEvents();
+    MUH1D *h = MakeEmptyH1D( name );
+    for( unsigned int i = 0; i < kNEvents; i += stride )
+    {
+      h->Fill( ev.x[i], ev.cvweight[i] );
+      h->FillVertErrorBand( "Flux", ev.x[i], &ev.weights[ (size_t)i*kNUniverses ], ev.cvweight[i] );
+    }
+    return h;
+  }
+
+  //largest differences between the CV and the "Flux" universes of two MUH1Ds, of contents and of errors
+  void MaxDiff( const MUH1D& a, const MUH1D& b, double& contentDiff, double& errorDiff )
+  {
+    contentDiff = errorDiff = 0.;
+    const MUUniverseStore& ua = a.GetVertErrorBand( "Flux" )->GetUniverseStore();
+    const MUUniverseStore& ub = b.GetVertErrorBand( "Flux" )->GetUniverseStore();
+    for( int bin = 0; bin <= kNBins + 1; ++bin )
+    {
+      contentDiff = max( contentDiff, RelDiff( a.GetBinContent( bin ), b.GetBinContent( bin ) ) );
+      errorDiff = max( errorDiff, RelDiff( a.GetBinError( bin ), b.GetBinError( bin ) ) );
+      for( unsigned int u = 0; u != kNUniverses; ++u )
+      {
+        contentDiff = max( contentDiff, RelDiff( ua.GetBinContent( bin, u ), ub.GetBinContent( bin, u ) ) );
+        errorDiff = max( errorDiff, RelDiff( ua.GetBinError2( bin, u ), ub.GetBinError2( bin, u ) ) );
+      }
+    }
+  }
+
+  //largest |a-b| of two matrices of the same shape, relative to the largest |b|
+  double MatrixDiff( const TMatrixD& a, const TMatrixD& b )
+  {
+    if( a.GetNrows() != b.GetNrows() || a.GetNcols() != b.GetNcols() )
+      return HUGE_VAL;
+    double diff = 0., scale = 0.;
+    for( int i = 0; i != b.GetNrows(); ++i )
+    {
+      for( int k = 0; k != b.GetNcols(); ++k )
+      {
+        diff = max( diff, fabs( a(i,k) - b(i,k) ) );
+        scale = max( scale, fabs( b(i,k) ) );
+      }
+    }
+    return ( 0. < scale ) ? diff / scale : diff;
+  }
+
+  //the universe store must hold what a TH1D per universe would
+  void CheckStore()
+  {
+    const Events& ev = GetEvents();
+    MUH1D *h = MakeH1D( "store" );
+
+    vector<TH1D*> universes;
+    for( unsigned int u = 0; u != kNUniverses; ++u )
+    {
+      TH1D *hu = new TH1D( Form( "store_universe_%d", u ), "", kNBins, 0., 10. );
+      hu->Sumw2();
+      universes.push_back( hu );
+    }
+    for( unsigned int i = 0; i != kNEvents; ++i )
+    {
+      for( unsigned int u = 0; u != kNUniverses; ++u )
+        universes[u]->Fill( ev.x[i], ev.weights[ (size_t)i*kNUniverses + u ] * ev.cvweight[i] );
+    }
+
+    const MUVertErrorBand *band = h->GetVertErrorBand( "Flux" );
+    double contentDiff = 0., errorDiff = 0.;
+    for( unsigned int u = 0; u != kNUniverses; ++u )
+    {
+      for( int bin = 0; bin <= kNBins + 1; ++bin )
+      {
+        contentDiff = max( contentDiff, fabs( band->GetHist( u )->GetBinContent( bin ) - universes[u]->GetBinContent( bin ) ) );
+        errorDiff = max( errorDiff, RelDiff( band->GetHist( u )->GetBinError( bin ), universes[u]->GetBinError( bin ) ) );
+      }
+      delete universes[u];
+    }
+    Report( "store: universe contents (bitwise)", contentDiff, 0. );
+    Report( "store: universe errors", errorDiff, 1e-12 );
+
+    delete h;
+  }
+
+  //fill events [first, last) into a shard
+  void FillShard( MUFillShard& shard, const MUErrorBandHandle& flux, const unsigned int first, const unsigned int last )
+  {
+    const Events& ev = GetEvents();
+    for( unsigned int i = first; i != last; ++i )
+    {
+      shard.Fill( ev.x[i], ev.cvweight[i] );
+      shard.FillVertErrorBand( flux, ev.x[i], &ev.weights[ (size_t)i*kNUniverses ], ev.cvweight[i] );
+    }
+  }
+
+  //merged shards must give what a direct fill gives, and not depend on the order the slots were filled in
+  void CheckShardMerge()
+  {
+    MUH1D *direct = MakeH1D( "shard_direct" );
+    double contentDiff, errorDiff;
+
+    //one shard sums the events in the same order as the direct fill
+    MUH1D *single = MakeEmptyH1D( "shard_single" );
+    FillShard( single->GetFillShard( 0 ), single->GetVertErrorBandHandle( "Flux" ), 0, kNEvents );
+    single->MergeFillShards();
+    MaxDiff( *single, *direct, contentDiff, errorDiff );
+    Report( "shard: one shard vs direct (bitwise)", contentDiff, 0. );
+    Report( "shard: one shard vs direct, errors", errorDiff, 1e-12 );
+
+    //events go to slots by entry range, and the slots are filled first to last, then last to first
+    const unsigned int nSlots = 4;
+    MUH1D *merged[2];
+    for( int order = 0; order != 2; ++order )
+    {
+      merged[order] = MakeEmptyH1D( order ? "shard_backward" : "shard_forward" );
+      const MUErrorBandHandle flux = merged[order]->GetVertErrorBandHandle( "Flux" );
+      for( unsigned int s = 0; s != nSlots; ++s )
+      {
+        const unsigned int slot = order ? nSlots - 1 - s : s;
+        FillShard( merged[order]->GetFillShard( slot ), flux, kNEvents * slot / nSlots, kNEvents * (slot+1) / nSlots );
+      }
+      merged[order]->MergeFillShards();
+    }
+    MaxDiff( *merged[0], *merged[1], contentDiff, errorDiff );
+    Report( "shard: slot fill order (bitwise)", max( contentDiff, errorDiff ), 0. );
+    MaxDiff( *merged[0], *direct, contentDiff, errorDiff );
+    Report( "shard: four shards vs direct", max( contentDiff, errorDiff ), 1e-12 );
+
+    delete direct;
+    delete single;
+    delete merged[0];
+    delete merged[1];
+  }
+
+  //largest differences between two bands with the same binning: their CVs and universes, of contents and of errors
+  void BandDiff( const TH1D& a, const MUUniverseStore& ua, const TH1D& b, const MUUniverseStore& ub, double& contentDiff, double& errorDiff )
+  {
+    contentDiff = errorDiff = 0.;
+    for( int bin = 0; bin <= kNBins + 1; ++bin )
+    {
+      contentDiff = max( contentDiff, RelDiff( a.GetBinContent( bin ), b.GetBinContent( bin ) ) );
+      errorDiff = max( errorDiff, RelDiff( a.GetBinError( bin ), b.GetBinError( bin ) ) );
+      for( unsigned int u = 0; u != kNUniverses; ++u )
+      {
+        contentDiff = max( contentDiff, RelDiff( ua.GetBinContent( bin, u ), ub.GetBinContent( bin, u ) ) );
+        errorDiff = max( errorDiff, RelDiff( ua.GetBinError2( bin, u ), ub.GetBinError2( bin, u ) ) );
+      }
+    }
+  }
+
+  //a batch fill must give what filling its events one at a time gives.  The vertical batch adds the events
+  //to the universes grouped by bin, so its sums may differ in the last bits; the lateral batch is the same loop.
+  void CheckBatchFill()
+  {
+    const Events& ev = GetEvents();
+    vector<double> cvWeightsFromMe( kNEvents ), shifts( ev.weights.size() );
+    for( unsigned int i = 0; i != kNEvents; ++i )
+      cvWeightsFromMe[i] = .5 + ev.cvweight[i];
+    for( unsigned int i = 0; i != shifts.size(); ++i )
+      shifts[i] = 10. * ( ev.weights[i] - 1. );
+
+    MUH1D *hists[2];
+    for( int batch = 0; batch != 2; ++batch )
+    {
+      hists[batch] = MakeEmptyH1D( batch ? "batch" : "batch_loop" );
+      hists[batch]->AddLatErrorBand( "Shift", kNUniverses );
+    }
+    hists[1]->FillVertErrorBandBatch( "Flux", kNEvents, &ev.x[0], &ev.weights[0], &ev.cvweight[0], &cvWeightsFromMe[0] );
+    hists[1]->FillLatErrorBandBatch( "Shift", kNEvents, &ev.x[0], &shifts[0], &ev.cvweight[0], true, &ev.weights[0] );
+    for( unsigned int i = 0; i != kNEvents; ++i )
+    {
+      const size_t row = (size_t)i*kNUniverses;
+      hists[0]->FillVertErrorBand( "Flux", ev.x[i], &ev.weights[row], ev.cvweight[i], cvWeightsFromMe[i] );
+      hists[0]->FillLatErrorBand( "Shift", ev.x[i], &shifts[row], ev.cvweight[i], true, &ev.weights[row] );
+    }
+
+    double contentDiff, errorDiff;
+    const MUVertErrorBand *vert[2] = { hists[0]->GetVertErrorBand( "Flux" ), hists[1]->GetVertErrorBand( "Flux" ) };
+    BandDiff( *vert[1], vert[1]->GetUniverseStore(), *vert[0], vert[0]->GetUniverseStore(), contentDiff, errorDiff );
+    Report( "batch: vertical batch vs loop", max( contentDiff, errorDiff ), 1e-12 );
+
+    const MULatErrorBand *lat[2] = { hists[0]->GetLatErrorBand( "Shift" ), hists[1]->GetLatErrorBand( "Shift" ) };
+    BandDiff( *lat[1], lat[1]->GetUniverseStore(), *lat[0], lat[0]->GetUniverseStore(), contentDiff, errorDiff );
+    Report( "batch: lateral batch vs loop (bitwise)", max( contentDiff, errorDiff ), 0. );
+
+    delete hists[0];
+    delete hists[1];
+  }
+
+  //CalcCovMx must be the covariance of the universes about their mean, with the universes scaled to the CV area
+  //for area normalization.  Universe 0 is filled with negative weights: a universe without a positive area is not scaled.
+  void CheckCovariance()
+  {
+    const Events& ev = GetEvents();
+    MUH1D *h = MakeEmptyH1D( "cov" );
+    vector<double> weights( kNUniverses );
+    for( unsigned int i = 0; i != kNEvents; ++i )
+    {
+      weights.assign( ev.weights.begin() + (size_t)i*kNUniverses, ev.weights.begin() + (size_t)(i+1)*kNUniverses );
+      weights[0] = -weights[0];
+      h->Fill( ev.x[i], ev.cvweight[i] );
+      h->FillVertErrorBand( "Flux", ev.x[i], &weights[0], ev.cvweight[i] );
+    }
+    const MUVertErrorBand *band = h->GetVertErrorBand( "Flux" );
+
+    for( int areaNorm = 0; areaNorm != 2; ++areaNorm )
+    {
+      //universe contents, scaled as the baseline CalcCovMx scaled them
+      const int n = kNBins + 2;
+      vector< vector<double> > x( kNUniverses, vector<double>( n ) );
+      vector<double> mean( n, 0. );
+      for( unsigned int u = 0; u != kNUniverses; ++u )
+      {
+        const TH1D *hu = band->GetHist( u );
+        const double area = hu->Integral();
+        const double scale = ( areaNorm && 0 < area ) ? h->Integral() / area : 1.;
+        for( int i = 0; i != n; ++i )
+        {
+          x[u][i] = scale * hu->GetBinContent( i );
+          mean[i] += x[u][i] / kNUniverses;
+        }
+      }
+
+      TMatrixD expected( n, n );
+      for( unsigned int u = 0; u != kNUniverses; ++u )
+      {
+        for( int i = 0; i != n; ++i )
+        {
+          for( int k = 0; k != n; ++k )
+            expected(i,k) += ( x[u][i] - mean[i] ) * ( x[u][k] - mean[k] );
+        }
+      }
+      expected *= 1. / kNUniverses;
+
+      Report( areaNorm ? "cov: area normalized CalcCovMx vs loop" : "cov: CalcCovMx vs loop", MatrixDiff( band->CalcCovMx( areaNorm ), expected ), 1e-10 );
+    }
+
+    delete h;
+  }
+
+  //the low-rank covariance must be the dense total error matrix, materialized or multiplied
+  void CheckLowRank()
+  {
+    MUH1D *h = MakeH1D( "lowrank" );
+
+    for( int areaNorm = 0; areaNorm != 2; ++areaNorm )
+    {
+      const TMatrixD dense = h->GetTotalErrorMatrix( true, false, areaNorm );
+      const MULowRankCovariance lowRank = h->GetTotalErrorLowRank( true, false, areaNorm );
+      Report( areaNorm ? "lowrank: area normalized matrix" : "lowrank: matrix", MatrixDiff( lowRank.GetMatrix(), dense ), 1e-12 );
+
+      //C v with a vector of ones against the row sums of the dense matrix
+      const int n = dense.GetNrows();
+      const vector<double> product = lowRank.Multiply( vector<double>( n, 1. ) );
+      const vector<double> diagonal = lowRank.GetDiagonal();
+      double productDiff = 0., diagonalDiff = 0.;
+      for( int i = 0; i != n; ++i )
+      {
+        double rowSum = 0.;
+        for( int k = 0; k != n; ++k )
+          rowSum += dense(i,k);
+        productDiff = max( productDiff, RelDiff( product[i], rowSum ) );
+        diagonalDiff = max( diagonalDiff, RelDiff( diagonal[i], dense(i,i) ) );
+      }
+      Report( areaNorm ? "lowrank: area normalized product" : "lowrank: product", productDiff, 1e-10 );
+      Report( areaNorm ? "lowrank: area normalized diagonal" : "lowrank: diagonal", diagonalDiff, 1e-12 );
+    }
+
+    delete h;
+  }
+
+  //the Woodbury chi2 and solve must agree with the dense matrix, also with bins where D is 0 or all variance is 0
+  void CheckChi2()
+  {
+    //rank 5 over 40 bins, so that Woodbury is used
+    const int nBins = 40;
+    const unsigned int rank = 5;
+    TRandom3 r(54321);
+    MULowRankCovariance cov( nBins );
+    vector<double> column( nBins ), diagonal( nBins );
+    for( unsigned int c = 0; c != rank; ++c )
+    {
+      for( int i = 0; i != nBins; ++i )
+        column[i] = r.Gaus( 0., 1. );
+      column[20] = 0.;
+      cov.AddColumn( &column[0] );
+    }
+    for( int i = 0; i != nBins; ++i )
+      diagonal[i] = ( 5 <= i && i < 8 ) || 20 == i ? 0. : .5 + fabs( r.Gaus( 0., 1. ) );
+    cov.AddDiagonal( &diagonal[0] );
+
+    //bins 5-7 only have variance from the columns, bin 20 has none and is left out
+    vector<int> bins, kept;
+    for( int i = 1; i != nBins - 1; ++i )
+    {
+      bins.push_back( i );
+      if( 20 != i )
+        kept.push_back( i );
+    }
+    vector<double> residuals( bins.size() );
+    for( unsigned int i = 0; i != bins.size(); ++i )
+      residuals[i] = r.Gaus( 0., 1. );
+
+    MUChi2Calculator calc;
+    calc.SetCovariance( cov, bins );
+    Report( "chi2: Woodbury is used", MUChi2Calculator::kWoodbury == calc.GetMethod() ? 0. : 1., 0. );
+    Report( "chi2: zero-variance bins dropped", fabs( calc.GetNDroppedBins() - 1. ), 0. );
+
+    //r^T C^-1 r over the kept bins with the dense inverse
+    TMatrixD inverse = cov.GetBlock( kept, kept );
+    TDecompSVD svd( inverse );
+    svd.Invert( inverse );
+    double chi2 = 0.;
+    vector<double> solved( bins.size(), 0. );
+    for( unsigned int i = 0; i != kept.size(); ++i )
+    {
+      double s = 0.;
+      for( unsigned int k = 0; k != kept.size(); ++k )
+        s += inverse(i,k) * residuals[ kept[k] - 1 ];
+      solved[ kept[i] - 1 ] = s;
+      chi2 += residuals[ kept[i] - 1 ] * s;
+    }
+    Report( "chi2: Woodbury vs dense chi2", RelDiff( calc.Chi2( residuals ), chi2 ), 1e-10 );
+
+    vector<double> x( bins.size() );
+    calc.Solve( &residuals[0], &x[0] );
+    double solveDiff = 0.;
+    for( unsigned int i = 0; i != bins.size(); ++i )
+      solveDiff = max( solveDiff, RelDiff( x[i], solved[i] ) );
+    Report( "chi2: Woodbury vs dense C^-1 r", solveDiff, 1e-10 );
+  }
+
+  //an expression must give the bits of its steps done one by one on copies
+  void CheckExpression()
+  {
+    MUH1D *data = MakeH1D( "expr_data" );
+    MUH1D *bkg = MakeH1D( "expr_bkg", 3 );
+    MUH1D *eff = MakeH1D( "expr_eff", 2 );
+    eff->Divide( eff, data );
+    TH1D flux( "expr_flux", "", kNBins, 0., 10. );
+    for( int bin = 0; bin <= kNBins + 1; ++bin )
+      flux.SetBinContent( bin, 1. + .1 * bin );
+    const double scale = .7, nTargets = 3.5;
+
+    const MUExpression xs = ( MUExpression( data ) - MUExpression( bkg ) * scale ) / ( MUExpression( eff ) * &flux * nTargets );
+    MUH1D *evaluated = xs.Eval1D( "expr_evaluated" );
+
+    MUH1D scaledBkg( *bkg );
+    scaledBkg.Scale( scale );
+    MUH1D numerator( *data );
+    numerator.Add( &scaledBkg, -1. );
+    MUH1D denominator( *eff );
+    denominator.MultiplySingle( eff, &flux );
+    denominator.Scale( nTargets );
+    MUH1D steps( numerator );
+    steps.Divide( &numerator, &denominator );
+
+    if( !evaluated )
+      Report( "expression: Eval1D", 1., 0. );
+    else
+    {
+      double contentDiff, errorDiff;
+      MaxDiff( *evaluated, steps, contentDiff, errorDiff );
+      Report( "expression: contents (bitwise)", contentDiff, 0. );
+      Report( "expression: errors (bitwise)", errorDiff, 0. );
+    }
+
+    delete evaluated;
+    delete data;
+    delete bkg;
+    delete eff;
+  }
+
+  //the band Divide and Multiply must give, universe by universe, what TH1D::Divide and Multiply give
+  void CheckBandArithmetic()
+  {
+    MUH1D *numHist = MakeH1D( "arith_num", 2 );
+    MUH1D *denHist = MakeH1D( "arith_den" );
+    MUVertErrorBand *num = numHist->GetVertErrorBand( "Flux" );
+    const MUVertErrorBand *den = denHist->GetVertErrorBand( "Flux" );
+
+    //bins 8-10 of the numerator are those of the denominator, in the CV and every universe
+    MUUniverseStore& numStore = num->GetUniverseStore();
+    const MUUniverseStore& denStore = den->GetUniverseStore();
+    for( int bin = 8; bin <= 10; ++bin )
+    {
+      num->SetBinContent( bin, den->GetBinContent( bin ) );
+      num->SetBinError( bin, den->GetBinError( bin ) );
+      for( unsigned int u = 0; u != kNUniverses; ++u )
+        numStore.SetBinContent( bin, u, denStore.GetBinContent( bin, u ), denStore.GetBinError2( bin, u ) );
+    }
+
+    TH1D flux( "arith_flux", "", kNBins, 0., 10. );
+    for( int bin = 0; bin <= kNBins + 1; ++bin )
+    {
+      flux.SetBinContent( bin, 1. + .1 * bin );
+      flux.SetBinError( bin, .01 * bin );
+    }
+
+    const double c1 = 1.5, c2 = .8;
+    const char *names[5] = { "Divide", "Divide B", "DivideSingle", "Multiply", "MultiplySingle" };
+    const MUVertErrorBand *numerator = num;
+    for( int op = 0; op != 5; ++op )
+    {
+      MUVertErrorBand result( *numerator );
+      if( 0 == op )
+        result.Divide( numerator, den, c1, c2, "" );
+      else if( 1 == op )
+        result.Divide( numerator, den, c1, c2, "B" );
+      else if( 2 == op )
+        result.DivideSingle( numerator, &flux, c1, c2, "" );
+      else if( 3 == op )
+        result.Multiply( numerator, den, c1, c2 );
+      else
+        result.MultiplySingle( numerator, &flux, c1, c2 );
+
+      //the CV (u = -1) and each universe on its own with TH1D
+      const MUVertErrorBand& constResult = result;
+      double contentDiff = 0., errorDiff = 0.;
+      for( int u = -1; u != (int)kNUniverses; ++u )
+      {
+        const TH1D h1( u < 0 ? *numerator : *numerator->GetHist( u ) );
+        const TH1D h2( 2 == op || 4 == op ? flux : ( u < 0 ? *den : *den->GetHist( u ) ) );
+        TH1D expected( h1 );
+        if( op < 3 )
+          expected.Divide( &h1, &h2, c1, c2, 1 == op ? "B" : "" );
+        else
+          expected.Multiply( &h1, &h2, c1, c2 );
+
+        const TH1D *got = u < 0 ? &constResult : constResult.GetHist( u );
+        for( int bin = 0; bin <= kNBins + 1; ++bin )
+        {
+          contentDiff = max( contentDiff, RelDiff( got->GetBinContent( bin ), expected.GetBinContent( bin ) ) );
+          errorDiff = max( errorDiff, RelDiff( got->GetBinError( bin ), expected.GetBinError( bin ) ) );
+        }
+      }
+      Report( Form( "arith: %s contents vs TH1D", names[op] ), contentDiff, 1e-12 );
+      Report( Form( "arith: %s errors vs TH1D", names[op] ), errorDiff, 1e-12 );
+    }
+
+    delete numHist;
+    delete denHist;
+  }
+
+  //rebinning must sum what TH1::Rebin sums, and give the error matrix M*C*M^T of the old one
+  void CheckRebin()
+  {
+    const int nNewBins = 8;
+    const double edges[nNewBins+1] = { 0., 1., 2., 3., 4., 5., 6., 8., 10. };
+    MUH1D *h = MakeH1D( "rebin" );
+    MUH1D *rebinned = dynamic_cast<MUH1D*>( h->Rebin( nNewBins, "rebin_new", edges ) );
+    if( !rebinned )
+    {
+      Report( "rebin: Rebin gives a MUH1D", 1., 0. );
+      delete h;
+      return;
+    }
+
+    //CV and universes one by one with TH1::Rebin
+    double contentDiff = 0., errorDiff = 0.;
+    const MUVertErrorBand *band = h->GetVertErrorBand( "Flux" );
+    const MUVertErrorBand *newBand = rebinned->GetVertErrorBand( "Flux" );
+    for( int u = -1; u != (int)kNUniverses; ++u )
+    {
+      TH1D old( u < 0 ? *h : *band->GetHist( u ) );
+      TH1 *expected = old.Rebin( nNewBins, "rebin_expected", edges );
+      const TH1 *result = u < 0 ? rebinned : newBand->GetHist( u );
+      for( int bin = 0; bin <= nNewBins + 1; ++bin )
+      {
+        contentDiff = max( contentDiff, RelDiff( result->GetBinContent( bin ), expected->GetBinContent( bin ) ) );
+        errorDiff = max( errorDiff, RelDiff( result->GetBinError( bin ), expected->GetBinError( bin ) ) );
+      }
+      delete expected;
+    }
+    Report( "rebin: contents vs TH1::Rebin", contentDiff, 1e-12 );
+    Report( "rebin: errors vs TH1::Rebin", errorDiff, 1e-12 );
+
+    //M is 1 where an old bin center falls in a new bin
+    TMatrixD m( nNewBins + 2, kNBins + 2 );
+    for( int bin = 0; bin <= kNBins + 1; ++bin )
+      m( rebinned->GetXaxis()->FindBin( h->GetXaxis()->GetBinCenter( bin ) ), bin ) = 1.;
+    const TMatrixD covmx = h->GetTotalErrorMatrix();
+    const TMatrixD mT( TMatrixD::kTransposed, m );
+    const TMatrixD expected = m * covmx * mT;
+
+    const MURebinMap map( h, rebinned->GetXaxis() );
+    Report( "rebin: MURebinMap M*C*M^T vs dense", MatrixDiff( map.Apply( covmx ), expected ), 1e-12 );
+    Report( "rebin: error matrix vs dense M*C*M^T", MatrixDiff( rebinned->GetTotalErrorMatrix(), expected ), 1e-10 );
+
+    delete rebinned;
+    delete h;
+  }
+
+  //a projection must sum what TH2::ProjectionX sums, and give the error matrix M*C*M^T of the 2D one
+  void CheckProjection()
+  {
+    const Events& ev = GetEvents();
+    const int nBinsX = 12, nBinsY = 10, firstY = 3, lastY = 7;
+    MUH2D *h = new MUH2D( "proj", "proj", nBinsX, 0., 10., nBinsY, 0., 10. );
+    h->AddVertErrorBand( "Flux", kNUniverses );
+    for( unsigned int i = 0; i != kNEvents; ++i )
+    {
+      h->Fill( ev.x[i], ev.y[i], ev.cvweight[i] );
+      h->FillVertErrorBand( "Flux", ev.x[i], ev.y[i], &ev.weights[ (size_t)i*kNUniverses ], ev.cvweight[i] );
+    }
+    MUH1D *px = h->ProjectionX( "proj_px", firstY, lastY );
+
+    //CV and universes one by one with TH2::ProjectionX
+    double contentDiff = 0., errorDiff = 0.;
+    const MUVertErrorBand2D *band = h->GetVertErrorBand( "Flux" );
+    const MUVertErrorBand *newBand = px->GetVertErrorBand( "Flux" );
+    for( int u = -1; u != (int)kNUniverses; ++u )
+    {
+      const TH2D old( u < 0 ? *h : *band->GetHist( u ) );
+      TH1D *expected = old.ProjectionX( "proj_expected", firstY, lastY );
+      const TH1 *result = u < 0 ? px : newBand->GetHist( u );
+      for( int bin = 0; bin <= nBinsX + 1; ++bin )
+      {
+        contentDiff = max( contentDiff, RelDiff( result->GetBinContent( bin ), expected->GetBinContent( bin ) ) );
+        errorDiff = max( errorDiff, RelDiff( result->GetBinError( bin ), expected->GetBinError( bin ) ) );
+      }
+      delete expected;
+    }
+    Report( "projection: contents vs TH2::ProjectionX", contentDiff, 1e-12 );
+    Report( "projection: errors vs TH2::ProjectionX", errorDiff, 1e-12 );
+
+    //M is 1 from every 2D bin of x bin ix and y bin in [firstY, lastY] to bin ix
+    TMatrixD m( nBinsX + 2, ( nBinsX + 2 ) * ( nBinsY + 2 ) );
+    for( int ix = 0; ix <= nBinsX + 1; ++ix )
+    {
+      for( int iy = firstY; iy <= lastY; ++iy )
+        m( ix, h->GetBin( ix, iy ) ) = 1.;
+    }
+    const TMatrixD covmx = h->GetTotalErrorMatrix();
+    const TMatrixD mT( TMatrixD::kTransposed, m );
+    const TMatrixD expected = m * covmx * mT;
+
+    const int firstBins[3] = { 0, firstY, 0 }, lastBins[3] = { -1, lastY, -1 };
+    const MULinearMap map = MULinearMap::Projection( h, px, "x", firstBins, lastBins );
+    Report( "projection: MULinearMap M*C*M^T vs dense", MatrixDiff( map.Apply( covmx ), expected ), 1e-12 );
+    Report( "projection: error matrix vs dense M*C*M^T", MatrixDiff( px->GetTotalErrorMatrix(), expected ), 1e-10 );
+
+    delete px;
+    delete h;
+  }
+  //the locator must give the bin TAxis::FindFixBin gives, also for values exactly on an edge and out of range
+  void CheckBinLocator()
+  {
+    const int nVarBins = 8;
+    const double edges[nVarBins+1] = { 0., 1., 2., 3., 4., 5., 6., 8., 10. };
+    const TAxis uniform( kNBins, 0., 10. );
+    const TAxis variable( nVarBins, edges );
+    const TAxis *axes[2] = { &uniform, &variable };
+
+    //every edge, the middle of every bin, far out of range and random values; an odd number so FindBins has a tail
+    vector<double> values;
+    values.push_back( -100. );
+    values.push_back( -1e-12 );
+    values.push_back( 10. + 1e-12 );
+    values.push_back( 100. );
+    for( int a = 0; a != 2; ++a )
+    {
+      for( int bin = 1; bin <= axes[a]->GetNbins() + 1; ++bin )
+      {
+        values.push_back( axes[a]->GetBinLowEdge( bin ) );
+        values.push_back( axes[a]->GetBinCenter( bin ) );
+      }
+    }
+    TRandom3 r(54321);
+    while( values.size() % 4 != 3 || values.size() < 1000 )
+      values.push_back( r.Uniform( -2., 12. ) );
+
+    //the shifts are taken from a CV value on each side, so that values are reached by shifting up and down
+    const double cvValues[2] = { 2., 7. };
+    for( int a = 0; a != 2; ++a )
+    {
+      const MUBinLocator locator( axes[a] );
+      const TAxis& axis = *axes[a];
+      int nWrong = 0;
+      for( unsigned int i = 0; i != values.size(); ++i )
+      {
+        if( locator.FindBin( values[i] ) != axis.FindFixBin( values[i] ) )
+          ++nWrong;
+      }
+      for( int c = 0; c != 2; ++c )
+      {
+        vector<double> shifts( values.size() );
+        for( unsigned int i = 0; i != values.size(); ++i )
+          shifts[i] = values[i] - cvValues[c];
+        vector<int> bins( values.size() );
+        locator.FindBins( cvValues[c], &shifts[0], shifts.size(), &bins[0] );
+        for( unsigned int i = 0; i != values.size(); ++i )
+        {
+          if( bins[i] != axis.FindFixBin( cvValues[c] + shifts[i] ) )
+            ++nWrong;
+        }
+      }
+      Report( a ? "bins: variable axis, wrong bins" : "bins: uniform axis, wrong bins", nWrong, 0. );
+    }
+  }
+}
+
+int main()
+{
+  PlotUtils::Initialize();
+
+  cout << "Comparing fast paths to their baselines on " << kNEvents << " events, " << kNBins << " bins, " << kNUniverses << " universes" << endl;
+  CheckStore();
+  CheckShardMerge();
+  CheckBatchFill();
+  CheckCovariance();
+  CheckLowRank();
+  CheckChi2();
+  CheckExpression();
+  CheckBandArithmetic();
+  CheckRebin();
+  CheckProjection();
+  CheckBinLocator();
+
+  if( gNFailures )
+    cout << gNFailures << " checks FAILED" << endl;
+  else
+    cout << "All checks passed" << endl;
+  return gNFailures ? 1 : 0;
+}